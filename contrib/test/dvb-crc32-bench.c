@@ -0,0 +1,132 @@
+/*
+ * Checks and measures the speed of the libdvbv5 MPEG-TS CRC32 code,
+ * comparing it with the classic byte-per-byte table lookup.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <libdvbv5/crc32.h>
+
+#define BUF_SIZE	4096
+
+static uint32_t crctab[256];
+
+static void ref_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = (uint32_t)i << 24;
+		for (j = 0; j < 8; j++)
+			crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+		crctab[i] = crc;
+	}
+}
+
+static uint32_t ref_crc32(const uint8_t *data, size_t len, uint32_t crc)
+{
+	while (len--)
+		crc = (crc << 8) ^ crctab[((crc >> 24) ^ *data++) & 0xff];
+	return crc;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *name, uint8_t *buf, size_t len, int loops,
+		  uint32_t (*func)(uint8_t *, size_t, uint32_t))
+{
+	uint32_t crc = 0;
+	double t;
+	int i;
+
+	t = now();
+	for (i = 0; i < loops; i++)
+		crc = func(buf, len, crc);
+	t = now() - t;
+
+	printf("%-10s %5zu bytes: %8.1f MB/s (%08x)\n", name, len,
+	       (double)len * loops / t / 1e6, crc);
+}
+
+static uint32_t ref_crc32_wrap(uint8_t *data, size_t len, uint32_t crc)
+{
+	return ref_crc32(data, len, crc);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 16, 188, 1024, 4096 };
+	uint8_t *buf;
+	size_t len, off, i;
+	uint32_t crc;
+	int loops = argc > 1 ? atoi(argv[1]) : 100000;
+	int errors = 0;
+
+	buf = malloc(BUF_SIZE + 16);
+	if (!buf)
+		return 1;
+
+	ref_init();
+	srand(1);
+	for (i = 0; i < BUF_SIZE + 16; i++)
+		buf[i] = rand();
+
+	/* All sizes, unaligned buffers and random initial values */
+	for (len = 0; len <= BUF_SIZE; len++) {
+		off = len % 16;
+		crc = rand();
+		if (dvb_crc32(buf + off, len, crc) !=
+		    ref_crc32(buf + off, len, crc)) {
+			fprintf(stderr, "crc mismatch: size %zu, offset %zu\n",
+				len, off);
+			errors++;
+		}
+	}
+
+	/* A section with its CRC appended should return 0 */
+	crc = ref_crc32(buf, 1020, 0xffffffff);
+	buf[1020] = crc >> 24;
+	buf[1021] = crc >> 16;
+	buf[1022] = crc >> 8;
+	buf[1023] = crc;
+	if (dvb_crc32(buf, 1024, 0xffffffff)) {
+		fprintf(stderr, "section CRC check failed\n");
+		errors++;
+	}
+
+	if (errors) {
+		fprintf(stderr, "%d errors\n", errors);
+		return 1;
+	}
+	printf("CRC32 results match\n");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int n = loops * 4096 / sizes[i];
+
+		bench("bytewise", buf, sizes[i], n / 4, ref_crc32_wrap);
+		bench("dvb_crc32", buf, sizes[i], n, dvb_crc32);
+	}
+
+	free(buf);
+	return 0;
+}
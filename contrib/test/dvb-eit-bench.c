@@ -0,0 +1,214 @@
+/*
+ * Measures how fast libdvbv5 parses EIT tables, with their event names
+ * and descriptions encoded with several DVB charsets.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <libdvbv5/dvb-fe.h>
+#include <libdvbv5/eit.h>
+#include <libdvbv5/desc_event_short.h>
+#include <libdvbv5/crc32.h>
+
+#define EVENTS_PER_SECTION	8
+
+/* Descriptors loop of the first event, parsed alone by the benchmark */
+static int desc_loop_start, desc_loop_len;
+
+struct charset {
+	const char *name;
+	const unsigned char *prefix;
+	unsigned prefix_len;
+	const char *text;
+};
+
+static const struct charset charsets[] = {
+	{
+		.name = "ISO-6937",
+		.prefix_len = 0,
+		.text = "Nachrichten und Wetter f\xc8ur Deutschland",
+	}, {
+		.name = "ISO-8859-9",
+		.prefix = (const unsigned char *)"\x05",
+		.prefix_len = 1,
+		.text = "Ak\xfe" "am haberleri ve hava durumu",
+	}, {
+		.name = "ISO-8859-15",
+		.prefix = (const unsigned char *)"\x10\x00\x0f",
+		.prefix_len = 3,
+		.text = "Journal t\xe9l\xe9vis\xe9 et m\xe9t\xe9o \xa4",
+	}, {
+		.name = "UTF-8",
+		.prefix = (const unsigned char *)"\x15",
+		.prefix_len = 1,
+		.text = "Telejornal e meteorologia \xc3\xa0 noite",
+	},
+};
+
+static int add_string(uint8_t *p, const struct charset *cs, const char *s)
+{
+	int len = strlen(s);
+
+	p[0] = cs->prefix_len + len;
+	memcpy(p + 1, cs->prefix, cs->prefix_len);
+	memcpy(p + 1 + cs->prefix_len, s, len);
+
+	return 1 + p[0];
+}
+
+/* Builds an EIT schedule section, with short and extended descriptors */
+static int build_section(uint8_t *buf, const struct charset *cs)
+{
+	int i, pos = 14, desc, start, len;
+	uint32_t crc;
+
+	buf[0] = 0x50;
+	buf[3] = 0x00;		/* service ID */
+	buf[4] = 0x65;
+	buf[5] = 0xc1;		/* version 0, current */
+	buf[6] = 0;		/* section number */
+	buf[7] = 0;
+	buf[8] = 0x00;		/* TS ID */
+	buf[9] = 0x01;
+	buf[10] = 0x20;		/* network ID */
+	buf[11] = 0x85;
+	buf[12] = 0;
+	buf[13] = 0x50;
+
+	for (i = 0; i < EVENTS_PER_SECTION; i++) {
+		buf[pos++] = 0;
+		buf[pos++] = i;
+		buf[pos++] = 0xe7;	/* MJD */
+		buf[pos++] = 0x5a;
+		buf[pos++] = 0x12 + i;	/* BCD start time */
+		buf[pos++] = 0x00;
+		buf[pos++] = 0x00;
+		buf[pos++] = 0x01;	/* BCD duration */
+		buf[pos++] = 0x00;
+		buf[pos++] = 0x00;
+		desc = pos;
+		pos += 2;
+
+		/* short event descriptor */
+		start = pos;
+		buf[pos++] = 0x4d;
+		pos++;
+		memcpy(buf + pos, "eng", 3);
+		pos += 3;
+		pos += add_string(buf + pos, cs, cs->text);
+		pos += add_string(buf + pos, cs, cs->text);
+		buf[start + 1] = pos - start - 2;
+
+		/* extended event descriptor */
+		start = pos;
+		buf[pos++] = 0x4e;
+		pos++;
+		buf[pos++] = 0x00;
+		memcpy(buf + pos, "eng", 3);
+		pos += 3;
+		buf[pos++] = 0;		/* no items */
+		pos += add_string(buf + pos, cs, cs->text);
+		buf[start + 1] = pos - start - 2;
+
+		len = pos - desc - 2;
+		buf[desc] = 0x80 | len >> 8;
+		buf[desc + 1] = len;
+		if (!i) {
+			desc_loop_start = desc + 2;
+			desc_loop_len = len;
+		}
+	}
+
+	len = pos + 4 - 3;
+	buf[1] = 0xf0 | len >> 8;
+	buf[2] = len;
+
+	crc = dvb_crc32(buf, pos, 0xffffffff);
+	buf[pos++] = crc >> 24;
+	buf[pos++] = crc >> 16;
+	buf[pos++] = crc >> 8;
+	buf[pos++] = crc;
+
+	return pos;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	struct dvb_v5_fe_parms *parms;
+	struct dvb_table_eit *eit;
+	struct dvb_desc_event_short *desc;
+	struct dvb_desc *head;
+	uint8_t buf[4096];
+	int loops = argc > 1 ? atoi(argv[1]) : 20000;
+	unsigned i;
+	double t;
+	int len, n;
+
+	parms = dvb_fe_dummy();
+	if (!parms)
+		return 1;
+
+	for (i = 0; i < sizeof(charsets) / sizeof(charsets[0]); i++) {
+		len = build_section(buf, &charsets[i]);
+
+		eit = NULL;
+		if (dvb_table_eit_init(parms, buf, len - 4, &eit) < 0) {
+			fprintf(stderr, "%s: failed to parse the EIT\n",
+				charsets[i].name);
+			return 1;
+		}
+		desc = (struct dvb_desc_event_short *)eit->event->descriptor;
+		printf("%-12s \"%s\"\n", charsets[i].name, desc->name);
+		dvb_table_eit_free(eit);
+
+		t = now();
+		for (n = 0; n < loops; n++) {
+			eit = NULL;
+			dvb_table_eit_init(parms, buf, len - 4, &eit);
+			dvb_table_eit_free(eit);
+		}
+		t = now() - t;
+
+		printf("%-12s %8.0f EIT sections/s\n", "", loops / t);
+
+		/*
+		 * The EIT parser also converts the event start times, so
+		 * measure the descriptors alone, where the strings are
+		 */
+		t = now();
+		for (n = 0; n < loops * EVENTS_PER_SECTION; n++) {
+			head = NULL;
+			dvb_desc_parse(parms, buf + desc_loop_start,
+				       desc_loop_len, &head);
+			dvb_desc_free(&head);
+		}
+		t = now() - t;
+
+		printf("%-12s %8.0f strings/s\n", "",
+		       loops * EVENTS_PER_SECTION * 3 / t);
+	}
+
+	dvb_fe_close(parms);
+	return 0;
+}
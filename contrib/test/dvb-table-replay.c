@@ -0,0 +1,641 @@
+/*
+ * Replays the MPEG-TS tables of a recorded .ts file through the libdvbv5
+ * table parsers, the same way dvb_read_sections() does with the sections
+ * read from a demux, and measures how much it costs for each table type.
+ *
+ * Usage: dvb-table-replay [-q] [-n loops] [-p pid]... file.ts
+ *
+ * By default, the sections of all PIDs that don't carry PES are used.
+ *
+ * The same code can also be built as a libFuzzer target, taking the
+ * fuzzer input as a MPEG-TS:
+ *	clang -g -DDVB_TABLE_FUZZER -fsanitize=fuzzer,address \
+ *		dvb-table-replay.c -ldvbv5 -o dvb-table-fuzzer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#include <libdvbv5/dvb-fe.h>
+#include <libdvbv5/dvb-scan.h>
+#include <libdvbv5/descriptors.h>
+#include <libdvbv5/pat.h>
+#include <libdvbv5/cat.h>
+#include <libdvbv5/pmt.h>
+#include <libdvbv5/nit.h>
+#include <libdvbv5/sdt.h>
+#include <libdvbv5/eit.h>
+#include <libdvbv5/mgt.h>
+#include <libdvbv5/atsc_eit.h>
+#include <libdvbv5/vct.h>
+
+#define TS_SIZE		188
+#define NUM_PIDS	8192
+#define MAX_SECTION	4096
+
+/*
+ * Allocation counters. The library allocates with the libc functions,
+ * so replacing them here also counts the allocations made by the parsers.
+ * Not used by the fuzzer, as the sanitizers replace them too.
+ */
+#if defined(__GLIBC__) && !defined(DVB_TABLE_FUZZER)
+#define COUNT_ALLOCS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long long num_allocs;
+static size_t live_bytes, peak_bytes;
+
+static void *count_alloc(void *ptr)
+{
+	if (ptr) {
+		num_allocs++;
+		live_bytes += malloc_usable_size(ptr);
+		if (live_bytes > peak_bytes)
+			peak_bytes = live_bytes;
+	}
+	return ptr;
+}
+
+void *malloc(size_t size)
+{
+	return count_alloc(__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	return count_alloc(__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (ptr)
+		live_bytes -= malloc_usable_size(ptr);
+	return count_alloc(__libc_realloc(ptr, size));
+}
+
+void free(void *ptr)
+{
+	if (ptr)
+		live_bytes -= malloc_usable_size(ptr);
+	__libc_free(ptr);
+}
+#endif
+
+struct table_type {
+	const char *name;
+	void (*free)(void *table);
+};
+
+#define TABLE_FREE(_x) (void (*)(void *))_x##_free
+
+static const struct table_type table_types[256] = {
+	[DVB_TABLE_PAT]		= { "PAT",		TABLE_FREE(dvb_table_pat) },
+	[DVB_TABLE_CAT]		= { "CAT",		TABLE_FREE(dvb_table_cat) },
+	[DVB_TABLE_PMT]		= { "PMT",		TABLE_FREE(dvb_table_pmt) },
+	[DVB_TABLE_NIT]		= { "NIT",		TABLE_FREE(dvb_table_nit) },
+	[DVB_TABLE_NIT2]	= { "NIT other",	TABLE_FREE(dvb_table_nit) },
+	[DVB_TABLE_SDT]		= { "SDT",		TABLE_FREE(dvb_table_sdt) },
+	[DVB_TABLE_SDT2]	= { "SDT other",	TABLE_FREE(dvb_table_sdt) },
+	[DVB_TABLE_EIT]		= { "EIT",		TABLE_FREE(dvb_table_eit) },
+	[DVB_TABLE_EIT_OTHER]	= { "EIT other",	TABLE_FREE(dvb_table_eit) },
+	[ATSC_TABLE_MGT]	= { "MGT",		TABLE_FREE(atsc_table_mgt) },
+	[ATSC_TABLE_EIT]	= { "ATSC EIT",		TABLE_FREE(atsc_table_eit) },
+	[ATSC_TABLE_TVCT]	= { "TVCT",		TABLE_FREE(atsc_table_vct) },
+	[ATSC_TABLE_CVCT]	= { "CVCT",		TABLE_FREE(atsc_table_vct) },
+};
+
+static const struct table_type eit_schedule = {
+	"EIT schedule", TABLE_FREE(dvb_table_eit)
+};
+
+static const struct table_type *get_table_type(uint8_t tid)
+{
+	if (tid >= DVB_TABLE_EIT_SCHEDULE && tid < DVB_TABLE_EIT_SCHEDULE_OTHER + 0x10)
+		return &eit_schedule;
+	if (!table_types[tid].name)
+		return NULL;
+	return &table_types[tid];
+}
+
+struct table_stats {
+	unsigned long long sections, tables, errors;
+	unsigned long long allocs;
+	size_t peak;
+	double time;
+};
+
+/* A table being read, like a call to dvb_read_sections() */
+struct table_reader {
+	struct dvb_table_filter sect;
+	void *table;
+	size_t bytes, peak;
+	unsigned long long allocs;
+};
+
+/* Sections extracted from the MPEG-TS, in the order they were received */
+struct section {
+	uint16_t pid;
+	uint16_t len;
+	uint32_t offset;
+};
+
+struct replay {
+	struct dvb_v5_fe_parms *parms;
+
+	/* Section extraction */
+	int use_pid[NUM_PIDS];
+	int cc[NUM_PIDS];
+	uint8_t *pid_buf[NUM_PIDS];
+	unsigned pid_len[NUM_PIDS];
+
+	uint8_t *data;
+	size_t data_len, data_size;
+	struct section *sections;
+	size_t num_sections, max_sections;
+
+	/* Section parsing. Allocated only for the PIDs with sections */
+	struct table_reader **readers[NUM_PIDS];
+	struct table_stats stats[256];
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int store_section(struct replay *r, uint16_t pid, const uint8_t *buf,
+			 unsigned len)
+{
+	struct section *s;
+	void *p;
+
+	if (r->num_sections == r->max_sections) {
+		r->max_sections = r->max_sections ? r->max_sections * 2 : 1024;
+		p = realloc(r->sections, r->max_sections * sizeof(*s));
+		if (!p)
+			return -1;
+		r->sections = p;
+	}
+	if (r->data_len + len > r->data_size) {
+		r->data_size = r->data_size ? r->data_size * 2 : 1 << 20;
+		p = realloc(r->data, r->data_size);
+		if (!p)
+			return -1;
+		r->data = p;
+	}
+
+	s = &r->sections[r->num_sections++];
+	s->pid = pid;
+	s->len = len;
+	s->offset = r->data_len;
+	memcpy(r->data + r->data_len, buf, len);
+	r->data_len += len;
+
+	return 0;
+}
+
+/* Stores the complete sections buffered for a PID */
+static int flush_sections(struct replay *r, uint16_t pid)
+{
+	uint8_t *buf = r->pid_buf[pid];
+	unsigned len, pos = 0;
+	int ret = 0;
+
+	while (pos + 3 <= r->pid_len[pid] && buf[pos] != 0xff) {
+		len = 3 + (((buf[pos + 1] & 0x0f) << 8) | buf[pos + 2]);
+		if (pos + len > r->pid_len[pid])
+			break;
+		ret = store_section(r, pid, buf + pos, len);
+		if (ret < 0)
+			return ret;
+		pos += len;
+	}
+
+	/* The rest is either stuffing or an incomplete section */
+	if (pos < r->pid_len[pid] && buf[pos] == 0xff)
+		pos = r->pid_len[pid];
+	memmove(buf, buf + pos, r->pid_len[pid] - pos);
+	r->pid_len[pid] -= pos;
+
+	return 0;
+}
+
+static void append_payload(struct replay *r, uint16_t pid,
+			   const uint8_t *buf, unsigned len)
+{
+	if (r->pid_len[pid] + len > MAX_SECTION + TS_SIZE) {
+		/* Garbage: no section is that big */
+		r->pid_len[pid] = 0;
+		return;
+	}
+	memcpy(r->pid_buf[pid] + r->pid_len[pid], buf, len);
+	r->pid_len[pid] += len;
+}
+
+/* Extracts the sections of a MPEG-TS, like the demux driver does */
+static int extract_sections(struct replay *r, const uint8_t *buf, size_t len)
+{
+	const uint8_t *p, *payload, *end;
+	uint16_t pid;
+	int cc, pusi, ptr;
+
+	for (p = buf; p + TS_SIZE <= buf + len; p += TS_SIZE) {
+		/* Resync, if needed */
+		while (p + TS_SIZE <= buf + len && p[0] != 0x47)
+			p++;
+		if (p + TS_SIZE > buf + len)
+			break;
+
+		end = p + TS_SIZE;
+		pid = ((p[1] & 0x1f) << 8) | p[2];
+		if (!r->use_pid[pid] || (p[1] & 0x80) || !(p[3] & 0x10))
+			continue;
+
+		pusi = p[1] & 0x40;
+		cc = p[3] & 0x0f;
+		payload = p + 4;
+		if (p[3] & 0x20)
+			payload += 1 + p[4];
+		if (payload >= end)
+			continue;
+
+		if (!r->pid_buf[pid]) {
+			/* Skip PIDs with PES */
+			if (pusi && end - payload >= 3 &&
+			    !payload[0] && !payload[1] && payload[2] == 1) {
+				r->use_pid[pid] = 0;
+				continue;
+			}
+			if (!pusi)
+				continue;
+			r->pid_buf[pid] = malloc(MAX_SECTION + TS_SIZE);
+			if (!r->pid_buf[pid])
+				return -1;
+		} else if (cc != ((r->cc[pid] + 1) & 0x0f)) {
+			/* Discontinuity: drop the incomplete section */
+			r->pid_len[pid] = 0;
+			if (cc == r->cc[pid])
+				continue;	/* Duplicated packet */
+		}
+		r->cc[pid] = cc;
+
+		if (!pusi) {
+			if (r->pid_len[pid])
+				append_payload(r, pid, payload, end - payload);
+		} else {
+			ptr = *payload++;
+			if (payload + ptr > end) {
+				r->pid_len[pid] = 0;
+				continue;
+			}
+			if (r->pid_len[pid])
+				append_payload(r, pid, payload, ptr);
+			if (flush_sections(r, pid) < 0)
+				return -1;
+
+			/* Drop what is left from a previous section */
+			r->pid_len[pid] = 0;
+			append_payload(r, pid, payload + ptr, end - payload - ptr);
+		}
+		if (flush_sections(r, pid) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void free_reader(struct replay *r, uint16_t pid, uint8_t tid)
+{
+	struct table_reader *reader;
+	const struct table_type *type = get_table_type(tid);
+
+	if (!r->readers[pid] || !r->readers[pid][tid])
+		return;
+	reader = r->readers[pid][tid];
+
+	if (reader->table)
+		type->free(reader->table);
+	dvb_table_filter_free(&reader->sect);
+	free(reader);
+	r->readers[pid][tid] = NULL;
+}
+
+/* Feeds a section to the parsers, as dvb_read_sections() does */
+static void parse_section(struct replay *r, uint16_t pid,
+			  const uint8_t *buf, unsigned len)
+{
+	struct table_reader *reader;
+	struct table_stats *stats;
+	uint8_t tid = buf[0];
+#ifdef COUNT_ALLOCS
+	unsigned long long allocs;
+	size_t live;
+#endif
+	double t;
+	int ret;
+
+	if (!get_table_type(tid) || !dvb_table_initializers[tid])
+		return;
+	stats = &r->stats[tid];
+
+	if (!r->readers[pid]) {
+		r->readers[pid] = calloc(256, sizeof(*r->readers[pid]));
+		if (!r->readers[pid])
+			return;
+	}
+
+	reader = r->readers[pid][tid];
+	if (!reader) {
+		reader = calloc(1, sizeof(*reader));
+		if (!reader)
+			return;
+		reader->sect.tid = tid;
+		reader->sect.pid = pid;
+		reader->sect.ts_id = -1;
+		reader->sect.table = &reader->table;
+
+		/* As done by dvb_scan_transponder() for the EIT */
+		if (tid >= DVB_TABLE_EIT && tid < DVB_TABLE_EIT_SCHEDULE_OTHER + 0x10)
+			reader->sect.allow_section_gaps = 1;
+
+		r->readers[pid][tid] = reader;
+	}
+
+#ifdef COUNT_ALLOCS
+	allocs = num_allocs;
+	live = live_bytes;
+	peak_bytes = live_bytes;
+#endif
+
+	t = now();
+	ret = dvb_table_filter_parse(r->parms, &reader->sect, buf, len);
+	stats->time += now() - t;
+	stats->sections++;
+
+#ifdef COUNT_ALLOCS
+	/*
+	 * Sections are parsed one at a time, so whatever was allocated
+	 * meanwhile belongs to this table.
+	 */
+	reader->allocs += num_allocs - allocs;
+	if (reader->bytes + peak_bytes - live > reader->peak)
+		reader->peak = reader->bytes + peak_bytes - live;
+	reader->bytes += live_bytes - live;
+#endif
+
+	if (!ret)
+		return;
+
+	if (ret < 0) {
+		stats->errors++;
+	} else {
+		stats->tables++;
+		stats->allocs += reader->allocs;
+		if (reader->peak > stats->peak)
+			stats->peak = reader->peak;
+	}
+	free_reader(r, pid, tid);
+}
+
+static void replay_sections(struct replay *r)
+{
+	struct section *s;
+	size_t i;
+
+	for (i = 0; i < r->num_sections; i++) {
+		s = &r->sections[i];
+		parse_section(r, s->pid, r->data + s->offset, s->len);
+	}
+}
+
+static void replay_free(struct replay *r)
+{
+	unsigned pid, tid;
+
+	for (pid = 0; pid < NUM_PIDS; pid++) {
+		if (r->readers[pid]) {
+			for (tid = 0; tid < 256; tid++)
+				free_reader(r, pid, tid);
+			free(r->readers[pid]);
+		}
+		free(r->pid_buf[pid]);
+	}
+	free(r->sections);
+	free(r->data);
+	free(r);
+}
+
+static struct replay *replay_alloc(struct dvb_v5_fe_parms *parms)
+{
+	struct replay *r;
+	unsigned pid;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	r->parms = parms;
+	for (pid = 0; pid < NUM_PIDS; pid++)
+		r->use_pid[pid] = 1;
+	r->use_pid[0x1fff] = 0;
+
+	return r;
+}
+
+static void quiet_log(int level, const char *fmt, ...)
+{
+}
+
+#ifdef DVB_TABLE_FUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static struct dvb_v5_fe_parms *parms;
+	struct replay *r;
+
+	if (!parms) {
+		parms = dvb_fe_dummy();
+		if (!parms)
+			abort();
+		parms->logfunc = quiet_log;
+	}
+
+	r = replay_alloc(parms);
+	if (!r)
+		return 0;
+	if (!extract_sections(r, data, size))
+		replay_sections(r);
+	replay_free(r);
+
+	return 0;
+}
+
+#else
+
+static uint8_t *read_file(const char *name, size_t *len)
+{
+	uint8_t *buf = NULL, *p;
+	size_t size = 0, n;
+	FILE *fp;
+
+	fp = fopen(name, "r");
+	if (!fp) {
+		perror(name);
+		return NULL;
+	}
+
+	*len = 0;
+	do {
+		if (*len == size) {
+			size = size ? size * 2 : 1 << 20;
+			p = realloc(buf, size);
+			if (!p) {
+				free(buf);
+				buf = NULL;
+				break;
+			}
+			buf = p;
+		}
+		n = fread(buf + *len, 1, size - *len, fp);
+		*len += n;
+	} while (n);
+	fclose(fp);
+
+	return buf;
+}
+
+int main(int argc, char *argv[])
+{
+	struct dvb_v5_fe_parms *parms;
+	const struct table_type *type;
+	struct table_stats *stats, total;
+	struct replay *r;
+	int loops = 1, pids = 0, quiet = 0, opt, n;
+	unsigned pid, tid;
+	size_t len;
+	uint8_t *buf;
+	double t;
+
+	parms = dvb_fe_dummy();
+	if (!parms)
+		return 1;
+	r = replay_alloc(parms);
+	if (!r)
+		return 1;
+
+	while ((opt = getopt(argc, argv, "n:p:q")) != -1) {
+		switch (opt) {
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		case 'p':
+			if (!pids++)
+				memset(r->use_pid, 0, sizeof(r->use_pid));
+			pid = strtoul(optarg, NULL, 0);
+			if (pid < NUM_PIDS)
+				r->use_pid[pid] = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-n loops] [-p pid]... file.ts\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || loops < 1) {
+		fprintf(stderr, "usage: %s [-q] [-n loops] [-p pid]... file.ts\n",
+			argv[0]);
+		return 1;
+	}
+	if (quiet)
+		parms->logfunc = quiet_log;
+
+	buf = read_file(argv[optind], &len);
+	if (!buf)
+		return 1;
+
+	t = now();
+	if (extract_sections(r, buf, len) < 0) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	t = now() - t;
+	free(buf);
+
+	printf("%zu sections extracted from %zu KB in %.3f s\n",
+	       r->num_sections, len / 1024, t);
+
+	t = now();
+	for (n = 0; n < loops; n++) {
+		replay_sections(r);
+
+		/* Tables left incomplete at the end of the file */
+		for (pid = 0; pid < NUM_PIDS; pid++) {
+			if (!r->readers[pid])
+				continue;
+			for (tid = 0; tid < 256; tid++)
+				free_reader(r, pid, tid);
+		}
+	}
+	t = now() - t;
+
+	printf("\n%-13s %9s %8s %7s %12s %13s %12s\n", "table", "sections",
+	       "tables", "errors", "sections/s", "allocs/table", "peak bytes");
+
+	memset(&total, 0, sizeof(total));
+	for (tid = 0; tid < 256; tid++) {
+		stats = &r->stats[tid];
+		if (!stats->sections)
+			continue;
+		type = get_table_type(tid);
+
+		printf("%-9s 0x%02x %9llu %8llu %7llu %12.0f ", type->name, tid,
+		       stats->sections, stats->tables, stats->errors,
+		       stats->sections / stats->time);
+#ifdef COUNT_ALLOCS
+		if (stats->tables)
+			printf("%13.1f %12zu\n",
+			       (double)stats->allocs / stats->tables, stats->peak);
+		else
+			printf("%13s %12s\n", "-", "-");
+#else
+		printf("%13s %12s\n", "n/a", "n/a");
+#endif
+
+		total.sections += stats->sections;
+		total.tables += stats->tables;
+		total.errors += stats->errors;
+		total.time += stats->time;
+	}
+	printf("%-13s %9llu %8llu %7llu %12.0f\n", "total", total.sections,
+	       total.tables, total.errors, total.sections / total.time);
+	printf("\n%d loop(s) in %.3f s\n", loops, t);
+
+	replay_free(r);
+	dvb_fe_close(parms);
+	return 0;
+}
+
+#endif
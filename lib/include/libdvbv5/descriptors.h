@@ -200,6 +200,53 @@ void dvb_desc_free (struct dvb_desc **list);
  */
 void dvb_desc_print(struct dvb_v5_fe_parms *parms, struct dvb_desc *desc);
 
+/**
+ * @struct dvb_arena
+ * @brief Opaque memory region where parsed tables can be allocated
+ * @ingroup dvb_table
+ */
+struct dvb_arena;
+
+/**
+ * @brief allocates a memory arena for parsed tables
+ * @ingroup dvb_table
+ *
+ * @param block_size	size of each memory block reserved by the arena.
+ *			If zero, a default of 64 KB is used.
+ *
+ * @return Returns a pointer to the arena, or NULL if out of memory.
+ */
+struct dvb_arena *dvb_arena_alloc(size_t block_size);
+
+/**
+ * @brief frees a memory arena and all tables and descriptors stored there
+ * @ingroup dvb_table
+ *
+ * @param arena		struct dvb_arena pointer
+ */
+void dvb_arena_free(struct dvb_arena *arena);
+
+/**
+ * @brief selects where the tables parsed with parms are allocated
+ * @ingroup dvb_table
+ *
+ * @param parms		Struct dvb_v5_fe_parms pointer
+ * @param arena		struct dvb_arena pointer, or NULL to go back to
+ *			the default allocation
+ *
+ * While an arena is set, the tables, their entries and descriptors parsed
+ * by the table initializers (including via dvb_read_sections()) are
+ * allocated from it. A big table, like an EIT schedule, is then freed by
+ * a single dvb_arena_free() call.
+ *
+ * The table free functions, like dvb_table_eit_free() or dvb_desc_free(),
+ * leave the tables parsed while an arena is set alone: their memory is only
+ * released by dvb_arena_free(). The tables read by dvb_get_ts_tables() and
+ * dvb_scan_transponder() are never taken from the arena, as
+ * dvb_scan_free_handler_table() releases them.
+ */
+void dvb_arena_set(struct dvb_v5_fe_parms *parms, struct dvb_arena *arena);
+
 #ifdef __cplusplus
 }
 #endif
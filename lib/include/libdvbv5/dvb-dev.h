@@ -286,10 +286,27 @@ void dvb_dev_close(struct dvb_open_descriptor *open_dev);
  *
  * @return On success, returns the number of bytes read. Returns -1 on
  * error.
+ *
+ * On remote devices, it returns the data already received, up to @count
+ * bytes, and only waits if there's none. If data was dropped because it
+ * was not read fast enough, -EOVERFLOW is returned once.
  */
 ssize_t dvb_dev_read(struct dvb_open_descriptor *open_dev,
 		     void *buf, size_t count);
 
+/**
+ * @brief Returns the file descriptor of an opened device
+ * @ingroup dvb_device
+ *
+ * @param open_dev	Points to the struct dvb_open_descriptor
+ *
+ * Allows applications to use syscalls not wrapped by libdvbv5, like
+ * poll() or splice(), on local devices.
+ *
+ * @return the file descriptor, or -1 if the device is not local.
+ */
+int dvb_dev_get_fd(struct dvb_open_descriptor *open_dev);
+
 /**
  * @brief Stops the demux filter for a given file descriptor
  * @ingroup dvb_device
@@ -425,6 +442,36 @@ struct dvb_v5_descriptors *dvb_dev_scan(struct dvb_open_descriptor *open_dev,
 					unsigned other_nit,
 					unsigned timeout_multiply);
 
+/* From dvb-dev-file.c */
+
+/**
+ * @brief initialize the dvb-dev to use recorded MPEG-TS files, instead
+ *	of a DTV device.
+ * @ingroup dvb_device
+ *
+ * @param dvb		pointer to struct dvb_device to be used
+ * @param path		a MPEG-TS file, or a directory with one file per
+ *			transponder
+ *
+ * Emulates an adapter with one frontend, one demux and one dvr device,
+ * as dvb0.frontend0, dvb0.demux0 and dvb0.dvr0.
+ *
+ * If path is a directory, tuning to a frequency opens the file named
+ * after it, like "474000000.ts", with the frequency as stored at the
+ * channel file. If there's no such file, the frontend doesn't lock. If
+ * path is a file, it is used for all frequencies.
+ *
+ * The demux filters get their data from the file as fast as they read
+ * it. The file is read as if it were broadcasted in a loop: a section
+ * filter times out only after getting through the whole file without
+ * finding a section. PES filters and the dvr device return 0 at
+ * the end of the file. So, dvb_dev_scan() can be used to scan recorded
+ * transponders, without hardware.
+ *
+ * @return 0 on success, or a negative error code.
+ */
+int dvb_dev_file_init(struct dvb_device *dvb, const char *path);
+
 /* From dvb-dev-remote.c */
 
 #ifdef HAVE_DVBV5_REMOTE
@@ -437,8 +484,14 @@ struct dvb_v5_descriptors *dvb_dev_scan(struct dvb_open_descriptor *open_dev,
  *	dvbv5-daemon.
  *
  * @param dvb		pointer to struct dvb_device to be used
- * @param server	server hostname or address
- * @param port		server port
+ * @param server	server hostname or address, or the path of its UNIX
+ *			socket
+ * @param port		server port. Ignored for UNIX sockets.
+ *
+ * When connected via an UNIX socket, the server passes the demux and dvr
+ * file descriptors to the client, and dvb_dev_read() reads them directly,
+ * instead of receiving a copy of the data through the socket. In this
+ * case, dvb_dev_get_fd() also works for those devices.
  *
  * @note The protocol between the dvbv5-daemon and the dvb_dev library is
  * highly experimental and is subject to changes in a near future. So,
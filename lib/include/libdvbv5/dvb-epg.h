@@ -0,0 +1,266 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+/**
+ * @file dvb-epg.h
+ * @ingroup epg
+ * @brief Provides a collector for the DVB Event Information Tables (EIT).
+ * @copyright GNU Lesser General Public License version 2.1 (LGPLv2.1)
+ *
+ * The collector keeps a section filter open on the EIT PID, parses each
+ * new section (present/following and schedule, for the actual and for the
+ * other transport streams) and keeps an in-memory database of the events,
+ * indexed by service and by start time.
+ *
+ * @par Bug Report
+ * Please submit bug reports and patches to linux-media@vger.kernel.org
+ */
+
+#ifndef _DVB_EPG_H
+#define _DVB_EPG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libdvbv5/dvb-fe.h>
+
+/**
+ * @def DVB_EPG_PF
+ *	@brief present/following events of the actual TS (table 0x4e)
+ * @def DVB_EPG_PF_OTHER
+ *	@brief present/following events of other TSs (table 0x4f)
+ * @def DVB_EPG_SCHEDULE
+ *	@brief schedule of the actual TS (tables 0x50 to 0x5f)
+ * @def DVB_EPG_SCHEDULE_OTHER
+ *	@brief schedule of other TSs (tables 0x60 to 0x6f)
+ * @def DVB_EPG_ALL
+ *	@brief all of the above
+ */
+#define DVB_EPG_PF		(1 << 0)
+#define DVB_EPG_PF_OTHER	(1 << 1)
+#define DVB_EPG_SCHEDULE	(1 << 2)
+#define DVB_EPG_SCHEDULE_OTHER	(1 << 3)
+#define DVB_EPG_ALL		0x0f
+
+/**
+ * @struct dvb_epg_event
+ * @brief An event (program) stored at the EPG database
+ * @ingroup epg
+ *
+ * @param network_id	original network ID
+ * @param transport_id	transport stream ID
+ * @param service_id	service ID
+ * @param event_id	event ID
+ * @param start		start time
+ * @param duration	duration, in seconds
+ * @param running_status running status, as in the EIT table
+ * @param free_CA_mode	if not zero, the event is scrambled
+ * @param language	ISO 639-2 language code of the texts below
+ * @param title		event name (from the short event descriptor)
+ * @param description	event text (from the short event descriptor)
+ * @param extended	text of the extended event descriptors
+ *
+ * The strings are converted to parms->output_charset. Any of them can be
+ * NULL, if not broadcasted.
+ */
+struct dvb_epg_event {
+	uint16_t network_id;
+	uint16_t transport_id;
+	uint16_t service_id;
+	uint16_t event_id;
+	time_t start;
+	uint32_t duration;
+	uint8_t running_status;
+	uint8_t free_CA_mode;
+	char language[4];
+	char *title;
+	char *description;
+	char *extended;
+};
+
+/**
+ * @struct dvb_epg
+ * @brief Opaque struct with the EPG collector and database
+ * @ingroup epg
+ */
+struct dvb_epg;
+
+/**
+ * @brief Callback used to walk through the EPG events
+ * @ingroup epg
+ *
+ * @param priv		the pointer given to dvb_epg_foreach()
+ * @param event		the event
+ *
+ * Should return zero to continue, or any other value to stop.
+ */
+typedef int (dvb_epg_handler_t)(void *priv, const struct dvb_epg_event *event);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Allocates an EPG collector
+ * @ingroup epg
+ *
+ * @param parms		struct dvb_v5_fe_parms pointer, used for logs and
+ *			charset conversion
+ * @param tables	bitmask with the tables to collect (DVB_EPG_*)
+ *
+ * @return a pointer to the collector, or NULL if out of memory.
+ */
+struct dvb_epg *dvb_epg_alloc(struct dvb_v5_fe_parms *parms, unsigned tables);
+
+/**
+ * @brief Stops collecting and frees all events
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ */
+void dvb_epg_free(struct dvb_epg *epg);
+
+/**
+ * @brief Starts collecting the EIT sections from a demux
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ * @param dmx_fd	an opened demux file descriptor. The collector keeps
+ *			a section filter there until dvb_epg_stop().
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+int dvb_epg_start(struct dvb_epg *epg, int dmx_fd);
+
+/**
+ * @brief Stops the section filter started by dvb_epg_start()
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ *
+ * The events already collected are kept.
+ */
+void dvb_epg_stop(struct dvb_epg *epg);
+
+/**
+ * @brief Reads and parses the EIT sections available at the demux
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ * @param timeout	time to wait for the first section, in milliseconds
+ *
+ * Waits up to timeout for a section, then handles all the sections that
+ * are already available, without waiting anymore.
+ *
+ * @return the number of events added, changed or removed, or a negative
+ *	error code.
+ */
+int dvb_epg_read(struct dvb_epg *epg, int timeout);
+
+/**
+ * @brief Adds a raw EIT section to the database
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ * @param buf		the section, including its CRC
+ * @param len		section size
+ *
+ * Sections already seen with the same version are ignored. When a new
+ * version of a section arrives, the events that were there and are not
+ * present anymore are removed.
+ *
+ * This is useful for applications that read the sections by themselves,
+ * like the ones using dvb_dev_read().
+ *
+ * @return the number of events added, changed or removed, or a negative
+ *	error code if the section is invalid.
+ */
+int dvb_epg_add_section(struct dvb_epg *epg, const uint8_t *buf, ssize_t len);
+
+/**
+ * @brief Walks through the events of a service, ordered by start time
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ * @param service_id	service ID, or -1 for all services
+ * @param start		only events that end after this time are handled
+ * @param end		only events that start before this time are handled.
+ *			0 means no limit.
+ * @param handler	called for each event
+ * @param priv		private data passed to the handler
+ *
+ * @return the value returned by the handler that stopped the walk, or 0.
+ */
+int dvb_epg_foreach(struct dvb_epg *epg, int service_id,
+		    time_t start, time_t end,
+		    dvb_epg_handler_t *handler, void *priv);
+
+/**
+ * @brief Gets the event of a service running at a given time
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ * @param service_id	service ID
+ * @param when		time
+ *
+ * @return a pointer to the event, or NULL. The pointer is valid until the
+ * next call to a function that changes the database.
+ */
+const struct dvb_epg_event *dvb_epg_get_event(struct dvb_epg *epg,
+					      uint16_t service_id,
+					      time_t when);
+
+/**
+ * @brief Returns the number of events at the database
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ */
+unsigned dvb_epg_num_events(struct dvb_epg *epg);
+
+/**
+ * @brief Sets the name of a service, used by dvb_epg_write_xmltv()
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ * @param service_id	service ID
+ * @param name		service name, like the one at the SDT table
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+int dvb_epg_set_service_name(struct dvb_epg *epg, uint16_t service_id,
+			     const char *name);
+
+/**
+ * @brief Writes all events in XMLTV format
+ * @ingroup epg
+ *
+ * @param epg		struct dvb_epg pointer
+ * @param fp		file to write
+ *
+ * Channels are identified as "<network_id>.<transport_id>.<service_id>.dvb".
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+int dvb_epg_write_xmltv(struct dvb_epg *epg, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
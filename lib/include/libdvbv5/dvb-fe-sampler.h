@@ -0,0 +1,170 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+/**
+ * @file dvb-fe-sampler.h
+ * @ingroup frontend
+ * @brief Samples the stats of several frontends on a background thread.
+ * @copyright GNU Lesser General Public License version 2.1 (LGPLv2.1)
+ *
+ * The sampler keeps, for each frontend, a time series of its stats on a
+ * ring buffer. The stats are read when the frontend reports an event,
+ * like a lock status change, and at a fixed interval while no events
+ * arrive.
+ *
+ * The ring buffers are written only by the sampler thread, without locks.
+ * Any number of threads may read them with dvb_fe_sampler_read().
+ *
+ * @par Bug Report
+ * Please submit bug reports and patches to linux-media@vger.kernel.org
+ */
+
+#ifndef _DVB_FE_SAMPLER_H
+#define _DVB_FE_SAMPLER_H
+
+#include <stdint.h>
+
+#include <libdvbv5/dvb-fe.h>
+
+/**
+ * @struct dvb_fe_sample
+ * @brief A sample of the frontend stats
+ * @ingroup frontend
+ *
+ * @param timestamp	CLOCK_MONOTONIC time of the sample, in nanoseconds
+ * @param status	frontend status, as in DTV_STATUS
+ * @param strength	signal strength, as in DTV_STAT_SIGNAL_STRENGTH
+ * @param cnr		carrier to noise ratio, as in DTV_STAT_CNR
+ * @param pre_ber	bit error rate before the inner code, or -EINVAL
+ *			if not available
+ * @param post_ber	bit error rate after the inner code, or -EINVAL
+ *			if not available
+ * @param per		packet error rate, or -EINVAL if not available
+ * @param quality	signal quality, as in DTV_QUALITY
+ *
+ * Only layer 0 stats are stored.
+ */
+struct dvb_fe_sample {
+	uint64_t		timestamp;
+	uint32_t		status;
+	struct dtv_stats	strength;
+	struct dtv_stats	cnr;
+	float			pre_ber;
+	float			post_ber;
+	float			per;
+	enum dvb_quality	quality;
+};
+
+/**
+ * @struct dvb_fe_sampler
+ * @brief Opaque struct with the sampler
+ * @ingroup frontend
+ */
+struct dvb_fe_sampler;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Allocates a stats sampler
+ * @ingroup frontend
+ *
+ * @param ring_size	number of samples kept for each frontend. Rounded
+ *			up to a power of two.
+ *
+ * @return a pointer to the sampler, or NULL if out of memory.
+ */
+struct dvb_fe_sampler *dvb_fe_sampler_alloc(unsigned ring_size);
+
+/**
+ * @brief Stops the sampler, if running, and frees it
+ * @ingroup frontend
+ *
+ * @param s		struct dvb_fe_sampler pointer
+ *
+ * The frontends are not closed.
+ */
+void dvb_fe_sampler_free(struct dvb_fe_sampler *s);
+
+/**
+ * @brief Adds a frontend to the sampler
+ * @ingroup frontend
+ *
+ * @param s		struct dvb_fe_sampler pointer
+ * @param parms		struct dvb_v5_fe_parms pointer to the opened device
+ *
+ * Frontends can only be added while the sampler is stopped.
+ *
+ * While the sampler is running, the application should not call
+ * dvb_fe_get_stats() or dvb_fe_get_event() for this frontend, as the
+ * stats cache is updated by the sampler thread.
+ *
+ * @return the frontend index, used by dvb_fe_sampler_read(), or a negative
+ *	error code.
+ */
+int dvb_fe_sampler_add(struct dvb_fe_sampler *s, struct dvb_v5_fe_parms *parms);
+
+/**
+ * @brief Starts the sampler thread
+ * @ingroup frontend
+ *
+ * @param s		struct dvb_fe_sampler pointer
+ * @param interval_ms	maximum time between two samples of a frontend
+ *
+ * For local frontends, the stats are also sampled when the frontend
+ * reports an event. Remote frontends are sampled only at each interval.
+ *
+ * @return 0 on success, -ENOSYS if the library was built without pthreads,
+ *	or another negative error code.
+ */
+int dvb_fe_sampler_start(struct dvb_fe_sampler *s, unsigned interval_ms);
+
+/**
+ * @brief Stops the sampler thread
+ * @ingroup frontend
+ *
+ * @param s		struct dvb_fe_sampler pointer
+ *
+ * The samples already stored can still be read.
+ */
+void dvb_fe_sampler_stop(struct dvb_fe_sampler *s);
+
+/**
+ * @brief Reads the samples of a frontend
+ * @ingroup frontend
+ *
+ * @param s		struct dvb_fe_sampler pointer
+ * @param idx		frontend index, as returned by dvb_fe_sampler_add()
+ * @param seq		sequence number of the first sample to read. Updated
+ *			to the sequence number of the next sample. Use 0 to
+ *			read from the oldest sample still stored.
+ * @param samples	where the samples will be stored
+ * @param max		maximum number of samples to read
+ *
+ * If the reader is too slow, the samples overwritten on the ring are
+ * skipped, and *seq jumps ahead.
+ *
+ * @return the number of samples read, or -EINVAL if idx is invalid.
+ */
+int dvb_fe_sampler_read(struct dvb_fe_sampler *s, unsigned idx, uint64_t *seq,
+			struct dvb_fe_sample *samples, unsigned max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
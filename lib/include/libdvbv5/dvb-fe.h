@@ -469,6 +469,47 @@ int dvb_fe_retrieve_stats(struct dvb_v5_fe_parms *parms,
  */
 int dvb_fe_get_stats(struct dvb_v5_fe_parms *parms);
 
+/**
+ * @brief Selects the Kernel stats read by dvb_fe_get_stats()
+ * @ingroup frontend
+ *
+ * @param parms	struct dvb_v5_fe_parms pointer to the opened device
+ * @param cmds	array with the DTV_STAT_* properties to read
+ * @param num	number of elements at cmds. If 0, all stats are read,
+ *		as done by default.
+ *
+ * By default, all Kernel stats are read on each dvb_fe_get_stats() call.
+ * Applications that sample the stats often may select just the ones they
+ * use, as each of them may require the driver to talk with the demod.
+ * The stats not selected are reported as FE_SCALE_NOT_AVAILABLE.
+ *
+ * Please notice that BER requires DTV_STAT_POST_ERROR_BIT_COUNT and
+ * DTV_STAT_POST_TOTAL_BIT_COUNT, and PER requires DTV_STAT_ERROR_BLOCK_COUNT
+ * and DTV_STAT_TOTAL_BLOCK_COUNT.
+ *
+ * @return 0 if success, -EINVAL if a property is not a Kernel stats.
+ */
+int dvb_fe_set_stats_props(struct dvb_v5_fe_parms *parms,
+			   const uint32_t *cmds, unsigned num);
+
+/**
+ * @brief Retrieve the stats of several frontends from the Kernel
+ * @ingroup frontend
+ *
+ * @param parms	array of struct dvb_v5_fe_parms pointers
+ * @param num	number of frontends
+ * @param ret	if not NULL, an array of num elements where the return
+ *		code of dvb_fe_get_stats() for each frontend is stored
+ *
+ * Updates the stats cache of all frontends, with a single FE_GET_PROPERTY
+ * call for each of them, with the stats selected via
+ * dvb_fe_set_stats_props().
+ *
+ * @return the number of frontends whose stats were updated.
+ */
+int dvb_fe_get_stats_batch(struct dvb_v5_fe_parms **parms, unsigned num,
+			   int *ret);
+
 /**
  * @brief Retrieve the BER stats from cache
  * @ingroup frontend
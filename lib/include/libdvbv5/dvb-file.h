@@ -127,11 +127,16 @@ struct dvb_entry {
  * @param fname		name of the file
  * @param n_entries	number of the entries read
  * @param first_entry	entry for the first entry. NULL if the file is empty.
+ * @param index		index used by dvb_file_find_channel() and friends.
+ *			Created by the library at the first lookup.
  */
+struct dvb_file_index;
+
 struct dvb_file {
 	char *fname;
 	int n_entries;
 	struct dvb_entry *first_entry;
+	struct dvb_file_index *index;
 };
 
 /*
@@ -270,6 +275,7 @@ static inline void dvb_file_free(struct dvb_file *dvb_file)
 		free(entry);
 		entry = next;
 	}
+	free(dvb_file->index);
 	free(dvb_file);
 }
 
@@ -332,6 +338,73 @@ struct dvb_file *dvb_read_file_format(const char *fname,
 					   uint32_t delsys,
 					   enum dvb_file_formats format);
 
+/**
+ * @brief Read a file on any format natively supported by the library,
+ *	  using a binary cache of its parsed contents
+ * @ingroup file
+ *
+ * @param fname		file name
+ * @param delsys	Delivery system, as specified by enum fe_delivery_system
+ * @param format	Name of the format to be read
+ * @param cache_fname	Name of the cache file. If NULL, this is the same as
+ *			dvb_read_file_format().
+ *
+ * If the cache file was created from the same version of fname, with
+ * the same delsys and format, the entries are read from it, without
+ * parsing fname. Otherwise, fname is parsed and the cache file is
+ * written again.
+ *
+ * @return It returns a pointer to struct dvb_file describing the entries that
+ * were read from the file. If it fails, NULL is returned.
+ */
+struct dvb_file *dvb_read_file_format_cached(const char *fname,
+					     uint32_t delsys,
+					     enum dvb_file_formats format,
+					     const char *cache_fname);
+
+/**
+ * @brief Seeks for a channel by its name or by its virtual channel number
+ * @ingroup file
+ *
+ * @param dvb_file	file with the channels
+ * @param name		channel name or virtual channel number
+ *
+ * Returns the first entry whose channel or vchannel is name. If none is
+ * found, seeks again by the channel name, ignoring the case.
+ *
+ * The lookups use an index, built at the first call. It is rebuilt if
+ * entries are appended to the file. Other changes at the list of
+ * entries require freeing dvb_file->index and setting it to NULL.
+ *
+ * @return the entry, or NULL if not found.
+ */
+struct dvb_entry *dvb_file_find_channel(struct dvb_file *dvb_file,
+					const char *name);
+
+/**
+ * @brief Seeks for the first entry with a given service ID
+ * @ingroup file
+ *
+ * @param dvb_file	file with the channels
+ * @param service_id	service ID
+ *
+ * @return the entry, or NULL if not found.
+ */
+struct dvb_entry *dvb_file_find_service(struct dvb_file *dvb_file,
+					uint16_t service_id);
+
+/**
+ * @brief Seeks for the first entry with a given frequency
+ * @ingroup file
+ *
+ * @param dvb_file	file with the channels
+ * @param freq		frequency, as stored at DTV_FREQUENCY
+ *
+ * @return the entry, or NULL if not found.
+ */
+struct dvb_entry *dvb_file_find_freq(struct dvb_file *dvb_file,
+				     uint32_t freq);
+
 /**
  * @brief Write a file on any format natively supported by
  *			    the library
@@ -349,6 +422,48 @@ int dvb_write_file_format(const char *fname,
 			  uint32_t delsys,
 			  enum dvb_file_formats format);
 
+/**
+ * @brief Read the entries of an already opened file, on any format
+ *	  natively supported by the library
+ * @ingroup file
+ *
+ * @param fp		file to be read, from its current position
+ * @param fname		file name, used only on error messages
+ * @param delsys	Delivery system, as specified by enum fe_delivery_system
+ * @param format	Name of the format to be read
+ *
+ * As the file is read via stdio, fp may also be a memory stream, from
+ * fmemopen(). The parsing doesn't use any global state, so several
+ * threads may parse different streams at the same time.
+ *
+ * @return It returns a pointer to struct dvb_file describing the entries that
+ * were read from the file. If it fails, NULL is returned.
+ */
+struct dvb_file *dvb_read_file_format_fp(FILE *fp, const char *fname,
+					 uint32_t delsys,
+					 enum dvb_file_formats format);
+
+/**
+ * @brief Write the entries to an already opened file, on any format
+ *	  natively supported by the library
+ * @ingroup file
+ *
+ * @param fp		file to be written, from its current position
+ * @param fname		file name, used only on error messages
+ * @param dvb_file	contents of the file to be written
+ * @param delsys	Delivery system, as specified by enum fe_delivery_system
+ * @param format	Name of the format to be written
+ *
+ * The file is not closed or flushed. fp may also be a memory stream, from
+ * open_memstream().
+ *
+ * @return It returns zero if success, or a negative number if it fails.
+ */
+int dvb_write_file_format_fp(FILE *fp, const char *fname,
+			     struct dvb_file *dvb_file,
+			     uint32_t delsys,
+			     enum dvb_file_formats format);
+
 
 /**
  * @brief Stores a key/value pair on a DVB file entry
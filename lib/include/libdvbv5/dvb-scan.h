@@ -226,6 +226,52 @@ int dvb_read_sections(struct dvb_v5_fe_parms *parms, int dmx_fd,
 			     struct dvb_table_filter *sect,
 			     unsigned timeout);
 
+/**
+ * @brief parses a MPEG-TS table section, as read from a demux
+ * @ingroup frontend_scan
+ *
+ * @param parms		pointer to struct dvb_v5_fe_parms created when the
+ *			frontend is opened
+ * @param sect		section filter pointer. Its priv field should be
+ *			NULL before the first section.
+ * @param buf		section data, including its CRC
+ * @param buf_length	section size
+ *
+ * Does the same as dvb_read_sections() does with each section it reads,
+ * for applications that get the sections from elsewhere, like a recorded
+ * MPEG-TS file. The table is stored at *sect->table, and should be freed
+ * with the table-specific free function. The filter should be freed with
+ * dvb_table_filter_free().
+ *
+ * @return 0 if more sections are needed, 1 if the table is complete, or
+ *	a negative value on errors, like a bad CRC.
+ */
+int dvb_table_filter_parse(struct dvb_v5_fe_parms *parms,
+			   struct dvb_table_filter *sect,
+			   const uint8_t *buf, ssize_t buf_length);
+
+/**
+ * @brief enables or disables the cache of MPEG-TS table sections
+ * @ingroup frontend_scan
+ *
+ * @param parms		pointer to struct dvb_v5_fe_parms created when the
+ *			frontend is opened
+ * @param enable	if not zero, enables the cache. Otherwise, disables
+ *			it and discards the cached sections.
+ *
+ * When enabled, the raw sections of each table read via dvb_read_sections()
+ * (and the functions that use it) are kept in memory, indexed by the
+ * transponder being tuned, PID, table ID, table ID extension and version.
+ * If a table is read again and its first section has the same version as
+ * a complete cached table, the cached sections are parsed and the read
+ * returns right away, instead of waiting for all sections to be received
+ * again.
+ *
+ * Useful for applications that periodically re-scan the same transponders.
+ * The cache is per frontend, and it is freed when the frontend is closed.
+ */
+void dvb_scan_set_section_cache(struct dvb_v5_fe_parms *parms, int enable);
+
 /**
  * @brief allocates a struct dvb_v5_descriptors
  * @ingroup frontend_scan
@@ -270,6 +316,23 @@ struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *parms, int
 					  unsigned other_nit,
 					  unsigned timeout_multiply);
 
+/**
+ * @brief sets how many demux filters dvb_get_ts_tables() may use at once
+ * @ingroup frontend_scan
+ *
+ * @param parms		pointer to struct dvb_v5_fe_parms created when the
+ *			frontend is opened
+ * @param num_filters	maximum number of simultaneous section filters.
+ *			0 or 1 reads one table after the other (default).
+ *
+ * With more than one filter, dvb_get_ts_tables() reads the PMT, NIT and
+ * SDT tables at the same time, re-opening the demux device passed to it
+ * to get more filters. If the device can't provide that many filters,
+ * it uses as many as it can.
+ */
+void dvb_scan_set_table_filters(struct dvb_v5_fe_parms *parms,
+				unsigned num_filters);
+
 /**
  * @brief frees a struct dvb_v5_descriptors
  * @ingroup frontend_scan
@@ -0,0 +1,160 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+/**
+ * @file dvb-spts.h
+ * @ingroup spts
+ * @brief Splits a MPEG-TS into Single Program Transport Streams (SPTS).
+ * @copyright GNU Lesser General Public License version 2.1 (LGPLv2.1)
+ *
+ * The splitter receives a full MPEG-TS, as read from the DVR device with
+ * the demux set to DMX_OUT_TS_TAP for all PIDs, and writes each service
+ * to a separate output: a file, a pipe or a datagram socket.
+ *
+ * The PIDs of each service are taken from the PAT and PMT tables of the
+ * MPEG-TS, and are updated when those tables change. Each output gets its
+ * own PAT, describing only its service.
+ *
+ * @par Bug Report
+ * Please submit bug reports and patches to linux-media@vger.kernel.org
+ */
+
+#ifndef _DVB_SPTS_H
+#define _DVB_SPTS_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <libdvbv5/dvb-fe.h>
+
+/**
+ * @def DVB_SPTS_MAX_OUTPUTS
+ *	@brief maximum number of outputs of a splitter
+ */
+#define DVB_SPTS_MAX_OUTPUTS	32
+
+/**
+ * @struct dvb_spts_stats
+ * @brief Statistics of a splitter output
+ * @ingroup spts
+ *
+ * @param packets	number of TS packets written
+ * @param bytes		number of bytes written
+ * @param dropped	number of TS packets that couldn't be written
+ * @param psi_updates	number of times the PAT or the PMT of the service
+ *			changed
+ * @param pmt_pid	PID of the service PMT, or -1 if not known yet
+ */
+struct dvb_spts_stats {
+	unsigned long long packets;
+	unsigned long long bytes;
+	unsigned long long dropped;
+	unsigned psi_updates;
+	int pmt_pid;
+};
+
+/**
+ * @struct dvb_spts
+ * @brief Opaque struct with the splitter
+ * @ingroup spts
+ */
+struct dvb_spts;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Allocates a MPEG-TS splitter
+ * @ingroup spts
+ *
+ * @param parms		struct dvb_v5_fe_parms pointer, used for logs
+ *
+ * @return a pointer to the splitter, or NULL if out of memory.
+ */
+struct dvb_spts *dvb_spts_alloc(struct dvb_v5_fe_parms *parms);
+
+/**
+ * @brief Flushes all outputs and frees the splitter
+ * @ingroup spts
+ *
+ * @param spts		struct dvb_spts pointer
+ *
+ * The output file descriptors are not closed.
+ */
+void dvb_spts_free(struct dvb_spts *spts);
+
+/**
+ * @brief Adds an output, with a service
+ * @ingroup spts
+ *
+ * @param spts		struct dvb_spts pointer
+ * @param service_id	service ID, as in the PAT table
+ * @param fd		file descriptor where the SPTS will be written
+ *
+ * If fd is a datagram socket, each datagram carries 7 TS packets, as
+ * usual for MPEG-TS over UDP. The socket should be already connected.
+ *
+ * More than one output may have the same service.
+ *
+ * @return the output number, used by dvb_spts_get_stats(), or a negative
+ *	error code.
+ */
+int dvb_spts_add_output(struct dvb_spts *spts, uint16_t service_id, int fd);
+
+/**
+ * @brief Routes the packets of a MPEG-TS to the outputs
+ * @ingroup spts
+ *
+ * @param spts		struct dvb_spts pointer
+ * @param buf		MPEG-TS data
+ * @param len		data size
+ *
+ * The data doesn't need to be aligned to the TS packets: partial packets
+ * are kept until the next call.
+ *
+ * The outputs are written with blocking writes, unless their file
+ * descriptors are non-blocking. In this case, the packets that don't
+ * fit are dropped.
+ */
+void dvb_spts_feed(struct dvb_spts *spts, const uint8_t *buf, size_t len);
+
+/**
+ * @brief Writes the packets still buffered on all outputs
+ * @ingroup spts
+ *
+ * @param spts		struct dvb_spts pointer
+ */
+void dvb_spts_flush(struct dvb_spts *spts);
+
+/**
+ * @brief Gets the statistics of an output
+ * @ingroup spts
+ *
+ * @param spts		struct dvb_spts pointer
+ * @param output	output number, as returned by dvb_spts_add_output()
+ * @param stats		where the statistics will be stored
+ *
+ * @return 0 on success, -EINVAL if output is invalid.
+ */
+int dvb_spts_get_stats(struct dvb_spts *spts, int output,
+		       struct dvb_spts_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -147,6 +147,25 @@ extern "C" {
 ssize_t dvb_table_pat_init (struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			    ssize_t buflen, struct dvb_table_pat **table);
 
+/**
+ * @brief Stores a PAT table as a MPEG-TS section
+ * @ingroup dvb_table
+ *
+ * @param parms	struct dvb_v5_fe_parms pointer to the opened device
+ * @param table pointer to struct dvb_table_pat to be stored
+ * @param buf buffer where the section will be written
+ * @param buflen length of the buffer
+ *
+ * This is the reverse of dvb_table_pat_init(). The section length is
+ * calculated from the list of programs, and the CRC is appended.
+ *
+ * @return On success, it returns the size of the section, including
+ *	   its CRC. A negative value indicates an error.
+ */
+ssize_t dvb_table_pat_store(struct dvb_v5_fe_parms *parms,
+			    const struct dvb_table_pat *table,
+			    uint8_t *buf, size_t buflen);
+
 /**
  * @brief Frees all data allocated by the PAT table parser
  * @ingroup dvb_table
@@ -20,6 +20,18 @@
 
 #include <libdvbv5/crc32.h>
 
+#include <string.h>
+#include <sched.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)))
+# define HAVE_CRC32_PCLMUL
+# include <immintrin.h>
+#endif
+
+#define CRC32_POLY	0x04c11db7
+
+
 static uint32_t crctab[256] = {
   0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9, 0x130476dc, 0x17c56b6b,
   0x1a864db2, 0x1e475005, 0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61,
@@ -66,10 +78,221 @@ static uint32_t crctab[256] = {
   0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
-inline uint32_t dvb_crc32(uint8_t *data, size_t len, uint32_t crc)
+/*
+ * Slicing-by-8: crctab8[k][i] is the CRC of the byte i followed by k
+ * zeroed bytes, so eight bytes can be handled per loop, with independent
+ * table lookups. crctab8[0] is crctab.
+ */
+static uint32_t crctab8[8][256];
+
+typedef uint32_t (crc32_func_t)(const uint8_t *data, size_t len, uint32_t crc);
+
+static crc32_func_t *crc32_impl;
+static int crc32_initializing;
+
+static uint32_t dvb_crc32_bytewise(const uint8_t *data, size_t len,
+				   uint32_t crc)
 {
   while(len--)
     crc = (crc << 8) ^ crctab[((crc >> 24) ^ *data++) & 0xff];
   return crc;
 }
 
+static uint32_t dvb_crc32_slice8(const uint8_t *data, size_t len, uint32_t crc)
+{
+	while (len >= 8) {
+		crc ^= (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+		       (uint32_t)data[2] << 8 | data[3];
+		crc = crctab8[7][crc >> 24] ^
+		      crctab8[6][(crc >> 16) & 0xff] ^
+		      crctab8[5][(crc >> 8) & 0xff] ^
+		      crctab8[4][crc & 0xff] ^
+		      crctab8[3][data[4]] ^
+		      crctab8[2][data[5]] ^
+		      crctab8[1][data[6]] ^
+		      crctab8[0][data[7]];
+		data += 8;
+		len -= 8;
+	}
+	return dvb_crc32_bytewise(data, len, crc);
+}
+
+#ifdef HAVE_CRC32_PCLMUL
+
+/*
+ * Carry-less multiplication folding, as described by Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction" paper,
+ * for the non-reflected MPEG-2 polynomial.
+ *
+ * The data is loaded byte-swapped, so bit 127 of each register is the
+ * first bit of the stream. Folding a register X by D bits uses the
+ * remainders of x^(D + 64) and x^D modulo P for its high and low halves.
+ */
+static struct {
+	uint64_t fold512[2];	/* x^576, x^512 mod P */
+	uint64_t fold128[2];	/* x^192, x^128 mod P */
+	uint64_t reduce[2];	/* x^96, x^64 mod P */
+	uint64_t barrett[2];	/* floor(x^64 / P), P */
+} crc32_k;
+
+#define CRC32_PCLMUL_TARGET __attribute__((target("pclmul,ssse3,sse4.1")))
+
+CRC32_PCLMUL_TARGET
+static inline __m128i crc32_load(const uint8_t *data)
+{
+	const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+					    7, 6, 5, 4, 3, 2, 1, 0);
+
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), bswap);
+}
+
+CRC32_PCLMUL_TARGET
+static inline __m128i crc32_fold(__m128i x, __m128i k, __m128i data)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x01),
+					   _mm_clmulepi64_si128(x, k, 0x10)),
+			     data);
+}
+
+CRC32_PCLMUL_TARGET
+static uint32_t dvb_crc32_pclmul(const uint8_t *data, size_t len, uint32_t crc)
+{
+	__m128i x0, x1, x2, x3, k, t;
+
+	if (len < 64)
+		return dvb_crc32_slice8(data, len, crc);
+
+	/* The initial CRC is added to the first 32 bits of the stream */
+	x0 = _mm_xor_si128(crc32_load(data), _mm_set_epi32(crc, 0, 0, 0));
+	x1 = crc32_load(data + 16);
+	x2 = crc32_load(data + 32);
+	x3 = crc32_load(data + 48);
+	data += 64;
+	len -= 64;
+
+	k = _mm_loadu_si128((const __m128i *)crc32_k.fold512);
+	while (len >= 64) {
+		x0 = crc32_fold(x0, k, crc32_load(data));
+		x1 = crc32_fold(x1, k, crc32_load(data + 16));
+		x2 = crc32_fold(x2, k, crc32_load(data + 32));
+		x3 = crc32_fold(x3, k, crc32_load(data + 48));
+		data += 64;
+		len -= 64;
+	}
+
+	k = _mm_loadu_si128((const __m128i *)crc32_k.fold128);
+	x0 = crc32_fold(x0, k, x1);
+	x0 = crc32_fold(x0, k, x2);
+	x0 = crc32_fold(x0, k, x3);
+	while (len >= 16) {
+		x0 = crc32_fold(x0, k, crc32_load(data));
+		data += 16;
+		len -= 16;
+	}
+
+	/* Reduce X * x^32 to 64 bits: first to 96 bits, then to 64 bits */
+	k = _mm_loadu_si128((const __m128i *)crc32_k.reduce);
+	t = _mm_slli_si128(_mm_move_epi64(x0), 4);
+	x0 = _mm_xor_si128(_mm_clmulepi64_si128(x0, k, 0x01), t);
+	t = _mm_move_epi64(x0);
+	x0 = _mm_xor_si128(_mm_clmulepi64_si128(x0, k, 0x11), t);
+
+	/* Barrett reduction of the remaining 64 bits */
+	k = _mm_loadu_si128((const __m128i *)crc32_k.barrett);
+	t = _mm_srli_epi64(x0, 32);
+	t = _mm_srli_epi64(_mm_clmulepi64_si128(t, k, 0x00), 32);
+	t = _mm_clmulepi64_si128(t, k, 0x10);
+	crc = _mm_cvtsi128_si32(_mm_xor_si128(x0, t));
+
+	return dvb_crc32_slice8(data, len, crc);
+}
+
+/* x^n mod P */
+static uint64_t crc32_xpow_mod(unsigned n)
+{
+	uint32_t r = 1;
+
+	while (n--)
+		r = (r << 1) ^ ((r & 0x80000000) ? CRC32_POLY : 0);
+	return r;
+}
+
+/* floor(x^64 / P), with P having its x^32 term */
+static uint64_t crc32_barrett_mu(void)
+{
+	uint64_t p = (1ULL << 32) | CRC32_POLY;
+	uint64_t hi = 1, lo = 0, q = 0;
+	int i, s;
+
+	for (i = 64; i >= 32; i--) {
+		if (!(i == 64 ? hi & 1 : (lo >> i) & 1))
+			continue;
+		s = i - 32;
+		q |= 1ULL << s;
+		if (s)
+			hi ^= p >> (64 - s);
+		lo ^= p << s;
+	}
+	return q;
+}
+
+static crc32_func_t *dvb_crc32_pclmul_setup(void)
+{
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("pclmul") ||
+	    !__builtin_cpu_supports("ssse3") ||
+	    !__builtin_cpu_supports("sse4.1"))
+		return NULL;
+
+	crc32_k.fold512[0] = crc32_xpow_mod(512 + 64);
+	crc32_k.fold512[1] = crc32_xpow_mod(512);
+	crc32_k.fold128[0] = crc32_xpow_mod(128 + 64);
+	crc32_k.fold128[1] = crc32_xpow_mod(128);
+	crc32_k.reduce[0] = crc32_xpow_mod(96);
+	crc32_k.reduce[1] = crc32_xpow_mod(64);
+	crc32_k.barrett[0] = crc32_barrett_mu();
+	crc32_k.barrett[1] = (1ULL << 32) | CRC32_POLY;
+
+	return dvb_crc32_pclmul;
+}
+#endif
+
+static crc32_func_t *dvb_crc32_setup(void)
+{
+	crc32_func_t *impl = NULL;
+	int i, k;
+
+	/* Only one thread builds the tables; the others wait for it */
+	if (__atomic_exchange_n(&crc32_initializing, 1, __ATOMIC_ACQUIRE)) {
+		while (!(impl = __atomic_load_n(&crc32_impl, __ATOMIC_ACQUIRE)))
+			sched_yield();
+		return impl;
+	}
+
+	memcpy(crctab8[0], crctab, sizeof(crctab));
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			uint32_t crc = crctab8[k - 1][i];
+
+			crctab8[k][i] = (crc << 8) ^ crctab[crc >> 24];
+		}
+	}
+
+#ifdef HAVE_CRC32_PCLMUL
+	impl = dvb_crc32_pclmul_setup();
+#endif
+	if (!impl)
+		impl = dvb_crc32_slice8;
+
+	__atomic_store_n(&crc32_impl, impl, __ATOMIC_RELEASE);
+	return impl;
+}
+
+uint32_t dvb_crc32(uint8_t *data, size_t len, uint32_t crc)
+{
+	crc32_func_t *impl = __atomic_load_n(&crc32_impl, __ATOMIC_ACQUIRE);
+
+	if (!impl)
+		impl = dvb_crc32_setup();
+	return impl(data, len, crc);
+}
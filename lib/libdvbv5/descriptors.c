@@ -17,6 +17,7 @@
  */
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -56,6 +57,227 @@
 #include <libdvbv5/desc_ca_identifier.h>
 #include <libdvbv5/desc_extension.h>
 
+#include "dvb-fe-priv.h"
+
+/*
+ * Arena allocator for parsed tables. Objects are carved out of big blocks
+ * and are all released at once by dvb_arena_free(). Descriptors that own
+ * memory of their own are remembered, in order to call their free method.
+ *
+ * The live arenas are kept on a list, for the table free functions to
+ * recognize, and skip, the objects that only the arena can release.
+ */
+
+#define DVB_ARENA_ALIGN		16
+#define DVB_ARENA_BLOCK_SIZE	65536
+
+struct dvb_arena_block {
+	struct dvb_arena_block *next;
+	size_t size, used;
+	uint8_t data[] __attribute__((aligned(DVB_ARENA_ALIGN)));
+};
+
+struct dvb_arena {
+	size_t block_size;
+	struct dvb_arena_block *blocks;
+
+	struct dvb_desc **descs;
+	unsigned num_descs, max_descs;
+
+	struct dvb_arena *next;
+};
+
+/* Protects the list of arenas and their list of blocks */
+static pthread_mutex_t dvb_arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dvb_arena *dvb_arena_list;
+
+struct dvb_arena *dvb_arena_alloc(size_t block_size)
+{
+	struct dvb_arena *arena;
+
+	arena = calloc(1, sizeof(*arena));
+	if (!arena)
+		return NULL;
+	arena->block_size = block_size ? block_size : DVB_ARENA_BLOCK_SIZE;
+
+	pthread_mutex_lock(&dvb_arena_lock);
+	arena->next = dvb_arena_list;
+	dvb_arena_list = arena;
+	pthread_mutex_unlock(&dvb_arena_lock);
+
+	return arena;
+}
+
+static void dvb_arena_free_descs(struct dvb_arena *arena)
+{
+	unsigned i;
+
+	for (i = 0; i < arena->num_descs; i++) {
+		struct dvb_desc *desc = arena->descs[i];
+
+		dvb_descriptors[desc->type].free(desc);
+	}
+	arena->num_descs = 0;
+}
+
+void dvb_arena_free(struct dvb_arena *arena)
+{
+	struct dvb_arena_block *block, *next;
+	struct dvb_arena **pos;
+
+	if (!arena)
+		return;
+
+	pthread_mutex_lock(&dvb_arena_lock);
+	for (pos = &dvb_arena_list; *pos; pos = &(*pos)->next) {
+		if (*pos == arena) {
+			*pos = arena->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dvb_arena_lock);
+
+	dvb_arena_free_descs(arena);
+	free(arena->descs);
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+void dvb_arena_reset(struct dvb_arena *arena)
+{
+	struct dvb_arena_block *block, *next;
+
+	dvb_arena_free_descs(arena);
+
+	/* Keep the block being filled, if it is not a dedicated one */
+	pthread_mutex_lock(&dvb_arena_lock);
+	block = arena->blocks;
+	if (block && block->size == arena->block_size) {
+		next = block->next;
+		block->next = NULL;
+		block->used = 0;
+	} else {
+		next = block;
+		arena->blocks = NULL;
+	}
+	pthread_mutex_unlock(&dvb_arena_lock);
+
+	for (block = next; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+}
+
+int dvb_arena_owns(const void *ptr)
+{
+	struct dvb_arena_block *block;
+	struct dvb_arena *arena;
+	const uint8_t *p = ptr;
+	int found = 0;
+
+	pthread_mutex_lock(&dvb_arena_lock);
+	for (arena = dvb_arena_list; arena && !found; arena = arena->next) {
+		for (block = arena->blocks; block; block = block->next) {
+			if (p >= block->data && p < block->data + block->size) {
+				found = 1;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&dvb_arena_lock);
+
+	return found;
+}
+
+void dvb_arena_set(struct dvb_v5_fe_parms *p, struct dvb_arena *arena)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+
+	parms->arena = arena;
+}
+
+static void *dvb_arena_calloc(struct dvb_arena *arena, size_t size)
+{
+	struct dvb_arena_block *block = arena->blocks;
+	void *p;
+
+	size = (size + DVB_ARENA_ALIGN - 1) & ~(size_t)(DVB_ARENA_ALIGN - 1);
+
+	if (!block || block->used + size > block->size) {
+		size_t block_size = arena->block_size;
+
+		/* Big objects get a block of their own */
+		if (size > block_size / 4)
+			block_size = size;
+
+		block = malloc(sizeof(*block) + block_size);
+		if (!block)
+			return NULL;
+		block->size = block_size;
+		block->used = 0;
+
+		/* Keep filling the current block, if the new one is dedicated */
+		pthread_mutex_lock(&dvb_arena_lock);
+		if (arena->blocks && block_size == size) {
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+		pthread_mutex_unlock(&dvb_arena_lock);
+	}
+
+	p = block->data + block->used;
+	block->used += size;
+	memset(p, 0, size);
+
+	return p;
+}
+
+static int dvb_arena_add_desc(struct dvb_arena *arena, struct dvb_desc *desc)
+{
+	struct dvb_desc **descs;
+	unsigned max;
+
+	if (arena->num_descs == arena->max_descs) {
+		max = arena->max_descs ? arena->max_descs * 2 : 64;
+		descs = realloc(arena->descs, max * sizeof(*descs));
+		if (!descs)
+			return -1;
+		arena->descs = descs;
+		arena->max_descs = max;
+	}
+	arena->descs[arena->num_descs++] = desc;
+
+	return 0;
+}
+
+void *dvb_parse_calloc(struct dvb_v5_fe_parms *p, size_t size)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+
+	if (parms && parms->arena)
+		return dvb_arena_calloc(parms->arena, size);
+
+	return calloc(1, size);
+}
+
+void dvb_parse_free(struct dvb_v5_fe_parms *p, void *ptr)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+
+	/* Arena memory is only released with the arena */
+	if (parms && parms->arena)
+		return;
+
+	free(ptr);
+}
+
 static void dvb_desc_init(uint8_t type, uint8_t length, struct dvb_desc *desc)
 {
 	desc->type   = type;
@@ -134,6 +356,8 @@ const dvb_table_init_func dvb_table_initializers[256] = {
 int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			   uint16_t buflen, struct dvb_desc **head_desc)
 {
+	struct dvb_v5_fe_parms_priv *priv = (void *)parms;
+	struct dvb_arena *arena = priv ? priv->arena : NULL;
 	const uint8_t *ptr = buf, *endbuf = buf + buflen;
 	struct dvb_desc *current = NULL;
 	struct dvb_desc *last = NULL;
@@ -185,16 +409,22 @@ int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			return -2;
 		}
 
-		current = calloc(1, size);
+		current = dvb_parse_calloc(parms, size);
 		if (!current) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -3;
 		}
 		dvb_desc_init(desc_type, desc_len, current); /* initialize the standard header */
 		if (init(parms, ptr, current) != 0) {
-			free(current);
+			dvb_parse_free(parms, current);
 			return -4;
 		}
+		if (arena && dvb_descriptors[desc_type].free &&
+		    dvb_arena_add_desc(arena, current)) {
+			dvb_descriptors[desc_type].free(current);
+			dvb_logerr("%s: out of memory", __func__);
+			return -3;
+		}
 		if (!*head_desc)
 			*head_desc = current;
 		if (last)
@@ -220,6 +450,10 @@ void dvb_desc_print(struct dvb_v5_fe_parms *parms, struct dvb_desc *desc)
 void dvb_desc_free(struct dvb_desc **list)
 {
 	struct dvb_desc *desc = *list;
+
+	/* The whole list was parsed at once: the arena will release it */
+	if (desc && dvb_arena_owns(desc))
+		desc = NULL;
 	while (desc) {
 		struct dvb_desc *tmp = desc;
 		desc = desc->next;
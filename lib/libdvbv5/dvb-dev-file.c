@@ -0,0 +1,871 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+/*
+ * Emulates a DTV adapter with recorded MPEG-TS files, so that the scan
+ * logic can be tested and measured without hardware. The demux filters
+ * are applied to the file contents on each read, as fast as the caller
+ * reads them.
+ */
+
+#define _FILE_OFFSET_BITS 64
+#define _LARGEFILE_SOURCE 1
+#define _LARGEFILE64_SOURCE 1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <config.h>
+
+#include "dvb-fe-priv.h"
+#include "dvb-dev-priv.h"
+#include <libdvbv5/crc32.h>
+
+#ifdef ENABLE_NLS
+# include "gettext.h"
+# include <libintl.h>
+# define _(string) dgettext(LIBDVBV5_DOMAIN, string)
+#else
+# define _(string) string
+#endif
+
+#define TS_SIZE		188
+#define MAX_SECTION	(3 + 0xfff)
+#define ALL_PIDS	0x2000
+
+enum dvb_file_filter_type {
+	FILE_FILTER_NONE,
+	FILE_FILTER_SECTION,
+	FILE_FILTER_PES,
+};
+
+/* An open device. Demux ones also have a filter */
+struct dvb_file_open {
+	/* Should be the first element, as it is casted from open_dev */
+	struct dvb_open_descriptor open_dev;
+
+	enum dvb_file_filter_type type;
+	uint16_t pid;
+	dmx_output_t output;
+	unsigned flags;
+	uint8_t filter[DMX_FILTER_SIZE];
+	uint8_t mask[DMX_FILTER_SIZE];
+	uint8_t mode[DMX_FILTER_SIZE];
+
+	/* Next TS packet to be filtered, and where the filter started */
+	size_t pkt, start_pkt;
+	int wrapped;
+
+	/* Section being assembled, and the next one after the pointer field */
+	uint8_t buf[MAX_SECTION + TS_SIZE];
+	unsigned len, rd;
+	const uint8_t *next_start;
+	unsigned next_len;
+	int cc;
+
+	/* Section ready to be read, or its part that didn't fit on the last read */
+	uint8_t pending[MAX_SECTION];
+	unsigned pending_len, pending_rd;
+};
+
+struct dvb_dev_file_priv {
+	char *path;
+	int is_dir;
+
+	/* The transponder being received */
+	uint8_t *data;
+	size_t size;
+	size_t first, num_pkts;
+	int locked;
+
+	/* Current position of the stream, where new filters start */
+	size_t pkt;
+
+	int next_uid;
+};
+
+static const fe_delivery_system_t file_systems[] = {
+	SYS_DVBT, SYS_DVBT2, SYS_DVBC_ANNEX_A, SYS_DVBC_ANNEX_B,
+	SYS_DVBC_ANNEX_C, SYS_DVBS, SYS_DVBS2, SYS_TURBO, SYS_DSS,
+	SYS_ISDBT, SYS_ISDBS, SYS_ISDBC, SYS_ATSC, SYS_DTMB,
+};
+
+static void dvb_file_reset_filter(struct dvb_dev_file_priv *priv,
+				  struct dvb_file_open *f)
+{
+	f->pkt = priv->pkt < priv->num_pkts ? priv->pkt : 0;
+	f->start_pkt = f->pkt;
+	f->wrapped = 0;
+	f->len = 0;
+	f->rd = 0;
+	f->next_len = 0;
+	f->cc = -1;
+	f->pending_len = 0;
+	f->pending_rd = 0;
+}
+
+static void dvb_file_unmap(struct dvb_dev_file_priv *priv)
+{
+	if (priv->data)
+		munmap(priv->data, priv->size);
+	priv->data = NULL;
+	priv->size = 0;
+	priv->num_pkts = 0;
+	priv->pkt = 0;
+	priv->locked = 0;
+}
+
+static int dvb_file_map(struct dvb_device_priv *dvb, const char *fname)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct dvb_dev_file_priv *priv = dvb->priv;
+	struct dvb_open_descriptor *cur;
+	struct stat st;
+	size_t i;
+	int fd;
+
+	dvb_file_unmap(priv);
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		dvb_logerr(_("Can't open %s: %m"), fname);
+		return -errno;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < TS_SIZE) {
+		dvb_logerr(_("%s is not a MPEG-TS file"), fname);
+		close(fd);
+		return -EINVAL;
+	}
+
+	priv->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (priv->data == MAP_FAILED) {
+		priv->data = NULL;
+		dvb_perror("mmap");
+		return -errno;
+	}
+	priv->size = st.st_size;
+	madvise(priv->data, priv->size, MADV_SEQUENTIAL);
+
+	/* Skip garbage before the first TS packet */
+	for (i = 0; i + TS_SIZE < priv->size; i++) {
+		if (priv->data[i] == 0x47 && priv->data[i + TS_SIZE] == 0x47)
+			break;
+	}
+	if (i + TS_SIZE >= priv->size)
+		i = 0;
+	priv->first = i;
+	priv->num_pkts = (priv->size - i) / TS_SIZE;
+	priv->locked = 1;
+
+	if (parms->p.verbose)
+		dvb_log(_("Using %s, with %zu TS packets"), fname,
+			priv->num_pkts);
+
+	/* The filters keep running, but on a new stream */
+	for (cur = dvb->open_list.next; cur; cur = cur->next)
+		dvb_file_reset_filter(priv, (struct dvb_file_open *)cur);
+
+	return 0;
+}
+
+static const uint8_t *dvb_file_packet(struct dvb_dev_file_priv *priv,
+				      size_t pkt)
+{
+	return priv->data + priv->first + pkt * TS_SIZE;
+}
+
+/* Returns the payload of a TS packet, or NULL if there is none */
+static const uint8_t *dvb_file_payload(const uint8_t *p, unsigned *len)
+{
+	unsigned start = 4;
+
+	if (p[0] != 0x47 || (p[1] & 0x80) || !(p[3] & 0x10))
+		return NULL;
+	if (p[3] & 0x20)
+		start += 1 + p[4];
+	if (start >= TS_SIZE)
+		return NULL;
+
+	*len = TS_SIZE - start;
+	return p + start;
+}
+
+static int dvb_file_pid_match(struct dvb_file_open *f, const uint8_t *p)
+{
+	uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
+
+	return f->pid == ALL_PIDS || f->pid == pid;
+}
+
+/* Matches a section like the Kernel demux does */
+static int dvb_file_section_match(struct dvb_file_open *f,
+				  const uint8_t *sec, unsigned len)
+{
+	int i, pos, neq = 0, has_neq = 0;
+	uint8_t xor;
+
+	for (i = 0; i < DMX_FILTER_SIZE; i++) {
+		pos = i ? i + 2 : 0;
+		if (!f->mask[i])
+			continue;
+		if (pos >= len)
+			return 0;
+
+		xor = sec[pos] ^ f->filter[i];
+		if (xor & f->mask[i] & ~f->mode[i])
+			return 0;
+		if (f->mask[i] & f->mode[i]) {
+			has_neq = 1;
+			if (xor & f->mask[i] & f->mode[i])
+				neq = 1;
+		}
+	}
+	if (has_neq && !neq)
+		return 0;
+
+	if ((f->flags & DMX_CHECK_CRC) && (sec[1] & 0x80) &&
+	    dvb_crc32((uint8_t *)sec, len, 0xffffffff))
+		return 0;
+
+	return 1;
+}
+
+static void dvb_file_append(struct dvb_file_open *f, const uint8_t *buf,
+			    unsigned len)
+{
+	if (f->rd) {
+		memmove(f->buf, f->buf + f->rd, f->len - f->rd);
+		f->len -= f->rd;
+		f->rd = 0;
+	}
+	if (f->len + len > sizeof(f->buf)) {
+		/* Garbage: sections are never that big */
+		f->len = 0;
+		return;
+	}
+	memcpy(f->buf + f->len, buf, len);
+	f->len += len;
+}
+
+/*
+ * Gets the next section that matches the filter. The file is read as if
+ * it were broadcasted in a loop, until getting back to where the filter
+ * started.
+ */
+static int dvb_file_next_section(struct dvb_dev_file_priv *priv,
+				 struct dvb_file_open *f,
+				 const uint8_t **sec, unsigned *sec_len)
+{
+	const uint8_t *p, *payload;
+	unsigned len, ptr;
+	int cc;
+
+	while (1) {
+		/* Complete sections already assembled */
+		while (f->len - f->rd >= 3) {
+			if (f->buf[f->rd] == 0xff) {
+				/* Stuffing up to the end of the packet */
+				f->rd = f->len;
+				break;
+			}
+			len = 3 + (((f->buf[f->rd + 1] & 0x0f) << 8) |
+				   f->buf[f->rd + 2]);
+			if (f->len - f->rd < len)
+				break;
+
+			*sec = f->buf + f->rd;
+			*sec_len = len;
+			f->rd += len;
+			if (dvb_file_section_match(f, *sec, len))
+				return 0;
+		}
+
+		/* A new section starts after the pointer field */
+		if (f->next_len) {
+			f->len = 0;
+			f->rd = 0;
+			dvb_file_append(f, f->next_start, f->next_len);
+			f->next_len = 0;
+			continue;
+		}
+
+		if (f->pkt == priv->num_pkts) {
+			f->pkt = 0;
+			f->wrapped = 1;
+			f->len = 0;
+			f->rd = 0;
+			f->cc = -1;
+		}
+		if (f->wrapped && f->pkt >= f->start_pkt)
+			return -ETIMEDOUT;
+
+		p = dvb_file_packet(priv, f->pkt++);
+		if (!dvb_file_pid_match(f, p))
+			continue;
+		payload = dvb_file_payload(p, &len);
+		if (!payload)
+			continue;
+
+		cc = p[3] & 0x0f;
+		if (f->cc >= 0 && cc != ((f->cc + 1) & 0x0f)) {
+			if (cc == f->cc)
+				continue;	/* Duplicated packet */
+			f->len = 0;
+			f->rd = 0;
+		}
+		f->cc = cc;
+
+		if (p[1] & 0x40) {
+			ptr = payload[0];
+			if (ptr + 1 > len) {
+				f->len = 0;
+				f->rd = 0;
+				continue;
+			}
+			if (f->len > f->rd)
+				dvb_file_append(f, payload + 1, ptr);
+			f->next_start = payload + 1 + ptr;
+			f->next_len = len - 1 - ptr;
+		} else if (f->len > f->rd) {
+			dvb_file_append(f, payload, len);
+		}
+	}
+}
+
+/* Reads TS packets, for TS filters and the dvr device */
+static ssize_t dvb_file_read_ts(struct dvb_device_priv *dvb,
+				struct dvb_file_open *f,
+				uint8_t *buf, size_t count)
+{
+	struct dvb_dev_file_priv *priv = dvb->priv;
+	struct dvb_open_descriptor *cur;
+	struct dvb_file_open *dmx;
+	uint8_t pids[ALL_PIDS];
+	const uint8_t *p;
+	size_t n = 0;
+	int all = 0;
+
+	if (f->open_dev.dev->dvb_type == DVB_DEVICE_DVR) {
+		/* The dvr gets the PIDs of all TS_TAP filters */
+		memset(pids, 0, sizeof(pids));
+		for (cur = dvb->open_list.next; cur; cur = cur->next) {
+			dmx = (struct dvb_file_open *)cur;
+			if (dmx->type != FILE_FILTER_PES ||
+			    dmx->output != DMX_OUT_TS_TAP)
+				continue;
+			if (dmx->pid == ALL_PIDS)
+				all = 1;
+			else
+				pids[dmx->pid] = 1;
+		}
+	}
+
+	while (n + TS_SIZE <= count && f->pkt < priv->num_pkts) {
+		p = dvb_file_packet(priv, f->pkt++);
+		if (f->open_dev.dev->dvb_type == DVB_DEVICE_DVR) {
+			if (!all && !pids[((p[1] & 0x1f) << 8) | p[2]])
+				continue;
+		} else if (!dvb_file_pid_match(f, p)) {
+			continue;
+		}
+		memcpy(buf + n, p, TS_SIZE);
+		n += TS_SIZE;
+	}
+	priv->pkt = f->pkt;
+
+	return n;
+}
+
+/* Reads the payload of the packets of a PID, for DMX_OUT_TAP filters */
+static ssize_t dvb_file_read_pes(struct dvb_dev_file_priv *priv,
+				 struct dvb_file_open *f,
+				 uint8_t *buf, size_t count)
+{
+	const uint8_t *p, *payload;
+	unsigned len;
+	size_t n = 0;
+
+	while (n + TS_SIZE <= count && f->pkt < priv->num_pkts) {
+		p = dvb_file_packet(priv, f->pkt++);
+		if (!dvb_file_pid_match(f, p))
+			continue;
+		payload = dvb_file_payload(p, &len);
+		if (!payload)
+			continue;
+
+		/* Start at the first PES packet */
+		if (f->cc < 0 && !(p[1] & 0x40))
+			continue;
+		f->cc = p[3] & 0x0f;
+
+		memcpy(buf + n, payload, len);
+		n += len;
+	}
+	priv->pkt = f->pkt;
+
+	return n;
+}
+
+static struct dvb_open_descriptor *dvb_file_open(struct dvb_device_priv *dvb,
+						 const char *sysname,
+						 int flags)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct dvb_dev_file_priv *priv = dvb->priv;
+	struct dvb_open_descriptor *cur;
+	struct dvb_dev_list *dev = NULL;
+	struct dvb_file_open *f;
+	int i;
+
+	for (i = 0; i < dvb->d.num_devices; i++) {
+		if (!strcmp(sysname, dvb->d.devices[i].sysname)) {
+			dev = &dvb->d.devices[i];
+			break;
+		}
+	}
+	if (!dev) {
+		dvb_logerr(_("Can't find device %s"), sysname);
+		return NULL;
+	}
+
+	f = calloc(1, sizeof(*f));
+	if (!f) {
+		dvb_perror("Can't create file descriptor");
+		return NULL;
+	}
+
+	if (dev->dvb_type == DVB_DEVICE_FRONTEND) {
+		strcpy(parms->p.info.name, "MPEG-TS file");
+		parms->p.version = 0x50a;
+		parms->p.has_v5_stats = 1;
+		parms->p.legacy_fe = 0;
+		parms->p.num_systems = ARRAY_SIZE(file_systems);
+		for (i = 0; i < parms->p.num_systems; i++)
+			parms->p.systems[i] = file_systems[i];
+		if (parms->p.current_sys == SYS_UNDEFINED)
+			parms->p.current_sys = parms->p.systems[0];
+		parms->fe_flags = flags;
+		parms->n_props = dvb_add_parms_for_sys(&parms->p,
+						       parms->p.current_sys);
+		dvb_fe_prepare_stats(parms);
+	}
+
+	f->open_dev.fd = priv->next_uid++;
+	f->open_dev.dev = dev;
+	f->open_dev.dvb = dvb;
+	dvb_file_reset_filter(priv, f);
+
+	cur = &dvb->open_list;
+	while (cur->next)
+		cur = cur->next;
+	cur->next = &f->open_dev;
+
+	return &f->open_dev;
+}
+
+static int dvb_file_close(struct dvb_open_descriptor *open_dev)
+{
+	struct dvb_file_open *f = (struct dvb_file_open *)open_dev;
+	struct dvb_device_priv *dvb = open_dev->dvb;
+	struct dvb_open_descriptor *cur;
+
+	for (cur = &dvb->open_list; cur->next; cur = cur->next) {
+		if (cur->next == open_dev) {
+			cur->next = open_dev->next;
+			free(f);
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int dvb_file_dmx_stop(struct dvb_open_descriptor *open_dev)
+{
+	struct dvb_file_open *f = (struct dvb_file_open *)open_dev;
+
+	if (open_dev->dev->dvb_type != DVB_DEVICE_DEMUX)
+		return -EINVAL;
+
+	f->type = FILE_FILTER_NONE;
+	return 0;
+}
+
+static int dvb_file_set_bufsize(struct dvb_open_descriptor *open_dev,
+				int buffersize)
+{
+	/* The whole file is already there */
+	return 0;
+}
+
+/* Gets the next section for the filter, if there's none pending */
+static int dvb_file_fill(struct dvb_dev_file_priv *priv,
+			 struct dvb_file_open *f)
+{
+	const uint8_t *sec;
+	unsigned len;
+	int ret;
+
+	if (f->pending_len)
+		return 0;
+	if (f->type != FILE_FILTER_SECTION)
+		return -EINVAL;
+
+	ret = dvb_file_next_section(priv, f, &sec, &len);
+	if (ret < 0)
+		return ret;
+
+	memcpy(f->pending, sec, len);
+	f->pending_len = len;
+	f->pending_rd = 0;
+	priv->pkt = f->pkt;
+	if (f->flags & DMX_ONESHOT)
+		f->type = FILE_FILTER_NONE;
+
+	return 0;
+}
+
+static ssize_t dvb_file_read(struct dvb_open_descriptor *open_dev,
+			     void *buf, size_t count)
+{
+	struct dvb_file_open *f = (struct dvb_file_open *)open_dev;
+	struct dvb_device_priv *dvb = open_dev->dvb;
+	struct dvb_dev_file_priv *priv = dvb->priv;
+	unsigned len;
+	int ret;
+
+	if (!priv->locked)
+		return -EAGAIN;
+
+	if (open_dev->dev->dvb_type == DVB_DEVICE_DVR)
+		return dvb_file_read_ts(dvb, f, buf, count);
+	if (open_dev->dev->dvb_type != DVB_DEVICE_DEMUX)
+		return -EINVAL;
+
+	if (f->type == FILE_FILTER_PES) {
+		if (f->output == DMX_OUT_TSDEMUX_TAP)
+			return dvb_file_read_ts(dvb, f, buf, count);
+		if (f->output == DMX_OUT_TAP)
+			return dvb_file_read_pes(priv, f, buf, count);
+		return -EINVAL;
+	}
+
+	ret = dvb_file_fill(priv, f);
+	if (ret < 0)
+		return ret;
+
+	len = f->pending_len < count ? f->pending_len : count;
+	memcpy(buf, f->pending + f->pending_rd, len);
+	f->pending_rd += len;
+	f->pending_len -= len;
+
+	return len;
+}
+
+static int dvb_file_dmx_poll(struct dvb_open_descriptor *open_dev,
+			     unsigned timeout_ms)
+{
+	struct dvb_file_open *f = (struct dvb_file_open *)open_dev;
+	struct dvb_dev_file_priv *priv = open_dev->dvb->priv;
+
+	/*
+	 * There's no need to wait: either there is data on the file for
+	 * the filter, or there will never be.
+	 */
+	if (!priv->locked)
+		return 0;
+	if (open_dev->dev->dvb_type == DVB_DEVICE_DVR ||
+	    f->type == FILE_FILTER_PES)
+		return f->pkt < priv->num_pkts;
+
+	return dvb_file_fill(priv, f) == 0;
+}
+
+static int dvb_file_dmx_set_pesfilter(struct dvb_open_descriptor *open_dev,
+				      int pid, dmx_pes_type_t type,
+				      dmx_output_t output, int bufsize)
+{
+	struct dvb_file_open *f = (struct dvb_file_open *)open_dev;
+	struct dvb_dev_file_priv *priv = open_dev->dvb->priv;
+
+	if (open_dev->dev->dvb_type != DVB_DEVICE_DEMUX || pid > ALL_PIDS)
+		return -EINVAL;
+
+	dvb_file_reset_filter(priv, f);
+	f->type = FILE_FILTER_PES;
+	f->pid = pid;
+	f->output = output;
+
+	return 0;
+}
+
+static int dvb_file_dmx_set_section_filter(struct dvb_open_descriptor *open_dev,
+					   int pid, unsigned filtsize,
+					   unsigned char *filter,
+					   unsigned char *mask,
+					   unsigned char *mode,
+					   unsigned int flags)
+{
+	struct dvb_file_open *f = (struct dvb_file_open *)open_dev;
+	struct dvb_dev_file_priv *priv = open_dev->dvb->priv;
+
+	if (open_dev->dev->dvb_type != DVB_DEVICE_DEMUX || pid >= ALL_PIDS)
+		return -EINVAL;
+
+	if (filtsize > DMX_FILTER_SIZE)
+		filtsize = DMX_FILTER_SIZE;
+
+	dvb_file_reset_filter(priv, f);
+	memset(f->filter, 0, sizeof(f->filter));
+	memset(f->mask, 0, sizeof(f->mask));
+	memset(f->mode, 0, sizeof(f->mode));
+	if (filter)
+		memcpy(f->filter, filter, filtsize);
+	if (mask)
+		memcpy(f->mask, mask, filtsize);
+	if (mode)
+		memcpy(f->mode, mode, filtsize);
+
+	f->type = FILE_FILTER_SECTION;
+	f->pid = pid;
+	f->flags = flags;
+
+	return 0;
+}
+
+static int dvb_file_dmx_get_pmt_pid(struct dvb_open_descriptor *open_dev,
+				    int sid)
+{
+	struct dvb_dev_file_priv *priv = open_dev->dvb->priv;
+	struct dvb_file_open *f;
+	const uint8_t *sec;
+	unsigned len, i;
+	int pmt_pid = 0;
+
+	if (open_dev->dev->dvb_type != DVB_DEVICE_DEMUX)
+		return -EINVAL;
+
+	/* Use a filter of its own, as the Kernel would reset the current one */
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		return -ENOMEM;
+	f->open_dev = *open_dev;
+	dvb_file_reset_filter(priv, f);
+	f->type = FILE_FILTER_SECTION;
+	f->pid = 0;
+	f->mask[0] = 0xff;
+	f->flags = DMX_CHECK_CRC;
+
+	/* Assumes one section contains the whole PAT, like dvb_get_pmt_pid() */
+	if (!dvb_file_next_section(priv, f, &sec, &len)) {
+		for (i = 8; i + 4 + 4 <= len; i += 4) {
+			if (((sec[i] << 8) | sec[i + 1]) == sid) {
+				pmt_pid = ((sec[i + 2] & 0x1f) << 8) | sec[i + 3];
+				break;
+			}
+		}
+	}
+	free(f);
+
+	return pmt_pid;
+}
+
+static struct dvb_v5_descriptors *dvb_file_scan(struct dvb_open_descriptor *open_dev,
+						struct dvb_entry *entry,
+						check_frontend_t *check_frontend,
+						void *args,
+						unsigned other_nit,
+						unsigned timeout_multiply)
+{
+	struct dvb_device_priv *dvb = open_dev->dvb;
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+
+	if (open_dev->dev->dvb_type != DVB_DEVICE_DEMUX) {
+		dvb_logerr(_("dvb_dev_scan: expecting a demux descriptor"));
+		return NULL;
+	}
+
+	return dvb_scan_transponder(dvb->d.fe_parms, entry, open_dev->fd,
+				    check_frontend, args, other_nit,
+				    timeout_multiply);
+}
+
+static int dvb_file_fe_set_sys(struct dvb_v5_fe_parms *p,
+			       fe_delivery_system_t sys)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	int rc;
+
+	rc = dvb_add_parms_for_sys(&parms->p, sys);
+	if (rc < 0)
+		return -EINVAL;
+
+	parms->p.current_sys = sys;
+	parms->n_props = rc;
+
+	return 0;
+}
+
+static int dvb_file_fe_get_parms(struct dvb_v5_fe_parms *p)
+{
+	/* The parameters are the ones set by the application */
+	return 0;
+}
+
+static int dvb_file_fe_set_parms(struct dvb_v5_fe_parms *p)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_device_priv *dvb = parms->dvb;
+	struct dvb_dev_file_priv *priv = dvb->priv;
+	uint32_t freq = 0;
+	char *fname;
+	int ret;
+
+	if (!priv->is_dir)
+		return priv->data ? 0 : dvb_file_map(dvb, priv->path);
+
+	dvb_fe_retrieve_parm(p, DTV_FREQUENCY, &freq);
+	if (asprintf(&fname, "%s/%u.ts", priv->path, freq) < 0)
+		return -ENOMEM;
+
+	/* Like a frequency without signal: the frontend won't lock */
+	if (access(fname, F_OK) < 0 && errno == ENOENT) {
+		if (parms->p.verbose)
+			dvb_log(_("No recorded transponder at %s"), fname);
+		dvb_file_unmap(priv);
+		free(fname);
+		return 0;
+	}
+
+	ret = dvb_file_map(dvb, fname);
+	free(fname);
+
+	return ret;
+}
+
+static int dvb_file_fe_get_stats(struct dvb_v5_fe_parms *p)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_dev_file_priv *priv = parms->dvb->priv;
+	fe_status_t status = 0;
+
+	if (priv->locked)
+		status = FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI |
+			 FE_HAS_SYNC | FE_HAS_LOCK;
+
+	dvb_fe_store_stats(parms, DTV_STATUS, FE_SCALE_RELATIVE, 0, status);
+
+	return 0;
+}
+
+static int dvb_file_find(struct dvb_device_priv *dvb,
+			 dvb_dev_change_t handler)
+{
+	/* The devices are there since dvb_dev_file_init(), and never change */
+	return 0;
+}
+
+static void dvb_dev_file_free(struct dvb_device_priv *dvb)
+{
+	struct dvb_dev_file_priv *priv = dvb->priv;
+
+	dvb_file_unmap(priv);
+	free(priv->path);
+	free(priv);
+	dvb->priv = NULL;
+}
+
+int dvb_dev_file_init(struct dvb_device *d, const char *path)
+{
+	struct dvb_device_priv *dvb = (void *)d;
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct dvb_dev_file_priv *priv;
+	struct dvb_dev_ops *ops = &dvb->ops;
+	static const enum dvb_dev_type types[] = {
+		DVB_DEVICE_FRONTEND, DVB_DEVICE_DEMUX, DVB_DEVICE_DVR,
+	};
+	struct dvb_dev_list *dev;
+	struct stat st;
+	unsigned i;
+
+	if (stat(path, &st) < 0) {
+		dvb_logerr(_("Can't access %s: %m"), path);
+		return -errno;
+	}
+
+	/* Call an implementation-specific free method, if defined */
+	if (ops->free)
+		ops->free(dvb);
+	dvb_dev_free_devices(dvb);
+	memset(ops, 0, sizeof(*ops));
+
+	dvb->priv = priv = calloc(1, sizeof(*priv));
+	if (!priv)
+		return -ENOMEM;
+	priv->path = strdup(path);
+	priv->is_dir = S_ISDIR(st.st_mode);
+	priv->next_uid = 1;
+
+	dvb->d.devices = calloc(ARRAY_SIZE(types), sizeof(*dvb->d.devices));
+	if (!priv->path || !dvb->d.devices) {
+		free(priv->path);
+		free(priv);
+		dvb->priv = NULL;
+		return -ENOMEM;
+	}
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		dev = &dvb->d.devices[i];
+		dev->dvb_type = types[i];
+		dev->path = strdup(path);
+		if (asprintf(&dev->sysname, "dvb0.%s0",
+			     dev_type_names[types[i]]) < 0)
+			dev->sysname = NULL;
+		dev->product = strdup("MPEG-TS file");
+		dvb->d.num_devices++;
+		dvb_dev_dump_device(_("Emulated dvb %s device: %s"), parms, dev);
+	}
+
+	ops->find = dvb_file_find;
+	ops->seek_by_sysname = dvb_local_seek_by_sysname;
+	ops->open = dvb_file_open;
+	ops->close = dvb_file_close;
+
+	ops->dmx_stop = dvb_file_dmx_stop;
+	ops->set_bufsize = dvb_file_set_bufsize;
+	ops->read = dvb_file_read;
+	ops->dmx_set_pesfilter = dvb_file_dmx_set_pesfilter;
+	ops->dmx_set_section_filter = dvb_file_dmx_set_section_filter;
+	ops->dmx_get_pmt_pid = dvb_file_dmx_get_pmt_pid;
+	ops->dmx_poll = dvb_file_dmx_poll;
+
+	ops->scan = dvb_file_scan;
+
+	ops->fe_set_sys = dvb_file_fe_set_sys;
+	ops->fe_get_parms = dvb_file_fe_get_parms;
+	ops->fe_set_parms = dvb_file_fe_set_parms;
+	ops->fe_get_stats = dvb_file_fe_get_stats;
+
+	ops->free = dvb_dev_file_free;
+
+	return 0;
+}
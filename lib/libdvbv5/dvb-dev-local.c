@@ -568,6 +568,11 @@ static ssize_t dvb_local_read(struct dvb_open_descriptor *open_dev,
 	return ret;
 }
 
+static int dvb_local_get_fd(struct dvb_open_descriptor *open_dev)
+{
+	return open_dev->fd;
+}
+
 static int dvb_local_dmx_set_pesfilter(struct dvb_open_descriptor *open_dev,
 			      int pid, dmx_pes_type_t type,
 			      dmx_output_t output, int bufsize)
@@ -774,6 +779,7 @@ void dvb_dev_local_init(struct dvb_device_priv *dvb)
 	ops->dmx_stop = dvb_local_dmx_stop;
 	ops->set_bufsize = dvb_local_set_bufsize;
 	ops->read = dvb_local_read;
+	ops->get_fd = dvb_local_get_fd;
 	ops->dmx_set_pesfilter = dvb_local_dmx_set_pesfilter;
 	ops->dmx_set_section_filter = dvb_local_dmx_set_section_filter;
 	ops->dmx_get_pmt_pid = dvb_local_dmx_get_pmt_pid;
@@ -46,6 +46,7 @@ struct dvb_dev_ops {
 			   int buffersize);
 	ssize_t (*read)(struct dvb_open_descriptor *open_dev,
 			void *buf, size_t count);
+	int (*get_fd)(struct dvb_open_descriptor *open_dev);
 	int (*dmx_set_pesfilter)(struct dvb_open_descriptor *open_dev,
 				 int pid, dmx_pes_type_t type,
 				 dmx_output_t output, int bufsize);
@@ -56,6 +57,14 @@ struct dvb_dev_ops {
 				     unsigned char *mode,
 				     unsigned int flags);
 	int (*dmx_get_pmt_pid)(struct dvb_open_descriptor *open_dev, int sid);
+
+	/*
+	 * Only for backends that emulate the demux, without kernel file
+	 * descriptors. If set, the scan functions use the dvb_dev_*
+	 * functions with the demux, instead of ioctls on its fd.
+	 */
+	int (*dmx_poll)(struct dvb_open_descriptor *open_dev,
+			unsigned timeout_ms);
 	struct dvb_v5_descriptors *(*scan)(struct dvb_open_descriptor *open_dev,
 					   struct dvb_entry *entry,
 					   check_frontend_t *check_frontend,
@@ -93,5 +102,23 @@ void dvb_dev_free_devices(struct dvb_device_priv *dvb);
 
 /* From dvb-dev-local.c */
 void dvb_dev_local_init(struct dvb_device_priv *dvb);
+struct dvb_dev_list *dvb_local_seek_by_sysname(struct dvb_device_priv *dvb,
+					       unsigned int adapter,
+					       unsigned int num,
+					       enum dvb_dev_type type);
+
+/* From dvb-dev-remote.c */
+
+/*
+ * The TS data of the open demux/dvr devices can be sent by the dvbv5-daemon
+ * on a second connection, the data channel, instead of as "data_read"
+ * messages on the command connection. Every chunk of data there is
+ * preceded by this header, with both fields in big endian. A negative len
+ * is an error returned by the read on the server.
+ */
+struct dvb_remote_data_hdr {
+	int32_t uid;
+	int32_t len;
+};
 
 #endif
@@ -37,7 +37,12 @@
 #include <unistd.h>
 #include <resolv.h>
 #include <string.h>
+#include <fcntl.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
 
 #include "dvb-fe-priv.h"
 #include "dvb-dev-priv.h"
@@ -67,15 +72,41 @@ const char *daemon_version = "dvbv5-daemon version " V4L_UTILS_VERSION;
 
 #define RINGBUF_SIZE (REMOTE_BUF_SIZE * 32)
 
+/*
+ * Single producer, single consumer ring buffer: receive_data() is the only
+ * writer and dvb_remote_read() the only reader. The write position is only
+ * changed by the writer and the read position only by the reader, so no
+ * lock is needed. One byte is always kept free to tell a full ring from an
+ * empty one.
+ *
+ * The reader sleeps on the write position with a futex when the ring is
+ * empty, and the writer only issues a wake up if the reader said it is
+ * waiting.
+ */
 struct ringbuffer {
 	/* Should be the first member of struct */
 	struct dvb_open_descriptor open_dev;
 
-	/* ringbuffer handling */
+	int flags;
+
+	/* Error reported by the server, returned by the next read */
 	int rc;
-	ssize_t read, write;
+
+	/* ringbuffer handling */
+	unsigned read, write;
+	unsigned waiting;
+
+	/* Data dropped because the reader didn't keep up */
+	int overflow;
+	size_t lost;
+
+	/*
+	 * Demux/dvr fd passed by a server on the same machine. If valid,
+	 * the data is read directly from it, and the ring is not used.
+	 */
+	int local_fd;
+
 	char buf[RINGBUF_SIZE];
-	pthread_mutex_t lock;
 };
 
 struct queued_msg {
@@ -89,12 +120,17 @@ struct queued_msg {
 	char args[REMOTE_BUF_SIZE];
 	ssize_t args_size;
 
+	/* File descriptor received with the response, if any */
+	int passed_fd;
+
 	struct queued_msg *next;
 };
 
 struct dvb_dev_remote_priv {
 	int fd;
-	struct sockaddr_in addr;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int is_unix;
 
 	int seq, disconnected;
 
@@ -103,6 +139,11 @@ struct dvb_dev_remote_priv {
 	pthread_t recv_id;
 	pthread_mutex_t lock_io;
 
+	/* Data channel, if the server supports and accepted it */
+	int has_data_channel;
+	int data_fd;
+	pthread_t data_id;
+
 	char output_charset[256];
 	char default_charset[256];
 
@@ -237,6 +278,7 @@ static struct queued_msg *send_fmt(struct dvb_device_priv *dvb, int fd,
 	pthread_mutex_init(&msg->lock, NULL);
 	pthread_cond_init(&msg->cond, NULL);
 	strcpy(msg->cmd, cmd);
+	msg->passed_fd = -1;
 
 	pthread_mutex_lock(&priv->lock_io);
 	msg->seq = ++priv->seq;
@@ -330,6 +372,7 @@ static struct queued_msg *send_buf(struct dvb_device_priv *dvb, int fd,
 	pthread_mutex_init(&msg->lock, NULL);
 	pthread_cond_init(&msg->cond, NULL);
 	strcpy(msg->cmd, cmd);
+	msg->passed_fd = -1;
 
 	pthread_mutex_lock(&priv->lock_io);
 	msg->seq = ++priv->seq;
@@ -411,6 +454,8 @@ static void free_msg(struct dvb_device_priv *dvb, struct queued_msg *msg)
 			msgs->next = msg->next;
 			pthread_mutex_unlock(&priv->lock_io);
 
+			if (msg->passed_fd >= 0)
+				close(msg->passed_fd);
 			pthread_cond_destroy(&msg->cond);
 			pthread_mutex_destroy(&msg->lock);
 			free(msg);
@@ -516,70 +561,107 @@ static void dvb_dev_remote_disconnect(struct dvb_dev_remote_priv *priv)
 	}
 }
 
+static long futex(unsigned *uaddr, int op, unsigned val,
+		  const struct timespec *timeout)
+{
+	return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+static void wake_ringbuffer(struct ringbuffer *ringbuf)
+{
+	if (__atomic_load_n(&ringbuf->waiting, __ATOMIC_SEQ_CST))
+		futex(&ringbuf->write, FUTEX_WAKE_PRIVATE, 1, NULL);
+}
+
 static void write_ringbuffer(struct dvb_open_descriptor *open_dev,
 			    ssize_t size, char *buf)
 {
 	struct ringbuffer *ringbuf = (struct ringbuffer *)open_dev;
-	ssize_t len = size, split;
+	unsigned read = __atomic_load_n(&ringbuf->read, __ATOMIC_ACQUIRE);
+	unsigned write = ringbuf->write;
+	unsigned avail = (read + RINGBUF_SIZE - write - 1) % RINGBUF_SIZE;
+	ssize_t split;
 
-	pthread_mutex_lock(&ringbuf->lock);
-
-	split = (ringbuf->write + size > RINGBUF_SIZE) ?
-		 RINGBUF_SIZE - ringbuf->write : 0;
+	/*
+	 * The writer can't block, as it also handles the command responses.
+	 * So, drop the whole chunk, keeping the TS packets aligned, and let
+	 * the reader know.
+	 */
+	if ((size_t)size > avail) {
+		__atomic_add_fetch(&ringbuf->lost, size, __ATOMIC_RELAXED);
+		__atomic_store_n(&ringbuf->overflow, 1, __ATOMIC_RELEASE);
+		wake_ringbuffer(ringbuf);
+		return;
+	}
 
+	split = (write + size > RINGBUF_SIZE) ? RINGBUF_SIZE - write : 0;
 	if (split > 0) {
-		memcpy(&ringbuf->buf[ringbuf->write], buf, split);
+		memcpy(&ringbuf->buf[write], buf, split);
 		buf += split;
-		len -= split;
-		ringbuf->write = 0;
+		size -= split;
+		write = 0;
 	}
+	memcpy(&ringbuf->buf[write], buf, size);
+	write = (write + size) % RINGBUF_SIZE;
 
-	memcpy(&ringbuf->buf[ringbuf->write], buf, len);
-	ringbuf->write = (ringbuf->write + len) % RINGBUF_SIZE;
-
-	/* Detect buffer overflows */
-	if ((unsigned)((ringbuf->write - ringbuf->read) % RINGBUF_SIZE) < size)
-		ringbuf->rc = -EOVERFLOW;
+	__atomic_store_n(&ringbuf->write, write, __ATOMIC_SEQ_CST);
+	wake_ringbuffer(ringbuf);
+}
 
-	pthread_mutex_unlock(&ringbuf->lock);
+static void set_ringbuffer_error(struct ringbuffer *ringbuf, int rc)
+{
+	__atomic_store_n(&ringbuf->rc, rc, __ATOMIC_RELEASE);
+	wake_ringbuffer(ringbuf);
 }
 
-static void read_ringbuffer(struct dvb_open_descriptor *open_dev,
-			    size_t *len, char *buf)
+/*
+ * Returns up to *len bytes, waiting only if the ring is empty. The wait
+ * times out every second, so the caller can check for disconnects and
+ * errors.
+ */
+static int read_ringbuffer(struct dvb_open_descriptor *open_dev,
+			   size_t *len, char *buf)
 {
 	struct ringbuffer *ringbuf = (struct ringbuffer *)open_dev;
-	ssize_t size, split;
-
-	/* Sets the read size */
-	if (*len > REMOTE_BUF_SIZE)
-		*len = REMOTE_BUF_SIZE;
-
-	/* Wait for data to arrive */
-	pthread_mutex_lock(&ringbuf->lock);
-	while ((unsigned)((ringbuf->write - ringbuf->read) % RINGBUF_SIZE) < *len) {
-		pthread_mutex_unlock(&ringbuf->lock);
-		usleep(1);
-		pthread_mutex_lock(&ringbuf->lock);
+	struct timespec timeout = { 1, 0 };
+	unsigned read = ringbuf->read;
+	unsigned write = __atomic_load_n(&ringbuf->write, __ATOMIC_ACQUIRE);
+	size_t size, split;
+
+	if (write == read) {
+		if (ringbuf->flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		__atomic_store_n(&ringbuf->waiting, 1, __ATOMIC_SEQ_CST);
+		write = __atomic_load_n(&ringbuf->write, __ATOMIC_SEQ_CST);
+		if (write == read)
+			futex(&ringbuf->write, FUTEX_WAIT_PRIVATE, write, &timeout);
+		__atomic_store_n(&ringbuf->waiting, 0, __ATOMIC_RELAXED);
+
+		write = __atomic_load_n(&ringbuf->write, __ATOMIC_ACQUIRE);
+		if (write == read)
+			return -EAGAIN;
 	}
 
-	size = *len;
+	size = (write + RINGBUF_SIZE - read) % RINGBUF_SIZE;
+	if (size > *len)
+		size = *len;
 
 	*len = 0;
-	split = (ringbuf->read + size > RINGBUF_SIZE) ? RINGBUF_SIZE - ringbuf->read : 0;
+	split = (read + size > RINGBUF_SIZE) ? RINGBUF_SIZE - read : 0;
 	if (split > 0) {
-
-		memcpy(buf, &ringbuf->buf[ringbuf->read], split);
+		memcpy(buf, &ringbuf->buf[read], split);
 		buf += split;
 		size -= split;
 		*len += split;
-		ringbuf->read = 0;
+		read = 0;
 	}
-	memcpy(buf, &ringbuf->buf[ringbuf->read], size);
+	memcpy(buf, &ringbuf->buf[read], size);
 	*len += size;
 
-	ringbuf->read = (ringbuf->read + size) % RINGBUF_SIZE;
-
-	pthread_mutex_unlock(&ringbuf->lock);
+	__atomic_store_n(&ringbuf->read, (read + size) % RINGBUF_SIZE,
+			 __ATOMIC_RELEASE);
+	return 0;
 }
 
 static void log_hexdump(struct dvb_v5_fe_parms_priv *parms, int len,
@@ -610,19 +692,88 @@ static void log_hexdump(struct dvb_v5_fe_parms_priv *parms, int len,
 	}
 }
 
+static void write_data(struct dvb_device_priv *dvb, int uid, int retval,
+		       char *buf, ssize_t size)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct dvb_open_descriptor *cur;
+	int found = 0;
+
+	for (cur = dvb->open_list.next; cur; cur = cur->next) {
+		if (cur->fd == uid) {
+			struct ringbuffer *ringbuf = (struct ringbuffer *)cur;
+
+			found = 1;
+			if (retval < 0) {
+				set_ringbuffer_error(ringbuf, retval);
+				continue;
+			}
+			write_ringbuffer(cur, size, buf);
+		}
+	}
+	/* FIXME: should we abort here? */
+	if (!found)
+		dvb_logerr("received data for unknown ID %d", uid);
+}
+
+/*
+ * Like recv() with MSG_WAITALL, but also gets a file descriptor passed
+ * via SCM_RIGHTS, when the server is on the same machine.
+ */
+static ssize_t recv_with_fd(int fd, void *buf, size_t len, int *passed_fd)
+{
+	union {
+		struct cmsghdr cmsg;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t ret;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &control;
+	msg.msg_controllen = sizeof(control);
+
+	ret = recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+	if (ret <= 0)
+		return ret;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS ||
+		    cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+			continue;
+		if (*passed_fd >= 0)
+			close(*passed_fd);
+		memcpy(passed_fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+
+	return ret;
+}
+
 static void *receive_data(void *privdata)
 {
 	struct dvb_device_priv *dvb = privdata;
 	struct dvb_dev_remote_priv *priv = dvb->priv;
 	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
 	struct queued_msg *msg;
-	struct dvb_open_descriptor *cur;
-	char buf[REMOTE_BUF_SIZE + 8], cmd[REMOTE_BUF_SIZE], *args;
+	char buf[REMOTE_BUF_SIZE + 32], cmd[REMOTE_BUF_SIZE], *args;
 	ssize_t size, args_size;
-	int ret, retval, seq, handled, uid, found;
+	int ret, retval, seq, handled, uid, passed_fd = -1;
 
 	do {
-		size = recv(priv->fd, buf, 4, MSG_WAITALL);
+		if (passed_fd >= 0) {
+			dvb_logerr("discarding unexpected file descriptor");
+			close(passed_fd);
+			passed_fd = -1;
+		}
+
+		size = recv_with_fd(priv->fd, buf, 4, &passed_fd);
 		if (size < 4) {
 			if (size < 0)
 				dvb_perror("recv");
@@ -632,7 +783,12 @@ static void *receive_data(void *privdata)
 			return NULL;
 		}
 		size = be32toh(*(int32_t *)buf);
-		ret = recv(priv->fd, buf, size, MSG_WAITALL);
+		if (size < 0 || size > sizeof(buf)) {
+			dvb_logerr("invalid message size %zd", size);
+			dvb_dev_remote_disconnect(priv);
+			return NULL;
+		}
+		ret = recv_with_fd(priv->fd, buf, size, &passed_fd);
 		if (ret != size) {
 			if (size < 0)
 				dvb_perror("recv");
@@ -692,22 +848,7 @@ static void *receive_data(void *privdata)
 				args += ret;
 				args_size -= ret;
 
-				found = 0;
-				for (cur = dvb->open_list.next; cur; cur = cur->next) {
-					if (cur->fd == uid) {
-						struct ringbuffer *ringbuf = (struct ringbuffer *)cur;
-
-						found = 1;
-						if (retval < 0) {
-							ringbuf->rc = retval;
-							continue;
-						}
-						write_ringbuffer(cur, args_size, args);
-					}
-				}
-				/* FIXME: should we abort here? */
-				if (!found)
-					dvb_logerr("received data for unknown ID %d", uid);
+				write_data(dvb, uid, retval, args, args_size);
 				args += args_size;
 				args_size = 0;
 			} else {
@@ -738,6 +879,8 @@ static void *receive_data(void *privdata)
 			memcpy(msg->args, args, args_size);
 			msg->args_size = args_size;
 			msg->retval = retval;
+			msg->passed_fd = passed_fd;
+			passed_fd = -1;
 			pthread_mutex_unlock(&priv->lock_io);
 			pthread_mutex_lock(&msg->lock);
 			ret = pthread_cond_signal(&msg->cond);
@@ -755,6 +898,45 @@ static void *receive_data(void *privdata)
 	} while (1);
 }
 
+/*
+ * Receives the TS data sent on the data channel. It bypasses the message
+ * parser used for the command connection.
+ */
+static void *receive_ts(void *privdata)
+{
+	struct dvb_device_priv *dvb = privdata;
+	struct dvb_dev_remote_priv *priv = dvb->priv;
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct dvb_remote_data_hdr hdr;
+	char buf[REMOTE_BUF_SIZE];
+	ssize_t ret;
+	int uid, len;
+
+	do {
+		ret = recv(priv->data_fd, &hdr, sizeof(hdr), MSG_WAITALL);
+		if (ret != sizeof(hdr))
+			break;
+		uid = be32toh(hdr.uid);
+		len = be32toh(hdr.len);
+		if (len > (int)sizeof(buf)) {
+			dvb_logerr("invalid data channel frame size %d", len);
+			break;
+		}
+		if (len > 0) {
+			ret = recv(priv->data_fd, buf, len, MSG_WAITALL);
+			if (ret != len)
+				break;
+		}
+		write_data(dvb, uid, len, buf, len);
+	} while (1);
+
+	if (ret < 0)
+		dvb_perror("recv");
+	else if (!priv->disconnected)
+		dvb_logerr("data channel disconnected");
+	return NULL;
+}
+
 /*
  * Function handlers
  */
@@ -763,7 +945,7 @@ static int dvb_remote_get_version(struct dvb_device_priv *dvb)
 	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
 	struct dvb_dev_remote_priv *priv = dvb->priv;
 	struct queued_msg *msg;
-	char version[REMOTE_BUF_SIZE];
+	char version[REMOTE_BUF_SIZE], features[REMOTE_BUF_SIZE] = "";
 	int ret;
 
 	if (priv->disconnected)
@@ -788,6 +970,12 @@ static int dvb_remote_get_version(struct dvb_device_priv *dvb)
 		goto error;
 	}
 
+	/* Newer servers also send the optional features they support */
+	if (ret < msg->args_size &&
+	    scan_data(parms, msg->args + ret, msg->args_size - ret, "%s",
+		      features) > 0)
+		priv->has_data_channel = strstr(features, "data_channel") != NULL;
+
 	if (strcmp(version, daemon_version)) {
 		dvb_logerr("Wrong version. Expecting '%s', received '%s'",
 			daemon_version, version);
@@ -806,6 +994,92 @@ error:
 	return ret;
 }
 
+/*
+ * Asks the server to send the TS data through a separate connection, so
+ * that it doesn't compete with the RPC replies. Must be called before
+ * opening any device, as the data thread is the only ring buffer producer.
+ */
+static int dvb_remote_data_channel(struct dvb_device_priv *dvb)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct dvb_dev_remote_priv *priv = dvb->priv;
+	struct dvb_remote_data_hdr ack;
+	struct queued_msg *msg;
+	char buf[REMOTE_BUF_SIZE];
+	int ret, fd, token, bufsize;
+	int32_t i32;
+
+	if (priv->disconnected)
+		return -ENODEV;
+
+	msg = send_fmt(dvb, priv->fd, "data_channel", "-");
+	if (!msg)
+		return -1;
+
+	ret = pthread_cond_wait(&msg->cond, &msg->lock);
+	if (ret < 0) {
+		dvb_logerr("error waiting for %s response", msg->cmd);
+		goto error;
+	}
+
+	ret = msg->retval;
+	if (ret < 0)
+		goto error;
+
+	ret = scan_data(parms, msg->args, msg->args_size, "%i", &token);
+	if (ret < 0)
+		goto error;
+
+error:
+	msg->seq = 0; /* Avoids any risk of a recursive call */
+	pthread_mutex_unlock(&msg->lock);
+
+	free_msg(dvb, msg);
+	if (ret < 0)
+		return ret;
+
+	/* Open the data connection and bind it to this session */
+	fd = socket(priv->addr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (connect(fd, (struct sockaddr *)&priv->addr, priv->addrlen))
+		goto err_close;
+
+	ret = prepare_data(parms, buf + 4, sizeof(buf) - 4, "%i%s%i",
+			   0, "data_attach", token);
+	if (ret < 0)
+		goto err_close;
+	i32 = htobe32(ret);
+	memcpy(buf, &i32, 4);
+	if (send(fd, buf, ret + 4, MSG_NOSIGNAL) != ret + 4)
+		goto err_close;
+
+	/* The server acks with an empty header */
+	if (recv(fd, &ack, sizeof(ack), MSG_WAITALL) != sizeof(ack) ||
+	    ack.uid || ack.len)
+		goto err_close;
+
+	bufsize = REMOTE_BUF_SIZE * 32;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+		   (void *)&bufsize, (int)sizeof(bufsize));
+
+	priv->data_fd = fd;
+	ret = pthread_create(&priv->data_id, NULL, receive_ts, dvb);
+	if (ret) {
+		priv->data_fd = -1;
+		errno = ret;
+		goto err_close;
+	}
+
+	return 0;
+
+err_close:
+	ret = -errno;
+	close(fd);
+	return ret ? ret : -EIO;
+}
+
 static int dvb_remote_find(struct dvb_device_priv *dvb,
 			   dvb_dev_change_t handler)
 {
@@ -947,6 +1221,84 @@ error:
 
 int dvb_remote_fe_get_parms(struct dvb_v5_fe_parms *par);
 
+/*
+ * When the server is on the same machine, it can pass the demux/dvr file
+ * descriptor, avoiding to copy all the data through the socket. The
+ * control calls still go through the server.
+ */
+static int dvb_remote_get_fd_from_server(struct dvb_device_priv *dvb,
+					 struct ringbuffer *ringbuf)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct dvb_dev_remote_priv *priv = dvb->priv;
+	struct queued_msg *msg;
+	int ret, fd = -1;
+
+	msg = send_fmt(dvb, priv->fd, "dev_get_fd", "%i", ringbuf->open_dev.fd);
+	if (!msg)
+		return -1;
+
+	ret = pthread_cond_wait(&msg->cond, &msg->lock);
+	if (ret < 0) {
+		dvb_logerr("error waiting for %s response", msg->cmd);
+		goto error;
+	}
+
+	if (msg->retval < 0 || msg->passed_fd < 0) {
+		dvb_logdbg("server didn't pass the fd for ID %d (error %d)",
+			   ringbuf->open_dev.fd, msg->retval);
+		goto error;
+	}
+
+	fd = msg->passed_fd;
+	msg->passed_fd = -1;
+
+	if (ringbuf->flags & O_NONBLOCK)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	else
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+error:
+	msg->seq = 0; /* Avoids any risk of a recursive call */
+	pthread_mutex_unlock(&msg->lock);
+
+	free_msg(dvb, msg);
+	return fd;
+}
+
+/*
+ * When the client can't use the passed fd, the server reads the
+ * demux/dvr on its behalf and forwards the data, as it does for TCP
+ * clients.
+ */
+static int dvb_remote_forward(struct dvb_device_priv *dvb,
+			      struct ringbuffer *ringbuf)
+{
+	struct dvb_dev_remote_priv *priv = dvb->priv;
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	struct queued_msg *msg;
+	int ret;
+
+	msg = send_fmt(dvb, priv->fd, "dev_forward", "%i", ringbuf->open_dev.fd);
+	if (!msg)
+		return -1;
+
+	ret = pthread_cond_wait(&msg->cond, &msg->lock);
+	if (ret < 0) {
+		dvb_logerr("error waiting for %s response", msg->cmd);
+		goto error;
+	}
+
+	ret = msg->retval;
+
+error:
+	msg->seq = 0; /* Avoids any risk of a recursive call */
+	pthread_mutex_unlock(&msg->lock);
+
+	free_msg(dvb, msg);
+	return ret;
+}
+
 static struct dvb_open_descriptor *dvb_remote_open(struct dvb_device_priv *dvb,
 						   const char *sysname,
 						   int flags)
@@ -956,7 +1308,7 @@ static struct dvb_open_descriptor *dvb_remote_open(struct dvb_device_priv *dvb,
 	struct dvb_open_descriptor *open_dev, *cur;
 	struct ringbuffer *ringbuf;
 	struct queued_msg *msg;
-	int ret;
+	int ret, type;
 
 	if (priv->disconnected)
 		return NULL;
@@ -981,13 +1333,36 @@ static struct dvb_open_descriptor *dvb_remote_open(struct dvb_device_priv *dvb,
 	if (msg->retval < 0)
 		goto error;
 
+	ret = scan_data(parms, msg->args, msg->args_size, "%i", &type);
+	if (ret < 0) {
+		dvb_logerr("Can't get the device type");
+		goto error;
+	}
+
 	/* Add the fd to the open descriptor's list */
 	open_dev->fd = msg->retval;
 	open_dev->dev = NULL;
 	open_dev->dvb = dvb;
 
+	msg->seq = 0; /* Avoids any risk of a recursive call */
+	pthread_mutex_unlock(&msg->lock);
+	free_msg(dvb, msg);
+
 	/* Initialize ringbuffer data*/
-	pthread_mutex_init(&ringbuf->lock, NULL);
+	ringbuf->flags = flags;
+	ringbuf->local_fd = -1;
+	if (priv->is_unix &&
+	    (type == DVB_DEVICE_DEMUX || type == DVB_DEVICE_DVR)) {
+		ringbuf->local_fd = dvb_remote_get_fd_from_server(dvb, ringbuf);
+
+		/* Without the fd, the server should forward the data */
+		if (ringbuf->local_fd < 0) {
+			ret = dvb_remote_forward(dvb, ringbuf);
+			if (ret < 0)
+				dvb_logerr("server can't forward data for ID %d (error %d)",
+					   open_dev->fd, ret);
+		}
+	}
 
 	cur = &dvb->open_list;
 	while (cur->next)
@@ -995,7 +1370,7 @@ static struct dvb_open_descriptor *dvb_remote_open(struct dvb_device_priv *dvb,
 	cur->next = open_dev;
 
 	/* Retrieve frontend initial parameters */
-	if (strstr(sysname, "frontend"))
+	if (type == DVB_DEVICE_FRONTEND)
 		dvb_remote_fe_get_parms(dvb->d.fe_parms);
 
 	return open_dev;
@@ -1043,7 +1418,8 @@ error:
 	for (cur = &dvb->open_list; cur->next; cur = cur->next) {
 		if (cur->next == open_dev) {
 			cur->next = open_dev->next;
-			pthread_mutex_destroy(&ringbuffer->lock);
+			if (ringbuffer->local_fd >= 0)
+				close(ringbuffer->local_fd);
 			free(ringbuffer);
 			goto ret;
 		}
@@ -1131,22 +1507,56 @@ static ssize_t dvb_remote_read(struct dvb_open_descriptor *open_dev,
 	struct ringbuffer *ringbuf = (struct ringbuffer *)open_dev;
 	struct dvb_device_priv *dvb = open_dev->dvb;
 	struct dvb_dev_remote_priv *priv = dvb->priv;
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+	size_t lost;
+	ssize_t rd;
 	int ret;
 
-	if (priv->disconnected)
-		return -ENODEV;
-
-	if (ringbuf->rc) {
-		ret = ringbuf->rc;
-		ringbuf->rc = 0;
-		return ret;
+	if (ringbuf->local_fd >= 0) {
+		rd = read(ringbuf->local_fd, buf, count);
+		if (rd == -1) {
+			if (errno != EOVERFLOW && errno != EAGAIN)
+				dvb_perror("read()");
+			return -errno;
+		}
+		return rd;
 	}
 
-	read_ringbuffer(open_dev, &count, buf);
+	do {
+		if (priv->disconnected)
+			return -ENODEV;
+
+		ret = __atomic_exchange_n(&ringbuf->rc, 0, __ATOMIC_ACQUIRE);
+		if (ret)
+			return ret;
+
+		/*
+		 * Like the demux driver, report an overflow once, then go on
+		 * with the data that was kept.
+		 */
+		if (__atomic_exchange_n(&ringbuf->overflow, 0, __ATOMIC_ACQUIRE)) {
+			lost = __atomic_exchange_n(&ringbuf->lost, 0,
+						   __ATOMIC_RELAXED);
+			dvb_logdbg("remote ID %d: dropped %zu bytes", open_dev->fd,
+				   lost);
+			return -EOVERFLOW;
+		}
+
+		ret = read_ringbuffer(open_dev, &count, buf);
+	} while (ret == -EAGAIN && !(ringbuf->flags & O_NONBLOCK));
 
+	if (ret < 0)
+		return ret;
 	return count;
 }
 
+static int dvb_remote_get_fd(struct dvb_open_descriptor *open_dev)
+{
+	struct ringbuffer *ringbuf = (struct ringbuffer *)open_dev;
+
+	return ringbuf->local_fd;
+}
+
 static int dvb_remote_dmx_set_pesfilter(struct dvb_open_descriptor *open_dev,
 			      int pid, dmx_pes_type_t type,
 			      dmx_output_t output, int bufsize)
@@ -1586,6 +1996,12 @@ static void dvb_dev_remote_free(struct dvb_device_priv *dvb)
 	 */
 
 	pthread_cancel(priv->recv_id);
+	if (priv->data_fd >= 0) {
+		pthread_cancel(priv->data_id);
+		pthread_join(priv->data_id, NULL);
+		close(priv->data_fd);
+		priv->data_fd = -1;
+	}
 
 	/* Cancel any pending messages */
 	dvb_dev_remote_disconnect(priv);
@@ -1633,10 +2049,37 @@ int dvb_dev_remote_init(struct dvb_device *d, char *server, int port)
 
 	strcpy(priv->output_charset, "utf-8");
 	strcpy(priv->default_charset, "iso-8859-1");
+	priv->data_fd = -1;
+
+	/* A path means a server on this machine, via an UNIX socket */
+
+	if (server[0] == '/') {
+		struct sockaddr_un *addr = (struct sockaddr_un *)&priv->addr;
+
+		if (strlen(server) >= sizeof(addr->sun_path)) {
+			dvb_logerr("socket path too long: %s", server);
+			return -1;
+		}
+		addr->sun_family = AF_UNIX;
+		strcpy(addr->sun_path, server);
+		priv->addrlen = sizeof(*addr);
+		priv->is_unix = 1;
+	} else {
+		struct sockaddr_in *addr = (struct sockaddr_in *)&priv->addr;
+
+		addr->sin_family = AF_INET;
+		addr->sin_port = htons(port);
+		if (!inet_aton(server, &addr->sin_addr))
+		{
+			dvb_perror(server);
+			return -1;
+		}
+		priv->addrlen = sizeof(*addr);
+	}
 
 	/* open socket */
 
-	fd = socket(AF_INET, SOCK_STREAM, 0);
+	fd = socket(priv->addr.ss_family, SOCK_STREAM, 0);
 	if (fd < 0) {
 		dvb_perror("socket");
 		return -1;
@@ -1645,14 +2088,7 @@ int dvb_dev_remote_init(struct dvb_device *d, char *server, int port)
 
 	/* connect socket to the server */
 
-	priv->addr.sin_family = AF_INET;
-	priv->addr.sin_port = htons(port);
-	if (!inet_aton(server, &priv->addr.sin_addr))
-	{
-		dvb_perror(server);
-		return -1;
-	}
-	ret = connect(fd, (struct sockaddr*)&priv->addr, sizeof(priv->addr));
+	ret = connect(fd, (struct sockaddr*)&priv->addr, priv->addrlen);
 
 	if (ret) {
 		dvb_perror("connect");
@@ -1676,8 +2112,20 @@ int dvb_dev_remote_init(struct dvb_device *d, char *server, int port)
 	/* Do protocol handshake */
 	ret = dvb_remote_get_version(dvb);
 	if (ret <= 0) {
-		pthread_mutex_destroy(&priv->lock_io);
 		pthread_cancel(priv->recv_id);
+		pthread_join(priv->recv_id, NULL);
+		pthread_mutex_destroy(&priv->lock_io);
+		close(fd);
+		priv->fd = 0;
+		return -1;
+	}
+
+	/* Older servers only know how to send data with the RPC replies */
+	if (priv->has_data_channel) {
+		ret = dvb_remote_data_channel(dvb);
+		if (ret < 0)
+			dvb_logdbg("no data channel (error %d). Using the RPC connection",
+				   ret);
 	}
 
 	/* Everything is OK, initialize data structs */
@@ -1690,6 +2138,7 @@ int dvb_dev_remote_init(struct dvb_device *d, char *server, int port)
 	ops->dmx_stop = dvb_remote_dmx_stop;
 	ops->set_bufsize = dvb_remote_set_bufsize;
 	ops->read = dvb_remote_read;
+	ops->get_fd = dvb_remote_get_fd;
 	ops->dmx_set_pesfilter = dvb_remote_dmx_set_pesfilter;
 	ops->dmx_set_section_filter = dvb_remote_dmx_set_section_filter;
 	ops->dmx_get_pmt_pid = dvb_remote_dmx_get_pmt_pid;
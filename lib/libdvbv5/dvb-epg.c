@@ -0,0 +1,942 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dvb-fe-priv.h"
+#include <libdvbv5/dvb-epg.h>
+#include <libdvbv5/dvb-demux.h>
+#include <libdvbv5/dvb-log.h>
+#include <libdvbv5/crc32.h>
+#include <libdvbv5/descriptors.h>
+#include <libdvbv5/eit.h>
+#include <libdvbv5/desc_event_short.h>
+#include <libdvbv5/desc_event_extended.h>
+
+#ifdef ENABLE_NLS
+# include "gettext.h"
+# include <libintl.h>
+# define _(string) dgettext(LIBDVBV5_DOMAIN, string)
+#else
+# define _(string) string
+#endif
+
+#define EPG_HASH_SIZE		1024
+#define EPG_SERVICE_HASH_SIZE	64
+
+/*
+ * Each event is indexed twice: by a hash on its IDs, in order to update it
+ * when it is broadcasted again, and by the per-service array, ordered by
+ * start time, used by the queries.
+ *
+ * The same event is usually carried by both the present/following and the
+ * schedule tables. It is only removed when no section lists it anymore.
+ */
+struct epg_event {
+	struct dvb_epg_event ev;
+	struct epg_event *hnext;
+	unsigned refs;
+};
+
+struct epg_service {
+	uint16_t network_id;
+	uint16_t transport_id;
+	uint16_t service_id;
+
+	struct epg_event **events;
+	unsigned num_events, max_events;
+
+	struct epg_service *hnext;
+	struct epg_service *next;
+};
+
+/*
+ * Stores the version of each section already parsed, and the event IDs
+ * it carried, in order to discard the repeated sections and to remove the
+ * events that disappear when a section changes.
+ */
+struct epg_section {
+	uint8_t table_id;
+	uint8_t section_number;
+	uint8_t version;
+	uint16_t network_id;
+	uint16_t transport_id;
+	uint16_t service_id;
+
+	uint16_t *event_ids;
+	unsigned num_event_ids;
+
+	struct epg_section *hnext;
+};
+
+struct epg_service_name {
+	uint16_t service_id;
+	char *name;
+	struct epg_service_name *next;
+};
+
+struct dvb_epg {
+	struct dvb_v5_fe_parms_priv *parms;
+	unsigned tables;
+	int dmx_fd;
+	uint8_t *buf;
+
+	/* The section being parsed, until its events are copied */
+	struct dvb_arena *arena;
+
+	struct epg_section *sections[EPG_HASH_SIZE];
+	struct epg_event *events[EPG_HASH_SIZE];
+	struct epg_service *services[EPG_SERVICE_HASH_SIZE];
+	struct epg_service *service_list, **service_tail;
+	struct epg_service_name *names;
+
+	unsigned num_events;
+};
+
+static unsigned epg_hash(uint16_t network_id, uint16_t transport_id,
+			 uint16_t service_id, uint32_t id)
+{
+	uint32_t h = 2166136261u;
+
+	h = (h ^ network_id) * 16777619u;
+	h = (h ^ transport_id) * 16777619u;
+	h = (h ^ service_id) * 16777619u;
+	h = (h ^ id) * 16777619u;
+
+	return h ^ (h >> 16);
+}
+
+struct dvb_epg *dvb_epg_alloc(struct dvb_v5_fe_parms *p, unsigned tables)
+{
+	struct dvb_epg *epg;
+
+	epg = calloc(1, sizeof(*epg));
+	if (!epg)
+		return NULL;
+
+	epg->buf = malloc(DVB_MAX_PAYLOAD_PACKET_SIZE);
+	epg->arena = dvb_arena_alloc(0);
+	if (!epg->buf || !epg->arena) {
+		dvb_arena_free(epg->arena);
+		free(epg->buf);
+		free(epg);
+		return NULL;
+	}
+	epg->parms = (void *)p;
+	epg->tables = tables ? tables : DVB_EPG_ALL;
+	epg->dmx_fd = -1;
+	epg->service_tail = &epg->service_list;
+
+	return epg;
+}
+
+static void epg_event_free(struct epg_event *event)
+{
+	free(event->ev.title);
+	free(event->ev.description);
+	free(event->ev.extended);
+	free(event);
+}
+
+void dvb_epg_free(struct dvb_epg *epg)
+{
+	struct epg_service *svc, *svc_next;
+	struct epg_service_name *name, *name_next;
+	int i;
+
+	if (!epg)
+		return;
+
+	dvb_epg_stop(epg);
+
+	for (i = 0; i < EPG_HASH_SIZE; i++) {
+		struct epg_section *sect, *sect_next;
+		struct epg_event *event, *event_next;
+
+		for (sect = epg->sections[i]; sect; sect = sect_next) {
+			sect_next = sect->hnext;
+			free(sect->event_ids);
+			free(sect);
+		}
+		for (event = epg->events[i]; event; event = event_next) {
+			event_next = event->hnext;
+			epg_event_free(event);
+		}
+	}
+	for (svc = epg->service_list; svc; svc = svc_next) {
+		svc_next = svc->next;
+		free(svc->events);
+		free(svc);
+	}
+	for (name = epg->names; name; name = name_next) {
+		name_next = name->next;
+		free(name->name);
+		free(name);
+	}
+	dvb_arena_free(epg->arena);
+	free(epg->buf);
+	free(epg);
+}
+
+int dvb_epg_start(struct dvb_epg *epg, int dmx_fd)
+{
+	struct dvb_v5_fe_parms_priv *parms = epg->parms;
+	unsigned char filter[1] = { 0x40 };
+	unsigned char mask[1] = { 0xc0 };
+	int ret;
+
+	if (epg->dmx_fd >= 0)
+		dvb_epg_stop(epg);
+
+	/* Table IDs from 0x40 to 0x7f: the non-EIT ones are dropped later */
+	ret = dvb_set_section_filter(dmx_fd, DVB_TABLE_EIT_PID, 1,
+				     filter, mask, NULL,
+				     DMX_IMMEDIATE_START | DMX_CHECK_CRC);
+	if (ret) {
+		dvb_perror(_("dvb_set_section_filter failed"));
+		return -errno;
+	}
+	epg->dmx_fd = dmx_fd;
+
+	return 0;
+}
+
+void dvb_epg_stop(struct dvb_epg *epg)
+{
+	if (epg->dmx_fd < 0)
+		return;
+
+	dvb_dmx_stop(epg->dmx_fd);
+	epg->dmx_fd = -1;
+}
+
+static int epg_table_wanted(struct dvb_epg *epg, uint8_t table_id)
+{
+	if (table_id == DVB_TABLE_EIT)
+		return epg->tables & DVB_EPG_PF;
+	if (table_id == DVB_TABLE_EIT_OTHER)
+		return epg->tables & DVB_EPG_PF_OTHER;
+	if (table_id >= DVB_TABLE_EIT_SCHEDULE &&
+	    table_id <= DVB_TABLE_EIT_SCHEDULE + 0xf)
+		return epg->tables & DVB_EPG_SCHEDULE;
+	if (table_id >= DVB_TABLE_EIT_SCHEDULE_OTHER &&
+	    table_id <= DVB_TABLE_EIT_SCHEDULE_OTHER + 0xf)
+		return epg->tables & DVB_EPG_SCHEDULE_OTHER;
+	return 0;
+}
+
+static struct epg_service *epg_get_service(struct dvb_epg *epg,
+					   uint16_t network_id,
+					   uint16_t transport_id,
+					   uint16_t service_id, int create)
+{
+	unsigned h = epg_hash(network_id, transport_id, service_id, 0) %
+		     EPG_SERVICE_HASH_SIZE;
+	struct epg_service *svc;
+
+	for (svc = epg->services[h]; svc; svc = svc->hnext) {
+		if (svc->service_id == service_id &&
+		    svc->transport_id == transport_id &&
+		    svc->network_id == network_id)
+			return svc;
+	}
+	if (!create)
+		return NULL;
+
+	svc = calloc(1, sizeof(*svc));
+	if (!svc)
+		return NULL;
+	svc->network_id = network_id;
+	svc->transport_id = transport_id;
+	svc->service_id = service_id;
+
+	svc->hnext = epg->services[h];
+	epg->services[h] = svc;
+	*epg->service_tail = svc;
+	epg->service_tail = &svc->next;
+
+	return svc;
+}
+
+/* Returns the position of the first event that starts at or after start */
+static unsigned epg_service_lookup(struct epg_service *svc, time_t start)
+{
+	unsigned lo = 0, hi = svc->num_events;
+
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if (svc->events[mid]->ev.start < start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int epg_service_insert(struct epg_service *svc,
+			      struct epg_event *event)
+{
+	unsigned pos;
+
+	if (svc->num_events == svc->max_events) {
+		unsigned max = svc->max_events ? svc->max_events * 2 : 32;
+		struct epg_event **events;
+
+		events = realloc(svc->events, max * sizeof(*events));
+		if (!events)
+			return -ENOMEM;
+		svc->events = events;
+		svc->max_events = max;
+	}
+
+	/* Events starting at the same time are kept in arrival order */
+	pos = epg_service_lookup(svc, event->ev.start + 1);
+	memmove(&svc->events[pos + 1], &svc->events[pos],
+		(svc->num_events - pos) * sizeof(*svc->events));
+	svc->events[pos] = event;
+	svc->num_events++;
+
+	return 0;
+}
+
+static void epg_service_remove(struct epg_service *svc,
+			       struct epg_event *event)
+{
+	unsigned pos = epg_service_lookup(svc, event->ev.start);
+
+	while (pos < svc->num_events && svc->events[pos] != event)
+		pos++;
+	if (pos == svc->num_events)
+		return;
+
+	svc->num_events--;
+	memmove(&svc->events[pos], &svc->events[pos + 1],
+		(svc->num_events - pos) * sizeof(*svc->events));
+}
+
+static struct epg_event **epg_find_event(struct dvb_epg *epg,
+					 uint16_t network_id,
+					 uint16_t transport_id,
+					 uint16_t service_id,
+					 uint16_t event_id)
+{
+	unsigned h = epg_hash(network_id, transport_id, service_id, event_id) %
+		     EPG_HASH_SIZE;
+	struct epg_event **pos;
+
+	for (pos = &epg->events[h]; *pos; pos = &(*pos)->hnext) {
+		struct dvb_epg_event *ev = &(*pos)->ev;
+
+		if (ev->event_id == event_id && ev->service_id == service_id &&
+		    ev->transport_id == transport_id &&
+		    ev->network_id == network_id)
+			break;
+	}
+	return pos;
+}
+
+static void epg_remove_event(struct dvb_epg *epg, struct epg_event **pos)
+{
+	struct epg_event *event = *pos;
+	struct epg_service *svc;
+
+	svc = epg_get_service(epg, event->ev.network_id,
+			      event->ev.transport_id, event->ev.service_id, 0);
+	if (svc)
+		epg_service_remove(svc, event);
+
+	*pos = event->hnext;
+	epg_event_free(event);
+	epg->num_events--;
+}
+
+static char *epg_strcat(char *dst, const char *src)
+{
+	size_t len, src_len;
+	char *p;
+
+	if (!src || !*src)
+		return dst;
+	if (!dst)
+		return strdup(src);
+
+	len = strlen(dst);
+	src_len = strlen(src);
+	p = realloc(dst, len + src_len + 1);
+	if (!p)
+		return dst;
+	memcpy(p + len, src, src_len + 1);
+
+	return p;
+}
+
+static int epg_strcmp(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a != b;
+	return strcmp(a, b);
+}
+
+/*
+ * dvb_time() returns a struct tm in local time, via mktime(). Do the
+ * conversion here directly, as the database is in UTC
+ */
+static time_t epg_event_start(struct dvb_table_eit_event *eit_event)
+{
+	unsigned mjd = eit_event->bitfield1;
+
+	return ((time_t)mjd - 40587) * 86400 +
+	       dvb_bcd(eit_event->dvbstart[2]) * 3600 +
+	       dvb_bcd(eit_event->dvbstart[3]) * 60 +
+	       dvb_bcd(eit_event->dvbstart[4]);
+}
+
+/*
+ * Fills an event from the parsed table. Returns 1 if anything changed,
+ * 0 otherwise.
+ */
+static int epg_fill_event(struct dvb_epg_event *ev,
+			  struct dvb_table_eit_event *eit_event)
+{
+	struct dvb_desc *desc;
+	char *title = NULL, *description = NULL, *extended = NULL;
+	char language[4] = "";
+	time_t start = epg_event_start(eit_event);
+	int changed = 0;
+
+	for (desc = eit_event->descriptor; desc; desc = desc->next) {
+		switch (desc->type) {
+		case short_event_descriptor: {
+			struct dvb_desc_event_short *d = (void *)desc;
+
+			if (title)
+				break;
+			memcpy(language, d->language, sizeof(language));
+			language[3] = '\0';
+			if (d->name)
+				title = strdup(d->name);
+			if (d->text)
+				description = strdup(d->text);
+			break;
+		}
+		case extended_event_descriptor: {
+			struct dvb_desc_event_extended *d = (void *)desc;
+
+			extended = epg_strcat(extended, d->text);
+			if (!language[0]) {
+				memcpy(language, d->language, sizeof(language));
+				language[3] = '\0';
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	if (ev->start != start || ev->duration != eit_event->duration ||
+	    ev->running_status != eit_event->running_status ||
+	    ev->free_CA_mode != eit_event->free_CA_mode ||
+	    strcmp(ev->language, language) ||
+	    epg_strcmp(ev->title, title) ||
+	    epg_strcmp(ev->description, description) ||
+	    epg_strcmp(ev->extended, extended))
+		changed = 1;
+
+	ev->start = start;
+	ev->duration = eit_event->duration;
+	ev->running_status = eit_event->running_status;
+	ev->free_CA_mode = eit_event->free_CA_mode;
+	memcpy(ev->language, language, sizeof(language));
+
+	free(ev->title);
+	free(ev->description);
+	free(ev->extended);
+	ev->title = title;
+	ev->description = description;
+	ev->extended = extended;
+
+	return changed;
+}
+
+static int epg_has_id(const uint16_t *ids, unsigned num_ids, uint16_t id)
+{
+	unsigned i;
+
+	for (i = 0; i < num_ids; i++)
+		if (ids[i] == id)
+			return 1;
+	return 0;
+}
+
+/* listed tells if the previous version of the section had the event */
+static int epg_update_event(struct dvb_epg *epg, struct epg_section *sect,
+			    struct dvb_table_eit_event *eit_event, int listed)
+{
+	struct epg_event **pos, *event;
+	struct epg_service *svc;
+	int changed;
+
+	svc = epg_get_service(epg, sect->network_id, sect->transport_id,
+			      sect->service_id, 1);
+	if (!svc)
+		return -ENOMEM;
+
+	pos = epg_find_event(epg, sect->network_id, sect->transport_id,
+			     sect->service_id, eit_event->event_id);
+	event = *pos;
+	if (event) {
+		int moved = event->ev.start != epg_event_start(eit_event);
+
+		if (!listed)
+			event->refs++;
+		if (moved)
+			epg_service_remove(svc, event);
+		changed = epg_fill_event(&event->ev, eit_event);
+		if (moved && epg_service_insert(svc, event) < 0) {
+			*pos = event->hnext;
+			epg_event_free(event);
+			epg->num_events--;
+			return -ENOMEM;
+		}
+		return changed;
+	}
+
+	event = calloc(1, sizeof(*event));
+	if (!event)
+		return -ENOMEM;
+	event->ev.network_id = sect->network_id;
+	event->ev.transport_id = sect->transport_id;
+	event->ev.service_id = sect->service_id;
+	event->ev.event_id = eit_event->event_id;
+	event->refs = 1;
+	epg_fill_event(&event->ev, eit_event);
+
+	if (epg_service_insert(svc, event) < 0) {
+		epg_event_free(event);
+		return -ENOMEM;
+	}
+	*pos = event;
+	epg->num_events++;
+
+	return 1;
+}
+
+int dvb_epg_add_section(struct dvb_epg *epg, const uint8_t *buf, ssize_t len)
+{
+	struct dvb_v5_fe_parms_priv *parms = epg->parms;
+	struct dvb_table_eit *eit = NULL;
+	struct dvb_table_eit_event *eit_event;
+	struct epg_section *sect, **pos;
+	struct dvb_arena *arena;
+	uint16_t service_id, transport_id, network_id;
+	uint8_t table_id, version, section_number;
+	uint16_t *old_ids;
+	unsigned h, num_old_ids, n, i;
+	int ret, changed = 0;
+
+	if (len < 14 + DVB_CRC_SIZE)
+		return -EINVAL;
+
+	table_id = buf[0];
+	if (!epg_table_wanted(epg, table_id))
+		return 0;
+
+	/* Discard the sections that will be valid only in the future */
+	if (!(buf[5] & 0x01))
+		return 0;
+
+	if (dvb_crc32((uint8_t *)buf, len, 0xFFFFFFFF)) {
+		dvb_logdbg(_("%s: crc error on table 0x%02x"),
+			   __func__, table_id);
+		return -EINVAL;
+	}
+
+	service_id = buf[3] << 8 | buf[4];
+	version = (buf[5] >> 1) & 0x1f;
+	section_number = buf[6];
+	transport_id = buf[8] << 8 | buf[9];
+	network_id = buf[10] << 8 | buf[11];
+
+	h = epg_hash(network_id, transport_id, service_id,
+		     table_id << 8 | section_number) % EPG_HASH_SIZE;
+	for (pos = &epg->sections[h]; *pos; pos = &(*pos)->hnext) {
+		sect = *pos;
+		if (sect->table_id == table_id &&
+		    sect->section_number == section_number &&
+		    sect->service_id == service_id &&
+		    sect->transport_id == transport_id &&
+		    sect->network_id == network_id)
+			break;
+	}
+	sect = *pos;
+	if (sect && sect->version == version)
+		return 0;
+
+	/*
+	 * The database has its own copies of the events: the table is
+	 * dropped at once after the update, keeping the arena blocks
+	 */
+	arena = parms->arena;
+	parms->arena = epg->arena;
+	ret = dvb_table_eit_init(&parms->p, buf, len - DVB_CRC_SIZE, &eit);
+	parms->arena = arena;
+	if (ret < 0) {
+		dvb_arena_reset(epg->arena);
+		return -EINVAL;
+	}
+
+	if (!sect) {
+		sect = calloc(1, sizeof(*sect));
+		if (!sect) {
+			dvb_arena_reset(epg->arena);
+			return -ENOMEM;
+		}
+		sect->table_id = table_id;
+		sect->section_number = section_number;
+		sect->service_id = service_id;
+		sect->transport_id = transport_id;
+		sect->network_id = network_id;
+		*pos = sect;
+	}
+	sect->version = version;
+
+	old_ids = sect->event_ids;
+	num_old_ids = sect->num_event_ids;
+
+	n = 0;
+	for (eit_event = eit->event; eit_event; eit_event = eit_event->next)
+		n++;
+	if (n) {
+		sect->event_ids = calloc(n, sizeof(*sect->event_ids));
+		if (!sect->event_ids) {
+			/* Keep the old events, and retry on the next repetition */
+			dvb_logerr(_("%s: out of memory"), __func__);
+			sect->event_ids = old_ids;
+			sect->version = 0xff;
+			dvb_arena_reset(epg->arena);
+			return -ENOMEM;
+		}
+	} else {
+		sect->event_ids = NULL;
+	}
+	sect->num_event_ids = 0;
+
+	/*
+	 * Each event counts the sections listing it. Only the events listed
+	 * here are counted for this section, even if an update fails.
+	 */
+	for (eit_event = eit->event; eit_event; eit_event = eit_event->next) {
+		ret = epg_update_event(epg, sect, eit_event,
+				       epg_has_id(old_ids, num_old_ids,
+						  eit_event->event_id));
+		if (ret < 0) {
+			dvb_logerr(_("%s: out of memory"), __func__);
+			break;
+		}
+		changed += ret;
+		sect->event_ids[sect->num_event_ids++] = eit_event->event_id;
+	}
+	dvb_arena_reset(epg->arena);
+
+	/* Release the events that were dropped from this section */
+	for (i = 0; i < num_old_ids; i++) {
+		struct epg_event **ev_pos;
+
+		if (epg_has_id(sect->event_ids, sect->num_event_ids, old_ids[i]))
+			continue;
+
+		ev_pos = epg_find_event(epg, network_id, transport_id,
+					service_id, old_ids[i]);
+		if (*ev_pos && !--(*ev_pos)->refs) {
+			epg_remove_event(epg, ev_pos);
+			changed++;
+		}
+	}
+	free(old_ids);
+
+	return changed;
+}
+
+int dvb_epg_read(struct dvb_epg *epg, int timeout)
+{
+	struct dvb_v5_fe_parms_priv *parms = epg->parms;
+	struct pollfd fds;
+	ssize_t len;
+	int ret, changed = 0;
+
+	if (epg->dmx_fd < 0)
+		return -EBADF;
+
+	fds.fd = epg->dmx_fd;
+	fds.events = POLLIN;
+
+	do {
+		if (parms->p.abort)
+			break;
+
+		ret = poll(&fds, 1, timeout);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (!ret)
+			break;
+
+		len = read(epg->dmx_fd, epg->buf, DVB_MAX_PAYLOAD_PACKET_SIZE);
+		if (len < 0) {
+			if (errno == EOVERFLOW || errno == EAGAIN ||
+			    errno == EINTR)
+				continue;
+			dvb_perror("read_sections: read error");
+			return -errno;
+		}
+
+		ret = dvb_epg_add_section(epg, epg->buf, len);
+		if (ret > 0)
+			changed += ret;
+
+		/* Handle whatever is already there, without sleeping */
+		timeout = 0;
+	} while (1);
+
+	return changed;
+}
+
+int dvb_epg_foreach(struct dvb_epg *epg, int service_id,
+		    time_t start, time_t end,
+		    dvb_epg_handler_t *handler, void *priv)
+{
+	struct epg_service *svc;
+	unsigned pos;
+	int ret;
+
+	for (svc = epg->service_list; svc; svc = svc->next) {
+		if (service_id >= 0 && svc->service_id != service_id)
+			continue;
+
+		/* The event that started before start may still be running */
+		pos = epg_service_lookup(svc, start);
+		while (pos > 0) {
+			struct dvb_epg_event *ev = &svc->events[pos - 1]->ev;
+
+			if (ev->start + (time_t)ev->duration <= start)
+				break;
+			pos--;
+		}
+
+		for (; pos < svc->num_events; pos++) {
+			struct dvb_epg_event *ev = &svc->events[pos]->ev;
+
+			if (end && ev->start >= end)
+				break;
+			if (ev->start + (time_t)ev->duration <= start)
+				continue;
+
+			ret = handler(priv, ev);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+const struct dvb_epg_event *dvb_epg_get_event(struct dvb_epg *epg,
+					      uint16_t service_id,
+					      time_t when)
+{
+	struct epg_service *svc;
+	unsigned pos;
+
+	for (svc = epg->service_list; svc; svc = svc->next) {
+		if (svc->service_id != service_id)
+			continue;
+
+		/* The last event that started up to when */
+		pos = epg_service_lookup(svc, when + 1);
+		if (pos > 0) {
+			struct dvb_epg_event *ev = &svc->events[pos - 1]->ev;
+
+			if (ev->start + (time_t)ev->duration > when)
+				return ev;
+		}
+	}
+	return NULL;
+}
+
+unsigned dvb_epg_num_events(struct dvb_epg *epg)
+{
+	return epg->num_events;
+}
+
+int dvb_epg_set_service_name(struct dvb_epg *epg, uint16_t service_id,
+			     const char *name)
+{
+	struct epg_service_name *n;
+	char *p;
+
+	p = strdup(name);
+	if (!p)
+		return -ENOMEM;
+
+	for (n = epg->names; n; n = n->next) {
+		if (n->service_id == service_id) {
+			free(n->name);
+			n->name = p;
+			return 0;
+		}
+	}
+
+	n = calloc(1, sizeof(*n));
+	if (!n) {
+		free(p);
+		return -ENOMEM;
+	}
+	n->service_id = service_id;
+	n->name = p;
+	n->next = epg->names;
+	epg->names = n;
+
+	return 0;
+}
+
+static void xmltv_puts(FILE *fp, const char *s)
+{
+	for (; *s; s++) {
+		switch (*s) {
+		case '<':
+			fputs("&lt;", fp);
+			break;
+		case '>':
+			fputs("&gt;", fp);
+			break;
+		case '&':
+			fputs("&amp;", fp);
+			break;
+		case '"':
+			fputs("&quot;", fp);
+			break;
+		default:
+			/* Control chars are not allowed at XML 1.0 */
+			if ((unsigned char)*s < 0x20 && *s != '\n' && *s != '\t')
+				break;
+			fputc(*s, fp);
+		}
+	}
+}
+
+static void xmltv_time(FILE *fp, time_t t)
+{
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+	fprintf(fp, "%04d%02d%02d%02d%02d%02d +0000",
+		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+		tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+static void xmltv_text(FILE *fp, const char *tag, const char *lang,
+		       const char *text)
+{
+	if (!text || !*text)
+		return;
+
+	fprintf(fp, "    <%s", tag);
+	if (lang[0]) {
+		fputs(" lang=\"", fp);
+		xmltv_puts(fp, lang);
+		fputc('"', fp);
+	}
+	fputc('>', fp);
+	xmltv_puts(fp, text);
+	fprintf(fp, "</%s>\n", tag);
+}
+
+int dvb_epg_write_xmltv(struct dvb_epg *epg, FILE *fp)
+{
+	struct dvb_v5_fe_parms_priv *parms = epg->parms;
+	struct epg_service *svc;
+	struct epg_service_name *n;
+	unsigned i;
+
+	fprintf(fp, "<?xml version=\"1.0\" encoding=\"%s\"?>\n",
+		parms->p.output_charset ? parms->p.output_charset : "UTF-8");
+	fprintf(fp, "<!DOCTYPE tv SYSTEM \"xmltv.dtd\">\n");
+	fprintf(fp, "<tv generator-info-name=\"libdvbv5\">\n");
+
+	for (svc = epg->service_list; svc; svc = svc->next) {
+		fprintf(fp, "  <channel id=\"%u.%u.%u.dvb\">\n",
+			svc->network_id, svc->transport_id, svc->service_id);
+		for (n = epg->names; n; n = n->next)
+			if (n->service_id == svc->service_id)
+				break;
+		fputs("    <display-name>", fp);
+		if (n)
+			xmltv_puts(fp, n->name);
+		else
+			fprintf(fp, "%u", svc->service_id);
+		fputs("</display-name>\n  </channel>\n", fp);
+	}
+
+	for (svc = epg->service_list; svc; svc = svc->next) {
+		for (i = 0; i < svc->num_events; i++) {
+			struct dvb_epg_event *ev = &svc->events[i]->ev;
+
+			fputs("  <programme start=\"", fp);
+			xmltv_time(fp, ev->start);
+			fputs("\" stop=\"", fp);
+			xmltv_time(fp, ev->start + ev->duration);
+			fprintf(fp, "\" channel=\"%u.%u.%u.dvb\">\n",
+				svc->network_id, svc->transport_id,
+				svc->service_id);
+
+			xmltv_text(fp, "title", ev->language,
+				   ev->title ? ev->title : "");
+			if (ev->description && ev->extended) {
+				fputs("    <desc", fp);
+				if (ev->language[0]) {
+					fputs(" lang=\"", fp);
+					xmltv_puts(fp, ev->language);
+					fputc('"', fp);
+				}
+				fputc('>', fp);
+				xmltv_puts(fp, ev->description);
+				fputc('\n', fp);
+				xmltv_puts(fp, ev->extended);
+				fputs("</desc>\n", fp);
+			} else {
+				xmltv_text(fp, "desc", ev->language,
+					   ev->description ? ev->description :
+							     ev->extended);
+			}
+			fputs("  </programme>\n", fp);
+		}
+	}
+	fputs("</tv>\n", fp);
+
+	if (ferror(fp))
+		return -EIO;
+	return 0;
+}
@@ -20,8 +20,11 @@
 #ifndef __DVB_FE_PRIV_H
 #define __DVB_FE_PRIV_H
 
+#include <pthread.h>
+
 #include <libdvbv5/dvb-fe.h>
 #include <libdvbv5/countries.h>
+#include <libdvbv5/dvb-fe-sampler.h>
 
 enum dvbv3_emulation_type {
 	DVBV3_UNKNOWN = -1,
@@ -52,9 +55,14 @@ struct dvb_v5_stats {
 
 	fe_status_t prev_status;
 
+	/* Kernel stats at the start of prop[] that are read on each call */
+	unsigned			num_kernel_stats;
 };
 
 struct dvb_device_priv;
+struct dvb_section_cache;
+struct dvb_arena;
+struct dvb_iconv_cache;
 
 struct dvb_v5_fe_parms_priv {
 	/* dvbv_v4_fe_parms should be the first element on this struct */
@@ -75,12 +83,39 @@ struct dvb_v5_fe_parms_priv {
 	/* Satellite specific stuff */
 	int				high_band;
 	unsigned			freq_offset;
+
+	/* Number of demux filters dvb_get_ts_tables() may use at once */
+	unsigned			table_filters;
+
+	/* Raw sections of the tables already read, if enabled */
+	int				use_section_cache;
+	struct dvb_section_cache	*section_cache;
+
+	/* If not NULL, parsed tables are allocated there */
+	struct dvb_arena		*arena;
+
+	/*
+	 * iconv descriptors already opened by the string parser. They keep
+	 * a conversion state, so iconv_lock also serializes their use.
+	 */
+	pthread_mutex_t			iconv_lock;
+	struct dvb_iconv_cache		*iconv_cache;
 };
 
 /* Functions used internally by dvb-dev.c. Aren't part of the API */
 int dvb_fe_open_fname(struct dvb_v5_fe_parms_priv *parms, char *fname,
 		      int flags);
 void dvb_v5_free(struct dvb_v5_fe_parms_priv *parms);
+void dvb_section_cache_free(struct dvb_v5_fe_parms_priv *parms);
+void dvb_iconv_cache_free(struct dvb_v5_fe_parms_priv *parms);
+
+/* Allocation of parsed tables and descriptors, from the arena if set */
+void *dvb_parse_calloc(struct dvb_v5_fe_parms *parms, size_t size);
+void dvb_parse_free(struct dvb_v5_fe_parms *parms, void *p);
+void dvb_arena_reset(struct dvb_arena *arena);
+
+/* The table free functions skip what only dvb_arena_free() can release */
+int dvb_arena_owns(const void *ptr);
 void __dvb_fe_close(struct dvb_v5_fe_parms_priv *parms);
 
 /* Functions that can be overriden to be executed remotely */
@@ -89,4 +124,21 @@ int __dvb_fe_get_parms(struct dvb_v5_fe_parms *p);
 int __dvb_fe_set_parms(struct dvb_v5_fe_parms *p);
 int __dvb_fe_get_stats(struct dvb_v5_fe_parms *p);
 
+/* Writes the VDR format to an already opened file, used by dvb-file.c */
+struct dvb_file;
+int dvb_write_format_vdr_fp(FILE *fp, const char *fname,
+			    struct dvb_file *dvb_file);
+
+/* Stats cache, also used by the backends that emulate a frontend */
+void dvb_fe_prepare_stats(struct dvb_v5_fe_parms_priv *parms);
+struct dtv_stats *dvb_fe_store_stats(struct dvb_v5_fe_parms_priv *parms,
+				     unsigned cmd,
+				     enum fecap_scale_params scale,
+				     unsigned layer,
+				     uint32_t value);
+
+/* Stores the layer 0 stats from the cache, used by dvb-fe-sampler.c */
+void dvb_fe_fill_sample(struct dvb_v5_fe_parms_priv *parms,
+			struct dvb_fe_sample *sample);
+
 #endif
@@ -0,0 +1,305 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <config.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "dvb-fe-priv.h"
+#include <libdvbv5/dvb-fe-sampler.h>
+
+#ifdef ENABLE_NLS
+# include "gettext.h"
+# include <libintl.h>
+# define _(string) dgettext(LIBDVBV5_DOMAIN, string)
+#else
+# define _(string) string
+#endif
+
+#define MAX_SAMPLER_FE	32
+
+/*
+ * Single producer ring. The sampler thread is the only writer: it fills
+ * the slot at head and then publishes it by incrementing head. Readers
+ * copy the samples and then check that head didn't move enough for the
+ * writer to overwrite them meanwhile.
+ */
+struct dvb_fe_ring {
+	struct dvb_v5_fe_parms_priv	*parms;
+	uint64_t			head;
+	uint64_t			next;	/* next timed sample, in ns */
+	struct dvb_fe_sample		*sample;
+};
+
+struct dvb_fe_sampler {
+	struct dvb_fe_ring		fe[MAX_SAMPLER_FE];
+	unsigned			num_fe;
+	unsigned			size;
+	uint64_t			interval;
+
+	int				running;
+	int				stop_pipe[2];
+#ifdef HAVE_PTHREAD
+	pthread_t			thread;
+#endif
+};
+
+static uint64_t sampler_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct dvb_fe_sampler *dvb_fe_sampler_alloc(unsigned ring_size)
+{
+	struct dvb_fe_sampler *s;
+	unsigned size = 1;
+
+	while (size < ring_size)
+		size <<= 1;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->size = size;
+	s->stop_pipe[0] = -1;
+	s->stop_pipe[1] = -1;
+
+	return s;
+}
+
+void dvb_fe_sampler_free(struct dvb_fe_sampler *s)
+{
+	unsigned i;
+
+	if (!s)
+		return;
+
+	dvb_fe_sampler_stop(s);
+	for (i = 0; i < s->num_fe; i++)
+		free(s->fe[i].sample);
+	free(s);
+}
+
+int dvb_fe_sampler_add(struct dvb_fe_sampler *s, struct dvb_v5_fe_parms *p)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_fe_ring *fe;
+
+	if (s->running)
+		return -EBUSY;
+	if (s->num_fe == MAX_SAMPLER_FE) {
+		dvb_logerr(_("Can't sample more than %d frontends"),
+			   MAX_SAMPLER_FE);
+		return -ENOSPC;
+	}
+
+	fe = &s->fe[s->num_fe];
+	fe->sample = calloc(s->size, sizeof(*fe->sample));
+	if (!fe->sample)
+		return -ENOMEM;
+	fe->parms = parms;
+	fe->head = 0;
+
+	return s->num_fe++;
+}
+
+int dvb_fe_sampler_read(struct dvb_fe_sampler *s, unsigned idx, uint64_t *seq,
+			struct dvb_fe_sample *samples, unsigned max)
+{
+	struct dvb_fe_ring *fe;
+	uint64_t head, first, i;
+	unsigned n = 0, skip;
+
+	if (idx >= s->num_fe)
+		return -EINVAL;
+	fe = &s->fe[idx];
+
+	head = __atomic_load_n(&fe->head, __ATOMIC_ACQUIRE);
+	first = *seq;
+	if (head > s->size && first < head - s->size)
+		first = head - s->size;
+	if (first >= head)
+		return 0;
+
+	for (i = first; i < head && n < max; i++, n++)
+		samples[n] = fe->sample[i & (s->size - 1)];
+
+	/*
+	 * The writer may be storing sample head, at the slot of sample
+	 * head - size. Discard the ones that could have been overwritten.
+	 */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	head = __atomic_load_n(&fe->head, __ATOMIC_RELAXED);
+	if (head + 1 > s->size && first < head + 1 - s->size) {
+		skip = head + 1 - s->size - first;
+		if (skip > n)
+			skip = n;
+		memmove(samples, samples + skip, (n - skip) * sizeof(*samples));
+		n -= skip;
+		first += skip;
+	}
+
+	*seq = first + n;
+	return n;
+}
+
+#ifdef HAVE_PTHREAD
+static void sampler_store(struct dvb_fe_sampler *s, struct dvb_fe_ring *fe)
+{
+	struct dvb_fe_sample *sample;
+
+	fe->next = sampler_now() + s->interval;
+	if (dvb_fe_get_stats(&fe->parms->p))
+		return;
+
+	sample = &fe->sample[fe->head & (s->size - 1)];
+	dvb_fe_fill_sample(fe->parms, sample);
+
+	__atomic_store_n(&fe->head, fe->head + 1, __ATOMIC_RELEASE);
+}
+
+static void *sampler_thread(void *privdata)
+{
+	struct dvb_fe_sampler *s = privdata;
+	struct pollfd fds[MAX_SAMPLER_FE + 1];
+	struct dvb_frontend_event event;
+	struct dvb_v5_fe_parms_priv *parms;
+	int fe_idx[MAX_SAMPLER_FE];
+	uint64_t now, next;
+	unsigned i, nfds;
+	int timeout;
+
+	nfds = 0;
+	for (i = 0; i < s->num_fe; i++) {
+		if (s->fe[i].parms->fd < 0)
+			continue;
+		fds[nfds].fd = s->fe[i].parms->fd;
+		fds[nfds].events = POLLPRI;
+		fe_idx[nfds++] = i;
+	}
+	fds[nfds].fd = s->stop_pipe[0];
+	fds[nfds].events = POLLIN;
+
+	for (i = 0; i < s->num_fe; i++)
+		sampler_store(s, &s->fe[i]);
+
+	while (1) {
+		/* Sleep until the next event or the next timed sample */
+		now = sampler_now();
+		next = now + s->interval;
+		for (i = 0; i < s->num_fe; i++)
+			if (s->fe[i].next < next)
+				next = s->fe[i].next;
+		timeout = next > now ? (next - now + 999999) / 1000000 : 0;
+
+		if (poll(fds, nfds + 1, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			parms = s->fe[0].parms;
+			dvb_perror("poll");
+			break;
+		}
+		if (fds[nfds].revents)
+			break;
+
+		for (i = 0; i < nfds; i++) {
+			if (!(fds[i].revents & POLLPRI))
+				continue;
+
+			/*
+			 * Dequeue the event, or the frontend would keep
+			 * waking up the thread. Its status is also at the
+			 * stats, so there's no need to parse it.
+			 */
+			ioctl(fds[i].fd, FE_GET_EVENT, &event);
+			sampler_store(s, &s->fe[fe_idx[i]]);
+		}
+
+		now = sampler_now();
+		for (i = 0; i < s->num_fe; i++)
+			if (s->fe[i].next <= now)
+				sampler_store(s, &s->fe[i]);
+	}
+
+	return NULL;
+}
+#endif
+
+int dvb_fe_sampler_start(struct dvb_fe_sampler *s, unsigned interval_ms)
+{
+#ifdef HAVE_PTHREAD
+	int ret;
+
+	if (s->running)
+		return -EBUSY;
+	if (!s->num_fe)
+		return -EINVAL;
+
+	s->interval = (interval_ms ? interval_ms : 1) * 1000000ULL;
+
+	if (pipe(s->stop_pipe) < 0)
+		return -errno;
+
+	ret = pthread_create(&s->thread, NULL, sampler_thread, s);
+	if (ret) {
+		close(s->stop_pipe[0]);
+		close(s->stop_pipe[1]);
+		s->stop_pipe[0] = -1;
+		s->stop_pipe[1] = -1;
+		return -ret;
+	}
+	s->running = 1;
+
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+void dvb_fe_sampler_stop(struct dvb_fe_sampler *s)
+{
+#ifdef HAVE_PTHREAD
+	char c = 0;
+
+	if (!s->running)
+		return;
+
+	if (write(s->stop_pipe[1], &c, 1) < 0)
+		pthread_cancel(s->thread);
+	pthread_join(s->thread, NULL);
+
+	close(s->stop_pipe[0]);
+	close(s->stop_pipe[1]);
+	s->stop_pipe[0] = -1;
+	s->stop_pipe[1] = -1;
+	s->running = 0;
+#endif
+}
@@ -82,6 +82,10 @@ void dvb_v5_free(struct dvb_v5_fe_parms_priv *parms)
 	if (parms->fname)
 		free(parms->fname);
 
+	dvb_section_cache_free(parms);
+	dvb_iconv_cache_free(parms);
+	pthread_mutex_destroy(&parms->iconv_lock);
+
 	free(parms);
 }
 
@@ -94,6 +98,7 @@ struct dvb_v5_fe_parms *dvb_fe_dummy(void)
 	parms = calloc(sizeof(*parms), 1);
 	if (!parms)
 		return NULL;
+	pthread_mutex_init(&parms->iconv_lock, NULL);
 	parms->p.logfunc = dvb_default_log;
 	parms->fd = -1;
 	parms->p.default_charset = "iso-8859-1";
@@ -162,6 +167,7 @@ struct dvb_v5_fe_parms *dvb_fe_open_flags(int adapter, int frontend,
 		free(fname);
 		return NULL;
 	}
+	pthread_mutex_init(&parms->iconv_lock, NULL);
 	parms->p.verbose = verbose;
 	parms->p.default_charset = "iso-8859-1";
 	parms->p.output_charset = "utf-8";
@@ -176,6 +182,7 @@ struct dvb_v5_fe_parms *dvb_fe_open_flags(int adapter, int frontend,
 
 	ret = dvb_fe_open_fname(parms, fname, flags);
 	if (ret < 0) {
+		pthread_mutex_destroy(&parms->iconv_lock);
 		free(parms);
 		return NULL;
 	}
@@ -336,6 +343,13 @@ int dvb_fe_open_fname(struct dvb_v5_fe_parms_priv *parms, char *fname,
 	if ((flags & O_ACCMODE) == O_RDWR)
 		dvb_set_sys(&parms->p, parms->p.current_sys);
 
+	dvb_fe_prepare_stats(parms);
+
+	return 0;
+}
+
+void dvb_fe_prepare_stats(struct dvb_v5_fe_parms_priv *parms)
+{
 	/*
 	 * Prepare the status struct - DVBv5.10 parameters should
 	 * come first, as they'll be read together.
@@ -348,6 +362,7 @@ int dvb_fe_open_fname(struct dvb_v5_fe_parms_priv *parms, char *fname,
 	parms->stats.prop[5].cmd = DTV_STAT_POST_TOTAL_BIT_COUNT;
 	parms->stats.prop[6].cmd = DTV_STAT_ERROR_BLOCK_COUNT;
 	parms->stats.prop[7].cmd = DTV_STAT_TOTAL_BLOCK_COUNT;
+	parms->stats.num_kernel_stats = DTV_NUM_KERNEL_STATS;
 
 	/* Now, status and the calculated stats */
 	parms->stats.prop[8].cmd = DTV_STATUS;
@@ -355,8 +370,6 @@ int dvb_fe_open_fname(struct dvb_v5_fe_parms_priv *parms, char *fname,
 	parms->stats.prop[10].cmd = DTV_PER;
 	parms->stats.prop[11].cmd = DTV_QUALITY;
 	parms->stats.prop[12].cmd = DTV_PRE_BER;
-
-	return 0;
 }
 
 
@@ -917,7 +930,7 @@ int __dvb_fe_set_parms(struct dvb_v5_fe_parms *p)
 	return 0;
 }
 
-static struct dtv_stats *dvb_fe_store_stats(struct dvb_v5_fe_parms_priv *parms,
+struct dtv_stats *dvb_fe_store_stats(struct dvb_v5_fe_parms_priv *parms,
 			      unsigned cmd,
 			      enum fecap_scale_params scale,
 			      unsigned layer,
@@ -1400,7 +1413,7 @@ int __dvb_fe_get_stats(struct dvb_v5_fe_parms *p)
 	if (parms->p.has_v5_stats) {
 		struct dtv_properties props;
 
-		props.num = DTV_NUM_KERNEL_STATS;
+		props.num = parms->stats.num_kernel_stats;
 		props.props = parms->stats.prop;
 
 		/* Do a DVBv5.10 stats call */
@@ -1472,6 +1485,115 @@ dvbv3_fallback:
 }
 
 
+static const uint32_t dvb_kernel_stats[DTV_NUM_KERNEL_STATS] = {
+	DTV_STAT_SIGNAL_STRENGTH,
+	DTV_STAT_CNR,
+	DTV_STAT_PRE_ERROR_BIT_COUNT,
+	DTV_STAT_PRE_TOTAL_BIT_COUNT,
+	DTV_STAT_POST_ERROR_BIT_COUNT,
+	DTV_STAT_POST_TOTAL_BIT_COUNT,
+	DTV_STAT_ERROR_BLOCK_COUNT,
+	DTV_STAT_TOTAL_BLOCK_COUNT,
+};
+
+int dvb_fe_set_stats_props(struct dvb_v5_fe_parms *p,
+			   const uint32_t *cmds, unsigned num)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	uint32_t order[DTV_NUM_KERNEL_STATS];
+	unsigned i, j, n = 0;
+
+	if (!num) {
+		cmds = dvb_kernel_stats;
+		num = DTV_NUM_KERNEL_STATS;
+	}
+	if (num > DTV_NUM_KERNEL_STATS)
+		return -EINVAL;
+
+	/* The wanted stats come first, as only those are read */
+	for (i = 0; i < num; i++) {
+		for (j = 0; j < DTV_NUM_KERNEL_STATS; j++)
+			if (cmds[i] == dvb_kernel_stats[j])
+				break;
+		if (j == DTV_NUM_KERNEL_STATS) {
+			dvb_logerr(_("%s is not a kernel statistics"),
+				   dvb_cmd_name(cmds[i]));
+			return -EINVAL;
+		}
+		for (j = 0; j < n; j++)
+			if (order[j] == cmds[i])
+				break;
+		if (j == n)
+			order[n++] = cmds[i];
+	}
+	num = n;
+	for (i = 0; i < DTV_NUM_KERNEL_STATS; i++) {
+		for (j = 0; j < num; j++)
+			if (order[j] == dvb_kernel_stats[i])
+				break;
+		if (j == num)
+			order[n++] = dvb_kernel_stats[i];
+	}
+
+	/* The stats that won't be read anymore become not available */
+	for (i = 0; i < DTV_NUM_KERNEL_STATS; i++) {
+		memset(&parms->stats.prop[i], 0, sizeof(parms->stats.prop[i]));
+		parms->stats.prop[i].cmd = order[i];
+	}
+	parms->stats.num_kernel_stats = num;
+
+	return 0;
+}
+
+int dvb_fe_get_stats_batch(struct dvb_v5_fe_parms **parms, unsigned num,
+			   int *ret)
+{
+	unsigned i;
+	int r, ok = 0;
+
+	for (i = 0; i < num; i++) {
+		r = dvb_fe_get_stats(parms[i]);
+		if (ret)
+			ret[i] = r;
+		if (!r)
+			ok++;
+	}
+
+	return ok;
+}
+
+void dvb_fe_fill_sample(struct dvb_v5_fe_parms_priv *parms,
+			struct dvb_fe_sample *sample)
+{
+	enum fecap_scale_params scale;
+	struct dtv_stats *stat;
+	uint32_t status = 0;
+	struct timespec ts;
+
+	memset(sample, 0, sizeof(*sample));
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	sample->timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	dvb_fe_retrieve_stats(&parms->p, DTV_STATUS, &status);
+	sample->status = status;
+
+	stat = dvb_fe_retrieve_stats_layer(&parms->p, DTV_STAT_SIGNAL_STRENGTH, 0);
+	if (stat)
+		sample->strength = *stat;
+	stat = dvb_fe_retrieve_stats_layer(&parms->p, DTV_STAT_CNR, 0);
+	if (stat)
+		sample->cnr = *stat;
+
+	sample->pre_ber = calculate_preBER(parms, 0);
+	sample->post_ber = dvb_fe_retrieve_ber(&parms->p, 0, &scale);
+	if (scale == FE_SCALE_NOT_AVAILABLE)
+		sample->post_ber = -EINVAL;
+	sample->per = dvb_fe_retrieve_per(&parms->p, 0);
+	sample->quality = dvb_fe_retrieve_quality(&parms->p, 0);
+}
+
+
 int dvb_fe_get_event(struct dvb_v5_fe_parms *p)
 {
 	struct dvb_v5_fe_parms_priv *parms = (void *)p;
@@ -21,7 +21,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp */
+#include <errno.h>
 #include <unistd.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "dvb-fe-priv.h"
 #include <libdvbv5/dvb-file.h>
@@ -217,18 +223,18 @@ static void adjust_delsys(struct dvb_entry *entry)
  * Generic parse function for all formats each channel is contained into
  * just one line.
  */
-struct dvb_file *dvb_parse_format_oneline(const char *fname,
-					  uint32_t delsys,
-					  const struct dvb_parse_file *parse_file)
+static struct dvb_file *parse_format_oneline_fp(FILE *fd,
+						const char *fname,
+						uint32_t delsys,
+						const struct dvb_parse_file *parse_file)
 {
 	const char *delimiter = parse_file->delimiter;
 	const struct dvb_parse_struct *formats = parse_file->formats;
-	char *buf = NULL, *p;
+	char *buf = NULL, *p, *save;
 	size_t size = 0;
 	int len = 0;
 	int i, j, line = 0;
 	struct dvb_file *dvb_file;
-	FILE *fd;
 	const struct dvb_parse_struct *fmt;
 	struct dvb_entry *entry = NULL;
 	const struct dvb_parse_table *table;
@@ -241,13 +247,6 @@ struct dvb_file *dvb_parse_format_oneline(const char *fname,
 		return NULL;
 	}
 
-	fd = fopen(fname, "r");
-	if (!fd) {
-		perror(fname);
-		free(dvb_file);
-		return NULL;
-	}
-
 	do {
 		len = getline(&buf, &size, fd);
 		if (len <= 0)
@@ -261,7 +260,7 @@ struct dvb_file *dvb_parse_format_oneline(const char *fname,
 			continue;
 
 		if (parse_file->has_delsys_id) {
-			p = strtok(p, delimiter);
+			p = strtok_r(p, delimiter, &save);
 			if (!p) {
 				sprintf(err_msg, _("unknown delivery system type for %s"),
 					p);
@@ -307,9 +306,9 @@ struct dvb_file *dvb_parse_format_oneline(const char *fname,
 		for (i = 0; i < fmt->size; i++) {
 			table = &fmt->table[i];
 			if (delsys && !i) {
-				p = strtok(p, delimiter);
+				p = strtok_r(p, delimiter, &save);
 			} else
-				p = strtok(NULL, delimiter);
+				p = strtok_r(NULL, delimiter, &save);
 			if (p && *p == '#')
 				p = NULL;
 			if (!p && !fmt->table[i].has_default_value) {
@@ -373,7 +372,6 @@ struct dvb_file *dvb_parse_format_oneline(const char *fname,
 		}
 		adjust_delsys(entry);
 	} while (1);
-	fclose(fd);
 	if (buf)
 		free(buf);
 	return dvb_file;
@@ -382,12 +380,29 @@ error:
 	fprintf (stderr, _("ERROR %s while parsing line %d of %s\n"),
 		 err_msg, line, fname);
 	dvb_file_free(dvb_file);
-	fclose(fd);
 	if (buf)
 		free(buf);
 	return NULL;
 }
 
+struct dvb_file *dvb_parse_format_oneline(const char *fname,
+					  uint32_t delsys,
+					  const struct dvb_parse_file *parse_file)
+{
+	struct dvb_file *dvb_file;
+	FILE *fd;
+
+	fd = fopen(fname, "r");
+	if (!fd) {
+		perror(fname);
+		return NULL;
+	}
+	dvb_file = parse_format_oneline_fp(fd, fname, delsys, parse_file);
+	fclose(fd);
+
+	return dvb_file;
+}
+
 static uint32_t get_compat_format(uint32_t delivery_system)
 {
 	switch (delivery_system) {
@@ -415,15 +430,14 @@ static uint32_t get_compat_format(uint32_t delivery_system)
 	}
 }
 
-int dvb_write_format_oneline(const char *fname,
-			     struct dvb_file *dvb_file,
-			     uint32_t delsys,
-			     const struct dvb_parse_file *parse_file)
+static int write_format_oneline_fp(FILE *fp, const char *fname,
+				   struct dvb_file *dvb_file,
+				   uint32_t delsys,
+				   const struct dvb_parse_file *parse_file)
 {
 	const char delimiter = parse_file->delimiter[0];
 	const struct dvb_parse_struct *formats = parse_file->formats;
 	int i, j, line = 0, first;
-	FILE *fp;
 	const struct dvb_parse_struct *fmt;
 	struct dvb_entry *entry;
 	const struct dvb_parse_table *table;
@@ -431,12 +445,6 @@ int dvb_write_format_oneline(const char *fname,
 	char err_msg[80];
 	uint32_t delsys_compat = 0;
 
-	fp = fopen(fname, "w");
-	if (!fp) {
-		perror(fname);
-		return -errno;
-	}
-
 	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
 		for (i = 0; i < entry->n_props; i++) {
 			if (entry->props[i].cmd == DTV_DELIVERY_SYSTEM) {
@@ -466,7 +474,7 @@ int dvb_write_format_oneline(const char *fname,
 		}
 		adjust_delsys(entry);
 		if (parse_file->has_delsys_id) {
-			fprintf(fp, "%s", formats[i].id);
+			fputs(formats[i].id, fp);
 			first = 0;
 		} else
 			first = 1;
@@ -478,7 +486,7 @@ int dvb_write_format_oneline(const char *fname,
 			if (first)
 				first = 0;
 			else
-				fprintf(fp, "%c", delimiter);
+				fputc(delimiter, fp);
 
 			for (j = 0; j < entry->n_props; j++)
 				if (entry->props[j].cmd == table->prop)
@@ -506,7 +514,7 @@ int dvb_write_format_oneline(const char *fname,
 					goto error;
 				}
 
-				fprintf(fp, "%s", table->table[data]);
+				fputs(table->table[data], fp);
 			} else {
 				switch (table->prop) {
 				case DTV_VIDEO_PID:
@@ -514,7 +522,7 @@ int dvb_write_format_oneline(const char *fname,
 						fprintf(stderr,
 							_("WARNING: missing video PID while parsing entry %d of %s\n"),
 							line, fname);
-						fprintf(fp, "%d",0);
+						fputc('0', fp);
 					} else
 						fprintf(fp, "%d",
 							entry->video_pid[0]);
@@ -524,7 +532,7 @@ int dvb_write_format_oneline(const char *fname,
 						fprintf(stderr,
 							_("WARNING: missing audio PID while parsing entry %d of %s\n"),
 							line, fname);
-						fprintf(fp, "%d",0);
+						fputc('0', fp);
 					} else
 						fprintf(fp, "%d",
 							entry->audio_pid[0]);
@@ -533,7 +541,7 @@ int dvb_write_format_oneline(const char *fname,
 					fprintf(fp, "%d", entry->service_id);
 					break;
 				case DTV_CH_NAME:
-					fprintf(fp, "%s", entry->channel);
+					fputs(entry->channel, fp);
 					break;
 				default:
 					if (j >= entry->n_props) {
@@ -555,37 +563,194 @@ int dvb_write_format_oneline(const char *fname,
 				}
 			}
 		}
-		fprintf(fp, "\n");
+		fputc('\n', fp);
 		line++;
 	};
-	fclose (fp);
 	return 0;
 
 error:
 	fprintf(stderr, _("ERROR: %s while parsing entry %d of %s\n"),
 		 err_msg, line, fname);
-	fclose(fp);
 	return -1;
 }
 
+int dvb_write_format_oneline(const char *fname,
+			     struct dvb_file *dvb_file,
+			     uint32_t delsys,
+			     const struct dvb_parse_file *parse_file)
+{
+	FILE *fp;
+	int ret;
+
+	fp = fopen(fname, "w");
+	if (!fp) {
+		perror(fname);
+		return -errno;
+	}
+	ret = write_format_oneline_fp(fp, fname, dvb_file, delsys, parse_file);
+	fclose(fp);
+
+	return ret;
+}
+
 #define CHANNEL "CHANNEL"
 
+/*
+ * Keys of the DVBv5 file format. Channel files may have thousands of
+ * entries with a dozen keys each, so the keys are looked up via a perfect
+ * hash, built at the first use, instead of comparing them with each name.
+ */
+enum dvb_file_key_type {
+	KEY_V5_PROP,
+	KEY_USER_PROP,
+	KEY_SERVICE_ID,
+	KEY_VCHANNEL,
+	KEY_SAT_NUMBER,
+	KEY_FREQ_BPF,
+	KEY_DISEQC_WAIT,
+	KEY_LNB,
+	KEY_COUNTRY,
+	KEY_VIDEO_PID,
+	KEY_AUDIO_PID,
+	KEY_POLARIZATION,
+};
+
+struct dvb_file_key {
+	const char *name;
+	enum dvb_file_key_type type;
+	int cmd;
+};
+
+#define KEY_HASH_BITS	11
+#define KEY_HASH_SIZE	(1 << KEY_HASH_BITS)
+#define MAX_FILE_KEYS	(ARRAY_SIZE(dvb_v5_name) + DTV_USER_NAME_SIZE + 10)
+
+static struct dvb_file_key dvb_file_keys[MAX_FILE_KEYS];
+static unsigned dvb_file_num_keys;
+static uint16_t dvb_file_key_hash[KEY_HASH_SIZE];
+static uint32_t dvb_file_key_seed;
+static int dvb_file_keys_state;	/* 0: not built, 1: building, 2: built */
+
+static uint32_t dvb_file_hash_key(const char *key, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ seed;
+
+	for (; *key; key++)
+		h = (h ^ toupper((unsigned char)*key)) * 16777619u;
+
+	return (h ^ (h >> 15)) & (KEY_HASH_SIZE - 1);
+}
+
+static void dvb_file_add_key(const char *name, enum dvb_file_key_type type,
+			     int cmd)
+{
+	unsigned i;
+
+	/* If the same name is used twice, the first one is used */
+	for (i = 0; i < dvb_file_num_keys; i++)
+		if (!strcasecmp(dvb_file_keys[i].name, name))
+			return;
+
+	dvb_file_keys[dvb_file_num_keys].name = name;
+	dvb_file_keys[dvb_file_num_keys].type = type;
+	dvb_file_keys[dvb_file_num_keys].cmd = cmd;
+	dvb_file_num_keys++;
+}
+
+static void dvb_file_build_keys(void)
+{
+	uint32_t seed;
+	unsigned i, h;
+	int state = 0;
+
+	if (__atomic_load_n(&dvb_file_keys_state, __ATOMIC_ACQUIRE) == 2)
+		return;
+
+	/* Only one thread builds the table; the others wait for it */
+	if (!__atomic_compare_exchange_n(&dvb_file_keys_state, &state, 1, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		while (__atomic_load_n(&dvb_file_keys_state,
+				       __ATOMIC_ACQUIRE) != 2)
+			sched_yield();
+		return;
+	}
+
+	/* The order matters: it is the same as the one used to parse */
+	for (i = 0; i < ARRAY_SIZE(dvb_v5_name); i++)
+		if (dvb_v5_name[i])
+			dvb_file_add_key(dvb_v5_name[i], KEY_V5_PROP, i);
+	dvb_file_add_key("SERVICE_ID", KEY_SERVICE_ID, 0);
+	dvb_file_add_key("VCHANNEL", KEY_VCHANNEL, 0);
+	dvb_file_add_key("SAT_NUMBER", KEY_SAT_NUMBER, 0);
+	dvb_file_add_key("FREQ_BPF", KEY_FREQ_BPF, 0);
+	dvb_file_add_key("DISEQC_WAIT", KEY_DISEQC_WAIT, 0);
+	dvb_file_add_key("LNB", KEY_LNB, 0);
+	dvb_file_add_key("COUNTRY", KEY_COUNTRY, 0);
+	dvb_file_add_key("VIDEO_PID", KEY_VIDEO_PID, 0);
+	dvb_file_add_key("AUDIO_PID", KEY_AUDIO_PID, 0);
+	dvb_file_add_key("POLARIZATION", KEY_POLARIZATION, 0);
+	for (i = 0; i < DTV_USER_NAME_SIZE; i++)
+		if (dvb_user_name[i])
+			dvb_file_add_key(dvb_user_name[i], KEY_USER_PROP,
+					 i + DTV_USER_COMMAND_START);
+
+	/* Seek for a seed where no two keys share the same slot */
+	for (seed = 1; seed < 100000; seed++) {
+		memset(dvb_file_key_hash, 0, sizeof(dvb_file_key_hash));
+		for (i = 0; i < dvb_file_num_keys; i++) {
+			h = dvb_file_hash_key(dvb_file_keys[i].name, seed);
+			if (dvb_file_key_hash[h])
+				break;
+			dvb_file_key_hash[h] = i + 1;
+		}
+		if (i == dvb_file_num_keys) {
+			dvb_file_key_seed = seed;
+			break;
+		}
+	}
+
+	__atomic_store_n(&dvb_file_keys_state, 2, __ATOMIC_RELEASE);
+}
+
+static const struct dvb_file_key *dvb_file_find_key(const char *key)
+{
+	const struct dvb_file_key *k;
+	unsigned i;
+
+	dvb_file_build_keys();
+
+	if (!dvb_file_key_seed) {
+		/* No perfect hash was found: just compare each name */
+		for (i = 0; i < dvb_file_num_keys; i++)
+			if (!strcasecmp(dvb_file_keys[i].name, key))
+				return &dvb_file_keys[i];
+		return NULL;
+	}
+
+	i = dvb_file_key_hash[dvb_file_hash_key(key, dvb_file_key_seed)];
+	if (!i)
+		return NULL;
+	k = &dvb_file_keys[i - 1];
+
+	return strcasecmp(k->name, key) ? NULL : k;
+}
+
 static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 {
+	const struct dvb_file_key *k;
 	int i, j, len, type = 0;
 	int is_video = 0, is_audio = 0, n_prop;
 	uint16_t *pid = NULL;
-	char *p;
+	char *p, *save;
+
+	k = dvb_file_find_key(key);
 
 	/* Handle the DVBv5 DTV_foo properties */
-	for (i = 0; i < ARRAY_SIZE(dvb_v5_name); i++) {
-		if (!dvb_v5_name[i])
-			continue;
-		if (!strcasecmp(key, dvb_v5_name[i]))
-			break;
-	}
-	if (i < ARRAY_SIZE(dvb_v5_name)) {
-		const char * const *attr_name = dvb_attr_names(i);
+	if (k && k->type == KEY_V5_PROP) {
+		const char * const *attr_name;
+
+		i = k->cmd;
+		attr_name = dvb_attr_names(i);
 		n_prop = entry->n_props;
 		entry->props[n_prop].cmd = i;
 		if (!attr_name || !*attr_name)
@@ -604,37 +769,37 @@ static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 
 	/* Handle the other properties */
 
-	if (!strcasecmp(key, "SERVICE_ID")) {
+	if (k && k->type == KEY_SERVICE_ID) {
 		entry->service_id = atol(value);
 		return 0;
 	}
 
-	if (!strcasecmp(key, "VCHANNEL")) {
+	if (k && k->type == KEY_VCHANNEL) {
 		entry->vchannel = strdup(value);
 		return 0;
 	}
 
-	if (!strcasecmp(key, "SAT_NUMBER")) {
+	if (k && k->type == KEY_SAT_NUMBER) {
 		entry->sat_number = atol(value);
 		return 0;
 	}
 
-	if (!strcasecmp(key, "FREQ_BPF")) {
+	if (k && k->type == KEY_FREQ_BPF) {
 		entry->freq_bpf = atol(value);
 		return 0;
 	}
 
-	if (!strcasecmp(key, "DISEQC_WAIT")) {
+	if (k && k->type == KEY_DISEQC_WAIT) {
 		entry->diseqc_wait = atol(value);
 		return 0;
 	}
 
-	if (!strcasecmp(key, "LNB")) {
+	if (k && k->type == KEY_LNB) {
 		entry->lnb = strdup(value);
 		return 0;
 	}
 
-	if (!strcasecmp(key, "COUNTRY")) {
+	if (k && k->type == KEY_COUNTRY) {
 		enum dvb_country_t id = dvb_country_a2_to_id(value);
 		if (id == COUNTRY_UNKNOWN)
 			return -2;
@@ -642,11 +807,11 @@ static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 		return 0;
 	}
 
-	if (!strcasecmp(key, "VIDEO_PID"))
+	if (k && k->type == KEY_VIDEO_PID)
 		is_video = 1;
-	else if (!strcasecmp(key, "AUDIO_PID"))
+	else if (k && k->type == KEY_AUDIO_PID)
 		is_audio = 1;
-	else if (!strcasecmp(key, "POLARIZATION")) {
+	else if (k && k->type == KEY_POLARIZATION) {
 		for (j = 0; j < ARRAY_SIZE(dvb_sat_pol_name); j++)
 			if (dvb_sat_pol_name[j] && !strcasecmp(value, dvb_sat_pol_name[j]))
 				break;
@@ -661,7 +826,7 @@ static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 
 		len = 0;
 
-		p = strtok(value," \t");
+		p = strtok_r(value, " \t", &save);
 		if (!p)
 			return 0;
 		while (p) {
@@ -670,34 +835,25 @@ static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 						      sizeof (*entry->other_el_pid));
 			entry->other_el_pid[len].type = type;
 			entry->other_el_pid[len].pid = atol(p);
-			p = strtok(NULL, " \t\n");
+			p = strtok_r(NULL, " \t\n", &save);
 			len++;
 		}
 		entry->other_el_pid_len = len;
 	}
 
 	if (!is_video && !is_audio) {
-		int cmd = 0;
-
-		for (i = 0; i < DTV_USER_NAME_SIZE; i++) {
-			cmd = i + DTV_USER_COMMAND_START;
-
-			if (!strcasecmp(key, dvb_user_name[i]))
-				break;
-		}
-
 		/*
 		 * If the key is not known, just discard.
 		 * This way, it provides forward compatibility with new keys
 		 * that may be added in the future.
 		 */
 
-		if (i >= DTV_USER_NAME_SIZE)
+		if (!k || k->type != KEY_USER_PROP)
 			return 0;
 
 		/* FIXME: this works only for integer values */
 		n_prop = entry->n_props;
-		entry->props[n_prop].cmd = cmd;
+		entry->props[n_prop].cmd = k->cmd;
 		entry->props[n_prop].u.data = atol(value);
 		entry->n_props++;
 
@@ -708,13 +864,13 @@ static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 
 	len = 0;
 
-	p = strtok(value," \t");
+	p = strtok_r(value, " \t", &save);
 	if (!p)
 		return 0;
 	while (p) {
 		pid = realloc(pid, (len + 1) * sizeof (*pid));
 		pid[len] = atol(p);
-		p = strtok(NULL, " \t\n");
+		p = strtok_r(NULL, " \t\n", &save);
 		len++;
 	}
 
@@ -730,14 +886,13 @@ static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 }
 
 
-struct dvb_file *dvb_read_file(const char *fname)
+static struct dvb_file *read_file_fp(FILE *fd, const char *fname)
 {
-	char *buf = NULL, *p, *key, *value;
+	char *buf = NULL, *p, *key, *value, *save;
 	size_t size = 0;
 	int len = 0;
 	int line = 0, rc;
 	struct dvb_file *dvb_file;
-	FILE *fd;
 	struct dvb_entry *entry = NULL;
 	char err_msg[80];
 
@@ -747,13 +902,6 @@ struct dvb_file *dvb_read_file(const char *fname)
 		return NULL;
 	}
 
-	fd = fopen(fname, "r");
-	if (!fd) {
-		perror(fname);
-		free(dvb_file);
-		return NULL;
-	}
-
 	do {
 		len = getline(&buf, &size, fd);
 		if (len <= 0)
@@ -777,7 +925,7 @@ struct dvb_file *dvb_read_file(const char *fname)
 			}
 			entry->sat_number = -1;
 			p++;
-			p = strtok(p, "]");
+			p = strtok_r(p, "]", &save);
 			if (!p) {
 				sprintf(err_msg, _("Missing channel group"));
 				goto error;
@@ -795,7 +943,7 @@ struct dvb_file *dvb_read_file(const char *fname)
 				sprintf(err_msg, _("key/value without a channel group"));
 				goto error;
 			}
-			key = strtok(p, "=");
+			key = strtok_r(p, "=", &save);
 			if (!key) {
 				sprintf(err_msg, _("missing key"));
 				goto error;
@@ -804,7 +952,7 @@ struct dvb_file *dvb_read_file(const char *fname)
 			while ((p > key) && (*(p - 1) == ' ' || *(p - 1) == '\t'))
 				p--;
 			*p = 0;
-			value = strtok(NULL, "\n");
+			value = strtok_r(NULL, "\n", &save);
 			if (!value) {
 				sprintf(err_msg, _("missing value"));
 				goto error;
@@ -824,7 +972,6 @@ struct dvb_file *dvb_read_file(const char *fname)
 		free(buf);
 	if (entry)
 		adjust_delsys(entry);
-	fclose(fd);
 	return dvb_file;
 
 error:
@@ -833,21 +980,29 @@ error:
 	if (buf)
 		free(buf);
 	dvb_file_free(dvb_file);
-	fclose(fd);
 	return NULL;
 };
 
-int dvb_write_file(const char *fname, struct dvb_file *dvb_file)
+struct dvb_file *dvb_read_file(const char *fname)
 {
-	FILE *fp;
-	int i;
-	struct dvb_entry *entry = dvb_file->first_entry;
+	struct dvb_file *dvb_file;
+	FILE *fd;
 
-	fp = fopen(fname, "w");
-	if (!fp) {
+	fd = fopen(fname, "r");
+	if (!fd) {
 		perror(fname);
-		return -errno;
+		return NULL;
 	}
+	dvb_file = read_file_fp(fd, fname);
+	fclose(fd);
+
+	return dvb_file;
+}
+
+static int write_file_fp(FILE *fp, struct dvb_file *dvb_file)
+{
+	int i;
+	struct dvb_entry *entry;
 
 	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
 		adjust_delsys(entry);
@@ -856,24 +1011,24 @@ int dvb_write_file(const char *fname, struct dvb_file *dvb_file)
 			if (entry->vchannel)
 				fprintf(fp, "\tVCHANNEL = %s\n", entry->vchannel);
 		} else {
-			fprintf(fp, "[CHANNEL]\n");
+			fputs("[CHANNEL]\n", fp);
 		}
 
 		if (entry->service_id)
 			fprintf(fp, "\tSERVICE_ID = %d\n", entry->service_id);
 
 		if (entry->video_pid_len){
-			fprintf(fp, "\tVIDEO_PID =");
+			fputs("\tVIDEO_PID =", fp);
 			for (i = 0; i < entry->video_pid_len; i++)
 				fprintf(fp, " %d", entry->video_pid[i]);
-			fprintf(fp, "\n");
+			fputc('\n', fp);
 		}
 
 		if (entry->audio_pid_len) {
-			fprintf(fp, "\tAUDIO_PID =");
+			fputs("\tAUDIO_PID =", fp);
 			for (i = 0; i < entry->audio_pid_len; i++)
 				fprintf(fp, " %d", entry->audio_pid[i]);
-			fprintf(fp, "\n");
+			fputc('\n', fp);
 		}
 
 		if (entry->other_el_pid_len) {
@@ -882,12 +1037,12 @@ int dvb_write_file(const char *fname, struct dvb_file *dvb_file)
 				if (type != entry->other_el_pid[i].type) {
 					type = entry->other_el_pid[i].type;
 					if (i)
-						fprintf(fp, "\n");
+						fputc('\n', fp);
 					fprintf(fp, "\tPID_%02x =", type);
 				}
 				fprintf(fp, " %d", entry->other_el_pid[i].pid);
 			}
-			fprintf(fp, "\n");
+			fputc('\n', fp);
 		}
 
 		if (entry->sat_number >= 0) {
@@ -943,12 +1098,27 @@ int dvb_write_file(const char *fname, struct dvb_file *dvb_file)
 					dvb_cmd_name(entry->props[i].cmd),
 					*attr_name);
 		}
-		fprintf(fp, "\n");
+		fputc('\n', fp);
 	}
-	fclose(fp);
 	return 0;
 };
 
+int dvb_write_file(const char *fname, struct dvb_file *dvb_file)
+{
+	FILE *fp;
+	int ret;
+
+	fp = fopen(fname, "w");
+	if (!fp) {
+		perror(fname);
+		return -errno;
+	}
+	ret = write_file_fp(fp, dvb_file);
+	fclose(fp);
+
+	return ret;
+}
+
 static char *dvb_vchannel(struct dvb_v5_fe_parms_priv *parms,
 			  struct dvb_table_nit *nit, uint16_t service_id)
 {
@@ -1434,25 +1604,25 @@ int dvb_parse_delsys(const char *name)
 	return -1;
 }
 
-struct dvb_file *dvb_read_file_format(const char *fname,
-				  uint32_t delsys,
-				  enum dvb_file_formats format)
+struct dvb_file *dvb_read_file_format_fp(FILE *fp, const char *fname,
+					 uint32_t delsys,
+					 enum dvb_file_formats format)
 {
 	struct dvb_file *dvb_file;
 
 	switch (format) {
 	case FILE_CHANNEL:		/* DVB channel/transponder old format */
-		dvb_file = dvb_parse_format_oneline(fname,
-						    SYS_UNDEFINED,
-						    &channel_file_format);
+		dvb_file = parse_format_oneline_fp(fp, fname,
+						   SYS_UNDEFINED,
+						   &channel_file_format);
 		break;
 	case FILE_ZAP:
-		dvb_file = dvb_parse_format_oneline(fname,
-						    delsys,
-						    &channel_file_zap_format);
+		dvb_file = parse_format_oneline_fp(fp, fname,
+						   delsys,
+						   &channel_file_zap_format);
 		break;
 	case FILE_DVBV5:
-		dvb_file = dvb_read_file(fname);
+		dvb_file = read_file_fp(fp, fname);
 		break;
 	case FILE_VDR:
 		/* FIXME: add support for VDR input */
@@ -1466,31 +1636,622 @@ struct dvb_file *dvb_read_file_format(const char *fname,
 	return dvb_file;
 }
 
-int dvb_write_file_format(const char *fname,
-			  struct dvb_file *dvb_file,
-			  uint32_t delsys,
-			  enum dvb_file_formats format)
+struct dvb_file *dvb_read_file_format(const char *fname,
+				  uint32_t delsys,
+				  enum dvb_file_formats format)
+{
+	struct dvb_file *dvb_file;
+	FILE *fp;
+
+	fp = fopen(fname, "r");
+	if (!fp) {
+		perror(fname);
+		return NULL;
+	}
+	dvb_file = dvb_read_file_format_fp(fp, fname, delsys, format);
+	fclose(fp);
+
+	return dvb_file;
+}
+
+/*
+ * Channel index
+ *
+ * Open addressing hash tables, all allocated on a single block, in order
+ * to allow the inlined dvb_file_free() to release it with a free().
+ */
+
+enum dvb_file_index_type {
+	INDEX_CHANNEL,
+	INDEX_VCHANNEL,
+	INDEX_CHANNEL_NOCASE,
+	INDEX_SERVICE_ID,
+	INDEX_FREQUENCY,
+
+	INDEX_MAX
+};
+
+struct dvb_file_slot {
+	uint32_t hash;
+	uint32_t pos;		/* entry position + 1. Zero if empty */
+};
+
+struct dvb_file_index {
+	struct dvb_entry *first_entry;
+	struct dvb_entry *last_entry;
+	unsigned n_entries;
+	unsigned bits;
+	struct dvb_entry **entries;
+	uint32_t *freq;
+	struct dvb_file_slot *table[INDEX_MAX];
+};
+
+static uint32_t dvb_file_hash_str(const char *s, int nocase)
+{
+	uint32_t h = 2166136261u;
+
+	for (; *s; s++)
+		h = (h ^ (nocase ? tolower((unsigned char)*s) :
+				   (unsigned char)*s)) * 16777619u;
+	return h;
+}
+
+static int dvb_file_index_match(struct dvb_file_index *idx,
+				enum dvb_file_index_type type,
+				struct dvb_file_slot *slot, uint32_t hash,
+				const char *name)
+{
+	struct dvb_entry *entry = idx->entries[slot->pos - 1];
+
+	if (slot->hash != hash)
+		return 0;
+
+	switch (type) {
+	case INDEX_CHANNEL:
+		return !strcmp(entry->channel, name);
+	case INDEX_VCHANNEL:
+		return !strcmp(entry->vchannel, name);
+	case INDEX_CHANNEL_NOCASE:
+		return !strcasecmp(entry->channel, name);
+	default:
+		/* For numeric keys, the hash is the value itself */
+		return 1;
+	}
+}
+
+static uint32_t dvb_file_index_lookup(struct dvb_file_index *idx,
+				      enum dvb_file_index_type type,
+				      uint32_t hash, const char *name)
+{
+	struct dvb_file_slot *table = idx->table[type];
+	unsigned mask = (1 << idx->bits) - 1;
+	unsigned i = (hash * 2654435761u) >> (32 - idx->bits);
+
+	for (; table[i].pos; i = (i + 1) & mask) {
+		if (dvb_file_index_match(idx, type, &table[i], hash, name))
+			return table[i].pos;
+	}
+	return 0;
+}
+
+static void dvb_file_index_add(struct dvb_file_index *idx,
+			       enum dvb_file_index_type type,
+			       uint32_t hash, const char *name, uint32_t pos)
+{
+	struct dvb_file_slot *table = idx->table[type];
+	unsigned mask = (1 << idx->bits) - 1;
+	unsigned i = (hash * 2654435761u) >> (32 - idx->bits);
+
+	/* When more entries have the same key, the first one is kept */
+	for (; table[i].pos; i = (i + 1) & mask) {
+		if (dvb_file_index_match(idx, type, &table[i], hash, name))
+			return;
+	}
+	table[i].hash = hash;
+	table[i].pos = pos;
+}
+
+static struct dvb_file_index *dvb_file_get_index(struct dvb_file *dvb_file)
+{
+	struct dvb_file_index *idx = dvb_file->index;
+	struct dvb_entry *entry, *last = NULL;
+	unsigned n = 0, bits, i, size;
+	size_t len;
+	uint8_t *p;
+
+	/* The index is rebuilt if entries were added to the file */
+	if (idx && idx->first_entry == dvb_file->first_entry &&
+	    (!idx->last_entry || !idx->last_entry->next))
+		return idx;
+
+	free(dvb_file->index);
+	dvb_file->index = NULL;
+
+	for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+		last = entry;
+		n++;
+	}
+
+	/* Keep the tables at most half full */
+	for (bits = 4; (1U << bits) < 2 * n; bits++);
+	size = 1 << bits;
+
+	len = sizeof(*idx) + n * (sizeof(*idx->entries) + sizeof(*idx->freq)) +
+	      INDEX_MAX * size * sizeof(struct dvb_file_slot);
+	idx = calloc(1, len);
+	if (!idx)
+		return NULL;
+
+	p = (uint8_t *)(idx + 1);
+	for (i = 0; i < INDEX_MAX; i++) {
+		idx->table[i] = (struct dvb_file_slot *)p;
+		p += size * sizeof(struct dvb_file_slot);
+	}
+	idx->entries = (struct dvb_entry **)p;
+	p += n * sizeof(*idx->entries);
+	idx->freq = (uint32_t *)p;
+
+	idx->first_entry = dvb_file->first_entry;
+	idx->last_entry = last;
+	idx->n_entries = n;
+	idx->bits = bits;
+
+	for (i = 0, entry = dvb_file->first_entry; entry; entry = entry->next, i++) {
+		idx->entries[i] = entry;
+		if (entry->channel) {
+			dvb_file_index_add(idx, INDEX_CHANNEL,
+					   dvb_file_hash_str(entry->channel, 0),
+					   entry->channel, i + 1);
+			dvb_file_index_add(idx, INDEX_CHANNEL_NOCASE,
+					   dvb_file_hash_str(entry->channel, 1),
+					   entry->channel, i + 1);
+		}
+		if (entry->vchannel)
+			dvb_file_index_add(idx, INDEX_VCHANNEL,
+					   dvb_file_hash_str(entry->vchannel, 0),
+					   entry->vchannel, i + 1);
+		dvb_file_index_add(idx, INDEX_SERVICE_ID, entry->service_id,
+				   NULL, i + 1);
+		if (!dvb_retrieve_entry_prop(entry, DTV_FREQUENCY, &idx->freq[i]))
+			dvb_file_index_add(idx, INDEX_FREQUENCY, idx->freq[i],
+					   NULL, i + 1);
+	}
+
+	dvb_file->index = idx;
+	return idx;
+}
+
+struct dvb_entry *dvb_file_find_channel(struct dvb_file *dvb_file,
+					const char *name)
+{
+	struct dvb_file_index *idx = dvb_file_get_index(dvb_file);
+	struct dvb_entry *entry;
+	uint32_t pos, vpos;
+
+	if (!idx) {
+		for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+			if (entry->channel && !strcmp(entry->channel, name))
+				return entry;
+			if (entry->vchannel && !strcmp(entry->vchannel, name))
+				return entry;
+		}
+		for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+			if (entry->channel && !strcasecmp(entry->channel, name))
+				return entry;
+		}
+		return NULL;
+	}
+
+	/* The first entry on the file matching either name wins */
+	pos = dvb_file_index_lookup(idx, INDEX_CHANNEL,
+				    dvb_file_hash_str(name, 0), name);
+	vpos = dvb_file_index_lookup(idx, INDEX_VCHANNEL,
+				     dvb_file_hash_str(name, 0), name);
+	if (vpos && (!pos || vpos < pos))
+		pos = vpos;
+
+	/* Give a second shot, using a case insensitive seek */
+	if (!pos)
+		pos = dvb_file_index_lookup(idx, INDEX_CHANNEL_NOCASE,
+					    dvb_file_hash_str(name, 1), name);
+
+	return pos ? idx->entries[pos - 1] : NULL;
+}
+
+struct dvb_entry *dvb_file_find_service(struct dvb_file *dvb_file,
+					uint16_t service_id)
+{
+	struct dvb_file_index *idx = dvb_file_get_index(dvb_file);
+	struct dvb_entry *entry;
+	uint32_t pos;
+
+	if (!idx) {
+		for (entry = dvb_file->first_entry; entry; entry = entry->next)
+			if (entry->service_id == service_id)
+				return entry;
+		return NULL;
+	}
+
+	pos = dvb_file_index_lookup(idx, INDEX_SERVICE_ID, service_id, NULL);
+	return pos ? idx->entries[pos - 1] : NULL;
+}
+
+struct dvb_entry *dvb_file_find_freq(struct dvb_file *dvb_file,
+				     uint32_t freq)
+{
+	struct dvb_file_index *idx = dvb_file_get_index(dvb_file);
+	struct dvb_entry *entry;
+	uint32_t pos, f;
+
+	if (!idx) {
+		for (entry = dvb_file->first_entry; entry; entry = entry->next)
+			if (!dvb_retrieve_entry_prop(entry, DTV_FREQUENCY, &f) &&
+			    f == freq)
+				return entry;
+		return NULL;
+	}
+
+	pos = dvb_file_index_lookup(idx, INDEX_FREQUENCY, freq, NULL);
+	return pos ? idx->entries[pos - 1] : NULL;
+}
+
+/*
+ * Binary cache
+ *
+ * It stores the parsed entries, together with the size and modification
+ * time of the original file. It is meant to be used only at the machine
+ * that wrote it, so the numbers are stored on the CPU endianness.
+ */
+
+#define DVB_FILE_CACHE_MAGIC	"DVBV5CCH"
+#define DVB_FILE_CACHE_VERSION	1
+#define DVB_FILE_CACHE_ENDIAN	0x01020304
+
+struct dvb_file_cache_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t format;
+	uint32_t delsys;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint32_t n_entries;
+	uint32_t reserved;
+};
+
+struct dvb_file_cache_buf {
+	uint8_t *data;
+	size_t len, size;
+	int err;
+};
+
+static void cache_put(struct dvb_file_cache_buf *b, const void *p, size_t len)
+{
+	if (b->err)
+		return;
+	if (b->len + len > b->size) {
+		size_t size = b->size ? b->size : 65536;
+		uint8_t *data;
+
+		while (size < b->len + len)
+			size *= 2;
+		data = realloc(b->data, size);
+		if (!data) {
+			b->err = 1;
+			return;
+		}
+		b->data = data;
+		b->size = size;
+	}
+	memcpy(b->data + b->len, p, len);
+	b->len += len;
+}
+
+static void cache_put_u32(struct dvb_file_cache_buf *b, uint32_t val)
+{
+	cache_put(b, &val, sizeof(val));
+}
+
+static void cache_put_str(struct dvb_file_cache_buf *b, const char *s)
+{
+	if (!s) {
+		cache_put_u32(b, 0xffffffff);
+		return;
+	}
+	cache_put_u32(b, strlen(s));
+	cache_put(b, s, strlen(s));
+}
+
+struct dvb_file_cache_cursor {
+	const uint8_t *p, *end;
+	int err;
+};
+
+static void *cache_get(struct dvb_file_cache_cursor *c, void *dst, size_t len)
+{
+	if (c->err || (size_t)(c->end - c->p) < len) {
+		c->err = 1;
+		return NULL;
+	}
+	if (dst)
+		memcpy(dst, c->p, len);
+	c->p += len;
+	return dst;
+}
+
+static uint32_t cache_get_u32(struct dvb_file_cache_cursor *c)
+{
+	uint32_t val = 0;
+
+	cache_get(c, &val, sizeof(val));
+	return val;
+}
+
+static char *cache_get_str(struct dvb_file_cache_cursor *c)
+{
+	uint32_t len = cache_get_u32(c);
+	char *s;
+
+	if (c->err || len == 0xffffffff)
+		return NULL;
+	if ((size_t)(c->end - c->p) < len) {
+		c->err = 1;
+		return NULL;
+	}
+	s = malloc(len + 1);
+	if (!s) {
+		c->err = 1;
+		return NULL;
+	}
+	cache_get(c, s, len);
+	s[len] = '\0';
+	return s;
+}
+
+static void *cache_get_array(struct dvb_file_cache_cursor *c, unsigned n,
+			     size_t elsize)
+{
+	void *p;
+
+	if (!n || c->err)
+		return NULL;
+	if ((size_t)(c->end - c->p) / elsize < n) {
+		c->err = 1;
+		return NULL;
+	}
+	p = malloc(n * elsize);
+	if (!p) {
+		c->err = 1;
+		return NULL;
+	}
+	return cache_get(c, p, n * elsize);
+}
+
+static void dvb_file_cache_fill_hdr(struct dvb_file_cache_hdr *hdr,
+				    struct stat *st, uint32_t delsys,
+				    enum dvb_file_formats format)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, DVB_FILE_CACHE_MAGIC, sizeof(hdr->magic));
+	hdr->version = DVB_FILE_CACHE_VERSION;
+	hdr->endian = DVB_FILE_CACHE_ENDIAN;
+	hdr->format = format;
+	hdr->delsys = delsys;
+	hdr->size = st->st_size;
+	hdr->mtime_sec = st->st_mtim.tv_sec;
+	hdr->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+static struct dvb_file *dvb_file_cache_load(const char *cache_fname,
+					    struct stat *st, uint32_t delsys,
+					    enum dvb_file_formats format)
+{
+	struct dvb_file_cache_hdr hdr, expected;
+	struct dvb_file_cache_cursor c;
+	struct dvb_file *dvb_file = NULL;
+	struct dvb_entry *entry, **tail;
+	struct stat cache_st;
+	void *map;
+	uint32_t i, j;
+	int fd;
+
+	fd = open(cache_fname, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &cache_st) < 0 || cache_st.st_size < (off_t)sizeof(hdr)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	c.p = map;
+	c.end = c.p + cache_st.st_size;
+	c.err = 0;
+
+	cache_get(&c, &hdr, sizeof(hdr));
+	dvb_file_cache_fill_hdr(&expected, st, delsys, format);
+	expected.n_entries = hdr.n_entries;
+	if (memcmp(&hdr, &expected, sizeof(hdr)))
+		goto out;
+
+	dvb_file = calloc(sizeof(*dvb_file), 1);
+	if (!dvb_file)
+		goto out;
+	tail = &dvb_file->first_entry;
+
+	for (i = 0; i < hdr.n_entries && !c.err; i++) {
+		entry = calloc(sizeof(*entry), 1);
+		if (!entry) {
+			c.err = 1;
+			break;
+		}
+		*tail = entry;
+		tail = &entry->next;
+
+		entry->n_props = cache_get_u32(&c);
+		if (entry->n_props > DTV_MAX_COMMAND) {
+			c.err = 1;
+			break;
+		}
+		for (j = 0; j < entry->n_props; j++) {
+			entry->props[j].cmd = cache_get_u32(&c);
+			entry->props[j].u.data = cache_get_u32(&c);
+		}
+		entry->service_id = cache_get_u32(&c);
+		entry->sat_number = cache_get_u32(&c);
+		entry->freq_bpf = cache_get_u32(&c);
+		entry->diseqc_wait = cache_get_u32(&c);
+
+		entry->video_pid_len = cache_get_u32(&c);
+		entry->video_pid = cache_get_array(&c, entry->video_pid_len,
+						   sizeof(*entry->video_pid));
+		entry->audio_pid_len = cache_get_u32(&c);
+		entry->audio_pid = cache_get_array(&c, entry->audio_pid_len,
+						   sizeof(*entry->audio_pid));
+		entry->other_el_pid_len = cache_get_u32(&c);
+		entry->other_el_pid = cache_get_array(&c, entry->other_el_pid_len,
+						      sizeof(*entry->other_el_pid));
+
+		entry->channel = cache_get_str(&c);
+		entry->vchannel = cache_get_str(&c);
+		entry->location = cache_get_str(&c);
+		entry->lnb = cache_get_str(&c);
+	}
+	dvb_file->n_entries = i;
+
+	if (c.err || c.p != c.end) {
+		dvb_file_free(dvb_file);
+		dvb_file = NULL;
+	}
+out:
+	munmap(map, cache_st.st_size);
+	return dvb_file;
+}
+
+static int dvb_file_cache_store(const char *cache_fname,
+				struct dvb_file *dvb_file, struct stat *st,
+				uint32_t delsys, enum dvb_file_formats format)
+{
+	struct dvb_file_cache_buf b = { NULL, 0, 0, 0 };
+	struct dvb_file_cache_hdr hdr;
+	struct dvb_entry *entry;
+	char tmp_fname[strlen(cache_fname) + 16];
+	unsigned j;
+	ssize_t ret = 0;
+	size_t pos;
+	int fd;
+
+	dvb_file_cache_fill_hdr(&hdr, st, delsys, format);
+	cache_put(&b, &hdr, sizeof(hdr));
+
+	for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+		cache_put_u32(&b, entry->n_props);
+		for (j = 0; j < entry->n_props; j++) {
+			cache_put_u32(&b, entry->props[j].cmd);
+			cache_put_u32(&b, entry->props[j].u.data);
+		}
+		cache_put_u32(&b, entry->service_id);
+		cache_put_u32(&b, entry->sat_number);
+		cache_put_u32(&b, entry->freq_bpf);
+		cache_put_u32(&b, entry->diseqc_wait);
+
+		cache_put_u32(&b, entry->video_pid_len);
+		cache_put(&b, entry->video_pid,
+			  entry->video_pid_len * sizeof(*entry->video_pid));
+		cache_put_u32(&b, entry->audio_pid_len);
+		cache_put(&b, entry->audio_pid,
+			  entry->audio_pid_len * sizeof(*entry->audio_pid));
+		cache_put_u32(&b, entry->other_el_pid_len);
+		cache_put(&b, entry->other_el_pid,
+			  entry->other_el_pid_len * sizeof(*entry->other_el_pid));
+
+		cache_put_str(&b, entry->channel);
+		cache_put_str(&b, entry->vchannel);
+		cache_put_str(&b, entry->location);
+		cache_put_str(&b, entry->lnb);
+
+		hdr.n_entries++;
+	}
+	if (b.err) {
+		free(b.data);
+		return -ENOMEM;
+	}
+	memcpy(b.data, &hdr, sizeof(hdr));
+
+	/* Write to a temporary file, as other instances may be reading it */
+	snprintf(tmp_fname, sizeof(tmp_fname), "%s.%d", cache_fname,
+		 (int)getpid());
+	fd = open(tmp_fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		free(b.data);
+		return -errno;
+	}
+	for (pos = 0; pos < b.len; pos += ret) {
+		ret = write(fd, b.data + pos, b.len - pos);
+		if (ret <= 0)
+			break;
+	}
+	free(b.data);
+	if (close(fd) < 0 || pos < b.len || rename(tmp_fname, cache_fname) < 0) {
+		ret = -errno;
+		unlink(tmp_fname);
+		return ret ? ret : -EIO;
+	}
+
+	return 0;
+}
+
+struct dvb_file *dvb_read_file_format_cached(const char *fname,
+					     uint32_t delsys,
+					     enum dvb_file_formats format,
+					     const char *cache_fname)
+{
+	struct dvb_file *dvb_file;
+	struct stat st;
+
+	if (!cache_fname || stat(fname, &st) < 0)
+		return dvb_read_file_format(fname, delsys, format);
+
+	dvb_file = dvb_file_cache_load(cache_fname, &st, delsys, format);
+	if (dvb_file)
+		return dvb_file;
+
+	dvb_file = dvb_read_file_format(fname, delsys, format);
+	if (dvb_file)
+		dvb_file_cache_store(cache_fname, dvb_file, &st, delsys, format);
+
+	return dvb_file;
+}
+
+int dvb_write_file_format_fp(FILE *fp, const char *fname,
+			     struct dvb_file *dvb_file,
+			     uint32_t delsys,
+			     enum dvb_file_formats format)
 {
 	int ret;
 
 	switch (format) {
 	case FILE_CHANNEL:		/* DVB channel/transponder old format */
-		ret = dvb_write_format_oneline(fname,
-					       dvb_file,
-					       SYS_UNDEFINED,
-					       &channel_file_format);
+		ret = write_format_oneline_fp(fp, fname,
+					      dvb_file,
+					      SYS_UNDEFINED,
+					      &channel_file_format);
 		break;
 	case FILE_ZAP:
-		ret = dvb_write_format_oneline(fname,
-					       dvb_file,
-					       delsys,
-					       &channel_file_zap_format);
+		ret = write_format_oneline_fp(fp, fname,
+					      dvb_file,
+					      delsys,
+					      &channel_file_zap_format);
 		break;
 	case FILE_DVBV5:
-		ret = dvb_write_file(fname, dvb_file);
+		ret = write_file_fp(fp, dvb_file);
 		break;
 	case FILE_VDR:
-		ret = dvb_write_format_vdr(fname, dvb_file);
+		ret = dvb_write_format_vdr_fp(fp, fname, dvb_file);
 		break;
 	default:
 		return -1;
@@ -1498,3 +2259,25 @@ int dvb_write_file_format(const char *fname,
 
 	return ret;
 }
+
+int dvb_write_file_format(const char *fname,
+			  struct dvb_file *dvb_file,
+			  uint32_t delsys,
+			  enum dvb_file_formats format)
+{
+	FILE *fp;
+	int ret;
+
+	if (format == FILE_UNKNOWN || format > FILE_VDR)
+		return -1;
+
+	fp = fopen(fname, "w");
+	if (!fp) {
+		perror(fname);
+		return -errno;
+	}
+	ret = dvb_write_file_format_fp(fp, fname, dvb_file, delsys, format);
+	fclose(fp);
+
+	return ret;
+}
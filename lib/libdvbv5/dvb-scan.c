@@ -30,7 +30,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -38,6 +40,7 @@
 #include <sys/time.h>
 
 #include "dvb-fe-priv.h"
+#include "dvb-dev-priv.h"
 #include <libdvbv5/dvb-scan.h>
 #include <libdvbv5/dvb-frontend.h>
 #include <libdvbv5/descriptors.h>
@@ -74,12 +77,78 @@
 
 # define N_(string) string
 
+/*
+ * Backends that emulate the demux, like dvb-dev-file.c, don't have a
+ * Kernel file descriptor: the fd is just an ID of their open descriptor.
+ */
+static struct dvb_open_descriptor *dvb_scan_emulated_dmx(struct dvb_v5_fe_parms_priv *parms,
+							 int fd)
+{
+	struct dvb_device_priv *dvb = parms->dvb;
+	struct dvb_open_descriptor *cur;
+
+	if (!dvb || !dvb->ops.dmx_poll)
+		return NULL;
+
+	for (cur = dvb->open_list.next; cur; cur = cur->next) {
+		if (cur->fd == fd)
+			return cur;
+	}
+	return NULL;
+}
+
+static int dvb_scan_set_filter(struct dvb_v5_fe_parms_priv *parms, int fd,
+			       struct dvb_table_filter *sect)
+{
+	struct dvb_open_descriptor *open_dev = dvb_scan_emulated_dmx(parms, fd);
+	uint8_t mask = 0xff;
+
+	if (open_dev)
+		return dvb_dev_dmx_set_section_filter(open_dev, sect->pid, 1,
+						      &sect->tid, &mask, NULL,
+						      DMX_IMMEDIATE_START | DMX_CHECK_CRC);
+
+	return dvb_set_section_filter(fd, sect->pid, 1, &sect->tid, &mask,
+				      NULL, DMX_IMMEDIATE_START | DMX_CHECK_CRC);
+}
+
+static void dvb_scan_dmx_stop(struct dvb_v5_fe_parms_priv *parms, int fd)
+{
+	struct dvb_open_descriptor *open_dev = dvb_scan_emulated_dmx(parms, fd);
+
+	if (open_dev)
+		dvb_dev_dmx_stop(open_dev);
+	else
+		dvb_dmx_stop(fd);
+}
+
+static ssize_t dvb_scan_read(struct dvb_v5_fe_parms_priv *parms, int fd,
+			     void *buf, size_t count)
+{
+	struct dvb_open_descriptor *open_dev = dvb_scan_emulated_dmx(parms, fd);
+	ssize_t ret;
+
+	if (!open_dev)
+		return read(fd, buf, count);
+
+	ret = dvb_dev_read(open_dev, buf, count);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
 static int dvb_poll(struct dvb_v5_fe_parms_priv *parms, int fd, unsigned int seconds)
 {
+	struct dvb_open_descriptor *open_dev = dvb_scan_emulated_dmx(parms, fd);
 	fd_set set;
 	struct timeval timeout;
 	int ret;
 
+	if (open_dev)
+		return parms->dvb->ops.dmx_poll(open_dev, seconds * 1000);
+
 	/* Initialize the file descriptor set. */
 	FD_ZERO (&set);
 	FD_SET (fd, &set);
@@ -301,6 +370,245 @@ ret:
 	return 1;
 }
 
+/*
+ * Section cache: keeps the raw sections of each table extension that was
+ * completely read. When the first section of a table arrives with the
+ * same version as a cached one, the cached sections are parsed instead of
+ * waiting for the others to be broadcasted again.
+ *
+ * The same PID, table ID, extension and version can be found on other
+ * transponders, with a different content. So, the entries are also
+ * indexed by the transponder tuned when the sections were read.
+ */
+
+struct dvb_section_cache_tp {
+	uint32_t delsys, freq, pol, stream_id;
+	int sat_number;
+};
+
+struct dvb_cached_section {
+	struct dvb_cached_section *next;
+	uint8_t section_id;
+	ssize_t len;
+	uint8_t data[];
+};
+
+struct dvb_section_cache {
+	struct dvb_section_cache *next;
+	struct dvb_section_cache_tp tp;
+	uint16_t pid;
+	uint8_t tid;
+	uint16_t ext_id;
+	uint8_t version;
+
+	int complete;	/* all sections are there */
+	int pending;	/* changed by the table being read */
+
+	struct dvb_cached_section *sections;
+};
+
+static void dvb_section_cache_clear(struct dvb_section_cache *c)
+{
+	struct dvb_cached_section *s, *next;
+
+	for (s = c->sections; s; s = next) {
+		next = s->next;
+		free(s);
+	}
+	c->sections = NULL;
+	c->complete = 0;
+}
+
+void dvb_section_cache_free(struct dvb_v5_fe_parms_priv *parms)
+{
+	struct dvb_section_cache *c, *next;
+
+	for (c = parms->section_cache; c; c = next) {
+		next = c->next;
+		dvb_section_cache_clear(c);
+		free(c);
+	}
+	parms->section_cache = NULL;
+}
+
+void dvb_scan_set_section_cache(struct dvb_v5_fe_parms *p, int enable)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+
+	parms->use_section_cache = enable;
+	if (!enable)
+		dvb_section_cache_free(parms);
+}
+
+static void dvb_section_cache_tp(struct dvb_v5_fe_parms_priv *parms,
+				 struct dvb_section_cache_tp *tp)
+{
+	int i;
+
+	memset(tp, 0, sizeof(*tp));
+	tp->delsys = parms->p.current_sys;
+	tp->sat_number = parms->p.sat_number;
+
+	/* Not all properties exist on all delivery systems */
+	for (i = 0; i < parms->n_props; i++) {
+		switch (parms->dvb_prop[i].cmd) {
+		case DTV_FREQUENCY:
+			tp->freq = parms->dvb_prop[i].u.data;
+			break;
+		case DTV_POLARIZATION:
+			tp->pol = parms->dvb_prop[i].u.data;
+			break;
+		case DTV_STREAM_ID:
+			tp->stream_id = parms->dvb_prop[i].u.data;
+			break;
+		}
+	}
+}
+
+static struct dvb_section_cache *dvb_section_cache_get(struct dvb_v5_fe_parms_priv *parms,
+						       uint16_t pid, uint8_t tid,
+						       uint16_t ext_id, int alloc)
+{
+	struct dvb_section_cache_tp tp;
+	struct dvb_section_cache *c;
+
+	dvb_section_cache_tp(parms, &tp);
+	for (c = parms->section_cache; c; c = c->next) {
+		if (c->pid == pid && c->tid == tid && c->ext_id == ext_id &&
+		    !memcmp(&c->tp, &tp, sizeof(tp)))
+			return c;
+	}
+	if (!alloc)
+		return NULL;
+
+	c = calloc(sizeof(*c), 1);
+	if (!c)
+		return NULL;
+	c->tp = tp;
+	c->pid = pid;
+	c->tid = tid;
+	c->ext_id = ext_id;
+	c->next = parms->section_cache;
+	parms->section_cache = c;
+
+	return c;
+}
+
+static void dvb_section_cache_add(struct dvb_section_cache *c,
+				  uint8_t section_id,
+				  const uint8_t *buf, ssize_t buf_length)
+{
+	struct dvb_cached_section *s, **p;
+
+	/* Keep the sections ordered and without duplicates */
+	for (p = &c->sections; *p; p = &(*p)->next) {
+		if ((*p)->section_id == section_id)
+			return;
+		if ((*p)->section_id > section_id)
+			break;
+	}
+
+	s = malloc(sizeof(*s) + buf_length);
+	if (!s)
+		return;
+	s->section_id = section_id;
+	s->len = buf_length;
+	memcpy(s->data, buf, buf_length);
+	s->next = *p;
+	*p = s;
+}
+
+static int dvb_filter_has_ext(struct dvb_table_filter *sect, uint16_t ext_id)
+{
+	struct dvb_table_filter_priv *priv = sect->priv;
+	int i, n;
+
+	if (!priv->extensions)
+		return 0;
+
+	/* The first extension is stored before num_extensions is updated */
+	n = priv->num_extensions ? priv->num_extensions : 1;
+	for (i = 0; i < n; i++) {
+		if (priv->extensions[i].ext_id == ext_id)
+			return 1;
+	}
+	return 0;
+}
+
+static int dvb_parse_section_cached(struct dvb_v5_fe_parms_priv *parms,
+				    struct dvb_table_filter *sect,
+				    const uint8_t *buf, ssize_t buf_length)
+{
+	struct dvb_table_header h;
+	struct dvb_section_cache *c;
+	struct dvb_cached_section *s;
+	int ret = 0;
+
+	/* Corrupted sections should neither be parsed nor cached */
+	if (dvb_crc32((uint8_t *)buf, buf_length, 0xFFFFFFFF)) {
+		dvb_logerr(_("%s: crc error"), __func__);
+		return -3;
+	}
+
+	if (!parms->use_section_cache ||
+	    buf_length < (ssize_t)(sizeof(h) + DVB_CRC_SIZE))
+		return dvb_parse_section(parms, sect, buf, buf_length);
+
+	memcpy(&h, buf, sizeof(h));
+	dvb_table_header_init(&h);
+	if (!h.current_next || h.table_id != sect->tid ||
+	    (sect->ts_id != -1 && h.id != sect->ts_id))
+		return dvb_parse_section(parms, sect, buf, buf_length);
+
+	c = dvb_section_cache_get(parms, sect->pid, h.table_id, h.id,
+				  !dvb_filter_has_ext(sect, h.id));
+	if (!c)
+		return dvb_parse_section(parms, sect, buf, buf_length);
+
+	if (c->complete && c->version == h.version) {
+		/* Already parsed on this read: just a repeated section */
+		if (dvb_filter_has_ext(sect, h.id))
+			return dvb_parse_section(parms, sect, buf, buf_length);
+
+		if (parms->p.verbose)
+			dvb_log(_("%s: table 0x%02x, extension ID 0x%04x, version %d: using cached sections"),
+				__func__, h.table_id, h.id, h.version);
+		for (s = c->sections; s && !ret; s = s->next)
+			ret = dvb_parse_section(parms, sect, s->data, s->len);
+		return ret;
+	}
+
+	if (c->version != h.version) {
+		dvb_section_cache_clear(c);
+		c->version = h.version;
+	}
+	c->pending = 1;
+	dvb_section_cache_add(c, h.section_id, buf, buf_length);
+
+	return dvb_parse_section(parms, sect, buf, buf_length);
+}
+
+/*
+ * Called when reading a table has finished. If the table is complete, its
+ * sections can be used by the next reads. Other filters may still be
+ * collecting other extensions of the same table, like several PMTs on one
+ * PID: only the extensions received by this filter are touched.
+ */
+static void dvb_section_cache_done(struct dvb_v5_fe_parms_priv *parms,
+				   struct dvb_table_filter *sect, int ret)
+{
+	struct dvb_section_cache *c;
+
+	for (c = parms->section_cache; c; c = c->next) {
+		if (!c->pending || c->pid != sect->pid || c->tid != sect->tid ||
+		    !dvb_filter_has_ext(sect, c->ext_id))
+			continue;
+		c->pending = 0;
+		if (ret > 0)
+			c->complete = 1;
+	}
+}
+
 int dvb_read_sections(struct dvb_v5_fe_parms *__p, int dmx_fd,
 			     struct dvb_table_filter *sect,
 			     unsigned timeout)
@@ -308,16 +616,13 @@ int dvb_read_sections(struct dvb_v5_fe_parms *__p, int dmx_fd,
 	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
 	int ret;
 	uint8_t *buf = NULL;
-	uint8_t mask = 0xff;
 
 	ret = dvb_parse_section_alloc(parms, sect);
 	if (ret < 0)
 		return ret;
 
-	if (dvb_set_section_filter(dmx_fd, sect->pid, 1,
-				   &sect->tid, &mask, NULL,
-				   DMX_IMMEDIATE_START | DMX_CHECK_CRC)) {
-		dvb_dmx_stop(dmx_fd);
+	if (dvb_scan_set_filter(parms, dmx_fd, sect)) {
+		dvb_scan_dmx_stop(parms, dmx_fd);
 		return -1;
 	}
 	if (parms->p.verbose)
@@ -327,7 +632,7 @@ int dvb_read_sections(struct dvb_v5_fe_parms *__p, int dmx_fd,
 	buf = calloc(DVB_MAX_PAYLOAD_PACKET_SIZE, 1);
 	if (!buf) {
 		dvb_logerr(_("%s: out of memory"), __func__);
-		dvb_dmx_stop(dmx_fd);
+		dvb_scan_dmx_stop(parms, dmx_fd);
 		dvb_table_filter_free(sect);
 		return -1;
 	}
@@ -335,7 +640,6 @@ int dvb_read_sections(struct dvb_v5_fe_parms *__p, int dmx_fd,
 
 	do {
 		int available;
-		uint32_t crc;
 		ssize_t buf_length = 0;
 
 		do {
@@ -351,7 +655,8 @@ int dvb_read_sections(struct dvb_v5_fe_parms *__p, int dmx_fd,
 			ret = -1;
 			break;
 		}
-		buf_length = read(dmx_fd, buf, DVB_MAX_PAYLOAD_PACKET_SIZE);
+		buf_length = dvb_scan_read(parms, dmx_fd, buf,
+					   DVB_MAX_PAYLOAD_PACKET_SIZE);
 
 		if (!buf_length) {
 			dvb_logerr(_("%s: buf returned an empty buffer"), __func__);
@@ -364,17 +669,11 @@ int dvb_read_sections(struct dvb_v5_fe_parms *__p, int dmx_fd,
 			break;
 		}
 
-		crc = dvb_crc32(buf, buf_length, 0xFFFFFFFF);
-		if (crc != 0) {
-			dvb_logerr(_("%s: crc error"), __func__);
-			ret = -3;
-			break;
-		}
-
-		ret = dvb_parse_section(parms, sect, buf, buf_length);
+		ret = dvb_parse_section_cached(parms, sect, buf, buf_length);
 	} while (!ret);
 	free(buf);
-	dvb_dmx_stop(dmx_fd);
+	dvb_scan_dmx_stop(parms, dmx_fd);
+	dvb_section_cache_done(parms, sect, ret);
 	dvb_table_filter_free(sect);
 
 	if (ret > 0)
@@ -383,6 +682,32 @@ int dvb_read_sections(struct dvb_v5_fe_parms *__p, int dmx_fd,
 	return ret;
 }
 
+int dvb_table_filter_parse(struct dvb_v5_fe_parms *__p,
+			   struct dvb_table_filter *sect,
+			   const uint8_t *buf, ssize_t buf_length)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
+	int ret;
+
+	if (!sect->priv) {
+		ret = dvb_parse_section_alloc(parms, sect);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* The demux driver never returns a section smaller than that */
+	if (buf_length < (ssize_t)(sizeof(struct dvb_table_header) + DVB_CRC_SIZE)) {
+		dvb_logerr(_("%s: section too short"), __func__);
+		return -1;
+	}
+
+	ret = dvb_parse_section_cached(parms, sect, buf, buf_length);
+	if (ret)
+		dvb_section_cache_done(parms, sect, ret);
+
+	return ret;
+}
+
 int dvb_read_section_with_id(struct dvb_v5_fe_parms *parms, int dmx_fd,
 			     unsigned char tid, uint16_t pid,
 			     int ts_id,
@@ -399,6 +724,294 @@ int dvb_read_section_with_id(struct dvb_v5_fe_parms *parms, int dmx_fd,
 	return dvb_read_sections(parms, dmx_fd, &tab, timeout);
 }
 
+/*
+ * Parallel table reading: each table gets its own demux filter, and all
+ * of them are read from a single poll loop.
+ */
+
+struct dvb_table_job {
+	struct dvb_table_filter sect;
+	unsigned timeout;
+	int ret;
+};
+
+void dvb_scan_set_table_filters(struct dvb_v5_fe_parms *p,
+				unsigned num_filters)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+
+	parms->table_filters = num_filters;
+}
+
+static uint64_t dvb_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Opening the demux device again gives a new, independent filter. As the
+ * caller only gives us a file descriptor, re-open it via procfs.
+ */
+static int dvb_reopen_demux(struct dvb_v5_fe_parms_priv *parms, int dmx_fd)
+{
+	struct dvb_open_descriptor *open_dev = dvb_scan_emulated_dmx(parms, dmx_fd);
+	char name[32];
+
+	if (open_dev) {
+		open_dev = dvb_dev_open(&parms->dvb->d, open_dev->dev->sysname,
+					O_RDWR | O_NONBLOCK);
+		return open_dev ? open_dev->fd : -1;
+	}
+
+	snprintf(name, sizeof(name), "/proc/self/fd/%d", dmx_fd);
+	return open(name, O_RDWR | O_NONBLOCK);
+}
+
+static void dvb_scan_close(struct dvb_v5_fe_parms_priv *parms, int fd)
+{
+	struct dvb_open_descriptor *open_dev = dvb_scan_emulated_dmx(parms, fd);
+
+	if (open_dev)
+		dvb_dev_close(open_dev);
+	else
+		close(fd);
+}
+
+/* Emulated filters are never waiting for data */
+static int dvb_scan_poll_emulated(struct dvb_v5_fe_parms_priv *parms,
+				  struct pollfd *pfd, unsigned n)
+{
+	struct dvb_open_descriptor *open_dev;
+	unsigned i;
+	int ret = 0;
+
+	for (i = 0; i < n; i++) {
+		open_dev = dvb_scan_emulated_dmx(parms, pfd[i].fd);
+		if (open_dev && parms->dvb->ops.dmx_poll(open_dev, 0)) {
+			pfd[i].revents = POLLIN;
+			ret++;
+		}
+	}
+	return ret;
+}
+
+static void dvb_table_job_init(struct dvb_table_job *job, unsigned char tid,
+			       uint16_t pid, void **table, unsigned timeout)
+{
+	job->sect.tid = tid;
+	job->sect.pid = pid;
+	job->sect.ts_id = -1;
+	job->sect.table = table;
+	job->sect.allow_section_gaps = 0;
+	job->timeout = timeout;
+	job->ret = -1;
+}
+
+static int dvb_table_job_start(struct dvb_v5_fe_parms_priv *parms,
+			       struct dvb_table_job *job, int dmx_fd)
+{
+	struct dvb_table_filter *sect = &job->sect;
+	int ret;
+
+	ret = dvb_parse_section_alloc(parms, sect);
+	if (ret < 0)
+		return ret;
+
+	if (dvb_scan_set_filter(parms, dmx_fd, sect)) {
+		dvb_scan_dmx_stop(parms, dmx_fd);
+		dvb_table_filter_free(sect);
+		return -1;
+	}
+	if (parms->p.verbose)
+		dvb_log(_("%s: waiting for table ID 0x%02x, program ID 0x%02x"),
+			__func__, sect->tid, sect->pid);
+
+	return 0;
+}
+
+static void dvb_table_job_stop(struct dvb_v5_fe_parms_priv *parms,
+			       struct dvb_table_job *job, int dmx_fd, int ret)
+{
+	dvb_scan_dmx_stop(parms, dmx_fd);
+	dvb_section_cache_done(parms, &job->sect, ret);
+	dvb_table_filter_free(&job->sect);
+	job->ret = (ret > 0) ? 0 : ret;
+}
+
+/*
+ * Reads all tables described by jobs, using up to parms->table_filters
+ * demux filters at the same time. The first filter is dmx_fd itself. When
+ * there are more tables than filters, a filter is reused as soon as its
+ * table is complete. Each job has its own timeout, counted from the time
+ * its filter was started.
+ */
+static void dvb_read_sections_parallel(struct dvb_v5_fe_parms_priv *parms,
+				       int dmx_fd, struct dvb_table_job *jobs,
+				       unsigned num_jobs)
+{
+	unsigned max_filters = parms->table_filters, num_fds = 0, next = 0;
+	unsigned active = 0, n, i;
+	struct dvb_table_job *job;
+	struct pollfd *pfd = NULL;
+	uint64_t *deadline = NULL, now;
+	int *fds = NULL, *slot = NULL, *map = NULL;
+	int emulated = dvb_scan_emulated_dmx(parms, dmx_fd) != NULL;
+	uint8_t *buf = NULL;
+	int ret, timeout;
+	ssize_t len;
+
+	if (max_filters > num_jobs)
+		max_filters = num_jobs;
+	if (max_filters < 1)
+		max_filters = 1;
+
+	fds = calloc(max_filters, sizeof(*fds));
+	slot = calloc(max_filters, sizeof(*slot));
+	map = calloc(max_filters, sizeof(*map));
+	pfd = calloc(max_filters, sizeof(*pfd));
+	deadline = calloc(max_filters, sizeof(*deadline));
+	buf = calloc(DVB_MAX_PAYLOAD_PACKET_SIZE, 1);
+	if (!fds || !slot || !map || !pfd || !deadline || !buf) {
+		dvb_logerr(_("%s: out of memory"), __func__);
+		goto free;
+	}
+
+	while (!parms->p.abort) {
+		/* Start a filter for each pending table, while possible */
+		now = dvb_time_ms();
+		for (i = 0; i < max_filters && next < num_jobs; i++) {
+			int new_fd = 0;
+
+			if (i < num_fds && slot[i] >= 0)
+				continue;
+			if (i == num_fds) {
+				fds[i] = i ? dvb_reopen_demux(parms, dmx_fd) : dmx_fd;
+				if (fds[i] < 0) {
+					if (parms->p.verbose)
+						dvb_log(_("%s: using %d demux filters"),
+							__func__, num_fds);
+					max_filters = num_fds;
+					break;
+				}
+				slot[i] = -1;
+				num_fds++;
+				new_fd = 1;
+			}
+			job = &jobs[next];
+			ret = dvb_table_job_start(parms, job, fds[i]);
+			if (ret < 0 && new_fd && i) {
+				/* Probably out of hardware filters */
+				dvb_scan_close(parms, fds[i]);
+				num_fds--;
+				max_filters = num_fds;
+				if (parms->p.verbose)
+					dvb_log(_("%s: using %d demux filters"),
+						__func__, num_fds);
+				break;
+			}
+			next++;
+			if (ret < 0) {
+				job->ret = ret;
+				i--;	/* Try the next table on this filter */
+				continue;
+			}
+			slot[i] = job - jobs;
+			deadline[i] = now + job->timeout * 1000ULL;
+			active++;
+		}
+		if (!active)
+			break;
+
+		/* Wait for data on any active filter */
+		timeout = -1;
+		for (i = 0, n = 0; i < num_fds; i++) {
+			if (slot[i] < 0)
+				continue;
+			pfd[n].fd = fds[i];
+			pfd[n].events = POLLIN;
+			pfd[n].revents = 0;
+			map[n++] = i;
+			if (deadline[i] <= now)
+				timeout = 0;
+			else if (timeout < 0 || deadline[i] - now < timeout)
+				timeout = deadline[i] - now;
+		}
+		if (emulated)
+			ret = dvb_scan_poll_emulated(parms, pfd, n);
+		else
+			ret = poll(pfd, n, timeout);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			dvb_perror("poll");
+			break;
+		}
+
+		now = dvb_time_ms();
+		for (i = 0; i < n; i++) {
+			unsigned s = map[i];
+
+			if (slot[s] < 0)
+				continue;
+			job = &jobs[slot[s]];
+
+			if (pfd[i].revents) {
+				ret = 0;
+				len = dvb_scan_read(parms, fds[s], buf,
+						    DVB_MAX_PAYLOAD_PACKET_SIZE);
+				if (len < 0) {
+					if (errno != EOVERFLOW && errno != EAGAIN) {
+						dvb_perror(_("dvb_read_section: read error"));
+						ret = -2;
+					}
+				} else if (!len) {
+					dvb_logerr(_("%s: buf returned an empty buffer"),
+						   __func__);
+					ret = -1;
+				} else {
+					ret = dvb_parse_section_cached(parms,
+								       &job->sect,
+								       buf, len);
+				}
+				if (ret) {
+					dvb_table_job_stop(parms, job, fds[s], ret);
+					slot[s] = -1;
+					active--;
+					continue;
+				}
+			}
+			/* An emulated filter without data will never get it */
+			if (now >= deadline[s] || (emulated && !pfd[i].revents)) {
+				dvb_logerr(_("%s: no data read on section filter for table 0x%02x, PID 0x%04x"),
+					   __func__, job->sect.tid, job->sect.pid);
+				dvb_table_job_stop(parms, job, fds[s], -1);
+				slot[s] = -1;
+				active--;
+			}
+		}
+	}
+
+	/* Stop whatever is still running, due to abort or errors */
+	for (i = 0; i < num_fds; i++) {
+		if (slot[i] >= 0)
+			dvb_table_job_stop(parms, &jobs[slot[i]], fds[i],
+					   parms->p.abort ? 0 : -1);
+		if (i)
+			dvb_scan_close(parms, fds[i]);
+	}
+
+free:
+	free(buf);
+	free(deadline);
+	free(pfd);
+	free(map);
+	free(slot);
+	free(fds);
+}
+
 struct dvb_v5_descriptors *dvb_scan_alloc_handler_table(uint32_t delivery_system)
 {
 	struct dvb_v5_descriptors *dvb_scan_handler;
@@ -437,13 +1050,133 @@ void dvb_scan_free_handler_table(struct dvb_v5_descriptors *dvb_scan_handler)
 	free(dvb_scan_handler);
 }
 
-struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *__p,
-					     int dmx_fd,
-					     uint32_t delivery_system,
-					     unsigned other_nit,
-					     unsigned timeout_multiply)
+/*
+ * Reads the PMT, NIT and SDT tables at the same time. The scan time is then
+ * bound by the slowest table, instead of by the sum of all of them.
+ */
+static void dvb_get_ts_tables_parallel(struct dvb_v5_fe_parms_priv *parms,
+				       int dmx_fd,
+				       struct dvb_v5_descriptors *dvb_scan_handler,
+				       unsigned other_nit,
+				       unsigned pmt_time,
+				       unsigned nit_time,
+				       unsigned sdt_time)
+{
+	struct dvb_table_job *jobs, *job;
+	unsigned num_jobs = 0, num_pmt = 0;
+	int nit_job, sdt_job = -1;
+
+	dvb_scan_handler->program = calloc(dvb_scan_handler->pat->programs,
+					   sizeof(*dvb_scan_handler->program));
+	jobs = calloc(dvb_scan_handler->pat->programs + 2, sizeof(*jobs));
+	if (!dvb_scan_handler->program || !jobs) {
+		dvb_logerr(_("%s: out of memory"), __func__);
+		free(jobs);
+		return;
+	}
+
+	/* PMT tables */
+	dvb_pat_program_foreach(program, dvb_scan_handler->pat) {
+		dvb_scan_handler->program[num_pmt].pat_pgm = program;
+
+		if (!program->service_id) {
+			if (parms->p.verbose)
+				dvb_log(_("Program #%d is network PID: 0x%04x"),
+					num_pmt, program->pid);
+			num_pmt++;
+			continue;
+		}
+		if (parms->p.verbose)
+			dvb_log(_("Program #%d ID 0x%04x, service ID 0x%04x"),
+				num_pmt, program->pid, program->service_id);
+		dvb_table_job_init(&jobs[num_jobs++], DVB_TABLE_PMT, program->pid,
+				   (void **)&dvb_scan_handler->program[num_pmt].pmt,
+				   pmt_time);
+		num_pmt++;
+	}
+	dvb_scan_handler->num_program = num_pmt;
+
+	/* NIT and SDT tables */
+	nit_job = num_jobs;
+	dvb_table_job_init(&jobs[num_jobs++], DVB_TABLE_NIT, DVB_TABLE_NIT_PID,
+			   (void **)&dvb_scan_handler->nit, nit_time);
+	if (!dvb_scan_handler->vct || other_nit) {
+		sdt_job = num_jobs;
+		dvb_table_job_init(&jobs[num_jobs++], DVB_TABLE_SDT,
+				   DVB_TABLE_SDT_PID,
+				   (void **)&dvb_scan_handler->sdt, sdt_time);
+	}
+
+	dvb_read_sections_parallel(parms, dmx_fd, jobs, num_jobs);
+	if (parms->p.abort)
+		goto ret;
+
+	job = jobs;
+	num_pmt = 0;
+	dvb_pat_program_foreach(program, dvb_scan_handler->pat) {
+		if (!program->service_id) {
+			num_pmt++;
+			continue;
+		}
+		if (job->ret < 0) {
+			dvb_logerr(_("error while reading the PMT table for service 0x%04x"),
+				   program->service_id);
+			/* Don't keep a partially parsed table */
+			if (dvb_scan_handler->program[num_pmt].pmt) {
+				dvb_table_pmt_free(dvb_scan_handler->program[num_pmt].pmt);
+				dvb_scan_handler->program[num_pmt].pmt = NULL;
+			}
+		} else if (parms->p.verbose) {
+			dvb_table_pmt_print(&parms->p,
+					    dvb_scan_handler->program[num_pmt].pmt);
+		}
+		job++;
+		num_pmt++;
+	}
+	if (jobs[nit_job].ret < 0)
+		dvb_logerr(_("error while reading the NIT table"));
+	else if (parms->p.verbose)
+		dvb_table_nit_print(&parms->p, dvb_scan_handler->nit);
+	if (sdt_job >= 0) {
+		if (jobs[sdt_job].ret < 0)
+			dvb_logerr(_("error while reading the SDT table"));
+		else if (parms->p.verbose)
+			dvb_table_sdt_print(&parms->p, dvb_scan_handler->sdt);
+	}
+
+	/* NIT/SDT other tables */
+	if (other_nit) {
+		if (parms->p.verbose)
+			dvb_log(_("Parsing other NIT/SDT"));
+		dvb_table_job_init(&jobs[0], DVB_TABLE_NIT2, DVB_TABLE_NIT_PID,
+				   (void **)&dvb_scan_handler->nit, nit_time);
+		dvb_table_job_init(&jobs[1], DVB_TABLE_SDT2, DVB_TABLE_SDT_PID,
+				   (void **)&dvb_scan_handler->sdt, sdt_time);
+
+		dvb_read_sections_parallel(parms, dmx_fd, jobs, 2);
+		if (parms->p.abort)
+			goto ret;
+
+		if (jobs[0].ret < 0)
+			dvb_logerr(_("error while reading the NIT table"));
+		else if (parms->p.verbose)
+			dvb_table_nit_print(&parms->p, dvb_scan_handler->nit);
+		if (jobs[1].ret < 0)
+			dvb_logerr(_("error while reading the SDT table"));
+		else if (parms->p.verbose)
+			dvb_table_sdt_print(&parms->p, dvb_scan_handler->sdt);
+	}
+
+ret:
+	free(jobs);
+}
+
+static struct dvb_v5_descriptors *__dvb_get_ts_tables(struct dvb_v5_fe_parms_priv *parms,
+							     int dmx_fd,
+							     uint32_t delivery_system,
+							     unsigned other_nit,
+							     unsigned timeout_multiply)
 {
-	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
 	int rc;
 	unsigned pat_pmt_time, sdt_time, nit_time, vct_time;
 	int atsc_filter = 0;
@@ -530,6 +1263,15 @@ struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *__p,
 			atsc_table_vct_print(&parms->p, dvb_scan_handler->vct);
 	}
 
+	if (parms->table_filters > 1) {
+		dvb_get_ts_tables_parallel(parms, dmx_fd, dvb_scan_handler,
+					   other_nit,
+					   pat_pmt_time * timeout_multiply,
+					   nit_time * timeout_multiply,
+					   sdt_time * timeout_multiply);
+		return dvb_scan_handler;
+	}
+
 	/* PMT tables */
 	dvb_scan_handler->program = calloc(dvb_scan_handler->pat->programs,
 					   sizeof(*dvb_scan_handler->program));
@@ -624,6 +1366,26 @@ struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *__p,
 	return dvb_scan_handler;
 }
 
+struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *__p,
+					     int dmx_fd,
+					     uint32_t delivery_system,
+					     unsigned other_nit,
+					     unsigned timeout_multiply)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
+	struct dvb_v5_descriptors *dvb_scan_handler;
+	struct dvb_arena *arena;
+
+	/* The tables are freed one by one: don't use the parse arena */
+	arena = parms->arena;
+	parms->arena = NULL;
+	dvb_scan_handler = __dvb_get_ts_tables(parms, dmx_fd, delivery_system,
+					       other_nit, timeout_multiply);
+	parms->arena = arena;
+
+	return dvb_scan_handler;
+}
+
 struct dvb_v5_descriptors *dvb_scan_transponder(struct dvb_v5_fe_parms *__p,
 					        struct dvb_entry *entry,
 						int dmx_fd,
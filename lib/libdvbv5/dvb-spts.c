@@ -0,0 +1,605 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "dvb-fe-priv.h"
+#include <libdvbv5/dvb-spts.h>
+#include <libdvbv5/dvb-log.h>
+#include <libdvbv5/crc32.h>
+#include <libdvbv5/descriptors.h>
+#include <libdvbv5/pat.h>
+#include <libdvbv5/pmt.h>
+
+#ifdef ENABLE_NLS
+# include "gettext.h"
+# include <libintl.h>
+# define _(string) dgettext(LIBDVBV5_DOMAIN, string)
+#else
+# define _(string) string
+#endif
+
+#define TS_SIZE			188
+#define TS_SYNC			0x47
+#define TS_MAX_PID		0x2000
+#define SECTION_MAX_SIZE	4096
+
+/* MPEG-TS over UDP uses 7 packets per datagram */
+#define SPTS_DGRAM_PACKETS	7
+#define SPTS_STREAM_PACKETS	348
+
+/* Reassembles the PSI sections of a PID */
+struct spts_section {
+	uint8_t buf[SECTION_MAX_SIZE + TS_SIZE];
+	unsigned len;
+	int cc;
+	int started;
+};
+
+struct spts_output {
+	uint16_t service_id;
+	int fd, dgram;
+
+	/* Regenerated PAT */
+	uint16_t transport_id;
+	int pmt_pid;
+	uint8_t pat_version, pat_cc;
+
+	/* Copy of the PMT section of the service */
+	uint8_t *pmt;
+	size_t pmt_len;
+	uint8_t pmt_cc;
+
+	/* Elementary stream and PCR PIDs routed to this output */
+	uint16_t *pids;
+	unsigned n_pids;
+
+	uint8_t *buf;
+	size_t len, size;
+
+	struct dvb_spts_stats stats;
+};
+
+struct dvb_spts {
+	struct dvb_v5_fe_parms_priv *parms;
+
+	/* Bitmask with the outputs of each PID */
+	uint32_t route[TS_MAX_PID];
+	struct spts_section *section[TS_MAX_PID];
+
+	struct spts_output *out[DVB_SPTS_MAX_OUTPUTS];
+	unsigned n_out;
+
+	uint8_t partial[TS_SIZE];
+	unsigned partial_len;
+};
+
+struct dvb_spts *dvb_spts_alloc(struct dvb_v5_fe_parms *p)
+{
+	struct dvb_spts *spts;
+
+	spts = calloc(1, sizeof(*spts));
+	if (!spts)
+		return NULL;
+
+	spts->parms = (void *)p;
+
+	/* The PAT is always needed */
+	spts->section[0] = calloc(1, sizeof(*spts->section[0]));
+	if (!spts->section[0]) {
+		free(spts);
+		return NULL;
+	}
+	spts->section[0]->cc = -1;
+
+	return spts;
+}
+
+void dvb_spts_free(struct dvb_spts *spts)
+{
+	struct spts_output *out;
+	unsigned i;
+
+	dvb_spts_flush(spts);
+
+	for (i = 0; i < spts->n_out; i++) {
+		out = spts->out[i];
+		free(out->pmt);
+		free(out->pids);
+		free(out->buf);
+		free(out);
+	}
+	for (i = 0; i < TS_MAX_PID; i++)
+		free(spts->section[i]);
+	free(spts);
+}
+
+int dvb_spts_add_output(struct dvb_spts *spts, uint16_t service_id, int fd)
+{
+	struct spts_output *out;
+	struct stat st;
+	int type = 0;
+	socklen_t len = sizeof(type);
+
+	if (spts->n_out == DVB_SPTS_MAX_OUTPUTS)
+		return -ENOSPC;
+
+	out = calloc(1, sizeof(*out));
+	if (!out)
+		return -ENOMEM;
+
+	out->service_id = service_id;
+	out->fd = fd;
+	out->pmt_pid = -1;
+	out->stats.pmt_pid = -1;
+
+	if (!fstat(fd, &st) && S_ISSOCK(st.st_mode) &&
+	    !getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) &&
+	    type == SOCK_DGRAM)
+		out->dgram = 1;
+
+	out->size = TS_SIZE * (out->dgram ? SPTS_DGRAM_PACKETS :
+					    SPTS_STREAM_PACKETS);
+	out->buf = malloc(out->size);
+	if (!out->buf) {
+		free(out);
+		return -ENOMEM;
+	}
+
+	spts->out[spts->n_out] = out;
+	return spts->n_out++;
+}
+
+static void spts_output_flush(struct spts_output *out)
+{
+	size_t pos = 0;
+	ssize_t ret;
+
+	while (pos < out->len) {
+		if (out->dgram)
+			ret = send(out->fd, out->buf, out->len, 0);
+		else
+			ret = write(out->fd, out->buf + pos, out->len - pos);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			/*
+			 * Non-blocking outputs that can't keep up, closed
+			 * pipes and unreachable destinations lose data.
+			 */
+			out->stats.dropped += (out->len - pos) / TS_SIZE;
+			break;
+		}
+		if (out->dgram)
+			ret = out->len;
+		out->stats.packets += ret / TS_SIZE;
+		out->stats.bytes += ret;
+		pos += ret;
+	}
+	out->len = 0;
+}
+
+static void spts_output_put(struct spts_output *out, const uint8_t *pkt)
+{
+	memcpy(out->buf + out->len, pkt, TS_SIZE);
+	out->len += TS_SIZE;
+	if (out->len == out->size)
+		spts_output_flush(out);
+}
+
+void dvb_spts_flush(struct dvb_spts *spts)
+{
+	unsigned i;
+
+	for (i = 0; i < spts->n_out; i++)
+		if (spts->out[i]->len)
+			spts_output_flush(spts->out[i]);
+}
+
+int dvb_spts_get_stats(struct dvb_spts *spts, int output,
+		       struct dvb_spts_stats *stats)
+{
+	if (output < 0 || (unsigned)output >= spts->n_out)
+		return -EINVAL;
+
+	*stats = spts->out[output]->stats;
+	return 0;
+}
+
+/* Splits a section into TS packets, written to an output */
+static void spts_put_section(struct spts_output *out, uint16_t pid,
+			     uint8_t *cc, const uint8_t *sec, size_t len)
+{
+	uint8_t pkt[TS_SIZE];
+	size_t n, pos;
+	int first = 1;
+
+	while (len) {
+		pkt[0] = TS_SYNC;
+		pkt[1] = (first ? 0x40 : 0) | pid >> 8;
+		pkt[2] = pid;
+		pkt[3] = 0x10 | *cc;
+		*cc = (*cc + 1) & 0x0f;
+		pos = 4;
+		if (first)
+			pkt[pos++] = 0;		/* pointer_field */
+
+		n = TS_SIZE - pos;
+		if (n > len)
+			n = len;
+		memcpy(pkt + pos, sec, n);
+		memset(pkt + pos + n, 0xff, TS_SIZE - pos - n);
+
+		sec += n;
+		len -= n;
+		first = 0;
+		spts_output_put(out, pkt);
+	}
+}
+
+static void spts_put_pat(struct dvb_spts *spts, struct spts_output *out)
+{
+	struct dvb_table_pat pat;
+	struct dvb_table_pat_program prog;
+	uint8_t buf[1024];
+	ssize_t len;
+
+	memset(&pat, 0, sizeof(pat));
+	memset(&prog, 0, sizeof(prog));
+
+	pat.header.id = out->transport_id;
+	pat.header.version = out->pat_version;
+	pat.header.current_next = 1;
+	pat.programs = 1;
+	pat.program = &prog;
+	prog.service_id = out->service_id;
+	prog.pid = out->pmt_pid;
+
+	len = dvb_table_pat_store(&spts->parms->p, &pat, buf, sizeof(buf));
+	if (len > 0)
+		spts_put_section(out, 0, &out->pat_cc, buf, len);
+}
+
+static struct spts_section *spts_get_section(struct dvb_spts *spts,
+					     uint16_t pid)
+{
+	struct spts_section *s = spts->section[pid];
+
+	if (!s) {
+		s = calloc(1, sizeof(*s));
+		if (!s)
+			return NULL;
+		s->cc = -1;
+		spts->section[pid] = s;
+	}
+	return s;
+}
+
+/* Replaces the elementary stream PIDs routed to an output */
+static void spts_set_routes(struct dvb_spts *spts, unsigned n,
+			    uint16_t *pids, unsigned n_pids)
+{
+	struct spts_output *out = spts->out[n];
+	unsigned i;
+
+	for (i = 0; i < out->n_pids; i++)
+		spts->route[out->pids[i]] &= ~(1U << n);
+	free(out->pids);
+
+	out->pids = pids;
+	out->n_pids = n_pids;
+	for (i = 0; i < n_pids; i++)
+		spts->route[pids[i]] |= 1U << n;
+}
+
+static void spts_handle_pat(struct dvb_spts *spts, const uint8_t *buf,
+			    size_t len)
+{
+	struct dvb_v5_fe_parms_priv *parms = spts->parms;
+	struct dvb_table_pat *pat = NULL;
+	struct dvb_table_pat_program *prog;
+	struct spts_output *out;
+	struct dvb_arena *arena;
+	unsigned i;
+	int ret;
+
+	/* The tables are freed right away: don't use the parse arena */
+	arena = parms->arena;
+	parms->arena = NULL;
+	ret = dvb_table_pat_init(&parms->p, buf, len, &pat);
+	parms->arena = arena;
+	if (ret < 0) {
+		if (pat)
+			dvb_table_pat_free(pat);
+		return;
+	}
+
+	for (i = 0; i < spts->n_out; i++) {
+		out = spts->out[i];
+
+		for (prog = pat->program; prog; prog = prog->next)
+			if (prog->service_id == out->service_id)
+				break;
+
+		if (prog && (prog->pid != out->pmt_pid ||
+			     pat->header.id != out->transport_id)) {
+			if (prog->pid != out->pmt_pid) {
+				if (!spts_get_section(spts, prog->pid)) {
+					dvb_logerr(_("%s: out of memory"),
+						   __func__);
+					continue;
+				}
+				free(out->pmt);
+				out->pmt = NULL;
+				out->pmt_len = 0;
+				spts_set_routes(spts, i, NULL, 0);
+			}
+			out->pmt_pid = prog->pid;
+			out->transport_id = pat->header.id;
+			out->pat_version = (out->pat_version + 1) & 0x1f;
+			out->stats.pmt_pid = out->pmt_pid;
+			out->stats.psi_updates++;
+		}
+
+		/* The PAT is repeated at the same rate as the original one */
+		if (out->pmt_pid >= 0 && (prog || !pat->header.section_id))
+			spts_put_pat(spts, out);
+	}
+
+	dvb_table_pat_free(pat);
+}
+
+static void spts_handle_pmt(struct dvb_spts *spts, uint16_t pid,
+			    const uint8_t *buf, size_t len)
+{
+	struct dvb_v5_fe_parms_priv *parms = spts->parms;
+	struct dvb_table_pmt *pmt;
+	struct dvb_table_pmt_stream *stream;
+	struct spts_output *out;
+	struct dvb_arena *arena;
+	uint16_t service_id = buf[3] << 8 | buf[4];
+	uint16_t *pids;
+	unsigned i, n_pids;
+	int ret;
+
+	for (i = 0; i < spts->n_out; i++) {
+		out = spts->out[i];
+		if (out->pmt_pid != pid || out->service_id != service_id)
+			continue;
+
+		if (out->pmt && out->pmt_len == len &&
+		    !memcmp(out->pmt, buf, len)) {
+			spts_put_section(out, pid, &out->pmt_cc, buf, len);
+			continue;
+		}
+
+		pmt = NULL;
+		arena = parms->arena;
+		parms->arena = NULL;
+		ret = dvb_table_pmt_init(&parms->p, buf, len, &pmt);
+		parms->arena = arena;
+		if (ret < 0) {
+			if (pmt)
+				dvb_table_pmt_free(pmt);
+			continue;
+		}
+
+		n_pids = 1;
+		for (stream = pmt->stream; stream; stream = stream->next)
+			n_pids++;
+		pids = calloc(n_pids, sizeof(*pids));
+		free(out->pmt);
+		out->pmt = malloc(len);
+		if (!pids || !out->pmt) {
+			dvb_logerr(_("%s: out of memory"), __func__);
+			free(pids);
+			free(out->pmt);
+			out->pmt = NULL;
+			out->pmt_len = 0;
+			dvb_table_pmt_free(pmt);
+			continue;
+		}
+
+		n_pids = 0;
+		if (pmt->pcr_pid != 0x1fff)
+			pids[n_pids++] = pmt->pcr_pid;
+		for (stream = pmt->stream; stream; stream = stream->next)
+			if (stream->elementary_pid != pmt->pcr_pid)
+				pids[n_pids++] = stream->elementary_pid;
+		dvb_table_pmt_free(pmt);
+
+		spts_set_routes(spts, i, pids, n_pids);
+
+		/*
+		 * The PMT describes only its own service, and all its
+		 * streams are routed, so the original section is kept.
+		 */
+		memcpy(out->pmt, buf, len);
+		out->pmt_len = len;
+		out->stats.psi_updates++;
+
+		spts_put_section(out, pid, &out->pmt_cc, buf, len);
+	}
+}
+
+static void spts_handle_section(struct dvb_spts *spts, uint16_t pid,
+				const uint8_t *buf, size_t len)
+{
+	struct dvb_v5_fe_parms_priv *parms = spts->parms;
+
+	/* Sections without syntax indicator don't have CRC */
+	if (len < 8 + DVB_CRC_SIZE || !(buf[1] & 0x80))
+		return;
+
+	/* Ignore tables that will be valid only in the future */
+	if (!(buf[5] & 0x01))
+		return;
+
+	if (dvb_crc32((uint8_t *)buf, len, 0xffffffff)) {
+		dvb_logdbg(_("%s: crc error on pid 0x%04x"), __func__, pid);
+		return;
+	}
+
+	if (!pid && buf[0] == DVB_TABLE_PAT)
+		spts_handle_pat(spts, buf, len);
+	else if (buf[0] == DVB_TABLE_PMT)
+		spts_handle_pmt(spts, pid, buf, len);
+}
+
+/* Handles the complete sections at the reassembly buffer */
+static void spts_parse_sections(struct dvb_spts *spts, uint16_t pid,
+				struct spts_section *s)
+{
+	unsigned len;
+
+	while (s->len >= 3) {
+		/* Stuffing after the last section of the packet */
+		if (s->buf[0] == 0xff) {
+			s->len = 0;
+			s->started = 0;
+			return;
+		}
+		len = 3 + ((s->buf[1] & 0x0f) << 8 | s->buf[2]);
+		if (len > SECTION_MAX_SIZE) {
+			s->len = 0;
+			s->started = 0;
+			return;
+		}
+		if (s->len < len)
+			return;
+
+		spts_handle_section(spts, pid, s->buf, len);
+
+		s->len -= len;
+		memmove(s->buf, s->buf + len, s->len);
+	}
+}
+
+static void spts_add_payload(struct dvb_spts *spts, uint16_t pid,
+			     struct spts_section *s, const uint8_t *p,
+			     unsigned len)
+{
+	if (s->len + len > sizeof(s->buf)) {
+		s->len = 0;
+		s->started = 0;
+		return;
+	}
+	memcpy(s->buf + s->len, p, len);
+	s->len += len;
+	spts_parse_sections(spts, pid, s);
+}
+
+static void spts_section_packet(struct dvb_spts *spts, uint16_t pid,
+				struct spts_section *s, const uint8_t *p)
+{
+	unsigned afc = (p[3] >> 4) & 3, cc = p[3] & 0x0f;
+	unsigned pos = 4, ptr;
+
+	if (!(afc & 1))
+		return;
+	if (afc & 2)
+		pos += 1 + p[4];
+
+	/* Discard the partial section if packets were lost */
+	if (s->cc >= 0 && cc != ((s->cc + 1) & 0x0f)) {
+		if (cc == (unsigned)s->cc)
+			return;
+		s->len = 0;
+		s->started = 0;
+	}
+	s->cc = cc;
+
+	if (pos >= TS_SIZE)
+		return;
+
+	if (p[1] & 0x40) {
+		ptr = p[pos++];
+		if (pos + ptr > TS_SIZE)
+			return;
+
+		/* The bytes before the pointer end the previous section */
+		if (s->started && ptr)
+			spts_add_payload(spts, pid, s, p + pos, ptr);
+
+		s->len = 0;
+		s->started = 1;
+		pos += ptr;
+	} else if (!s->started) {
+		return;
+	}
+
+	spts_add_payload(spts, pid, s, p + pos, TS_SIZE - pos);
+}
+
+static void spts_packet(struct dvb_spts *spts, const uint8_t *p)
+{
+	uint16_t pid = (p[1] & 0x1f) << 8 | p[2];
+	uint32_t mask;
+	int n;
+
+	if (spts->section[pid])
+		spts_section_packet(spts, pid, spts->section[pid], p);
+
+	for (mask = spts->route[pid]; mask; mask &= mask - 1) {
+		n = ffs(mask) - 1;
+		spts_output_put(spts->out[n], p);
+	}
+}
+
+void dvb_spts_feed(struct dvb_spts *spts, const uint8_t *buf, size_t len)
+{
+	const uint8_t *end = buf + len;
+	size_t n;
+
+	if (spts->partial_len) {
+		n = TS_SIZE - spts->partial_len;
+		if (n > len)
+			n = len;
+		memcpy(spts->partial + spts->partial_len, buf, n);
+		spts->partial_len += n;
+		buf += n;
+		if (spts->partial_len < TS_SIZE)
+			return;
+		spts_packet(spts, spts->partial);
+		spts->partial_len = 0;
+	}
+
+	while ((size_t)(end - buf) >= TS_SIZE) {
+		if (*buf != TS_SYNC) {
+			/* Seek for a sync byte followed by another one */
+			do {
+				buf = memchr(buf + 1, TS_SYNC, end - buf - 1);
+				if (!buf)
+					return;
+			} while (end - buf > TS_SIZE && buf[TS_SIZE] != TS_SYNC);
+			continue;
+		}
+		spts_packet(spts, buf);
+		buf += TS_SIZE;
+	}
+
+	if (buf < end && *buf == TS_SYNC) {
+		spts->partial_len = end - buf;
+		memcpy(spts->partial, buf, spts->partial_len);
+	}
+}
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "dvb-fe-priv.h"
 #include <libdvbv5/dvb-file.h>
 #include <libdvbv5/dvb-v5-std.h>
 
@@ -255,13 +256,12 @@ static const struct dvb_parse_file vdr_file_format = {
 	}
 };
 
-int dvb_write_format_vdr(const char *fname,
-			 struct dvb_file *dvb_file)
+int dvb_write_format_vdr_fp(FILE *fp, const char *fname,
+			    struct dvb_file *dvb_file)
 {
 	const struct dvb_parse_file *parse_file = &vdr_file_format;
 	const struct dvb_parse_struct *formats = parse_file->formats;
 	int i, j, line = 0;
-	FILE *fp;
 	const struct dvb_parse_struct *fmt;
 	struct dvb_entry *entry;
 	const struct dvb_parse_table *table;
@@ -269,12 +269,6 @@ int dvb_write_format_vdr(const char *fname,
 	uint32_t delsys, freq, data, srate;
 	char err_msg[80];
 
-	fp = fopen(fname, "w");
-	if (!fp) {
-		perror(fname);
-		return -errno;
-	}
-
 	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
 		if (dvb_retrieve_entry_prop(entry, DTV_DELIVERY_SYSTEM, &delsys) < 0)
 			continue;
@@ -306,10 +300,12 @@ int dvb_write_format_vdr(const char *fname,
 		}
 
 		/* Output channel name */
-		fprintf(fp, "%s", entry->channel);
-		if (entry->vchannel)
-			fprintf(fp, ",%s", entry->vchannel);
-		fprintf(fp, ":");
+		fputs(entry->channel, fp);
+		if (entry->vchannel) {
+			fputc(',', fp);
+			fputs(entry->vchannel, fp);
+		}
+		fputc(':', fp);
 
 		/*
 		 * Output frequency:
@@ -348,9 +344,9 @@ int dvb_write_format_vdr(const char *fname,
 				goto error;
 			}
 
-			fprintf(fp, "%s", table->table[data]);
+			fputs(table->table[data], fp);
 		}
-		fprintf(fp, ":");
+		fputc(':', fp);
 
 		/*
 		 * Output sources configuration for VDR
@@ -364,16 +360,16 @@ int dvb_write_format_vdr(const char *fname,
 			switch(delsys) {
 			case SYS_DVBS:
 			case SYS_DVBS2:
-				fprintf(fp, "%s", entry->location);
+				fputs(entry->location, fp);
 				break;
 			default:
-				fprintf(fp, "%s", id);
+				fputs(id, fp);
 				break;
 			}
 		} else {
-			fprintf(fp, "%s", id);
+			fputs(id, fp);
 		}
-		fprintf(fp, ":");
+		fputc(':', fp);
 
 		/* Output symbol rate */
 		srate = 27500000;
@@ -395,50 +391,65 @@ int dvb_write_format_vdr(const char *fname,
 		/* Output video PID(s) */
 		for (i = 0; i < entry->video_pid_len; i++) {
 			if (i)
-				fprintf(fp,",");
+				fputc(',', fp);
 			fprintf(fp, "%d", entry->video_pid[i]);
 		}
 		if (!i)
-			fprintf(fp, "0");
-		fprintf(fp, ":");
+			fputc('0', fp);
+		fputc(':', fp);
 
 		/* Output audio PID(s) */
 		for (i = 0; i < entry->audio_pid_len; i++) {
 			if (i)
-				fprintf(fp,",");
+				fputc(',', fp);
 			fprintf(fp, "%d", entry->audio_pid[i]);
 		}
 		if (!i)
-			fprintf(fp, "0");
-		fprintf(fp, ":");
+			fputc('0', fp);
+		fputc(':', fp);
 
 		/* FIXME: Output teletex PID(s) */
-		fprintf(fp, "0:");
+		fputs("0:", fp);
 
 		/* Output Conditional Access - let VDR discover it */
-		fprintf(fp, "0:");
+		fputs("0:", fp);
 
 		/* Output Service ID */
 		fprintf(fp, "%d:", entry->service_id);
 
 		/* Output Network ID */
-		fprintf(fp, "0:");
+		fputs("0:", fp);
 
 		/* Output Transport Stream ID */
-		fprintf(fp, "0:");
+		fputs("0:", fp);
 
 		/* Output Radio ID
 		 * this is the last entry, tagged bei a new line (not a colon!)
 		 */
-		fprintf(fp, "0\n");
+		fputs("0\n", fp);
 		line++;
 	};
-	fclose (fp);
 	return 0;
 
 error:
 	fprintf(stderr, _("ERROR: %s while parsing entry %d of %s\n"),
 		 err_msg, line, fname);
-	fclose(fp);
 	return -1;
 }
+
+int dvb_write_format_vdr(const char *fname,
+			 struct dvb_file *dvb_file)
+{
+	FILE *fp;
+	int ret;
+
+	fp = fopen(fname, "w");
+	if (!fp) {
+		perror(fname);
+		return -errno;
+	}
+	ret = dvb_write_format_vdr_fp(fp, fname, dvb_file);
+	fclose(fp);
+
+	return ret;
+}
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <strings.h> /* strcasecmp */
 
+#include "dvb-fe-priv.h"
 #include <parse_string.h>
 #include <libdvbv5/dvb-log.h>
 #include <libdvbv5/dvb-fe.h>
@@ -39,6 +40,20 @@ struct charset_conv {
 	unsigned char  data[3];
 };
 
+/*
+ * Opening an iconv descriptor loads and initializes a gconv module, and
+ * the EIT tables alone have thousands of strings per transponder. So,
+ * the descriptors are kept open while the frontend is opened. Single-byte
+ * charsets also get a table to convert them to UTF-8 without iconv().
+ */
+struct dvb_iconv_cache {
+	char			*input_charset;
+	char			*output_charset;
+	iconv_t			cd;
+	struct charset_conv	*table;
+	struct dvb_iconv_cache	*next;
+};
+
 /* This table is the Latin 00 table. Basically ISO-6937 + Euro sign */
 static struct charset_conv en300468_latin_00_to_utf8[256] = {
 	[0x00] = { 1, {0x00, } },
@@ -299,72 +314,236 @@ static struct charset_conv en300468_latin_00_to_utf8[256] = {
 	[0xff] = { 2, {0xc2, 0xad, } },
 };
 
-void dvb_iconv_to_charset(struct dvb_v5_fe_parms *parms,
-			  char *dest,
-			  size_t destlen,
-			  const unsigned char *src,
-			  size_t len,
-			  char *input_charset, char *output_charset)
+static int is_utf8(const char *charset)
+{
+	return !strcasecmp(charset, "UTF-8") || !strcasecmp(charset, "UTF8") ||
+	       !strcasecmp(charset, "ISO-10646/UTF-8");
+}
+
+/* Strict check, as the input is copied unchanged if it is valid */
+static int is_valid_utf8(const unsigned char *s, size_t len)
 {
+	const unsigned char *end = s + len;
+	unsigned n, i;
+	uint32_t c;
+
+	while (s < end) {
+		if (*s < 0x80) {
+			s++;
+			continue;
+		}
+		if (*s >= 0xc2 && *s <= 0xdf) {
+			n = 1;
+			c = *s & 0x1f;
+		} else if (*s >= 0xe0 && *s <= 0xef) {
+			n = 2;
+			c = *s & 0x0f;
+		} else if (*s >= 0xf0 && *s <= 0xf4) {
+			n = 3;
+			c = *s & 0x07;
+		} else {
+			return 0;
+		}
+		if ((size_t)(end - s) <= n)
+			return 0;
+		for (i = 1; i <= n; i++) {
+			if ((s[i] & 0xc0) != 0x80)
+				return 0;
+			c = c << 6 | (s[i] & 0x3f);
+		}
+		/* Overlong forms, UTF-16 surrogates and beyond Unicode */
+		if ((n == 2 && c < 0x800) || (n == 3 && c < 0x10000) ||
+		    (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff)
+			return 0;
+		s += n + 1;
+	}
+	return 1;
+}
+
+/* Should be called with parms->iconv_lock held */
+static struct dvb_iconv_cache *dvb_iconv_get(struct dvb_v5_fe_parms_priv *parms,
+					      const char *input_charset,
+					      const char *output_charset)
+{
+	struct dvb_iconv_cache *c, **prev;
 	char out_cs[strlen(output_charset) + 1 + sizeof(CS_OPTIONS)];
-	char *p = dest;
+
+	for (prev = &parms->iconv_cache; *prev; prev = &(*prev)->next) {
+		c = *prev;
+		if (strcasecmp(c->input_charset, input_charset) ||
+		    strcasecmp(c->output_charset, output_charset))
+			continue;
+
+		/* Keep the last used one at the head of the list */
+		*prev = c->next;
+		c->next = parms->iconv_cache;
+		parms->iconv_cache = c;
+		return c;
+	}
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+	c->input_charset = strdup(input_charset);
+	c->output_charset = strdup(output_charset);
+	if (!c->input_charset || !c->output_charset) {
+		free(c->input_charset);
+		free(c->output_charset);
+		free(c);
+		return NULL;
+	}
 
 	strcpy(out_cs, output_charset);
 	strcat(out_cs, CS_OPTIONS);
 
-	iconv_t cd = iconv_open(out_cs, input_charset);
-	if (cd == (iconv_t)(-1)) {
-		memcpy(p, src, len);
-		p[len] = '\0';
+	/* A failure is also cached, in order to not complain every time */
+	c->cd = iconv_open(out_cs, input_charset);
+	if (c->cd == (iconv_t)(-1)) {
 		dvb_logerr("Conversion from %s to %s not supported\n",
 				input_charset, output_charset);
 		if (!strcasecmp(input_charset, "ARIB-STD-B24"))
 			dvb_log("Try setting GCONV_PATH to the bundled gconv dir.\n");
+	}
+
+	c->next = parms->iconv_cache;
+	parms->iconv_cache = c;
+
+	return c;
+}
+
+void dvb_iconv_cache_free(struct dvb_v5_fe_parms_priv *parms)
+{
+	struct dvb_iconv_cache *c, *next;
+
+	for (c = parms->iconv_cache; c; c = next) {
+		next = c->next;
+		if (c->cd != (iconv_t)(-1))
+			iconv_close(c->cd);
+		free(c->input_charset);
+		free(c->output_charset);
+		free(c->table);
+		free(c);
+	}
+	parms->iconv_cache = NULL;
+}
+
+/*
+ * Converts each one of the 256 chars of a single-byte charset, in order
+ * to build a conversion table. Chars without a valid conversion are
+ * dropped, as iconv() would stop converting there. Should be called with
+ * parms->iconv_lock held. Once built, the table is only read.
+ */
+static struct charset_conv *dvb_iconv_table(struct dvb_iconv_cache *c)
+{
+	struct charset_conv *table;
+	char in, out[4], *inp, *outp;
+	size_t inlen, outlen;
+	int i;
+
+	if (c->table || c->cd == (iconv_t)(-1))
+		return c->table;
+
+	table = calloc(256, sizeof(*table));
+	if (!table)
+		return NULL;
+
+	for (i = 0; i < 256; i++) {
+		in = i;
+		inp = &in;
+		inlen = 1;
+		outp = out;
+		outlen = sizeof(out);
+
+		iconv(c->cd, NULL, NULL, NULL, NULL);
+		if (iconv(c->cd, (ICONV_CONST char **)&inp, &inlen,
+			  &outp, &outlen) == (size_t)(-1))
+			continue;
+		if (outp - out > (ssize_t)sizeof(table[i].data))
+			continue;
+		table[i].len = outp - out;
+		memcpy(table[i].data, out, table[i].len);
+	}
+	c->table = table;
+
+	return table;
+}
+
+void dvb_iconv_to_charset(struct dvb_v5_fe_parms *p,
+			  char *dest,
+			  size_t destlen,
+			  const unsigned char *src,
+			  size_t len,
+			  char *input_charset, char *output_charset)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_iconv_cache *c;
+	char *out = dest;
+
+	pthread_mutex_lock(&parms->iconv_lock);
+	c = dvb_iconv_get(parms, input_charset, output_charset);
+	if (!c || c->cd == (iconv_t)(-1)) {
+		memcpy(out, src, len);
+		out[len] = '\0';
 	} else {
-		iconv(cd, (ICONV_CONST char **)&src, &len, &p, &destlen);
-		iconv_close(cd);
-		*p = '\0';
+		/* Reset the shift state left by the previous string */
+		iconv(c->cd, NULL, NULL, NULL, NULL);
+		iconv(c->cd, (ICONV_CONST char **)&src, &len, &out, &destlen);
+		*out = '\0';
 	}
+	pthread_mutex_unlock(&parms->iconv_lock);
 }
 
-static void charset_conversion(struct dvb_v5_fe_parms *parms, char **dest, const unsigned char *s,
+static void charset_conversion(struct dvb_v5_fe_parms *p, char **dest, const unsigned char *s,
 			       size_t len, char *input_charset)
 {
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
 	size_t destlen = len * 3;
-	int need_conversion = 1;
+	struct charset_conv *table = NULL;
+	struct dvb_iconv_cache *c;
+	int utf8_output = is_utf8(parms->p.output_charset);
 
-	/* Special handler for ISO-6937 */
 	if (!strcasecmp(input_charset, "ISO-6937")) {
-		char *p = *dest;
-		unsigned char *tmp;
-		unsigned char *p1, *p2;
-
-		/* Convert charset to UTF-8 using Code table 00 - Latin */
-		for (p1 = (unsigned char *)s; p1 < s + len; p1++)
-			for (p2 = en300468_latin_00_to_utf8[*p1].data;
-			     p2 < en300468_latin_00_to_utf8[*p1].data + en300468_latin_00_to_utf8[*p1].len;
-			     p2++)
-				*p++ = *p2;
-		*p = '\0';
+		/* Special handler for ISO-6937: Code table 00 - Latin */
+		table = en300468_latin_00_to_utf8;
+	} else if (utf8_output && is_utf8(input_charset) &&
+		   is_valid_utf8(s, len)) {
+		memcpy(*dest, s, len);
+		(*dest)[len] = '\0';
+		return;
+	} else if (utf8_output && !strncasecmp(input_charset, "ISO-8859-", 9)) {
+		pthread_mutex_lock(&parms->iconv_lock);
+		c = dvb_iconv_get(parms, input_charset, parms->p.output_charset);
+		if (c)
+			table = dvb_iconv_table(c);
+		pthread_mutex_unlock(&parms->iconv_lock);
+	}
 
-		/* If desired charset is not UTF-8, prepare for conversion */
-		if (strcasecmp(parms->output_charset, "UTF-8")) {
-			tmp = (unsigned char *)*dest;
-			len = p - *dest;
+	if (table) {
+		unsigned char *tmp, *p1, *p2 = (unsigned char *)*dest;
 
-			*dest = malloc(destlen + 1);
-			input_charset = "UTF-8";
-			s = tmp;
-		} else
-			need_conversion = 0;
+		for (p1 = (unsigned char *)s; p1 < s + len; p1++) {
+			memcpy(p2, table[*p1].data, table[*p1].len);
+			p2 += table[*p1].len;
+		}
+		*p2 = '\0';
+
+		if (utf8_output)
+			return;
 
+		/* ISO-6937 to a charset other than UTF-8: convert it again */
+		tmp = (unsigned char *)*dest;
+		len = p2 - tmp;
+		*dest = malloc(destlen + 1);
+		if (*dest)
+			dvb_iconv_to_charset(&parms->p, *dest, destlen, tmp, len,
+					     "UTF-8", parms->p.output_charset);
+		free(tmp);
+		return;
 	}
 
 	/* Convert from original charset to the desired one */
-	if (need_conversion)
-		dvb_iconv_to_charset(parms, *dest, destlen, s, len,
-				     input_charset,
-				     parms->output_charset);
+	dvb_iconv_to_charset(&parms->p, *dest, destlen, s, len,
+			     input_charset, parms->p.output_charset);
 }
 
 void dvb_parse_string(struct dvb_v5_fe_parms *parms, char **dest, char **emph,
@@ -20,6 +20,7 @@
 #include <libdvbv5/atsc_eit.h>
 #include <libdvbv5/descriptors.h>
 #include <libdvbv5/dvb-fe.h>
+#include <dvb-fe-priv.h>
 
 ssize_t atsc_table_eit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		ssize_t buflen, struct atsc_table_eit **table)
@@ -44,7 +45,7 @@ ssize_t atsc_table_eit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	}
 
 	if (!*table) {
-		*table = calloc(sizeof(struct atsc_table_eit), 1);
+		*table = dvb_parse_calloc(parms, sizeof(struct atsc_table_eit));
 		if (!*table) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -3;
@@ -70,7 +71,7 @@ ssize_t atsc_table_eit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 				   endbuf - p, size);
 			return -4;
 		}
-		event = (struct atsc_table_eit_event *) malloc(sizeof(struct atsc_table_eit_event));
+		event = dvb_parse_calloc(parms, sizeof(struct atsc_table_eit_event));
 		if (!event) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -5;
@@ -130,6 +131,9 @@ void atsc_table_eit_free(struct atsc_table_eit *eit)
 {
 	struct atsc_table_eit_event *event = eit->event;
 
+	if (dvb_arena_owns(eit))
+		return;
+
 	while (event) {
 		struct atsc_table_eit_event *tmp = event;
 
@@ -20,6 +20,7 @@
 #include <libdvbv5/cat.h>
 #include <libdvbv5/descriptors.h>
 #include <libdvbv5/dvb-fe.h>
+#include <dvb-fe-priv.h>
 
 ssize_t dvb_table_cat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		ssize_t buflen, struct dvb_table_cat **table)
@@ -43,7 +44,7 @@ ssize_t dvb_table_cat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	}
 
 	if (!*table) {
-		*table = calloc(sizeof(struct dvb_table_cat), 1);
+		*table = dvb_parse_calloc(parms, sizeof(struct dvb_table_cat));
 		if (!*table) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -3;
@@ -86,6 +87,9 @@ ssize_t dvb_table_cat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 
 void dvb_table_cat_free(struct dvb_table_cat *cat)
 {
+	if (dvb_arena_owns(cat))
+		return;
+
 	dvb_desc_free((struct dvb_desc **) &cat->descriptor);
 	free(cat);
 }
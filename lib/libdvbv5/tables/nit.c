@@ -20,6 +20,7 @@
 
 #include <libdvbv5/nit.h>
 #include <libdvbv5/dvb-fe.h>
+#include <dvb-fe-priv.h>
 
 ssize_t dvb_table_nit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			ssize_t buflen, struct dvb_table_nit **table)
@@ -44,7 +45,7 @@ ssize_t dvb_table_nit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	}
 
 	if (!*table) {
-		*table = calloc(sizeof(struct dvb_table_nit), 1);
+		*table = dvb_parse_calloc(parms, sizeof(struct dvb_table_nit));
 		if (!*table) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -3;
@@ -88,7 +89,7 @@ ssize_t dvb_table_nit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	while (p + size <= endbuf) {
 		struct dvb_table_nit_transport *transport;
 
-		transport = malloc(sizeof(struct dvb_table_nit_transport));
+		transport = dvb_parse_calloc(parms, sizeof(struct dvb_table_nit_transport));
 		if (!transport) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -7;
@@ -129,6 +130,10 @@ ssize_t dvb_table_nit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 void dvb_table_nit_free(struct dvb_table_nit *nit)
 {
 	struct dvb_table_nit_transport *transport = nit->transport;
+
+	if (dvb_arena_owns(nit))
+		return;
+
 	dvb_desc_free((struct dvb_desc **) &nit->descriptor);
 	while (transport) {
 		dvb_desc_free((struct dvb_desc **) &transport->descriptor);
@@ -19,8 +19,10 @@
  */
 
 #include <libdvbv5/pat.h>
+#include <libdvbv5/crc32.h>
 #include <libdvbv5/descriptors.h>
 #include <libdvbv5/dvb-fe.h>
+#include <dvb-fe-priv.h>
 
 ssize_t dvb_table_pat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			ssize_t buflen, struct dvb_table_pat **table)
@@ -44,7 +46,7 @@ ssize_t dvb_table_pat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	}
 
 	if (!*table) {
-		*table = calloc(sizeof(struct dvb_table_pat), 1);
+		*table = dvb_parse_calloc(parms, sizeof(struct dvb_table_pat));
 		if (!*table) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -3;
@@ -72,7 +74,7 @@ ssize_t dvb_table_pat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	while (p + size <= endbuf) {
 		struct dvb_table_pat_program *prog;
 
-		prog = malloc(sizeof(struct dvb_table_pat_program));
+		prog = dvb_parse_calloc(parms, sizeof(struct dvb_table_pat_program));
 		if (!prog) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -5;
@@ -84,7 +86,7 @@ ssize_t dvb_table_pat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		bswap16(prog->service_id);
 
 		if (prog->pid == 0x1fff) { /* ignore null packets */
-			free(prog);
+			dvb_parse_free(parms, prog);
 			break;
 		}
 		bswap16(prog->bitfield);
@@ -101,10 +103,67 @@ ssize_t dvb_table_pat_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	return p - buf;
 }
 
+ssize_t dvb_table_pat_store(struct dvb_v5_fe_parms *parms,
+			    const struct dvb_table_pat *pat,
+			    uint8_t *buf, size_t buflen)
+{
+	const struct dvb_table_pat_program *prog;
+	struct dvb_table_header header;
+	struct dvb_table_pat_program pgm;
+	uint8_t *p = buf;
+	size_t size, len;
+	uint32_t crc;
+
+	size = offsetof(struct dvb_table_pat, programs);
+	len = size + DVB_CRC_SIZE;
+	for (prog = pat->program; prog; prog = prog->next)
+		len += offsetof(struct dvb_table_pat_program, next);
+
+	/* A PAT section can't be bigger than 1024 bytes */
+	if (len > buflen || len > 1024) {
+		dvb_logerr("%s: PAT doesn't fit on %zd bytes", __func__,
+			   buflen < 1024 ? buflen : 1024);
+		return -1;
+	}
+
+	header = pat->header;
+	header.table_id = DVB_TABLE_PAT;
+	header.section_length = len - 3;
+	header.syntax = 1;
+	header.zero = 0;
+	header.one = 3;
+	header.one2 = 3;
+	bswap16(header.bitfield);
+	bswap16(header.id);
+	memcpy(p, &header, size);
+	p += size;
+
+	size = offsetof(struct dvb_table_pat_program, next);
+	for (prog = pat->program; prog; prog = prog->next) {
+		memcpy(&pgm, prog, size);
+		pgm.reserved = 7;
+		bswap16(pgm.service_id);
+		bswap16(pgm.bitfield);
+		memcpy(p, &pgm, size);
+		p += size;
+	}
+
+	crc = dvb_crc32(buf, p - buf, 0xffffffff);
+	*p++ = crc >> 24;
+	*p++ = crc >> 16;
+	*p++ = crc >> 8;
+	*p++ = crc;
+
+	return p - buf;
+}
+
 void dvb_table_pat_free(struct dvb_table_pat *pat)
 {
 	struct dvb_table_pat_program *prog = pat->program;
 
+	if (dvb_arena_owns(pat))
+		return;
+
 	while (prog) {
 		struct dvb_table_pat_program *tmp = prog;
 		prog = prog->next;
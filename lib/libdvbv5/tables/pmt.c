@@ -23,6 +23,7 @@
 #include <libdvbv5/dvb-fe.h>
 
 #include <string.h> /* memcpy */
+#include <dvb-fe-priv.h>
 
 ssize_t dvb_table_pmt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			ssize_t buflen, struct dvb_table_pmt **table)
@@ -47,7 +48,7 @@ ssize_t dvb_table_pmt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	}
 
 	if (!*table) {
-		*table = calloc(sizeof(struct dvb_table_pmt), 1);
+		*table = dvb_parse_calloc(parms, sizeof(struct dvb_table_pmt));
 		if (!*table) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -3;
@@ -96,7 +97,7 @@ ssize_t dvb_table_pmt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	while (p + size <= endbuf) {
 		struct dvb_table_pmt_stream *stream;
 
-		stream = malloc(sizeof(struct dvb_table_pmt_stream));
+		stream = dvb_parse_calloc(parms, sizeof(struct dvb_table_pmt_stream));
 		if (!stream) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -5;
@@ -137,6 +138,10 @@ ssize_t dvb_table_pmt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 void dvb_table_pmt_free(struct dvb_table_pmt *pmt)
 {
 	struct dvb_table_pmt_stream *stream = pmt->stream;
+
+	if (dvb_arena_owns(pmt))
+		return;
+
 	while(stream) {
 		dvb_desc_free((struct dvb_desc **) &stream->descriptor);
 		struct dvb_table_pmt_stream *tmp = stream;
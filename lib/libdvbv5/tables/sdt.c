@@ -21,6 +21,7 @@
 #include <libdvbv5/sdt.h>
 #include <libdvbv5/descriptors.h>
 #include <libdvbv5/dvb-fe.h>
+#include <dvb-fe-priv.h>
 
 ssize_t dvb_table_sdt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			ssize_t buflen, struct dvb_table_sdt **table)
@@ -44,7 +45,7 @@ ssize_t dvb_table_sdt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	}
 
 	if (!*table) {
-		*table = calloc(sizeof(struct dvb_table_sdt), 1);
+		*table = dvb_parse_calloc(parms, sizeof(struct dvb_table_sdt));
 		if (!*table) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -3;
@@ -74,7 +75,7 @@ ssize_t dvb_table_sdt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	while (p + size <= endbuf) {
 		struct dvb_table_sdt_service *service;
 
-		service = malloc(sizeof(struct dvb_table_sdt_service));
+		service = dvb_parse_calloc(parms, sizeof(struct dvb_table_sdt_service));
 		if (!service) {
 			dvb_logerr("%s: out of memory", __func__);
 			return -5;
@@ -116,6 +117,10 @@ ssize_t dvb_table_sdt_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 void dvb_table_sdt_free(struct dvb_table_sdt *sdt)
 {
 	struct dvb_table_sdt_service *service = sdt->service;
+
+	if (dvb_arena_owns(sdt))
+		return;
+
 	while(service) {
 		dvb_desc_free((struct dvb_desc **) &service->descriptor);
 		struct dvb_table_sdt_service *tmp = service;
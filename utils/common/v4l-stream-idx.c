@@ -0,0 +1,264 @@
+/*
+ * V4L2 indexed stream file source
+ *
+ * This program is free software; you may redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "v4l-stream-idx.h"
+
+#define IDX_ALIGN(x, a)	(((x) + (a) - 1) & ~((__u64)(a) - 1))
+
+static const __u8 idx_zeroes[V4L_IDX_ALIGN];
+
+static int idx_write(struct v4l_idx_writer *w, const void *p, size_t size)
+{
+	if (size && fwrite(p, 1, size, w->f) != size)
+		return -1;
+	w->offset += size;
+	return 0;
+}
+
+static int idx_pad(struct v4l_idx_writer *w)
+{
+	return idx_write(w, idx_zeroes,
+			 IDX_ALIGN(w->offset, V4L_IDX_ALIGN) - w->offset);
+}
+
+int v4l_idx_write_header(struct v4l_idx_writer *w, FILE *f,
+			 const struct v4l2_format *fmt, unsigned num_planes)
+{
+	struct v4l_idx_file_hdr hdr;
+
+	memset(w, 0, sizeof(*w));
+	w->f = f;
+	w->num_planes = num_planes;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = V4L_IDX_MAGIC;
+	hdr.version = V4L_IDX_VERSION;
+	hdr.hdr_size = sizeof(hdr);
+	hdr.align = V4L_IDX_ALIGN;
+	hdr.num_planes = num_planes;
+	hdr.fmt_type = fmt->type;
+	memcpy(hdr.fmt, fmt->fmt.raw_data, sizeof(hdr.fmt));
+
+	if (idx_write(w, &hdr, sizeof(hdr)) || idx_pad(w))
+		return -1;
+	return 0;
+}
+
+int v4l_idx_write_frame(struct v4l_idx_writer *w, const struct v4l2_buffer *buf,
+			void * const *data, const __u32 *bytesused)
+{
+	struct v4l_idx_frame_hdr frm;
+	struct v4l_idx_entry *e;
+	__u64 start = w->offset;
+	__u64 offset;
+	unsigned p;
+
+	if (w->num_frames == w->max_frames) {
+		unsigned max = w->max_frames ? 2 * w->max_frames : 256;
+
+		e = (struct v4l_idx_entry *)realloc(w->index, max * sizeof(*e));
+		if (!e)
+			return -1;
+		w->index = e;
+		w->max_frames = max;
+	}
+
+	memset(&frm, 0, sizeof(frm));
+	frm.magic = V4L_IDX_FRAME_MAGIC;
+	frm.timestamp = (__u64)buf->timestamp.tv_sec * 1000000ULL +
+			buf->timestamp.tv_usec;
+	frm.sequence = buf->sequence;
+	frm.flags = buf->flags;
+	frm.field = buf->field;
+	frm.num_planes = w->num_planes;
+	offset = IDX_ALIGN(sizeof(frm), V4L_IDX_ALIGN);
+	for (p = 0; p < w->num_planes; p++) {
+		frm.planes[p].offset = offset;
+		frm.planes[p].bytesused = bytesused[p];
+		offset += IDX_ALIGN(bytesused[p], V4L_IDX_ALIGN);
+	}
+	frm.size = offset;
+
+	if (idx_write(w, &frm, sizeof(frm)) || idx_pad(w))
+		return -1;
+	for (p = 0; p < w->num_planes; p++)
+		if (idx_write(w, data[p], bytesused[p]) || idx_pad(w))
+			return -1;
+
+	e = &w->index[w->num_frames++];
+	e->offset = start;
+	e->timestamp = frm.timestamp;
+	e->sequence = frm.sequence;
+	e->flags = frm.flags;
+	return 0;
+}
+
+int v4l_idx_write_trailer(struct v4l_idx_writer *w)
+{
+	struct v4l_idx_trailer trailer;
+	int ret;
+
+	trailer.magic = V4L_IDX_TRAILER_MAGIC;
+	trailer.num_frames = w->num_frames;
+	trailer.index_offset = w->offset;
+	ret = idx_write(w, w->index, w->num_frames * sizeof(*w->index));
+	if (!ret)
+		ret = idx_write(w, &trailer, sizeof(trailer));
+	free(w->index);
+	w->index = NULL;
+	w->num_frames = w->max_frames = 0;
+	fflush(w->f);
+	return ret;
+}
+
+int v4l_idx_is_idx_file(int fd)
+{
+	__u32 magic;
+
+	if (pread(fd, &magic, sizeof(magic), 0) != sizeof(magic))
+		return 0;
+	return magic == V4L_IDX_MAGIC;
+}
+
+/*
+ * Check that the frame record at offset, and all its planes, are inside
+ * the mapped file.
+ */
+static int idx_frame_valid(const struct v4l_idx_reader *r, __u64 offset)
+{
+	const struct v4l_idx_frame_hdr *frm;
+	unsigned p;
+
+	if (offset > r->size || r->size - offset < sizeof(*frm))
+		return 0;
+	frm = (const struct v4l_idx_frame_hdr *)(r->map + offset);
+	if (frm->magic != V4L_IDX_FRAME_MAGIC || frm->size < sizeof(*frm) ||
+	    frm->size > r->size - offset ||
+	    frm->num_planes > VIDEO_MAX_PLANES)
+		return 0;
+	for (p = 0; p < frm->num_planes; p++)
+		if (frm->planes[p].offset < sizeof(*frm) ||
+		    (__u64)frm->planes[p].offset + frm->planes[p].bytesused > frm->size)
+			return 0;
+	return 1;
+}
+
+/*
+ * Walk the frame headers to recreate the index of a file that has
+ * no trailer.
+ */
+static int idx_rebuild(struct v4l_idx_reader *r)
+{
+	__u64 offset = IDX_ALIGN(r->hdr->hdr_size, r->hdr->align);
+	unsigned max = 0;
+
+	r->num_frames = 0;
+	while (offset + sizeof(struct v4l_idx_frame_hdr) <= r->size) {
+		const struct v4l_idx_frame_hdr *frm =
+			(const struct v4l_idx_frame_hdr *)(r->map + offset);
+		struct v4l_idx_entry *e;
+
+		if (!idx_frame_valid(r, offset))
+			break;
+		if (r->num_frames == max) {
+			max = max ? 2 * max : 256;
+			e = (struct v4l_idx_entry *)realloc(r->built_index,
+							    max * sizeof(*e));
+			if (!e)
+				return -1;
+			r->built_index = e;
+		}
+		e = &r->built_index[r->num_frames++];
+		e->offset = offset;
+		e->timestamp = frm->timestamp;
+		e->sequence = frm->sequence;
+		e->flags = frm->flags;
+		offset += frm->size;
+	}
+	r->index = r->built_index;
+	return 0;
+}
+
+int v4l_idx_open(struct v4l_idx_reader *r, int fd)
+{
+	const struct v4l_idx_trailer *trailer;
+	struct stat st;
+	void *map;
+
+	memset(r, 0, sizeof(*r));
+	if (fstat(fd, &st) || (__u64)st.st_size < sizeof(struct v4l_idx_file_hdr))
+		return -1;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	r->map = (const __u8 *)map;
+	r->size = st.st_size;
+	r->hdr = (const struct v4l_idx_file_hdr *)r->map;
+	if (r->hdr->magic != V4L_IDX_MAGIC ||
+	    r->hdr->version != V4L_IDX_VERSION ||
+	    r->hdr->hdr_size < sizeof(struct v4l_idx_file_hdr) ||
+	    !r->hdr->align || (r->hdr->align & (r->hdr->align - 1)) ||
+	    r->hdr->num_planes > VIDEO_MAX_PLANES) {
+		v4l_idx_close(r);
+		return -1;
+	}
+
+	trailer = (const struct v4l_idx_trailer *)
+		(r->map + r->size - sizeof(*trailer));
+	if (trailer->magic == V4L_IDX_TRAILER_MAGIC &&
+	    trailer->index_offset <= r->size - sizeof(*trailer) &&
+	    (__u64)trailer->num_frames * sizeof(struct v4l_idx_entry) ==
+	    r->size - sizeof(*trailer) - trailer->index_offset) {
+		r->index = (const struct v4l_idx_entry *)
+			(r->map + trailer->index_offset);
+		r->num_frames = trailer->num_frames;
+	} else if (idx_rebuild(r)) {
+		v4l_idx_close(r);
+		return -1;
+	}
+	return 0;
+}
+
+void v4l_idx_close(struct v4l_idx_reader *r)
+{
+	if (r->map)
+		munmap((void *)r->map, r->size);
+	free(r->built_index);
+	memset(r, 0, sizeof(*r));
+}
+
+void v4l_idx_get_fmt(const struct v4l_idx_reader *r, struct v4l2_format *fmt)
+{
+	memset(fmt, 0, sizeof(*fmt));
+	fmt->type = r->hdr->fmt_type;
+	memcpy(fmt->fmt.raw_data, r->hdr->fmt, sizeof(r->hdr->fmt));
+}
+
+const struct v4l_idx_frame_hdr *v4l_idx_frame(const struct v4l_idx_reader *r,
+					      unsigned frame)
+{
+	if (frame >= r->num_frames ||
+	    !idx_frame_valid(r, r->index[frame].offset))
+		return NULL;
+	return (const struct v4l_idx_frame_hdr *)(r->map + r->index[frame].offset);
+}
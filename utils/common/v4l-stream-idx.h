@@ -0,0 +1,130 @@
+/*
+ * V4L2 indexed stream file header
+ *
+ * This program is free software; you may redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _V4L_STREAM_IDX_H_
+#define _V4L_STREAM_IDX_H_
+
+#include <stdio.h>
+#include <linux/videodev2.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * The indexed stream file is a seekable container for captured frames.
+ *
+ * It starts with a file header containing the v4l2_format of the stream,
+ * followed by one record per frame and ends with an index of all frames
+ * and a trailer pointing to that index.
+ *
+ * The file header, each frame header and each plane are aligned to
+ * hdr.align bytes (the page size), so the file can be mmap()ed and the
+ * plane data can be handed to the driver directly as a user pointer.
+ *
+ * All values are stored in host byte order. A reader that finds a byte
+ * swapped magic must refuse the file.
+ *
+ * If the trailer is missing (e.g. the capture was interrupted), then the
+ * index can be rebuilt by walking the frame headers from the start.
+ */
+#define V4L_IDX_MAGIC			v4l2_fourcc('V', '4', 'L', 'I')
+#define V4L_IDX_VERSION			1
+#define V4L_IDX_ALIGN			4096
+
+#define V4L_IDX_FRAME_MAGIC		v4l2_fourcc('f', 'r', 'm', 'i')
+#define V4L_IDX_TRAILER_MAGIC		v4l2_fourcc('i', 'd', 'x', 't')
+
+struct v4l_idx_file_hdr {
+	__u32 magic;
+	__u32 version;
+	__u32 hdr_size;		/* sizeof(struct v4l_idx_file_hdr) */
+	__u32 align;		/* alignment of frame headers and planes */
+	__u32 num_planes;
+	__u32 fmt_type;		/* v4l2_format.type */
+	__u8  fmt[200];		/* v4l2_format.fmt.raw_data */
+};
+
+struct v4l_idx_frame_hdr {
+	__u32 magic;
+	__u32 size;		/* size of the frame record including padding */
+	__u64 timestamp;	/* v4l2_buffer timestamp in microseconds */
+	__u32 sequence;
+	__u32 flags;
+	__u32 field;
+	__u32 num_planes;
+	struct {
+		__u32 offset;	/* offset of the plane data from the frame header */
+		__u32 bytesused;
+	} planes[VIDEO_MAX_PLANES];
+};
+
+struct v4l_idx_entry {
+	__u64 offset;		/* file offset of the frame header */
+	__u64 timestamp;
+	__u32 sequence;
+	__u32 flags;
+};
+
+struct v4l_idx_trailer {
+	__u32 magic;
+	__u32 num_frames;
+	__u64 index_offset;	/* file offset of the v4l_idx_entry array */
+};
+
+struct v4l_idx_writer {
+	FILE *f;
+	__u64 offset;
+	unsigned num_planes;
+	struct v4l_idx_entry *index;
+	unsigned num_frames;
+	unsigned max_frames;
+};
+
+struct v4l_idx_reader {
+	const __u8 *map;
+	__u64 size;
+	const struct v4l_idx_file_hdr *hdr;
+	const struct v4l_idx_entry *index;
+	struct v4l_idx_entry *built_index;
+	unsigned num_frames;
+};
+
+int v4l_idx_write_header(struct v4l_idx_writer *w, FILE *f,
+			 const struct v4l2_format *fmt, unsigned num_planes);
+int v4l_idx_write_frame(struct v4l_idx_writer *w, const struct v4l2_buffer *buf,
+			void * const *data, const __u32 *bytesused);
+int v4l_idx_write_trailer(struct v4l_idx_writer *w);
+
+int v4l_idx_is_idx_file(int fd);
+int v4l_idx_open(struct v4l_idx_reader *r, int fd);
+void v4l_idx_close(struct v4l_idx_reader *r);
+void v4l_idx_get_fmt(const struct v4l_idx_reader *r, struct v4l2_format *fmt);
+const struct v4l_idx_frame_hdr *v4l_idx_frame(const struct v4l_idx_reader *r,
+					      unsigned frame);
+
+static inline const __u8 *v4l_idx_plane(const struct v4l_idx_frame_hdr *frm,
+					unsigned plane)
+{
+	return (const __u8 *)frm + frm->planes[plane].offset;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
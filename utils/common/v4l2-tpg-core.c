@@ -1915,7 +1915,7 @@ static unsigned tpg_calc_buffer_line(const struct tpg_data *tpg, unsigned y,
 	}
 }
 
-static void tpg_recalc(struct tpg_data *tpg)
+void tpg_recalc(struct tpg_data *tpg)
 {
 	if (tpg->recalc_colors) {
 		tpg->recalc_colors = false;
@@ -2339,20 +2339,29 @@ static void tpg_fill_plane_pattern(const struct tpg_data *tpg,
 	}
 }
 
-void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
-			   unsigned p, u8 *vbuf)
+/*
+ * Fill compose lines [first, last) of plane p. The lines are independent of
+ * one another, so disjoint line ranges of the same buffer can be filled
+ * concurrently, provided tpg_recalc() was called beforehand. Ranges should
+ * start at a multiple of 4 so line pairs that are combined when vertically
+ * downsampling stay together.
+ */
+void tpg_fill_plane_lines(const struct tpg_data *tpg, v4l2_std_id std,
+			  unsigned p, u8 *vbuf, unsigned first, unsigned last)
 {
 	struct tpg_draw_params params;
 	unsigned factor = V4L2_FIELD_HAS_T_OR_B(tpg->field) ? 2 : 1;
 
-	/* Coarse scaling with Bresenham */
+	/* Coarse scaling with Bresenham, starting at line 'first' */
 	unsigned int_part = (tpg->crop.height / factor) / tpg->compose.height;
 	unsigned fract_part = (tpg->crop.height / factor) % tpg->compose.height;
-	unsigned src_y = 0;
-	unsigned error = 0;
+	unsigned src_y = first * int_part +
+			 (first * fract_part) / tpg->compose.height;
+	unsigned error = (first * fract_part) % tpg->compose.height;
 	unsigned h;
 
-	tpg_recalc(tpg);
+	if (last > tpg->compose.height)
+		last = tpg->compose.height;
 
 	params.is_tv = std;
 	params.is_60hz = std & V4L2_STD_525_60;
@@ -2366,7 +2375,7 @@ void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
 
 	vbuf += tpg_hdiv(tpg, p, tpg->compose.left);
 
-	for (h = 0; h < tpg->compose.height; h++) {
+	for (h = first; h < last; h++) {
 		unsigned buf_line;
 
 		params.frame_line = tpg_calc_frameline(tpg, src_y, tpg->field);
@@ -2422,6 +2431,13 @@ void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
 	}
 }
 
+void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
+			   unsigned p, u8 *vbuf)
+{
+	tpg_recalc(tpg);
+	tpg_fill_plane_lines(tpg, std, p, vbuf, 0, tpg->compose.height);
+}
+
 void tpg_fillbuffer(struct tpg_data *tpg, v4l2_std_id std, unsigned p, u8 *vbuf)
 {
 	unsigned offset = 0;
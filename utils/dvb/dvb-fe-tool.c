@@ -63,7 +63,7 @@ static const struct argp_option options[] = {
 	{"set",		's',	N_("PARAMS"),	0,	N_("set frontend"), 0},
 #endif
 	{"get",		'g',	0,		0,	N_("get frontend"), 0},
-	{"server",	'H',	N_("SERVER"),	0, 	N_("dvbv5-daemon host IP address"), 0},
+	{"server",	'H',	N_("SERVER"),	0, 	N_("dvbv5-daemon host IP address, or the path of its UNIX socket"), 0},
 	{"tcp-port",	'T',	N_("PORT"),	0, 	N_("dvbv5-daemon host tcp port"), 0},
 	{"device-mon",	'D',	0,		0,	N_("monitors device insert/removal"), 0},
 	{"help",        '?',	0,		0,	N_("Give this help list"), -1},
@@ -335,7 +335,7 @@ int main(int argc, char *argv[])
 	if (!dvb)
 		return -1;
 
-	if (server && port) {
+	if (server && (port || server[0] == '/')) {
 		printf(_("Connecting to %s:%d\n"), server, port);
 		ret = dvb_dev_remote_init(dvb, server, port);
 		if (ret < 0)
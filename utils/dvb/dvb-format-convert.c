@@ -24,7 +24,9 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <argp.h>
@@ -49,16 +51,20 @@
 
 #define PROGRAM_NAME	"dvb-format-convert"
 
+/* Number of entries parsed and written by each thread at once */
+#define BLOCK_ENTRIES	256
+
 struct arguments {
 	char *input_file, *output_file;
 	enum dvb_file_formats input_format, output_format;
-	int delsys;
+	int delsys, jobs;
 };
 
 static const struct argp_option options[] = {
 	{"input-format",	'I',	N_("format"),	0, N_("Valid input formats: ZAP, CHANNEL, DVBV5"), 0},
 	{"output-format",	'O',	N_("format"),	0, N_("Valid output formats: VDR, ZAP, CHANNEL, DVBV5"), 0},
 	{"delsys",		's',	N_("system"),	0, N_("Delivery system type. Needed if input or output format is ZAP"), 0},
+	{"jobs",		'j',	N_("number"),	0, N_("number of threads used for the conversion. Default: number of CPUs"), 0},
 	{"help",        '?',	0,		0,	N_("Give this help list"), -1},
 	{"usage",	-3,	0,		0,	N_("Give a short usage message")},
 	{"version",	'V',	0,		0,	N_("Print program version"), -1},
@@ -81,6 +87,9 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	case 's':
 		args->delsys = dvb_parse_delsys(optarg);
 		break;
+	case 'j':
+		args->jobs = atoi(optarg);
+		break;
 	case '?':
 		argp_state_help(state, state->out_stream,
 				ARGP_HELP_SHORT_USAGE | ARGP_HELP_LONG
@@ -99,24 +108,301 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	return 0;
 }
 
-static int convert_file(struct arguments *args)
+/*
+ * The input is split into blocks of entries, converted in parallel by the
+ * worker threads. Each block is parsed from memory and written into its
+ * own memory buffer, and the main thread writes the buffers in order.
+ */
+enum block_state {
+	BLOCK_FREE,
+	BLOCK_READY,
+	BLOCK_DONE,
+};
+
+struct convert_block {
+	enum block_state state;
+	unsigned first_line, first_entry;
+	char *in, *out;
+	size_t in_len, in_size, out_len;
+	int ret;
+};
+
+struct convert_ctx {
+	struct arguments *args;
+	struct convert_block *block;
+	unsigned num_blocks;
+
+	/* Sequence numbers of the next block to be read and converted */
+	unsigned next_read, next_conv;
+	int eof;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* Line read from the input, but belonging to the next block */
+	char *line;
+	size_t line_size;
+	ssize_t line_len;
+	unsigned line_num, entry_num;
+};
+
+static int starts_entry(enum dvb_file_formats format, const char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	if (format == FILE_DVBV5)
+		return *p == '[';
+
+	return *p != '\n' && *p != '#' && *p != '\a' && *p != '\0';
+}
+
+static int block_append(struct convert_block *blk, const char *p, size_t len)
 {
-	struct dvb_file *dvb_file = NULL;
+	char *buf;
+
+	if (blk->in_len + len > blk->in_size) {
+		blk->in_size = (blk->in_len + len) * 2;
+		buf = realloc(blk->in, blk->in_size);
+		if (!buf)
+			return -ENOMEM;
+		blk->in = buf;
+	}
+	memcpy(blk->in + blk->in_len, p, len);
+	blk->in_len += len;
+
+	return 0;
+}
+
+/* Reads the input lines up to the start of the next block */
+static int read_block(struct convert_ctx *ctx, FILE *fp,
+		      struct convert_block *blk)
+{
+	enum dvb_file_formats format = ctx->args->input_format;
+	unsigned entries = 0;
+
+	blk->in_len = 0;
+	blk->first_line = ctx->line_num - (ctx->line_len > 0);
+	blk->first_entry = ctx->entry_num;
+
+	while (1) {
+		if (ctx->line_len <= 0) {
+			ctx->line_len = getline(&ctx->line, &ctx->line_size, fp);
+			if (ctx->line_len <= 0)
+				break;
+			ctx->line_num++;
+		}
+		if (starts_entry(format, ctx->line)) {
+			if (entries == BLOCK_ENTRIES)
+				break;
+			entries++;
+			ctx->entry_num++;
+		}
+		if (block_append(blk, ctx->line, ctx->line_len) < 0)
+			return -ENOMEM;
+		ctx->line_len = 0;
+	}
+
+	return blk->in_len;
+}
+
+static int convert_block(struct arguments *args, struct convert_block *blk)
+{
+	char in_name[PATH_MAX + 32], out_name[PATH_MAX + 32];
+	struct dvb_file *dvb_file;
+	FILE *fp;
 	int ret;
 
-	printf(_("Reading file %s\n"), args->input_file);
+	/* Line and entry numbers at the messages are relative to the block */
+	if (blk->first_line) {
+		snprintf(in_name, sizeof(in_name), _("%s (block from line %d)"),
+			 args->input_file, blk->first_line + 1);
+		snprintf(out_name, sizeof(out_name), _("%s (block from entry %d)"),
+			 args->output_file, blk->first_entry);
+	} else {
+		snprintf(in_name, sizeof(in_name), "%s", args->input_file);
+		snprintf(out_name, sizeof(out_name), "%s", args->output_file);
+	}
+
+	fp = fmemopen(blk->in, blk->in_len, "r");
+	if (!fp)
+		return -errno;
+	dvb_file = dvb_read_file_format_fp(fp, in_name, args->delsys,
+					   args->input_format);
+	fclose(fp);
+	if (!dvb_file)
+		return -1;
+
+	fp = open_memstream(&blk->out, &blk->out_len);
+	if (!fp) {
+		dvb_file_free(dvb_file);
+		return -errno;
+	}
+	ret = dvb_write_file_format_fp(fp, out_name, dvb_file, args->delsys,
+				       args->output_format);
+	fclose(fp);
+	dvb_file_free(dvb_file);
 
-	dvb_file = dvb_read_file_format(args->input_file, args->delsys,
-				    args->input_format);
-	if (!dvb_file) {
+	return ret;
+}
+
+static void *convert_thread(void *privdata)
+{
+	struct convert_ctx *ctx = privdata;
+	struct convert_block *blk;
+
+	pthread_mutex_lock(&ctx->lock);
+	while (1) {
+		if (ctx->next_conv == ctx->next_read) {
+			if (ctx->eof)
+				break;
+			pthread_cond_wait(&ctx->cond, &ctx->lock);
+			continue;
+		}
+		blk = &ctx->block[ctx->next_conv++ % ctx->num_blocks];
+		pthread_mutex_unlock(&ctx->lock);
+
+		blk->ret = convert_block(ctx->args, blk);
+
+		pthread_mutex_lock(&ctx->lock);
+		blk->state = BLOCK_DONE;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	return NULL;
+}
+
+/* Waits for a block to be converted and writes it */
+static int write_block(struct convert_ctx *ctx, struct convert_block *blk,
+		       FILE *fp, int ret)
+{
+	pthread_mutex_lock(&ctx->lock);
+	while (blk->state != BLOCK_DONE)
+		pthread_cond_wait(&ctx->cond, &ctx->lock);
+	pthread_mutex_unlock(&ctx->lock);
+
+	if (!ret && blk->ret)
+		ret = blk->ret;
+	if (!ret && blk->out_len &&
+	    fwrite(blk->out, blk->out_len, 1, fp) != 1) {
+		perror(ctx->args->output_file);
+		ret = -errno;
+	}
+
+	free(blk->out);
+	blk->out = NULL;
+	blk->out_len = 0;
+	blk->state = BLOCK_FREE;
+
+	return ret;
+}
+
+static int convert_file(struct arguments *args)
+{
+	struct convert_ctx ctx;
+	struct convert_block *blk;
+	pthread_t *threads;
+	FILE *in, *out;
+	unsigned i, seq;
+	int ret = 0, len;
+
+	printf(_("Reading file %s\n"), args->input_file);
+	in = fopen(args->input_file, "r");
+	if (!in) {
+		perror(args->input_file);
 		fprintf(stderr, _("Error reading file %s\n"), args->input_file);
 		return -1;
 	}
 
 	printf(_("Writing file %s\n"), args->output_file);
-	ret = dvb_write_file_format(args->output_file, dvb_file,
-				    args->delsys, args->output_format);
-	dvb_file_free(dvb_file);
+	out = fopen(args->output_file, "w");
+	if (!out) {
+		perror(args->output_file);
+		fclose(in);
+		return -1;
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.args = args;
+	ctx.num_blocks = args->jobs * 2;
+	ctx.block = calloc(ctx.num_blocks, sizeof(*ctx.block));
+	threads = calloc(args->jobs, sizeof(*threads));
+	if (!ctx.block || !threads) {
+		fprintf(stderr, _("Not enough memory\n"));
+		ret = -ENOMEM;
+		goto err;
+	}
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.cond, NULL);
+
+	for (i = 0; i < args->jobs; i++) {
+		if (pthread_create(&threads[i], NULL, convert_thread, &ctx)) {
+			perror("pthread_create");
+			ret = -1;
+			break;
+		}
+	}
+	if (!i)
+		goto err;
+	args->jobs = i;
+
+	/*
+	 * Reuse each block after writing the one converted before on it,
+	 * as the blocks are queued in order
+	 */
+	for (seq = 0; !ret; seq++) {
+		blk = &ctx.block[seq % ctx.num_blocks];
+		if (seq >= ctx.num_blocks)
+			ret = write_block(&ctx, blk, out, ret);
+		if (ret)
+			break;
+
+		len = read_block(&ctx, in, blk);
+		if (len <= 0) {
+			if (len < 0) {
+				fprintf(stderr, _("Not enough memory\n"));
+				ret = len;
+			}
+			break;
+		}
+
+		pthread_mutex_lock(&ctx.lock);
+		blk->state = BLOCK_READY;
+		ctx.next_read++;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.lock);
+	}
+
+	pthread_mutex_lock(&ctx.lock);
+	ctx.eof = 1;
+	pthread_cond_broadcast(&ctx.cond);
+	pthread_mutex_unlock(&ctx.lock);
+
+	/* Write the blocks still queued */
+	for (i = seq + 1 > ctx.num_blocks ? seq + 1 - ctx.num_blocks : 0;
+	     i < ctx.next_read; i++)
+		ret = write_block(&ctx, &ctx.block[i % ctx.num_blocks], out, ret);
+
+	for (i = 0; i < args->jobs; i++)
+		pthread_join(threads[i], NULL);
+
+err:
+	if (ctx.block) {
+		for (i = 0; i < ctx.num_blocks; i++) {
+			free(ctx.block[i].in);
+			free(ctx.block[i].out);
+		}
+		free(ctx.block);
+	}
+	free(threads);
+	free(ctx.line);
+	fclose(in);
+	if (fclose(out) && !ret) {
+		perror(args->output_file);
+		ret = -1;
+	}
 
 	return ret;
 }
@@ -169,5 +455,10 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
+	if (args.jobs <= 0)
+		args.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (args.jobs <= 0)
+		args.jobs = 1;
+
 	return convert_file(&args);
 }
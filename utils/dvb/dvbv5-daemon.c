@@ -33,8 +33,8 @@
 #include <argp.h>
 #include <config.h>
 #include <endian.h>
+#include <fcntl.h>
 #include <netinet/in.h>
-#include <poll.h>
 #include <pthread.h>
 #include <search.h>
 #include <signal.h>
@@ -43,7 +43,12 @@
 #include <stdio.h>
 #include <signal.h>
 #include <syslog.h>
+#include <sys/epoll.h>
+#include <sys/poll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <netdb.h>
@@ -85,6 +90,7 @@ static const char doc[] = N_(
 static const struct argp_option options[] = {
 	{"verbose",	'v',	0,		0,	N_("enables debug messages"), 0},
 	{"port",	'p',	"5555",		0,	N_("port to listen"), 0},
+	{"unix-socket",	'u',	"path",		0,	N_("UNIX socket to listen, for clients at the same machine"), 0},
 	{"help",        '?',	0,		0,	N_("Give this help list"), -1},
 	{"usage",	-3,	0,		0,	N_("Give a short usage message")},
 	{"version",	'V',	0,		0,	N_("Print program version"), -1},
@@ -92,6 +98,7 @@ static const struct argp_option options[] = {
 };
 
 static int port = 0;
+static char *unix_path = NULL;
 static int verbose = 0;
 
 static error_t parse_opt(int k, char *arg, struct argp_state *state)
@@ -100,6 +107,9 @@ static error_t parse_opt(int k, char *arg, struct argp_state *state)
 	case 'p':
 		port = atoi(arg);
 		break;
+	case 'u':
+		unix_path = arg;
+		break;
 	case 'v':
 		verbose	++;
 		break;
@@ -195,24 +205,57 @@ void local_log(int level, const char *fmt, ...)
  * Static data used by the code
  */
 
-static pthread_mutex_t msg_mutex;
-static pthread_mutex_t dvb_read_mutex;
-static pthread_t read_id = 0;
-
 struct dvb_descriptors {
 	int uid;
 	struct dvb_open_descriptor *open_dev;
 };
 
-static struct dvb_device *dvb = NULL;
-static void *desc_root = NULL;
-static int dvb_fd = -1;
+/*
+ * Each client connection is handled as a separate session, with its own
+ * struct dvb_device (and so its own frontend parameters), its own opened
+ * devices and its own thread forwarding the demux/dvr data. This way,
+ * several clients can use different adapters at the same time, and a
+ * slow client doesn't hold back the data sent to the others.
+ */
+struct session {
+	int fd;
+	pthread_mutex_t msg_mutex;
+
+	/* Client is on this machine, so it can receive file descriptors */
+	int is_unix;
+
+	/* Optional connection used only to send the TS data */
+	int data_fd;
+	uint32_t token;
+	struct session *next;
+
+	struct dvb_device *dvb;
+	char output_charset[256];
+	char default_charset[256];
+
+	/* Opened devices. Changes are protected by read_mutex */
+	pthread_mutex_t read_mutex;
+	void *desc_root;
+	int epoll_fd;
+	unsigned numfds;
+	pthread_t read_id;
+	int stop;
+
+	/* Throughput counters */
+	struct timespec start;
+	uint64_t data_bytes, data_msgs, data_errors;
+};
+
+/* Session handled by the current thread, used by the log callback */
+static __thread struct session *cur_session;
 
-static struct pollfd fds[NUM_FOPEN];
-static nfds_t numfds = 0;
+/* Sessions, used to find the one a data channel belongs to */
+static pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct session *sessions;
 
-static char output_charset[256] = "utf-8";
-static char default_charset[256] = "iso-8859-1";
+/* Only one session at a time can monitor device changes */
+static pthread_mutex_t monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct session *monitor_session;
 
 void stack_dump()
 {
@@ -246,15 +289,16 @@ static int dvb_desc_compare(const void *__a, const void *__b)
 	return (b->uid - a->uid);
 }
 
-static struct dvb_open_descriptor *get_open_dev(int uid)
+static struct dvb_open_descriptor *get_open_dev(struct session *session,
+						int uid)
 {
 	struct dvb_descriptors desc, **p;
 
-	if (!desc_root)
+	if (!session->desc_root)
 		return NULL;
 
 	desc.uid = uid;
-	p = tfind(&desc, &desc_root, dvb_desc_compare);
+	p = tfind(&desc, &session->desc_root, dvb_desc_compare);
 
 	if (!p) {
 		err("open element not retrieved!");
@@ -264,12 +308,12 @@ static struct dvb_open_descriptor *get_open_dev(int uid)
 	return (*p)->open_dev;
 }
 
-static void destroy_open_dev(int uid)
+static void destroy_open_dev(struct session *session, int uid)
 {
 	struct dvb_descriptors desc, **p;
 
 	desc.uid = uid;
-	p = tdelete(&desc, &desc_root, dvb_desc_compare);
+	p = tdelete(&desc, &session->desc_root, dvb_desc_compare);
 	if (!p)
 		err("can't destroy opened element");
 }
@@ -285,13 +329,13 @@ static void free_opendevs(void *node)
 	free (desc);
 }
 
-static void close_all_devs(void)
+static void close_all_devs(struct session *session)
 {
-	dvb_fd = -1;
-	numfds = 0;
-	tdestroy(desc_root, free_opendevs);
-
-	desc_root = NULL;
+	pthread_mutex_lock(&session->read_mutex);
+	session->numfds = 0;
+	tdestroy(session->desc_root, free_opendevs);
+	session->desc_root = NULL;
+	pthread_mutex_unlock(&session->read_mutex);
 }
 
 /*
@@ -303,9 +347,6 @@ static void sigterm_handler(int const sig_class)
 	info(PROGRAM_NAME" interrupted.");
 
 	pthread_exit(NULL);
-
-	close_all_devs();
-	dvb_dev_free(dvb);
 }
 
 static void start_signal_handler(void)
@@ -430,35 +471,67 @@ static ssize_t prepare_data(char *buf, const size_t size,
 	return ret;
 }
 
-static int send_buf(int fd, const char *buf, size_t size)
+/*
+ * Sends a message. If passed_fd is not -1, the file descriptor is also
+ * sent, via SCM_RIGHTS. This only works with UNIX sockets.
+ */
+static int send_buf_fd(struct session *session, const char *buf, size_t size,
+		       int passed_fd)
 {
+	union {
+		struct cmsghdr cmsg;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct iovec iov[2];
+	struct msghdr msg;
 	int ret;
 	int32_t i32;
 
-	if (fd < 0)
-		return ECONNRESET;
+	if (session->fd < 0)
+		return -ECONNRESET;
 
-	pthread_mutex_lock(&msg_mutex);
 	i32 = htobe32(size);
-	ret = send(fd, (void *)&i32, 4, MSG_MORE);
-	if (ret >= 0)
-		ret = send(fd, buf, size, 0);
-	pthread_mutex_unlock(&msg_mutex);
+	iov[0].iov_base = &i32;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = (void *)buf;
+	iov[1].iov_len = size;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	if (passed_fd >= 0) {
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = &control;
+		msg.msg_controllen = sizeof(control);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+	}
+
+	pthread_mutex_lock(&session->msg_mutex);
+	ret = sendmsg(session->fd, &msg, MSG_NOSIGNAL);
+	pthread_mutex_unlock(&session->msg_mutex);
 	if (ret < 0) {
+		ret = -errno;
 		local_perror("write");
-		if (ret == ECONNRESET)
-			close_all_devs();
-
-		return errno;
+		return ret;
 	}
 
 	return ret;
 }
 
-static ssize_t send_data(int fd, const char *fmt, ...)
+static int send_buf(struct session *session, const char *buf, size_t size)
+{
+	return send_buf_fd(session, buf, size, -1);
+}
+
+static ssize_t send_data(struct session *session, const char *fmt, ...)
 	__attribute__ (( format( printf, 2, 3 )));
 
-static ssize_t send_data(int fd, const char *fmt, ...)
+static ssize_t send_data(struct session *session, const char *fmt, ...)
 {
 	char buf[REMOTE_BUF_SIZE];
 	va_list ap;
@@ -473,7 +546,7 @@ static ssize_t send_data(int fd, const char *fmt, ...)
 	if (ret < 0)
 		return ret;
 
-	return send_buf(fd, buf, ret);
+	return send_buf(session, buf, ret);
 }
 
 static ssize_t scan_data(char *buf, int buf_size, const char *fmt, ...)
@@ -569,8 +642,8 @@ void dvb_remote_log(int level, const char *fmt, ...)
 
 	va_end(ap);
 
-	if (dvb_fd > 0)
-		send_data(dvb_fd, "%i%s%i%s", 0, "log", level, buf);
+	if (cur_session)
+		send_data(cur_session, "%i%s%i%s", 0, "log", level, buf);
 	else
 		local_log(level, buf);
 
@@ -580,7 +653,11 @@ void dvb_remote_log(int level, const char *fmt, ...)
 static int dev_change_monitor(char *sysname,
 			      enum dvb_dev_change_type type)
 {
-	send_data(dvb_fd, "%i%s%i%s", 0, "dev_change", type, sysname);
+	pthread_mutex_lock(&monitor_mutex);
+	if (monitor_session)
+		send_data(monitor_session, "%i%s%i%s", 0, "dev_change",
+			  type, sysname);
+	pthread_mutex_unlock(&monitor_mutex);
 
 	return 0;
 }
@@ -589,15 +666,21 @@ static int dev_change_monitor(char *sysname,
 /*
  * command handler methods
  */
-static int daemon_get_version(uint32_t seq, char *cmd, int fd,
+static int daemon_get_version(struct session *session, uint32_t seq, char *cmd,
 			      char *buf, ssize_t size)
 {
 	int ret = 0;
 
-	return send_data(fd, "%i%s%i%s", seq, cmd, ret, argp_program_version);
+	/*
+	 * Optional features follow the version. Older clients just ignore
+	 * them.
+	 */
+	return send_data(session, "%i%s%i%s%s", seq, cmd, ret,
+			 argp_program_version, "data_channel");
 }
 
-static int dev_find(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
+static int dev_find(struct session *session, uint32_t seq, char *cmd,
+		    char *buf, ssize_t size)
 {
 	int enable_monitor = 0, ret;
 	dvb_dev_change_t handler = NULL;
@@ -606,24 +689,38 @@ static int dev_find(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
 	if (ret < 0)
 		goto error;
 
-	if (enable_monitor)
+	if (enable_monitor) {
+		pthread_mutex_lock(&monitor_mutex);
+		if (monitor_session && monitor_session != session) {
+			pthread_mutex_unlock(&monitor_mutex);
+			ret = -EBUSY;
+			goto error;
+		}
+		monitor_session = session;
+		pthread_mutex_unlock(&monitor_mutex);
 		handler = &dev_change_monitor;
+	}
 
-	ret = dvb_dev_find(dvb, handler);
+	ret = dvb_dev_find(session->dvb, handler);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_stop_monitor(uint32_t seq, char *cmd, int fd,
+static int dev_stop_monitor(struct session *session, uint32_t seq, char *cmd,
 			    char *buf, ssize_t size)
 {
-	dvb_dev_stop_monitor(dvb);
+	dvb_dev_stop_monitor(session->dvb);
+
+	pthread_mutex_lock(&monitor_mutex);
+	if (monitor_session == session)
+		monitor_session = NULL;
+	pthread_mutex_unlock(&monitor_mutex);
 
-	return send_data(fd, "%i%s%i", seq, cmd, 0);
+	return send_data(session, "%i%s%i", seq, cmd, 0);
 }
 
-static int dev_seek_by_sysname(uint32_t seq, char *cmd, int fd,
+static int dev_seek_by_sysname(struct session *session, uint32_t seq, char *cmd,
 			       char *buf, ssize_t size)
 {
 	struct dvb_dev_list *dev;
@@ -633,124 +730,194 @@ static int dev_seek_by_sysname(uint32_t seq, char *cmd, int fd,
 	if (ret < 0)
 		goto error;
 
-	dev = dvb_dev_seek_by_sysname(dvb, adapter, num, type);
+	dev = dvb_dev_seek_by_sysname(session->dvb, adapter, num, type);
 	if (!dev)
 		goto error;
 
-	return send_data(fd, "%i%s%i%s%s%s%i%s%s%s%s%s", seq, cmd, ret,
+	return send_data(session, "%i%s%i%s%s%s%i%s%s%s%s%s", seq, cmd, ret,
 			 dev->syspath, dev->path, dev->sysname, dev->dvb_type,
 			 dev->bus_addr, dev->bus_id, dev->manufacturer,
 			 dev->product, dev->serial);
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
+}
+
+/* Sends a whole data channel frame, or fails */
+static int send_all(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+	ssize_t ret;
+
+	while (size) {
+		ret = send(fd, p, size, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		size -= ret;
+	}
+	return 0;
 }
 
+/*
+ * Forwards the data of all demux/dvr devices of a session with a pending
+ * read. The data is read straight after the room reserved for the message
+ * header, so it is only copied once before being sent.
+ */
 static void *read_data(void *privdata)
 {
+	struct session *session = privdata;
 	struct dvb_open_descriptor *open_dev;
+	struct epoll_event events[NUM_FOPEN];
 	int timeout;
-	int ret, read_ret = -1, fd, i;
-	char databuf[REMOTE_BUF_SIZE];
-	char buf[REMOTE_BUF_SIZE + 32], *p;
-	size_t size;
-	size_t count;
-	struct pollfd __fds[NUM_FOPEN];
-	nfds_t __numfds;
-
-	timeout = 10; /* ms */
-	while (1) {
-		pthread_mutex_lock(&dvb_read_mutex);
-		if (!numfds) {
-			pthread_mutex_unlock(&dvb_read_mutex);
-			break;
-		}
-		__numfds = numfds;
-		memcpy(__fds, fds, sizeof(fds));
-		pthread_mutex_unlock(&dvb_read_mutex);
-
-		ret = poll(__fds, __numfds, timeout);
-		if (!ret)
+	int ret, read_ret = -1, fd, data_fd, i, nevents;
+	char buf[REMOTE_BUF_SIZE + 32], *databuf;
+	struct dvb_remote_data_hdr *data_hdr;
+	ssize_t hdr_size;
+
+	cur_session = session;
+
+	/* All fields of the header have a fixed size */
+	hdr_size = prepare_data(buf, sizeof(buf), "%i%s%i%i", 0, "data_read",
+				0, 0);
+	if (hdr_size < 0) {
+		err("Failed to prepare answer to dvb_read()");
+		return NULL;
+	}
+	databuf = buf + hdr_size;
+	data_hdr = (void *)(databuf - sizeof(*data_hdr));
+
+	timeout = 100; /* ms */
+	while (!session->stop) {
+		nevents = epoll_wait(session->epoll_fd, events, NUM_FOPEN,
+				     timeout);
+		if (!nevents)
 			continue;
-		if (ret < 0) {
-			err("poll");
+		if (nevents < 0) {
+			if (errno != EINTR)
+				err("epoll_wait");
 			continue;
 		}
 
-		for (i = 0; i < __numfds; i++) {
-			if (__fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+		/* Service every ready fd, so none of them starves */
+		for (i = 0; i < nevents; i++) {
+			fd = events[i].data.fd;
+
+			/* Don't let the device be closed while reading it */
+			pthread_mutex_lock(&session->read_mutex);
+			open_dev = get_open_dev(session, fd);
+			if (open_dev)
+				read_ret = dvb_dev_read(open_dev, databuf,
+							REMOTE_BUF_SIZE);
+			data_fd = session->data_fd;
+			pthread_mutex_unlock(&session->read_mutex);
+			if (!open_dev) {
+				err("Couldn't find opened file %d", fd);
 				continue;
-			if (__fds[i].revents)
-				break;
-		}
-
-		/*
-		 * it means that one error condition happened.
-		 * Likely the file was closed.
-		 */
-		if (i == __numfds)
-			continue;
+			}
 
-		fd = __fds[i].fd;
+			if (verbose) {
+				if (read_ret < 0)
+					dbg("#%d: read error: %d on %p", fd, read_ret, open_dev);
+				else
+					dbg("#%d: read %d bytes", fd, read_ret);
+			}
 
-		if (!desc_root)
-			break;
+			if (data_fd >= 0) {
+				data_hdr->uid = htobe32(fd);
+				data_hdr->len = htobe32(read_ret);
+				ret = send_all(data_fd, data_hdr,
+					       sizeof(*data_hdr) + (read_ret > 0 ? read_ret : 0));
+				if (ret < 0) {
+					/*
+					 * The client drops a partial frame when
+					 * the channel closes: resend it, and
+					 * everything else, via the command
+					 * connection.
+					 */
+					err("data channel error %d: using the command connection",
+					    ret);
+					pthread_mutex_lock(&session->read_mutex);
+					if (session->data_fd == data_fd) {
+						close(data_fd);
+						session->data_fd = -1;
+					}
+					pthread_mutex_unlock(&session->read_mutex);
+					data_fd = -1;
+				}
+			}
+			if (data_fd < 0) {
+				prepare_data(buf, hdr_size, "%i%s%i%i", 0,
+					     "data_read", read_ret, fd);
 
-		open_dev = get_open_dev(fd);
-		if (!open_dev) {
-			err("Couldn't find opened file %d", fd);
-			continue;
-		}
+				ret = send_buf(session, buf,
+					       hdr_size + (read_ret > 0 ? read_ret : 0));
+			}
+			if (ret < 0) {
+				err("Error %d sending buffer\n", ret);
+				if (ret == -ECONNRESET || ret == -EPIPE) {
+					/* Let the session thread tear it down */
+					shutdown(session->fd, SHUT_RDWR);
+					goto out;
+				}
+				continue;
+			}
 
-		count = REMOTE_BUF_SIZE;
-		read_ret = dvb_dev_read(open_dev, databuf, count);
-		if (verbose) {
-			if (read_ret < 0)
-				dbg("#%d: read error: %d on %p", fd, read_ret, open_dev);
+			session->data_msgs++;
+			if (read_ret > 0)
+				session->data_bytes += read_ret;
 			else
-				dbg("#%d: read %d bytes (count %d)", fd, read_ret, count);
+				session->data_errors++;
 		}
+	}
 
-		/* Initialize to the start of the buffer */
-		p = buf;
-		size = sizeof(buf);
+out:
+	dbg("Finishing kthread");
+	return NULL;
+}
 
-		ret = prepare_data(p, size, "%i%s%i%i", 0, "data_read",
-				   read_ret, fd);
-		if (ret < 0) {
-			err("Failed to prepare answer to dvb_read()");
-			break;
-		}
+/*
+ * Starts reading a demux/dvr fd, forwarding its data to the client.
+ */
+static int start_polling(struct session *session,
+			 struct dvb_open_descriptor *open_dev)
+{
+	struct epoll_event ev;
+	int ret;
 
-		p += ret;
-		size -= ret;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.fd = open_dev->fd;
 
-		if (read_ret > 0) {
-			if (read_ret > size) {
-				dbg("buffer to short to store read data!");
-				read_ret = -EOVERFLOW;
-			} else {
-				memcpy(p, databuf, read_ret);
-				p += read_ret;
-			}
-		}
+	pthread_mutex_lock(&session->read_mutex);
+	ret = epoll_ctl(session->epoll_fd, EPOLL_CTL_ADD, open_dev->fd, &ev);
+	if (ret < 0) {
+		ret = -errno;
+		local_perror("epoll_ctl");
+	} else {
+		session->numfds++;
+	}
+	pthread_mutex_unlock(&session->read_mutex);
+	if (ret < 0)
+		return ret;
 
-		ret = send_buf(dvb_fd, buf, p - buf);
-		if (ret < 0) {
-			err("Error %d sending buffer\n", ret);
-			if (ret == ECONNRESET) {
-				close_all_devs();
-				break;
-			}
-			continue;
+	if (!session->read_id) {
+		ret = pthread_create(&session->read_id, NULL, read_data,
+				     session);
+		if (ret) {
+			errno = ret;
+			local_perror("pthread_create");
+			session->read_id = 0;
+			return -ret;
 		}
 	}
-
-	dbg("Finishing kthread");
-	read_id = 0;
-	return NULL;
+	return 0;
 }
 
-static int dev_open(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
+static int dev_open(struct session *session, uint32_t seq, char *cmd,
+		    char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
 	struct dvb_dev_list *dev;
@@ -777,7 +944,7 @@ static int dev_open(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
 	 */
 	flags &= ~O_NONBLOCK;
 
-	open_dev = dvb_dev_open(dvb, sysname, flags);
+	open_dev = dvb_dev_open(session->dvb, sysname, flags);
 	if (!open_dev) {
 		ret = -errno;
 		free(desc);
@@ -788,90 +955,165 @@ static int dev_open(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
 	if (verbose)
 		dbg("open dev handler for %s: %p with uid#%d", sysname, open_dev, open_dev->fd);
 
-	dev = open_dev->dev;
-	if (dev->dvb_type == DVB_DEVICE_DEMUX ||
-	    dev->dvb_type == DVB_DEVICE_DVR) {
-		pthread_mutex_lock(&dvb_read_mutex);
-		fds[numfds].fd = open_dev->fd;
-		fds[numfds].events = POLLIN | POLLPRI;
-		numfds++;
-		pthread_mutex_unlock(&dvb_read_mutex);
-	}
-
-	if (!read_id) {
-		ret = pthread_create(&read_id, NULL, read_data, NULL);
-		if (ret < 0) {
-			local_perror("pthread_create");
-			pthread_mutex_unlock(&msg_mutex);
-			free(desc);
-			return -1;
-		}
-	}
-
-	pthread_mutex_unlock(&msg_mutex);
 	uid = open_dev->fd;
 
 	desc->uid = uid;
 	desc->open_dev = open_dev;
 
 	/* Add element to the desc_root tree */
-	p = tsearch(desc, &desc_root, dvb_desc_compare);
-	if (!p) {
-		local_perror("tsearch");
-		uid = 0;
-	}
-	if (*p != desc) {
-		err("uid %d was already opened!");
+	pthread_mutex_lock(&session->read_mutex);
+	p = tsearch(desc, &session->desc_root, dvb_desc_compare);
+	if (!p || *p != desc) {
+		if (!p) {
+			local_perror("tsearch");
+			ret = -ENOMEM;
+		} else {
+			err("uid %d was already opened!", uid);
+			ret = -EEXIST;
+		}
+		pthread_mutex_unlock(&session->read_mutex);
+		dvb_dev_close(open_dev);
+		free(desc);
+		goto error;
 	}
+	pthread_mutex_unlock(&session->read_mutex);
 
-	pthread_mutex_unlock(&msg_mutex);
+	/*
+	 * UNIX clients take the demux/dvr fd with dev_get_fd. The daemon
+	 * only reads it on their behalf if they ask for it with dev_forward,
+	 * as nothing should be forwarded before the client is ready for it.
+	 */
+	dev = open_dev->dev;
+	if (!session->is_unix &&
+	    (dev->dvb_type == DVB_DEVICE_DEMUX ||
+	     dev->dvb_type == DVB_DEVICE_DVR))
+		start_polling(session, open_dev);
 
-	ret = uid;
+	return send_data(session, "%i%s%i%i", seq, cmd, uid, dev->dvb_type);
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_close(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
+static int dev_close(struct session *session, uint32_t seq, char *cmd,
+		     char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
-	int uid, ret, i;
+	int uid, ret;
 
 	ret = scan_data(buf, size, "%i",  &uid);
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
+	open_dev = get_open_dev(session, uid);
 	if (!open_dev) {
 		err("Can't find uid to close");
 		ret = -1;
 		goto error;
 	}
 
-	/* Delete fd from the opened array */
-	pthread_mutex_lock(&dvb_read_mutex);
-	for (i = 0; i < numfds; i++) {
-		if (fds[i].fd != open_dev->fd)
-		    continue;
-		if (i < numfds - 1)
-			memmove(&fds[i], &fds[i + 1],
-				sizeof(*fds)*(numfds - i - 1));
-		numfds--;
-		break;
+	/* Stop polling the fd and wait for a pending read to finish */
+	pthread_mutex_lock(&session->read_mutex);
+	if (!epoll_ctl(session->epoll_fd, EPOLL_CTL_DEL, open_dev->fd, NULL))
+		session->numfds--;
+
+	dvb_dev_close(open_dev);
+	destroy_open_dev(session, uid);
+	pthread_mutex_unlock(&session->read_mutex);
+
+error:
+	return send_data(session, "%i%s%i", seq, cmd, ret);
+}
+
+static int dev_get_fd(struct session *session, uint32_t seq, char *cmd,
+		      char *buf, ssize_t size)
+{
+	struct dvb_open_descriptor *open_dev;
+	struct dvb_dev_list *dev;
+	char reply[REMOTE_BUF_SIZE];
+	int uid, ret;
+
+	ret = scan_data(buf, size, "%i",  &uid);
+	if (ret < 0)
+		goto error;
+
+	/* File descriptors can only be passed over UNIX sockets */
+	if (!session->is_unix) {
+		ret = -EPERM;
+		goto error;
 	}
-	pthread_mutex_unlock(&dvb_read_mutex);
-	if (read_id && !numfds) {
-		pthread_cancel(read_id);
-		read_id = 0;
+
+	open_dev = get_open_dev(session, uid);
+	if (!open_dev) {
+		ret = -1;
+		err("Can't find uid to pass");
+		goto error;
 	}
 
-	dvb_dev_close(open_dev);
-	destroy_open_dev(uid);
+	dev = open_dev->dev;
+	if (dev->dvb_type != DVB_DEVICE_DEMUX &&
+	    dev->dvb_type != DVB_DEVICE_DVR) {
+		ret = -EINVAL;
+		goto error;
+	}
+
+	/*
+	 * From now on, the client reads the data directly. Stop polling
+	 * the fd, in case it already asked for dev_forward, waiting for a
+	 * pending read to finish.
+	 */
+	pthread_mutex_lock(&session->read_mutex);
+	if (!epoll_ctl(session->epoll_fd, EPOLL_CTL_DEL, open_dev->fd, NULL))
+		session->numfds--;
+	pthread_mutex_unlock(&session->read_mutex);
+
+	ret = prepare_data(reply, sizeof(reply), "%i%s%i", seq, cmd, 0);
+	if (ret < 0)
+		goto error;
+
+	return send_buf_fd(session, reply, ret, open_dev->fd);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_dmx_stop(uint32_t seq, char *cmd, int fd,
+static int dev_forward(struct session *session, uint32_t seq, char *cmd,
+		       char *buf, ssize_t size)
+{
+	struct dvb_open_descriptor *open_dev;
+	struct dvb_dev_list *dev;
+	int uid, ret;
+
+	ret = scan_data(buf, size, "%i",  &uid);
+	if (ret < 0)
+		goto error;
+
+	/* Data from TCP clients is always forwarded */
+	if (!session->is_unix) {
+		ret = 0;
+		goto error;
+	}
+
+	open_dev = get_open_dev(session, uid);
+	if (!open_dev) {
+		ret = -1;
+		err("Can't find uid to forward");
+		goto error;
+	}
+
+	dev = open_dev->dev;
+	if (dev->dvb_type != DVB_DEVICE_DEMUX &&
+	    dev->dvb_type != DVB_DEVICE_DVR) {
+		ret = -EINVAL;
+		goto error;
+	}
+
+	ret = start_polling(session, open_dev);
+
+error:
+	return send_data(session, "%i%s%i", seq, cmd, ret);
+}
+
+static int dev_dmx_stop(struct session *session, uint32_t seq, char *cmd,
 			char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
@@ -881,7 +1123,7 @@ static int dev_dmx_stop(uint32_t seq, char *cmd, int fd,
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
+	open_dev = get_open_dev(session, uid);
 	if (!open_dev) {
 		ret = -1;
 		err("Can't find uid to stop");
@@ -891,10 +1133,10 @@ static int dev_dmx_stop(uint32_t seq, char *cmd, int fd,
 	dvb_dev_dmx_stop(open_dev);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_set_bufsize(uint32_t seq, char *cmd, int fd,
+static int dev_set_bufsize(struct session *session, uint32_t seq, char *cmd,
 			   char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
@@ -904,7 +1146,7 @@ static int dev_set_bufsize(uint32_t seq, char *cmd, int fd,
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
+	open_dev = get_open_dev(session, uid);
 	if (!open_dev) {
 		ret = -1;
 		err("Can't find uid to stop");
@@ -914,11 +1156,11 @@ static int dev_set_bufsize(uint32_t seq, char *cmd, int fd,
 	dvb_dev_set_bufsize(open_dev, bufsize);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_dmx_set_pesfilter(uint32_t seq, char *cmd, int fd,
-				 char *buf, ssize_t size)
+static int dev_dmx_set_pesfilter(struct session *session, uint32_t seq,
+				 char *cmd, char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
 	int uid, ret, pid, type, output, bufsize;
@@ -928,7 +1170,7 @@ static int dev_dmx_set_pesfilter(uint32_t seq, char *cmd, int fd,
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
+	open_dev = get_open_dev(session, uid);
 	if (!open_dev) {
 		ret = -1;
 		err("Can't find uid to set pesfilter");
@@ -938,11 +1180,11 @@ static int dev_dmx_set_pesfilter(uint32_t seq, char *cmd, int fd,
 	ret = dvb_dev_dmx_set_pesfilter(open_dev, pid, type, output, bufsize);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_dmx_set_section_filter(uint32_t seq, char *cmd, int fd,
-				      char *buf, ssize_t size)
+static int dev_dmx_set_section_filter(struct session *session, uint32_t seq,
+				      char *cmd, char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
 	int uid, ret, pid, filtsize, flags;
@@ -953,7 +1195,7 @@ static int dev_dmx_set_section_filter(uint32_t seq, char *cmd, int fd,
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
+	open_dev = get_open_dev(session, uid);
 	if (!open_dev) {
 		ret = -1;
 		err("Can't find uid to set section filter");
@@ -964,10 +1206,10 @@ static int dev_dmx_set_section_filter(uint32_t seq, char *cmd, int fd,
 					     mask, mode, flags);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_dmx_get_pmt_pid(uint32_t seq, char *cmd, int fd,
+static int dev_dmx_get_pmt_pid(struct session *session, uint32_t seq, char *cmd,
 			       char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
@@ -977,7 +1219,7 @@ static int dev_dmx_get_pmt_pid(uint32_t seq, char *cmd, int fd,
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
+	open_dev = get_open_dev(session, uid);
 	if (!open_dev) {
 		ret = -1;
 		err("Can't find uid to get PMT PID");
@@ -987,10 +1229,11 @@ static int dev_dmx_get_pmt_pid(uint32_t seq, char *cmd, int fd,
 	ret = dvb_dev_dmx_get_pmt_pid(open_dev, sid);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_scan(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
+static int dev_scan(struct session *session, uint32_t seq, char *cmd,
+		    char *buf, ssize_t size)
 {
 	int ret = -1;
 
@@ -1007,7 +1250,7 @@ static int dev_scan(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
+	open_dev = get_open_dev(session, uid);
 	if (!open_dev) {
 		ret = -1;
 		err("Can't find uid to scan");
@@ -1017,16 +1260,16 @@ static int dev_scan(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
 	ret = dvb_scan(foo);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 #else
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 #endif
 }
 
-static int dev_set_sys(uint32_t seq, char *cmd, int fd,
+static int dev_set_sys(struct session *session, uint32_t seq, char *cmd,
 		       char *buf, ssize_t size)
 {
-	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->fe_parms;
+	struct dvb_v5_fe_parms_priv *parms = (void *)session->dvb->fe_parms;
 	struct dvb_v5_fe_parms *p = (void *)parms;
 	int sys = 0, ret;
 
@@ -1036,13 +1279,13 @@ static int dev_set_sys(uint32_t seq, char *cmd, int fd,
 
 	ret = __dvb_set_sys(p, sys);
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_get_parms(uint32_t seq, char *cmd, int fd,
+static int dev_get_parms(struct session *session, uint32_t seq, char *cmd,
 			 char *inbuf, ssize_t insize)
 {
-	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->fe_parms;
+	struct dvb_v5_fe_parms_priv *parms = (void *)session->dvb->fe_parms;
 	struct dvb_v5_fe_parms *par = (void *)parms;
 	struct dvb_frontend_info *info = &par->info;
 	int ret, i;
@@ -1118,18 +1361,18 @@ static int dev_get_parms(uint32_t seq, char *cmd, int fd,
 		size -= ret;
 	}
 
-	strcpy(output_charset, par->output_charset);
-	strcpy(default_charset, par->default_charset);
+	strcpy(session->output_charset, par->output_charset);
+	strcpy(session->default_charset, par->default_charset);
 
-	return send_buf(fd, buf, p - buf);
+	return send_buf(session, buf, p - buf);
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_set_parms(uint32_t seq, char *cmd, int fd,
+static int dev_set_parms(struct session *session, uint32_t seq, char *cmd,
 			 char *buf, ssize_t size)
 {
-	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->fe_parms;
+	struct dvb_v5_fe_parms_priv *parms = (void *)session->dvb->fe_parms;
 	struct dvb_v5_fe_parms *par = (void *)parms;
 	int ret, i;
 	char *p = buf;
@@ -1148,7 +1391,8 @@ static int dev_set_parms(uint32_t seq, char *cmd, int fd,
 	ret = scan_data(p, size, "%i%i%s%i%i%i%i%s%s",
 			&par->abort, &par->lna, new_lnb,
 			&par->sat_number, &par->freq_bpf, &par->diseqc_wait,
-			&par->verbose, default_charset, output_charset);
+			&par->verbose, session->default_charset,
+			session->output_charset);
 
 	if (ret < 0)
 		goto error;
@@ -1191,19 +1435,19 @@ static int dev_set_parms(uint32_t seq, char *cmd, int fd,
 		par->lnb = dvb_sat_get_lnb(lnb);
 	}
 
-	par->output_charset = output_charset;
-	par->default_charset = default_charset;
+	par->output_charset = session->output_charset;
+	par->default_charset = session->default_charset;
 
 	ret = __dvb_fe_set_parms(par);
 
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
 }
 
-static int dev_get_stats(uint32_t seq, char *cmd, int fd,
+static int dev_get_stats(struct session *session, uint32_t seq, char *cmd,
 			 char *inbuf, ssize_t insize)
 {
-	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->fe_parms;
+	struct dvb_v5_fe_parms_priv *parms = (void *)session->dvb->fe_parms;
 	struct dvb_v5_stats *st = &parms->stats;
 	struct dvb_v5_fe_parms *par = (void *)parms;
 	int ret, i;
@@ -1270,59 +1514,177 @@ static int dev_get_stats(uint32_t seq, char *cmd, int fd,
 		size -= ret;
 	}
 
-	return send_buf(fd, buf, p - buf);
+	return send_buf(session, buf, p - buf);
 error:
-	return send_data(fd, "%i%s%i", seq, cmd, ret);
+	return send_data(session, "%i%s%i", seq, cmd, ret);
+}
+
+/*
+ * Data channel handshake: the client asks for a token on the command
+ * connection, then opens a new connection and sends it with "data_attach".
+ * That connection then only carries TS data.
+ */
+static int data_channel(struct session *session, uint32_t seq, char *cmd,
+			char *buf, ssize_t size)
+{
+	uint32_t token = 0;
+	int fd, ret = 0;
+
+	if (session->data_fd >= 0) {
+		ret = -EBUSY;
+		goto error;
+	}
+
+	fd = open("/dev/urandom", O_RDONLY);
+	if (fd >= 0) {
+		if (read(fd, &token, sizeof(token)) != sizeof(token))
+			token = 0;
+		close(fd);
+	}
+	if (!token) {
+		ret = -EIO;
+		goto error;
+	}
+
+	pthread_mutex_lock(&sessions_mutex);
+	session->token = token;
+	pthread_mutex_unlock(&sessions_mutex);
+
+	return send_data(session, "%i%s%i%i", seq, cmd, ret, token);
+error:
+	return send_data(session, "%i%s%i", seq, cmd, ret);
+}
+
+static int data_attach(struct session *session, uint32_t seq, char *cmd,
+		       char *buf, ssize_t size)
+{
+	struct dvb_remote_data_hdr ack = { 0, 0 };
+	struct session *owner;
+	int ret, token, bufsize;
+
+	/* Only a new connection can become a data channel */
+	if (session->dvb)
+		return send_data(session, "%i%s%i%s", 0, "log", LOG_ERR,
+				 "not a new connection");
+
+	ret = scan_data(buf, size, "%i", &token);
+	if (ret < 0 || !token)
+		goto error;
+
+	pthread_mutex_lock(&sessions_mutex);
+	for (owner = sessions; owner; owner = owner->next) {
+		if (owner != session && owner->token == (uint32_t)token)
+			break;
+	}
+	if (owner) {
+		owner->token = 0;
+		if (send(session->fd, &ack, sizeof(ack), MSG_NOSIGNAL) < 0) {
+			local_perror("send");
+			owner = NULL;
+		} else {
+			/* The owner's read_data() thread uses it */
+			pthread_mutex_lock(&owner->read_mutex);
+			owner->data_fd = session->fd;
+			pthread_mutex_unlock(&owner->read_mutex);
+			bufsize = REMOTE_BUF_SIZE * 32;
+			setsockopt(session->fd, SOL_SOCKET, SO_SNDBUF,
+				   (void *)&bufsize, (int)sizeof(bufsize));
+		}
+	}
+	pthread_mutex_unlock(&sessions_mutex);
+	if (!owner)
+		goto error;
+
+	if (verbose)
+		dbg("socket %d is the data channel of socket %d",
+		    session->fd, owner->fd);
+
+	/* The connection belongs to the other session from now on */
+	session->fd = -1;
+	return 0;
+
+error:
+	/* Don't give another chance to guess the token */
+	send_data(session, "%i%s%i%s", 0, "log", LOG_ERR,
+		  "invalid data channel token");
+	close(session->fd);
+	session->fd = -1;
+	return -EPERM;
 }
 
 /*
  * Structure with all methods with RPC calls
  */
 
-typedef int (*method_handler) (uint32_t seq, char *cmd, int fd,
-			       char *buf, ssize_t size);
+typedef int (*method_handler) (struct session *session, uint32_t seq,
+			       char *cmd, char *buf, ssize_t size);
 
 struct method_types {
 	char *name;
 	method_handler handler;
-	int locks_dvb;
 };
 
 static const struct method_types const methods[] = {
-	{"daemon_get_version", &daemon_get_version, 1},
-	{"dev_find", &dev_find, 0},
-	{"dev_stop_monitor", &dev_stop_monitor, 0},
-	{"dev_seek_by_sysname", &dev_seek_by_sysname, 0},
-	{"dev_open", &dev_open, 0},
-	{"dev_close", &dev_close, 0},
-	{"dev_dmx_stop", &dev_dmx_stop, 0},
-	{"dev_set_bufsize", &dev_set_bufsize, 0},
-	{"dev_dmx_set_pesfilter", &dev_dmx_set_pesfilter, 0},
-	{"dev_dmx_set_section_filter", &dev_dmx_set_section_filter, 0},
-	{"dev_dmx_get_pmt_pid", &dev_dmx_get_pmt_pid, 0},
-
-	{"dev_scan", &dev_scan, 0},
-
-	{"dev_set_sys", &dev_set_sys, 0},
-	{"fe_get_parms", &dev_get_parms, 0},
-	{"fe_set_parms", &dev_set_parms, 0},
-	{"fe_get_stats", &dev_get_stats, 0},
+	{"daemon_get_version", &daemon_get_version},
+	{"dev_find", &dev_find},
+	{"dev_stop_monitor", &dev_stop_monitor},
+	{"dev_seek_by_sysname", &dev_seek_by_sysname},
+	{"dev_open", &dev_open},
+	{"dev_close", &dev_close},
+	{"dev_get_fd", &dev_get_fd},
+	{"dev_forward", &dev_forward},
+	{"dev_dmx_stop", &dev_dmx_stop},
+	{"dev_set_bufsize", &dev_set_bufsize},
+	{"dev_dmx_set_pesfilter", &dev_dmx_set_pesfilter},
+	{"dev_dmx_set_section_filter", &dev_dmx_set_section_filter},
+	{"dev_dmx_get_pmt_pid", &dev_dmx_get_pmt_pid},
+
+	{"dev_scan", &dev_scan},
+
+	{"dev_set_sys", &dev_set_sys},
+	{"fe_get_parms", &dev_get_parms},
+	{"fe_set_parms", &dev_set_parms},
+	{"fe_get_stats", &dev_get_stats},
+
+	{"data_channel", &data_channel},
+	{"data_attach", &data_attach},
 
 	{}
 };
 
-static void *start_server(void *fd_pointer)
+static void *start_server(void *privdata)
 {
+	struct session *session = privdata, **s;
 	const struct method_types *method;
-	int fd = *(int *)fd_pointer, ret, flag = 1;
+	int fd = session->fd, ret, flag = 1;
 	char buf[REMOTE_BUF_SIZE + 8], cmd[80], *p;
 	ssize_t size;
 	uint32_t seq;
 	int bufsize;
+	struct timespec now;
+	double secs;
 
 	if (verbose)
 		dbg("Opening socket %d", fd);
 
+	cur_session = session;
+	pthread_mutex_init(&session->msg_mutex, NULL);
+	pthread_mutex_init(&session->read_mutex, NULL);
+	strcpy(session->output_charset, "utf-8");
+	strcpy(session->default_charset, "iso-8859-1");
+	clock_gettime(CLOCK_MONOTONIC, &session->start);
+
+	session->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (session->epoll_fd < 0) {
+		local_perror("epoll_create1");
+		goto free_session;
+	}
+
+	pthread_mutex_lock(&sessions_mutex);
+	session->next = sessions;
+	sessions = session;
+	pthread_mutex_unlock(&sessions_mutex);
+
 	/* Set a large buffer for read() to work better */
 	bufsize = REMOTE_BUF_SIZE;
 	setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
@@ -1345,7 +1707,7 @@ static void *start_server(void *fd_pointer)
 		if (ret < 0) {
 			if (verbose)
 				dbg("message too short: %d", size);
-			send_data(fd, "%i%s%i%s", 0, "log", LOG_ERR,
+			send_data(session, "%i%s%i%s", 0, "log", LOG_ERR,
 				  "msg too short");
 			continue;
 		}
@@ -1359,51 +1721,124 @@ static void *start_server(void *fd_pointer)
 		if (size > buf + sizeof(buf) - p) {
 			if (verbose)
 				dbg("data length too big: %d", size);
-			send_data(fd, "%i%s%i%s", 0, "log", LOG_ERR,
+			send_data(session, "%i%s%i%s", 0, "log", LOG_ERR,
 				  "data length too big");
 			continue;
 		}
 
+		/*
+		 * Allocate DVB structure and start seek for devices, unless
+		 * this connection is just a data channel
+		 */
+		if (!session->dvb && strcmp(cmd, "data_attach")) {
+			session->dvb = dvb_dev_alloc();
+			if (!session->dvb) {
+				err("Can't allocate DVB data\n");
+				break;
+			}
+
+			/* FIXME: should allow the caller to set the verbosity */
+			dvb_dev_set_log(session->dvb, 1, dvb_remote_log);
+
+			dvb_dev_find(session->dvb, 0);
+		}
+
 		method = methods;
 		while (method->name) {
 			if (!strcmp(cmd, method->name)) {
-				if (dvb_fd > 0 || method->locks_dvb) {
-					ret = method->handler(seq, cmd,
-							      fd, p, size);
-					if (ret < 0)
-						break;
-					if (method->locks_dvb)
-						dvb_fd = fd;
-					break;
-				}
-				send_data(fd, "%i%s%i%s", 0, "log", LOG_ERR,
-					  "daemon busy");
+				method->handler(session, seq, cmd, p, size);
 				break;
 			}
 			method++;
 		}
+
+		/*
+		 * The connection became the data channel of another session,
+		 * or was dropped by data_attach()
+		 */
+		if (session->fd < 0)
+			break;
 		if (!method->name) {
 			if (verbose)
 				dbg("invalid command: %s", cmd);
-			send_data(fd, "%i%s%i%s", 0, "log", LOG_ERR,
+			send_data(session, "%i%s%i%s", 0, "log", LOG_ERR,
 				  "invalid command");
 		}
 	} while (1);
 
+	pthread_mutex_lock(&sessions_mutex);
+	for (s = &sessions; *s; s = &(*s)->next) {
+		if (*s == session) {
+			*s = session->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sessions_mutex);
+
+	if (session->fd < 0)
+		goto free_session;
+
 	if (verbose)
 		dbg("Closing socket %d", fd);
 
-	close(fd);
-	if (read_id) {
-		pthread_cancel(read_id);
-		read_id = 0;
+	if (session->read_id) {
+		session->stop = 1;
+		pthread_join(session->read_id, NULL);
 	}
-	if (dvb_fd > 0)
-		close_all_devs();
+
+	pthread_mutex_lock(&monitor_mutex);
+	if (monitor_session == session) {
+		dvb_dev_stop_monitor(session->dvb);
+		monitor_session = NULL;
+	}
+	pthread_mutex_unlock(&monitor_mutex);
+
+	close_all_devs(session);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = now.tv_sec - session->start.tv_sec +
+	       (now.tv_nsec - session->start.tv_nsec) / 1E9;
+	info("session %d: sent %llu bytes in %llu data messages (%llu errors), %.1f kB/s",
+	     fd, (unsigned long long)session->data_bytes,
+	     (unsigned long long)session->data_msgs,
+	     (unsigned long long)session->data_errors,
+	     secs > 0 ? session->data_bytes / secs / 1000 : 0);
+
+free_session:
+	cur_session = NULL;
+	if (session->dvb)
+		dvb_dev_free(session->dvb);
+	if (session->epoll_fd >= 0)
+		close(session->epoll_fd);
+	if (session->data_fd >= 0)
+		close(session->data_fd);
+	if (session->fd >= 0)
+		close(session->fd);
+	pthread_mutex_destroy(&session->read_mutex);
+	pthread_mutex_destroy(&session->msg_mutex);
+	free(session);
 
 	return NULL;
 }
 
+/*
+ * Removes a socket left by a previous run. Anything else at the path is
+ * kept, as it is likely a typo at the --unix argument.
+ */
+static int unlink_socket(const char *path)
+{
+	struct stat st;
+
+	if (lstat(path, &st) < 0)
+		return errno == ENOENT ? 0 : -errno;
+	if (!S_ISSOCK(st.st_mode))
+		return -EEXIST;
+	if (unlink(path) < 0)
+		return -errno;
+
+	return 0;
+}
+
 /*
  * main program
  */
@@ -1411,9 +1846,11 @@ static void *start_server(void *fd_pointer)
 int main(int argc, char *argv[])
 {
 	int ret;
-	int sockfd;
-	socklen_t addrlen;
-	struct sockaddr_in serv_addr, cli_addr;
+	int sockfd = -1, unix_fd = -1, unix_bound = 0;
+	unsigned nfds = 0, i;
+	struct sockaddr_in serv_addr;
+	struct sockaddr_un unix_addr;
+	struct pollfd fds[2];
 
 #ifdef ENABLE_NLS
 	setlocale (LC_ALL, "");
@@ -1426,50 +1863,79 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	if (!port) {
+	if (!port && !unix_path) {
 		argp_help(&argp, stderr, ARGP_HELP_SHORT_USAGE, PROGRAM_NAME);
 		return -1;
 	}
 
-	/* Allocate DVB structure and start seek for devices */
-	dvb = dvb_dev_alloc();
-	if (!dvb) {
-		err("Can't allocate DVB data\n");
-		return -1;
-	}
+	if (port) {
+		/* Create a socket */
+		sockfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (sockfd < 0) {
+			local_perror("socket");
+			goto error;
+		}
 
-	dvb_dev_find(dvb, 0);
+		/* Initialize listen address struct */
+		bzero((char *) &serv_addr, sizeof(serv_addr));
+		serv_addr.sin_family = AF_INET;
+		serv_addr.sin_addr.s_addr = INADDR_ANY;
+		serv_addr.sin_port = htons(port);
 
-	/* Create a socket */
-	sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	if (sockfd < 0) {
-		local_perror("socket");
-		goto error;
+		/* Bind to the address */
+		ret = bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
+		if (ret < 0) {
+			local_perror("bind");
+			goto error;
+		}
+
+		/* Listen up to 5 connections */
+		listen(sockfd, 5);
+		fds[nfds++].fd = sockfd;
 	}
 
-	/* Initialize listen address struct */
-	bzero((char *) &serv_addr, sizeof(serv_addr));
-	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_addr.s_addr = INADDR_ANY;
-	serv_addr.sin_port = htons(port);
+	if (unix_path) {
+		if (strlen(unix_path) >= sizeof(unix_addr.sun_path)) {
+			err("socket path too long: %s", unix_path);
+			goto error;
+		}
 
-	/* Bind to the address */
-	ret = bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
-	if (ret < 0) {
-		local_perror("bind");
-		goto error;
-	}
+		unix_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (unix_fd < 0) {
+			local_perror("socket");
+			goto error;
+		}
 
-	/* FIXME: should allow the caller to set the verbosity */
-	dvb_dev_set_log(dvb, 1, dvb_remote_log);
+		memset(&unix_addr, 0, sizeof(unix_addr));
+		unix_addr.sun_family = AF_UNIX;
+		strcpy(unix_addr.sun_path, unix_path);
 
-	/* Listen up to 5 connections */
-	listen(sockfd, 5);
-	addrlen = sizeof(cli_addr);
+		ret = unlink_socket(unix_path);
+		if (ret == -EEXIST) {
+			err("%s exists and it is not a socket", unix_path);
+			goto error;
+		}
+		if (ret < 0) {
+			errno = -ret;
+			local_perror(unix_path);
+			goto error;
+		}
+		ret = bind(unix_fd, (struct sockaddr *)&unix_addr,
+			   sizeof(unix_addr));
+		if (ret < 0) {
+			local_perror("bind");
+			goto error;
+		}
+		unix_bound = 1;
+
+		listen(unix_fd, 5);
+		fds[nfds++].fd = unix_fd;
+	}
+
+	for (i = 0; i < nfds; i++)
+		fds[i].events = POLLIN;
 
 	start_signal_handler();
-	pthread_mutex_init(&msg_mutex, NULL);
-	pthread_mutex_init(&dvb_read_mutex, NULL);
 
 	/* Accept actual connection from the client */
 
@@ -1484,36 +1950,65 @@ int main(int argc, char *argv[])
 	info(PROGRAM_NAME" started.");
 
 	while (1) {
+		struct session *session;
 		int fd;
 		pthread_t id;
 
 		if (verbose)
 			dbg("waiting for connections");
-		fd = accept(sockfd, (struct sockaddr *)&cli_addr, &addrlen);
-		if (fd < 0) {
-			local_perror("accept");
-			break;
-		}
 
-		if (verbose)
-			dbg("accepted connection %d", fd);
-		ret = pthread_create(&id, NULL, start_server, (void *)&fd);
+		ret = poll(fds, nfds, -1);
 		if (ret < 0) {
-			local_perror("pthread_create");
+			if (errno == EINTR)
+				continue;
+			local_perror("poll");
 			break;
 		}
+
+		for (i = 0; i < nfds; i++) {
+			if (!fds[i].revents)
+				continue;
+
+			fd = accept(fds[i].fd, NULL, NULL);
+			if (fd < 0) {
+				local_perror("accept");
+				continue;
+			}
+
+			if (verbose)
+				dbg("accepted connection %d", fd);
+			session = calloc(1, sizeof(*session));
+			if (!session) {
+				local_perror("calloc");
+				close(fd);
+				continue;
+			}
+			session->fd = fd;
+			session->data_fd = -1;
+			session->epoll_fd = -1;
+			session->is_unix = (fds[i].fd == unix_fd);
+
+			ret = pthread_create(&id, NULL, start_server, session);
+			if (ret) {
+				errno = ret;
+				local_perror("pthread_create");
+				close(fd);
+				free(session);
+				continue;
+			}
+			pthread_detach(id);
+		}
 	}
 
 	/* Just in case we add some way for the remote part to stop the daemon */
 	stop_signal_handler();
 
 error:
+	if (unix_bound)
+		unlink_socket(unix_path);
 	info(PROGRAM_NAME" stopped.");
 
 	pthread_exit(NULL);
 
-	if (dvb)
-		dvb_dev_free(dvb);
-
 	return -1;
 }
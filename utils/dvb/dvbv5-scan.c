@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <argp.h>
@@ -54,19 +55,23 @@
 
 #define PROGRAM_NAME	"dvbv5-scan"
 #define DEFAULT_OUTPUT  "dvb_channel.conf"
+#define MAX_SCAN_ADAPTERS 32
 
 const char *argp_program_version = PROGRAM_NAME " version " V4L_UTILS_VERSION;
 const char *argp_program_bug_address = "Mauro Carvalho Chehab <m.chehab@samsung.com>";
 
 struct arguments {
-	char *confname, *lnb_name, *output, *demux_dev;
+	char *confname, *lnb_name, *output, *demux_dev, *replay;
 	unsigned adapter, n_adapter, adapter_fe, adapter_dmx, frontend, demux, get_detected, get_nit;
 	int lna, lnb, sat_number, freq_bpf;
 	unsigned diseqc_wait, dont_add_new_freqs, timeout_multiply;
-	unsigned other_nit;
+	unsigned other_nit, table_filters;
 	enum dvb_file_formats input_format, output_format;
 	const char *cc;
 
+	/* Adapters used for parallel scan */
+	unsigned scan_adapter[MAX_SCAN_ADAPTERS], n_scan_adapters;
+
 	/* Used by status print */
 	unsigned n_status_lines;
 };
@@ -87,6 +92,9 @@ static const struct argp_option options[] = {
 	{"file-freqs-only", 'F', NULL,			0, N_("don't use the other frequencies discovered during scan"), 0},
 	{"timeout-multiply", 'T', N_("factor"),		0, N_("Multiply scan timeouts by this factor"), 0},
 	{"parse-other-nit", 'p', NULL,			0, N_("Parse the other NIT/SDT tables"), 0},
+	{"parallel",	'P',	N_("filters"),		0, N_("read up to this number of MPEG-TS tables at the same time"), 0},
+	{"adapters",	'A',	N_("list"),		0, N_("scan in parallel with the adapters on this list (like 0,1,4-7)"), 0},
+	{"replay",	'R',	N_("path"),		0, N_("scan a recorded MPEG-TS file, or a directory with one <frequency>.ts file per transponder, instead of an adapter"), 0},
 	{"input-format", 'I',	N_("format"),		0, N_("Input format: CHANNEL, DVBV5 (default: DVBV5)"), 0},
 	{"output-format", 'O',	N_("format"),		0, N_("Output format: VDR, CHANNEL, ZAP, DVBV5 (default: DVBV5)"), 0},
 	{"cc",		'C',	N_("country_code"),	0, N_("Set the default country to be used (in ISO 3166-1 two letter code)"), 0},
@@ -200,7 +208,8 @@ static int check_frontend(void *__args,
 		rc = dvb_fe_retrieve_stats(parms, DTV_STATUS, &status);
 		if (rc)
 			status = 0;
-		print_frontend_stats(args, parms);
+		if (args->n_scan_adapters < 2)
+			print_frontend_stats(args, parms);
 		if (status & FE_HAS_LOCK)
 			break;
 		usleep(100000);
@@ -213,40 +222,64 @@ static int check_frontend(void *__args,
 	return (status & FE_HAS_LOCK) ? 0 : -1;
 }
 
-static int run_scan(struct arguments *args, struct dvb_device *dvb)
+/*
+ * If the channel file has duplicated frequencies, or some entries without
+ * any frequency at all, they should be discarded.
+ */
+static int entry_is_needed(struct dvb_v5_fe_parms *parms,
+			   struct dvb_file *dvb_file, struct dvb_entry *entry,
+			   uint32_t *freq)
 {
-	struct dvb_v5_fe_parms *parms = dvb->fe_parms;
-	struct dvb_file *dvb_file = NULL, *dvb_file_new = NULL;
-	struct dvb_entry *entry;
-	struct dvb_open_descriptor *dmx_fd;
-	int count = 0, shift;
-	uint32_t freq, sys;
 	enum dvb_sat_polarization pol;
+	uint32_t stream_id;
+	int shift;
+
+	if (dvb_retrieve_entry_prop(entry, DTV_FREQUENCY, freq))
+		return 0;
+	shift = dvb_estimate_freq_shift(parms);
 
+	if (dvb_retrieve_entry_prop(entry, DTV_POLARIZATION, &pol))
+		pol = POLARIZATION_OFF;
+
+	if (dvb_retrieve_entry_prop(entry, DTV_STREAM_ID, &stream_id))
+		stream_id = NO_STREAM_ID_FILTER;
+
+	return dvb_new_entry_is_needed(dvb_file->first_entry, entry,
+				       *freq, shift, pol, stream_id);
+}
+
+static uint32_t get_file_sys(struct dvb_v5_fe_parms *parms)
+{
 	/* This is used only when reading old formats */
 	switch (parms->current_sys) {
 	case SYS_DVBT:
 	case SYS_DVBS:
 	case SYS_DVBC_ANNEX_A:
 	case SYS_ATSC:
-		sys = parms->current_sys;
-		break;
+		return parms->current_sys;
 	case SYS_DVBC_ANNEX_C:
-		sys = SYS_DVBC_ANNEX_A;
-		break;
+		return SYS_DVBC_ANNEX_A;
 	case SYS_DVBC_ANNEX_B:
-		sys = SYS_ATSC;
-		break;
+		return SYS_ATSC;
 	case SYS_ISDBT:
 	case SYS_DTMB:
-		sys = SYS_DVBT;
-		break;
+		return SYS_DVBT;
 	default:
-		sys = SYS_UNDEFINED;
-		break;
+		return SYS_UNDEFINED;
 	}
-	dvb_file = dvb_read_file_format(args->confname, sys,
-				    args->input_format);
+}
+
+static int run_scan(struct arguments *args, struct dvb_device *dvb)
+{
+	struct dvb_v5_fe_parms *parms = dvb->fe_parms;
+	struct dvb_file *dvb_file = NULL, *dvb_file_new = NULL;
+	struct dvb_entry *entry;
+	struct dvb_open_descriptor *dmx_fd;
+	int count = 0;
+	uint32_t freq;
+
+	dvb_file = dvb_read_file_format(args->confname, get_file_sys(parms),
+					args->input_format);
 	if (!dvb_file)
 		return -2;
 
@@ -259,24 +292,8 @@ static int run_scan(struct arguments *args, struct dvb_device *dvb)
 
 	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
 		struct dvb_v5_descriptors *dvb_scan_handler = NULL;
-		uint32_t stream_id;
-
-		/*
-		 * If the channel file has duplicated frequencies, or some
-		 * entries without any frequency at all, discard.
-		 */
-		if (dvb_retrieve_entry_prop(entry, DTV_FREQUENCY, &freq))
-			continue;
-		shift = dvb_estimate_freq_shift(parms);
-
-		if (dvb_retrieve_entry_prop(entry, DTV_POLARIZATION, &pol))
-			pol = POLARIZATION_OFF;
-
-		if (dvb_retrieve_entry_prop(entry, DTV_STREAM_ID, &stream_id))
-			stream_id = NO_STREAM_ID_FILTER;
 
-		if (!dvb_new_entry_is_needed(dvb_file->first_entry, entry,
-						  freq, shift, pol, stream_id))
+		if (!entry_is_needed(parms, dvb_file, entry, &freq))
 			continue;
 
 		count++;
@@ -396,6 +413,9 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	case 'p':
 		args->other_nit++;
 		break;
+	case 'P':
+		args->table_filters = strtoul(optarg, NULL, 0);
+		break;
 	case 'v':
 		verbose++;
 		break;
@@ -411,9 +431,33 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	case 'o':
 		args->output = optarg;
 		break;
+	case 'R':
+		args->replay = optarg;
+		break;
 	case 'C':
 		args->cc = strndup(optarg, 2);
 		break;
+	case 'A': {
+		char *p = optarg;
+		unsigned first, last;
+
+		while (*p) {
+			first = last = strtoul(p, &p, 0);
+			if (*p == '-')
+				last = strtoul(p + 1, &p, 0);
+			while (first <= last) {
+				if (args->n_scan_adapters == MAX_SCAN_ADAPTERS)
+					argp_error(state, _("too many adapters"));
+				args->scan_adapter[args->n_scan_adapters++] = first++;
+			}
+			if (*p && *p != ',')
+				argp_error(state, _("invalid adapter list: %s"),
+					   optarg);
+			if (*p)
+				p++;
+		}
+		break;
+	}
 	case '?':
 		argp_state_help(state, state->out_stream,
 				ARGP_HELP_SHORT_USAGE | ARGP_HELP_LONG
@@ -432,13 +476,17 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	return 0;
 }
 
-static int *timeout_flag;
+static int *timeout_flag[MAX_SCAN_ADAPTERS];
+static unsigned n_timeout_flags;
 
 static void do_timeout(int x)
 {
+	unsigned i;
+
 	(void)x;
-	if (*timeout_flag == 0) {
-		*timeout_flag = 1;
+	if (*timeout_flag[0] == 0) {
+		for (i = 0; i < n_timeout_flags; i++)
+			*timeout_flag[i] = 1;
 		alarm(5);
 		signal(SIGALRM, do_timeout);
 	} else {
@@ -447,6 +495,298 @@ static void do_timeout(int x)
 	}
 }
 
+/*
+ * Parallel scan: each adapter has its own thread, picking the next
+ * transponder from the shared list as soon as it is done with the previous
+ * one. Results are committed in the same order as the transponders were
+ * taken from the list, so the output file and the transponders found via
+ * NIT don't depend on which adapter finished first.
+ */
+
+struct scan_result {
+	unsigned seq;
+	struct dvb_file *channels;
+	struct dvb_entry *new_freqs;
+	struct scan_result *next;
+};
+
+struct scan_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct dvb_file *dvb_file, *dvb_file_new;
+	struct dvb_entry *last;		/* last entry taken from the list */
+	struct scan_result *pending;	/* sorted by seq */
+	unsigned seq, committed, busy;
+	int count;
+};
+
+struct scan_worker {
+	struct arguments args;
+	struct scan_queue *q;
+	unsigned adapter;
+	struct dvb_device *dvb;
+	struct dvb_open_descriptor *dmx_fd;
+	pthread_t thread;
+};
+
+static void append_entries(struct dvb_entry **list, struct dvb_entry *entries)
+{
+	while (*list)
+		list = &(*list)->next;
+	*list = entries;
+}
+
+/* Must be called with q->lock held */
+static void scan_queue_commit(struct scan_queue *q, struct scan_result *res)
+{
+	struct scan_result **p = &q->pending;
+
+	while (*p && (*p)->seq < res->seq)
+		p = &(*p)->next;
+	res->next = *p;
+	*p = res;
+
+	while (q->pending && q->pending->seq == q->committed) {
+		res = q->pending;
+		q->pending = res->next;
+
+		if (res->channels) {
+			if (!q->dvb_file_new) {
+				q->dvb_file_new = res->channels;
+			} else {
+				append_entries(&q->dvb_file_new->first_entry,
+					       res->channels->first_entry);
+				q->dvb_file_new->n_entries += res->channels->n_entries;
+				free(res->channels);
+			}
+		}
+		if (res->new_freqs)
+			append_entries(&q->dvb_file->first_entry,
+				       res->new_freqs);
+		q->committed++;
+		free(res);
+	}
+}
+
+/* Must be called with q->lock held */
+static struct dvb_entry *scan_queue_get(struct scan_queue *q,
+					struct scan_worker *w,
+					struct scan_result **res)
+{
+	struct dvb_v5_fe_parms *parms = w->dvb->fe_parms;
+	struct dvb_entry *entry;
+	uint32_t freq;
+
+	*res = calloc(1, sizeof(**res));
+	if (!*res)
+		return NULL;
+
+	while (!parms->abort) {
+		entry = q->last ? q->last->next : q->dvb_file->first_entry;
+		for (; entry; entry = entry->next) {
+			q->last = entry;
+			if (!entry_is_needed(parms, q->dvb_file, entry, &freq))
+				continue;
+
+			(*res)->seq = q->seq++;
+			q->count++;
+			dvb_log(_("Scanning frequency #%d %d on adapter %d"),
+				q->count, freq, w->adapter);
+			return entry;
+		}
+
+		/* Scans in progress may still add new transponders */
+		if (!q->busy)
+			break;
+		pthread_cond_wait(&q->cond, &q->lock);
+	}
+
+	free(*res);
+	return NULL;
+}
+
+static void *scan_thread(void *__w)
+{
+	struct scan_worker *w = __w;
+	struct scan_queue *q = w->q;
+	struct arguments *args = &w->args;
+	struct dvb_v5_fe_parms *parms = w->dvb->fe_parms;
+	struct dvb_v5_descriptors *dvb_scan_handler;
+	struct dvb_entry *entry, tmp;
+	struct scan_result *res;
+
+	pthread_mutex_lock(&q->lock);
+	while ((entry = scan_queue_get(q, w, &res))) {
+		q->busy++;
+		pthread_mutex_unlock(&q->lock);
+
+		if (!args->lnb_name && entry->lnb &&
+		    (!parms->lnb || strcasecmp(entry->lnb, parms->lnb->alias)))
+			parms->lnb = dvb_sat_get_lnb(dvb_sat_search_lnb(entry->lnb));
+
+		dvb_scan_handler = dvb_dev_scan(w->dmx_fd, entry,
+						&check_frontend, args,
+						args->other_nit,
+						args->timeout_multiply);
+
+		if (dvb_scan_handler && !parms->abort) {
+			dvb_store_channel(&res->channels, parms,
+					  dvb_scan_handler,
+					  args->get_detected, args->get_nit);
+
+			/*
+			 * Collect the new transponders on a private list,
+			 * starting with a copy of this entry. They're added
+			 * to the scan list when this result is committed.
+			 */
+			if (!args->dont_add_new_freqs) {
+				memset(&tmp, 0, sizeof(tmp));
+				memcpy(tmp.props, entry->props, sizeof(tmp.props));
+				tmp.n_props = entry->n_props;
+				tmp.sat_number = entry->sat_number;
+				tmp.freq_bpf = entry->freq_bpf;
+				tmp.diseqc_wait = entry->diseqc_wait;
+				tmp.lnb = entry->lnb;
+
+				pthread_mutex_lock(&q->lock);
+				dvb_add_scaned_transponders(parms, dvb_scan_handler,
+							    q->dvb_file->first_entry,
+							    &tmp);
+				pthread_mutex_unlock(&q->lock);
+				res->new_freqs = tmp.next;
+			}
+		}
+		dvb_scan_free_handler_table(dvb_scan_handler);
+
+		pthread_mutex_lock(&q->lock);
+		q->busy--;
+		scan_queue_commit(q, res);
+		pthread_cond_broadcast(&q->cond);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return NULL;
+}
+
+static int scan_worker_open(struct scan_worker *w, int lnb)
+{
+	struct arguments *args = &w->args;
+	struct dvb_v5_fe_parms *parms;
+	struct dvb_dev_list *dvb_dev;
+
+	w->dvb = dvb_dev_alloc();
+	if (!w->dvb)
+		return -1;
+	dvb_dev_set_log(w->dvb, verbose, NULL);
+	dvb_dev_find(w->dvb, NULL);
+	parms = w->dvb->fe_parms;
+
+	dvb_dev = dvb_dev_seek_by_sysname(w->dvb, w->adapter, args->frontend,
+					  DVB_DEVICE_FRONTEND);
+	if (!dvb_dev || !dvb_dev_open(w->dvb, dvb_dev->sysname, O_RDWR)) {
+		fprintf(stderr, _("Couldn't open the frontend of adapter %d\n"),
+			w->adapter);
+		return -1;
+	}
+
+	dvb_dev = dvb_dev_seek_by_sysname(w->dvb, w->adapter, args->demux,
+					  DVB_DEVICE_DEMUX);
+	if (dvb_dev)
+		w->dmx_fd = dvb_dev_open(w->dvb, dvb_dev->sysname, O_RDWR);
+	if (!w->dmx_fd) {
+		fprintf(stderr, _("Couldn't open the demux of adapter %d\n"),
+			w->adapter);
+		return -1;
+	}
+
+	if (lnb >= 0)
+		parms->lnb = dvb_sat_get_lnb(lnb);
+	if (args->sat_number >= 0)
+		parms->sat_number = args->sat_number % 3;
+	parms->diseqc_wait = args->diseqc_wait;
+	parms->freq_bpf = args->freq_bpf;
+	parms->lna = args->lna;
+	if (dvb_fe_set_default_country(parms, args->cc) < 0)
+		fprintf(stderr, _("Failed to set the country code:%s\n"), args->cc);
+	dvb_scan_set_table_filters(parms, args->table_filters);
+
+	return 0;
+}
+
+static int run_parallel_scan(struct arguments *args, int lnb)
+{
+	struct scan_worker *workers;
+	struct scan_queue q;
+	struct dvb_v5_fe_parms *parms;
+	unsigned i, j, n = args->n_scan_adapters;
+	int ret = 0;
+
+	workers = calloc(n, sizeof(*workers));
+	if (!workers)
+		return -1;
+
+	memset(&q, 0, sizeof(q));
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.cond, NULL);
+
+	for (i = 0; i < n; i++) {
+		workers[i].args = *args;
+		workers[i].q = &q;
+		workers[i].adapter = args->scan_adapter[i];
+		if (scan_worker_open(&workers[i], lnb)) {
+			ret = -3;
+			goto free;
+		}
+		timeout_flag[i] = &workers[i].dvb->fe_parms->abort;
+	}
+	n_timeout_flags = n;
+	parms = workers[0].dvb->fe_parms;
+
+	q.dvb_file = dvb_read_file_format(args->confname, get_file_sys(parms),
+					  args->input_format);
+	if (!q.dvb_file) {
+		ret = -2;
+		goto free;
+	}
+
+	signal(SIGTERM, do_timeout);
+	signal(SIGINT, do_timeout);
+
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&workers[i].thread, NULL, scan_thread,
+				   &workers[i])) {
+			PERROR(_("pthread_create"));
+			for (j = 0; j < n; j++)
+				*timeout_flag[j] = 1;
+			n = i;
+			ret = -1;
+			break;
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	if (q.dvb_file_new) {
+		dvb_write_file_format(args->output, q.dvb_file_new,
+				      parms->current_sys, args->output_format);
+		dvb_file_free(q.dvb_file_new);
+	}
+	dvb_file_free(q.dvb_file);
+
+free:
+	for (i = 0; i < args->n_scan_adapters; i++) {
+		if (workers[i].dmx_fd)
+			dvb_dev_close(workers[i].dmx_fd);
+		if (workers[i].dvb)
+			dvb_dev_free(workers[i].dvb);
+	}
+	free(workers);
+	pthread_cond_destroy(&q.cond);
+	pthread_mutex_destroy(&q.lock);
+
+	return ret;
+}
 
 int main(int argc, char **argv)
 {
@@ -517,10 +857,25 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
+	if (args.replay && args.n_scan_adapters) {
+		fprintf(stderr, _("ERROR: --replay can't be used with --adapters\n"));
+		return -1;
+	}
+	if (args.n_scan_adapters > 1)
+		return run_parallel_scan(&args, lnb);
+	if (args.n_scan_adapters == 1) {
+		args.adapter_fe = args.scan_adapter[0];
+		args.adapter_dmx = args.scan_adapter[0];
+	}
+
 	dvb = dvb_dev_alloc();
 	if (!dvb)
 		return -1;
 	dvb_dev_set_log(dvb, verbose, NULL);
+	if (args.replay && dvb_dev_file_init(dvb, args.replay) < 0) {
+		dvb_dev_free(dvb);
+		return -1;
+	}
 	dvb_dev_find(dvb, NULL);
 	parms = dvb->fe_parms;
 
@@ -551,11 +906,13 @@ int main(int argc, char **argv)
 	parms->diseqc_wait = args.diseqc_wait;
 	parms->freq_bpf = args.freq_bpf;
 	parms->lna = args.lna;
+	dvb_scan_set_table_filters(parms, args.table_filters);
 	err = dvb_fe_set_default_country(parms, args.cc);
 	if (err < 0)
 		fprintf(stderr, _("Failed to set the country code:%s\n"), args.cc);
 
-	timeout_flag = &parms->abort;
+	timeout_flag[0] = &parms->abort;
+	n_timeout_flags = 1;
 	signal(SIGTERM, do_timeout);
 	signal(SIGINT, do_timeout);
 
@@ -30,8 +30,16 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <argp.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 
 #include <config.h>
@@ -55,6 +63,7 @@
 #include "libdvbv5/dvb-scan.h"
 #include "libdvbv5/header.h"
 #include "libdvbv5/countries.h"
+#include "libdvbv5/dvb-spts.h"
 
 #define CHANNEL_FILE	"channels.conf"
 #define PROGRAM_NAME	"dvbv5-zap"
@@ -64,7 +73,7 @@ const char *argp_program_bug_address = "Mauro Carvalho Chehab <m.chehab@samsung.
 
 struct arguments {
 	char *confname, *lnb_name, *output, *demux_dev, *dvr_dev, *dvr_fname;
-	char *filename, *dvr_pipe;
+	char *filename, *dvr_pipe, *cache_fname;
 	unsigned adapter, frontend, demux, get_detected, get_nit;
 	int lna, lnb, sat_number;
 	unsigned diseqc_wait, silent, verbose, frontend_only, freq_bpf;
@@ -72,6 +81,9 @@ struct arguments {
 	unsigned n_apid, n_vpid, all_pids;
 	enum dvb_file_formats input_format, output_format;
 	unsigned traffic_monitor, low_traffic, non_human, port;
+	unsigned rec_buffer, splice;
+	char *spts[DVB_SPTS_MAX_OUTPUTS];
+	unsigned n_spts;
 	char *search, *server;
 	const char *cc;
 
@@ -83,6 +95,7 @@ static const struct argp_option options[] = {
 	{"adapter",	'a', N_("adapter#"),		0, N_("use given adapter (default 0)"), 0},
 	{"audio_pid",	'A', N_("audio_pid#"),		0, N_("audio pid program to use (default 0)"), 0},
 	{"channels",	'c', N_("file"),		0, N_("read channels list from 'file'"), 0},
+	{"cache",	'k', N_("file"),		0, N_("keep a parsed copy of the channels list at 'file', for faster startup"), 0},
 	{"demux",	'd', N_("demux#"),		0, N_("use given demux (default 0)"), 0},
 	{"frontend",	'f', N_("frontend#"),		0, N_("use given frontend (default 0)"), 0},
 	{"input-format", 'I',	N_("format"),		0, N_("Input format: ZAP, CHANNEL, DVBV5 (default: DVBV5)"), 0},
@@ -105,9 +118,12 @@ static const struct argp_option options[] = {
 	{"low_traffic",	'X', NULL,			0, N_("also shows DVB traffic with less then 1 packet per second"), 0},
 	{"cc",		'C', N_("country_code"),	0, N_("Set the default country to be used (in ISO 3166-1 two letter code)"), 0},
 	{"non-numan",	'N', NULL,			0, N_("Non-human formatted stats (useful for scripts)"), 0},
-	{"server",	'H', N_("SERVER"),		0, N_("dvbv5-daemon host IP address"), 0},
+	{"server",	'H', N_("SERVER"),		0, N_("dvbv5-daemon host IP address, or the path of its UNIX socket"), 0},
 	{"tcp-port",	'T', N_("PORT"),		0, N_("dvbv5-daemon host tcp port"), 0},
 	{"dvr-pipe",	'D', N_("PIPE"),		0, N_("Named pipe for DVR output, when using remote access (by default: /tmp/dvr-pipe)"), 0},
+	{"buffer-size",	'B', N_("Mbytes"),		0, N_("size of the recording buffer (default: 32 Mbytes)"), 0},
+	{"splice",	'Z', NULL,			0, N_("record using splice(), if the DVR device is local"), 0},
+	{"spts",	'O', N_("SID:output"),		0, N_("write service SID to a file, '-' or udp://host:port. Can be used more than once"), 0},
 	{"help",        '?', 0,				0, N_("Give this help list"), -1},
 	{"usage",	-3,  0,				0, N_("Give a short usage message")},
 	{"version",	-4,  0,				0, N_("Print program version"), -1},
@@ -162,27 +178,13 @@ static int parse(struct arguments *args,
 		sys = SYS_UNDEFINED;
 		break;
 	}
-	dvb_file = dvb_read_file_format(args->confname, sys,
-				    args->input_format);
+	dvb_file = dvb_read_file_format_cached(args->confname, sys,
+					       args->input_format,
+					       args->cache_fname);
 	if (!dvb_file)
 		return -2;
 
-	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
-		if (entry->channel && !strcmp(entry->channel, channel))
-			break;
-		if (entry->vchannel && !strcmp(entry->vchannel, channel))
-			break;
-	}
-	/*
-	 * Give a second shot, using a case insensitive seek
-	 */
-	if (!entry) {
-		for (entry = dvb_file->first_entry; entry != NULL;
-		     entry = entry->next) {
-			if (entry->channel && !strcasecmp(entry->channel, channel))
-				break;
-		}
-	}
+	entry = dvb_file_find_channel(dvb_file, channel);
 
 	/*
 	 * When this tool is used to just tune to a channel, to monitor it or
@@ -193,16 +195,9 @@ static int parse(struct arguments *args,
 	 * It is also easier to use it for testing purposes.
 	 */
 	if (!entry && (!args->dvr && !args->rec_psi)) {
-		uint32_t f, freq = atoi(channel);
-		if (freq) {
-			for (entry = dvb_file->first_entry; entry != NULL;
-			entry = entry->next) {
-				dvb_retrieve_entry_prop(entry, DTV_FREQUENCY, &f);
-				if (f == freq)
-					break;
-			}
-
-		}
+		uint32_t freq = atoi(channel);
+		if (freq)
+			entry = dvb_file_find_freq(dvb_file, freq);
 	}
 
 	if (!entry) {
@@ -490,35 +485,395 @@ static void get_show_stats(struct arguments *args,
 	} while (!timeout_flag && loop);
 }
 
-#define BUFLEN (188 * 256)
-static void copy_to_file(struct dvb_open_descriptor *in_fd, int out_fd,
-			 int timeout, int silent)
+/*
+ * Recording engine
+ *
+ * The DVR device is read into a ring of large chunks, while a separate
+ * thread writes them to the output file. This way, stalls when writing to
+ * the disk don't block reading from the DVR, which would cause demux
+ * buffer overruns on high bitrate transponders.
+ */
+
+/* Multiple of both the TS packet size and of the page size */
+#define REC_CHUNK	(188 * 4096)
+
+struct rec_stats {
+	unsigned long long bytes;
+	unsigned overruns, buffer_full;
+	size_t peak, size;
+};
+
+struct rec_ring {
+	uint8_t *buf;
+	size_t *len;
+	unsigned n_chunks;
+
+	/* Number of chunks filled by the reader and written to the file */
+	unsigned long long head, tail;
+	size_t pending;
+	int out_fd, done, error;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct rec_stats *stats;
+};
+
+static int write_all(int fd, const uint8_t *buf, size_t len)
 {
-	char buf[BUFLEN];
-	int r;
-	long long int rc = 0LL;
-	while (timeout_flag == 0) {
-		r = dvb_dev_read(in_fd, buf, BUFLEN);
+	ssize_t r;
+
+	while (len) {
+		r = write(fd, buf, len);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		buf += r;
+		len -= r;
+	}
+	return 0;
+}
+
+static void *rec_writer(void *priv)
+{
+	struct rec_ring *ring = priv;
+	unsigned idx;
+	size_t len;
+	int ret;
+
+	pthread_mutex_lock(&ring->lock);
+	while (1) {
+		while (ring->head == ring->tail && !ring->done)
+			pthread_cond_wait(&ring->cond, &ring->lock);
+		if (ring->head == ring->tail)
+			break;
+
+		idx = ring->tail % ring->n_chunks;
+		len = ring->len[idx];
+		pthread_mutex_unlock(&ring->lock);
+
+		ret = write_all(ring->out_fd,
+				ring->buf + (size_t)idx * REC_CHUNK, len);
+
+		pthread_mutex_lock(&ring->lock);
+		if (ret < 0) {
+			ring->error = ret;
+			pthread_cond_broadcast(&ring->cond);
+			break;
+		}
+		ring->tail++;
+		ring->pending -= len;
+		ring->stats->bytes += len;
+		pthread_cond_broadcast(&ring->cond);
+	}
+	pthread_mutex_unlock(&ring->lock);
+
+	return NULL;
+}
+
+/* Signals should be handled by the reader, to interrupt it on timeout */
+static int rec_start_thread(pthread_t *thread, void *(*func)(void *),
+			    void *priv)
+{
+	sigset_t set, old;
+	int ret;
+
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	ret = pthread_create(thread, NULL, func, priv);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return -ret;
+}
+
+/* Hands the chunk being filled to the writer. Called with the lock held */
+static void rec_commit(struct rec_ring *ring, size_t len)
+{
+	ring->len[ring->head % ring->n_chunks] = len;
+	ring->head++;
+	ring->pending += len;
+	if (ring->pending > ring->stats->peak)
+		ring->stats->peak = ring->pending;
+	pthread_cond_broadcast(&ring->cond);
+
+	if (ring->head - ring->tail < ring->n_chunks)
+		return;
+
+	/* The chunk to be filled next is still being written: wait */
+	ring->stats->buffer_full++;
+	while (ring->head - ring->tail == ring->n_chunks && !ring->error)
+		pthread_cond_wait(&ring->cond, &ring->lock);
+}
+
+static int rec_buffered(struct arguments *args, struct dvb_open_descriptor *in_fd,
+		    int out_fd, struct rec_stats *stats)
+{
+	struct rec_ring ring;
+	pthread_t thread;
+	size_t pos = 0;
+	uint8_t *chunk;
+	ssize_t r;
+	int ret;
+
+	memset(&ring, 0, sizeof(ring));
+	ring.n_chunks = ((size_t)args->rec_buffer << 20) / REC_CHUNK;
+	if (ring.n_chunks < 2)
+		ring.n_chunks = 2;
+	ring.out_fd = out_fd;
+	ring.stats = stats;
+	stats->size = (size_t)ring.n_chunks * REC_CHUNK;
+
+	ring.len = calloc(ring.n_chunks, sizeof(*ring.len));
+	if (!ring.len)
+		return -ENOMEM;
+	ret = posix_memalign((void **)&ring.buf, sysconf(_SC_PAGESIZE),
+			     stats->size);
+	if (ret) {
+		free(ring.len);
+		return -ret;
+	}
+
+	pthread_mutex_init(&ring.lock, NULL);
+	pthread_cond_init(&ring.cond, NULL);
+	ret = rec_start_thread(&thread, rec_writer, &ring);
+	if (ret < 0)
+		goto err;
+
+	while (!timeout_flag) {
+		chunk = ring.buf + (size_t)(ring.head % ring.n_chunks) * REC_CHUNK;
+
+		r = dvb_dev_read(in_fd, chunk + pos, REC_CHUNK - pos);
 		if (r < 0) {
 			if (r == -EOVERFLOW) {
+				stats->overruns++;
 				fprintf(stderr, _("buffer overrun\n"));
 				continue;
 			}
 			ERROR("Read failed");
 			break;
 		}
-		if (write(out_fd, buf, r) < 0) {
-			PERROR(_("Write failed"));
+		pos += r;
+
+		pthread_mutex_lock(&ring.lock);
+		if (ring.error) {
+			pthread_mutex_unlock(&ring.lock);
+			break;
+		}
+		/*
+		 * Fill the chunk while the writer is busy, but don't hold
+		 * the data while it is idle, as the output can be a pipe
+		 */
+		if (pos && (pos == REC_CHUNK || ring.head == ring.tail)) {
+			rec_commit(&ring, pos);
+			pos = 0;
+		}
+		pthread_mutex_unlock(&ring.lock);
+	}
+
+	pthread_mutex_lock(&ring.lock);
+	if (pos && !ring.error)
+		rec_commit(&ring, pos);
+	ring.done = 1;
+	pthread_cond_broadcast(&ring.cond);
+	pthread_mutex_unlock(&ring.lock);
+
+	pthread_join(thread, NULL);
+
+	ret = ring.error;
+	if (ret < 0) {
+		errno = -ret;
+		PERROR(_("Write failed"));
+	}
+err:
+	pthread_cond_destroy(&ring.cond);
+	pthread_mutex_destroy(&ring.lock);
+	free(ring.buf);
+	free(ring.len);
+
+	return ret;
+}
+
+struct rec_splice_priv {
+	int pipe_fd, out_fd, error;
+	struct rec_stats *stats;
+};
+
+static void *rec_splice_writer(void *priv)
+{
+	struct rec_splice_priv *sp = priv;
+	ssize_t r;
+
+	while (1) {
+		r = splice(sp->pipe_fd, NULL, sp->out_fd, NULL, REC_CHUNK,
+			   SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			sp->error = -errno;
+			break;
+		}
+		if (!r)
 			break;
+		__atomic_add_fetch(&sp->stats->bytes, r, __ATOMIC_RELAXED);
+	}
+
+	/* Unblocks the reader, if the pipe is full */
+	close(sp->pipe_fd);
+	return NULL;
+}
+
+/* Unprivileged users can't make pipes bigger than that */
+static size_t pipe_max_size(void)
+{
+	unsigned long max;
+	FILE *fp;
+
+	fp = fopen("/proc/sys/fs/pipe-max-size", "r");
+	if (!fp)
+		return INT_MAX;
+	if (fscanf(fp, "%lu", &max) != 1 || max > INT_MAX)
+		max = INT_MAX;
+	fclose(fp);
+
+	return max;
+}
+
+/*
+ * Moves the data from the DVR to the file through a pipe, without copying
+ * it to userspace. The pipe works as the recording buffer.
+ *
+ * Returns a negative error before reading anything if splice can't be used,
+ * like -EINVAL if the DVR doesn't support it. Once the recording started,
+ * errors are reported here and stats->size is set.
+ */
+static int rec_splice(struct arguments *args, int in_fd, int out_fd,
+		      struct rec_stats *stats)
+{
+	struct rec_splice_priv sp;
+	struct pollfd pfd;
+	pthread_t thread;
+	int fds[2], ret = 0, fill, pipe_size;
+	size_t size;
+	ssize_t r;
+
+	if (pipe(fds) < 0)
+		return -errno;
+
+	/* The per-user pipe limits may still refuse it: try smaller sizes */
+	size = (size_t)args->rec_buffer << 20;
+	if (size > pipe_max_size())
+		size = pipe_max_size();
+	for (; size > REC_CHUNK; size /= 2) {
+		if (fcntl(fds[1], F_SETPIPE_SZ, (int)size) >= 0)
+			break;
+	}
+	pipe_size = fcntl(fds[1], F_GETPIPE_SZ);
+
+	/* Check if the DVR device supports splice */
+	do {
+		r = splice(in_fd, NULL, fds[1], NULL, REC_CHUNK, SPLICE_F_MOVE);
+	} while (r < 0 && errno == EOVERFLOW && !timeout_flag);
+	if (r < 0) {
+		ret = -errno;
+		close(fds[0]);
+		close(fds[1]);
+		return ret;
+	}
+
+	memset(&sp, 0, sizeof(sp));
+	sp.pipe_fd = fds[0];
+	sp.out_fd = out_fd;
+	sp.stats = stats;
+	ret = rec_start_thread(&thread, rec_splice_writer, &sp);
+	if (ret < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return ret;
+	}
+	stats->size = pipe_size > 0 ? pipe_size : 0;
+
+	pfd.fd = fds[1];
+	pfd.events = POLLOUT;
+	while (!timeout_flag) {
+		if (ioctl(fds[0], FIONREAD, &fill) == 0 &&
+		    (size_t)fill > stats->peak)
+			stats->peak = fill;
+
+		/* The writer didn't keep up: the splice below will wait */
+		if (poll(&pfd, 1, 0) == 0)
+			stats->buffer_full++;
+
+		r = splice(in_fd, NULL, fds[1], NULL, REC_CHUNK, SPLICE_F_MOVE);
+		if (r < 0) {
+			if (errno == EOVERFLOW) {
+				stats->overruns++;
+				fprintf(stderr, _("buffer overrun\n"));
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
+			/* EPIPE means that the writer failed */
+			if (errno != EPIPE)
+				PERROR(_("Read failed"));
+			break;
+		}
+		if (!r)
+			break;
+	}
+
+	close(fds[1]);
+	pthread_join(thread, NULL);
+
+	if (sp.error < 0) {
+		errno = -sp.error;
+		PERROR(_("Write failed"));
+	}
+	return sp.error;
+}
+
+static void copy_to_file(struct arguments *args,
+			 struct dvb_open_descriptor *in_fd, int out_fd)
+{
+	struct rec_stats stats;
+	struct timespec start, end;
+	double t;
+	int ret = -EINVAL;
+
+	memset(&stats, 0, sizeof(stats));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (args->splice && dvb_dev_get_fd(in_fd) >= 0) {
+		ret = rec_splice(args, dvb_dev_get_fd(in_fd), out_fd, &stats);
+		if (ret == -EINVAL && !stats.size) {
+			fprintf(stderr, _("DVR doesn't support splice. Using a buffer instead\n"));
+		} else if (ret < 0 && !stats.size) {
+			errno = -ret;
+			PERROR(_("Can't splice. Using a buffer instead"));
 		}
-		rc += r;
 	}
-	if (silent < 2) {
-		if (timeout)
-			fprintf(stderr, _("received %lld bytes (%lld Kbytes/sec)\n"), rc,
-				rc / (1024 * timeout));
+	if (ret < 0 && !stats.size) {
+		memset(&stats, 0, sizeof(stats));
+		ret = rec_buffered(args, in_fd, out_fd, &stats);
+		if (ret == -ENOMEM)
+			ERROR("Can't allocate the recording buffer");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	t = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (args->silent < 2) {
+		if (args->timeout)
+			fprintf(stderr, _("received %llu bytes (%llu Kbytes/sec)\n"),
+				stats.bytes, stats.bytes / (1024 * args->timeout));
 		else
-			fprintf(stderr, _("received %lld bytes\n"), rc);
+			fprintf(stderr, _("received %llu bytes\n"), stats.bytes);
+
+		fprintf(stderr, _("recorded at %.2f Mbytes/sec, %u overruns, peak buffer fill %zu Kbytes of %zu Kbytes (%u times full)\n"),
+			t > 0 ? stats.bytes / t / 1e6 : 0.,
+			stats.overruns, stats.peak / 1024, stats.size / 1024,
+			stats.buffer_full);
 	}
 }
 
@@ -557,6 +912,9 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	case 'c':
 		args->confname = strdup(optarg);
 		break;
+	case 'k':
+		args->cache_fname = strdup(optarg);
+		break;
 	case 'w':
 		if (!strcasecmp(optarg,"on")) {
 			args->lna = 1;
@@ -625,6 +983,19 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	case 'D':
 		args->dvr_pipe = strdup(optarg);
 		break;
+	case 'B':
+		args->rec_buffer = strtoul(optarg, NULL, 0);
+		break;
+	case 'Z':
+		args->splice = 1;
+		break;
+	case 'O':
+		if (args->n_spts == DVB_SPTS_MAX_OUTPUTS) {
+			argp_error(state, _("too many SPTS outputs"));
+			return ARGP_ERR_UNKNOWN;
+		}
+		args->spts[args->n_spts++] = optarg;
+		break;
 	case '?':
 		argp_state_help(state, state->out_stream,
 				ARGP_HELP_SHORT_USAGE | ARGP_HELP_LONG
@@ -643,31 +1014,308 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	return 0;
 }
 
-#define BSIZE 188
+/*
+ * Traffic monitor
+ *
+ * The DVR is read in large blocks, and all packets of a block are
+ * analyzed at once, in order to keep up with full transponders.
+ */
+
+#define TS_SIZE		188
+#define TS_SYNC		0x47
+#define TS_NULL_PID	0x1fff
+#define MON_BSIZE	(TS_SIZE * 8192)
+
+/* PCR is a 33 bits base at 90 kHz plus a 9 bits extension at 27 MHz */
+#define PCR_HZ		27000000LL
+#define PCR_WRAP	((1LL << 33) * 300)
+
+struct pid_stats {
+	unsigned long long packets;
+	unsigned long long scrambled;
+	unsigned cc_errors, tei;
+	int last_cc;		/* -1 if unknown */
+
+	/* PCR statistics. Positions are packet numbers on the stream */
+	unsigned long long first_pcr_pos, last_pcr_pos;
+	long long first_pcr, last_pcr;
+	unsigned long long n_pcr;
+	double max_pcr_interval, max_pcr_jitter;
+};
+
+struct ts_monitor {
+	struct pid_stats *pid;
+	unsigned long long packets, total, resyncs;
+	uint16_t active[0x2000];
+	unsigned n_active, sorted;
+
+	const char *search;
+	size_t search_len;
+	uint8_t *match;
+};
+
+static void ts_monitor_pcr(struct pid_stats *ps, const uint8_t *p,
+			   unsigned long long pos)
+{
+	long long pcr, delta;
+	double interval, rate, jitter;
+
+	pcr = ((long long)p[6] << 25 | p[7] << 17 | p[8] << 9 | p[9] << 1 |
+	       p[10] >> 7) * 300 + ((p[10] & 1) << 8 | p[11]);
+
+	if (!ps->n_pcr++) {
+		ps->first_pcr = pcr;
+		ps->first_pcr_pos = pos;
+		ps->last_pcr = pcr;
+		ps->last_pcr_pos = pos;
+		return;
+	}
+
+	delta = (pcr - ps->last_pcr + PCR_WRAP) % PCR_WRAP;
+	interval = (double)delta / PCR_HZ;
+	if (interval > ps->max_pcr_interval)
+		ps->max_pcr_interval = interval;
+
+	/*
+	 * Broadcast muxes have a constant bitrate, so the time between two
+	 * PCRs should match the number of packets between them, at the
+	 * average packet rate since the first PCR.
+	 */
+	delta = (pcr - ps->first_pcr + PCR_WRAP) % PCR_WRAP;
+	if (delta && pos > ps->first_pcr_pos) {
+		rate = (pos - ps->first_pcr_pos) * (double)PCR_HZ / delta;
+		jitter = interval - (pos - ps->last_pcr_pos) / rate;
+		if (jitter < 0)
+			jitter = -jitter;
+		if (ps->n_pcr > 2 && jitter > ps->max_pcr_jitter)
+			ps->max_pcr_jitter = jitter;
+	}
+
+	ps->last_pcr = pcr;
+	ps->last_pcr_pos = pos;
+}
+
+/*
+ * When searching for a string, only the packets containing it are
+ * counted, but all of them are checked for errors
+ */
+static void ts_monitor_packet(struct ts_monitor *mon, const uint8_t *p,
+			      int count)
+{
+	struct pid_stats *ps;
+	unsigned pid = (p[1] & 0x1f) << 8 | p[2];
+	unsigned afc = (p[3] >> 4) & 3, cc = p[3] & 0x0f;
+	int discontinuity = 0;
+
+	ps = &mon->pid[pid];
+	if (count) {
+		if (!ps->packets++) {
+			mon->active[mon->n_active++] = pid;
+			mon->sorted = 0;
+		}
+		mon->total++;
+	}
+
+	if (p[1] & 0x80)
+		ps->tei++;
+	if (p[3] & 0xc0)
+		ps->scrambled++;
+
+	if ((afc & 2) && p[4]) {
+		discontinuity = p[5] & 0x80;
+		if ((p[5] & 0x10) && p[4] >= 7)
+			ts_monitor_pcr(ps, p, mon->packets);
+	}
+
+	/* The continuity counter is incremented only on packets with payload */
+	if (pid != TS_NULL_PID) {
+		if (ps->last_cc >= 0 && !discontinuity) {
+			if (afc & 1) {
+				/* A packet may be sent twice */
+				if (cc != ((ps->last_cc + 1) & 0x0f) &&
+				    cc != (unsigned)ps->last_cc)
+					ps->cc_errors++;
+			} else if (cc != (unsigned)ps->last_cc) {
+				ps->cc_errors++;
+			}
+		}
+		ps->last_cc = cc;
+	}
+}
+
+/*
+ * Marks the packets containing the search string. The whole block is
+ * searched at once with memmem(), which is vectorized on most libcs,
+ * instead of comparing at each position of every packet.
+ */
+static void ts_monitor_search(struct ts_monitor *mon, const uint8_t *buf,
+			      unsigned n)
+{
+	const uint8_t *p = buf, *end = buf + n * TS_SIZE;
+	size_t off;
+
+	memset(mon->match, 0, n);
+	while (p < end) {
+		p = memmem(p, end - p, mon->search, mon->search_len);
+		if (!p)
+			break;
+		off = (p - buf) % TS_SIZE;
+		if (off + mon->search_len <= TS_SIZE) {
+			mon->match[(p - buf) / TS_SIZE] = 1;
+			p += TS_SIZE - off;
+		} else {
+			/* Crosses to the next packet */
+			p++;
+		}
+	}
+}
+
+/* Handles a run of aligned packets */
+static void ts_monitor_run(struct ts_monitor *mon, const uint8_t *buf,
+			   unsigned n)
+{
+	unsigned i, pid;
+
+	if (!mon->search) {
+		for (i = 0; i < n; i++, buf += TS_SIZE, mon->packets++)
+			ts_monitor_packet(mon, buf, 1);
+		return;
+	}
+
+	ts_monitor_search(mon, buf, n);
+	for (i = 0; i < n; i++, buf += TS_SIZE, mon->packets++) {
+		pid = (buf[1] & 0x1f) << 8 | buf[2];
+		ts_monitor_packet(mon, buf,
+				  mon->match[i] && pid != TS_NULL_PID);
+	}
+}
+
+/*
+ * Processes a block read from the DVR. Returns the number of bytes at
+ * the end that don't form a full packet, and should be handled together
+ * with the next block.
+ */
+static size_t ts_monitor_block(struct ts_monitor *mon, const uint8_t *buf,
+			       size_t len)
+{
+	const uint8_t *p = buf, *end = buf + len, *run;
+
+	while ((size_t)(end - p) >= TS_SIZE) {
+		if (*p != TS_SYNC) {
+			/* Seek for a sync byte followed by another one */
+			mon->resyncs++;
+			do {
+				p = memchr(p + 1, TS_SYNC, end - p - 1);
+				if (!p)
+					return 0;
+			} while (end - p > TS_SIZE && p[TS_SIZE] != TS_SYNC);
+			continue;
+		}
+
+		run = p;
+		while ((size_t)(end - p) >= TS_SIZE && *p == TS_SYNC)
+			p += TS_SIZE;
+		ts_monitor_run(mon, run, (p - run) / TS_SIZE);
+	}
+
+	return end - p;
+}
+
+/* After losing data, the continuity counters can't be checked anymore */
+static void ts_monitor_reset_cc(struct ts_monitor *mon)
+{
+	unsigned i;
+
+	for (i = 0; i < mon->n_active; i++)
+		mon->pid[mon->active[i]].last_cc = -1;
+}
+
+static int cmp_pid(const void *a, const void *b)
+{
+	return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+static void ts_monitor_print(struct arguments *args, struct ts_monitor *mon,
+			     int diff)
+{
+	struct pid_stats *ps;
+	unsigned long long total = mon->total;
+	unsigned i;
+
+	if (!mon->sorted) {
+		qsort(mon->active, mon->n_active, sizeof(*mon->active),
+		      cmp_pid);
+		mon->sorted = 1;
+	}
+
+	printf(_(" PID          FREQ         SPEED       TOTAL  CC ERR    TEI SCRAMBLED  PCR INT  PCR JITTER\n"));
+	for (i = 0; i < mon->n_active; i++) {
+		ps = &mon->pid[mon->active[i]];
+		if (!args->low_traffic && (ps->packets * 1000. / diff) < 1)
+			continue;
+		printf("%04x %9.2f p/s %8.1f Kbps ",
+		       mon->active[i],
+		       ps->packets * 1000. / diff,
+		       ps->packets * 1000. / diff * 8 * 188 / 1024);
+		if (ps->packets * 188 / 1024)
+			printf("%8llu KB", ps->packets * 188 / 1024);
+		else
+			printf(" %8llu B", ps->packets * 188);
+		printf(" %7u %6u %9llu", ps->cc_errors, ps->tei, ps->scrambled);
+		if (ps->n_pcr > 2)
+			printf(" %5.1f ms %8.1f us", ps->max_pcr_interval * 1e3,
+			       ps->max_pcr_jitter * 1e6);
+		printf("\n");
+	}
+	printf("TOT %10.2f p/s %8.1f Kbps %8llu KB\n",
+	       total * 1000. / diff,
+	       total * 1000. / diff * 8 * 188 / 1024,
+	       total * 188 / 1024);
+	if (mon->resyncs)
+		printf(_("Lost TS sync %llu times\n"), mon->resyncs);
+}
 
 int do_traffic_monitor(struct arguments *args, struct dvb_device *dvb)
 {
 	struct dvb_open_descriptor *fd, *dvr_fd;
-	long long unsigned pidt[0x2001], wait;
-	int packets = 0;
-	struct timeval startt;
+	struct ts_monitor mon;
+	long long unsigned wait;
+	struct timeval startt, now;
 	struct dvb_v5_fe_parms *parms = dvb->fe_parms;
-
-	memset(pidt, 0, sizeof(pidt));
+	uint8_t *buffer;
+	size_t pending = 0;
+	unsigned i;
+	int diff, ret = -1;
+	ssize_t r;
+
+	memset(&mon, 0, sizeof(mon));
+	mon.pid = calloc(0x2000, sizeof(*mon.pid));
+	buffer = malloc(MON_BSIZE);
+	if (args->search) {
+		mon.search = args->search;
+		mon.search_len = strlen(args->search);
+		mon.match = malloc(MON_BSIZE / TS_SIZE);
+	}
+	if (!mon.pid || !buffer || (args->search && !mon.match)) {
+		ERROR("Not enough memory");
+		goto free;
+	}
+	for (i = 0; i < 0x2000; i++)
+		mon.pid[i].last_cc = -1;
 
 	args->exit_after_tuning = 1;
 	check_frontend(args, parms);
 
 	dvr_fd = dvb_dev_open(dvb, args->dvr_dev, O_RDONLY);
 	if (!dvr_fd)
-		return -1;
+		goto free;
 
-	dvb_dev_set_bufsize(dvr_fd, 1024 * 1024);
+	dvb_dev_set_bufsize(dvr_fd, 4 * 1024 * 1024);
 
 	fd = dvb_dev_open(dvb, args->demux_dev, O_RDWR);
 	if (!fd) {
 		dvb_dev_close(dvr_fd);
-		return -1;
+		goto free;
 	}
 
 	if (args->silent < 2)
@@ -676,118 +1324,254 @@ int do_traffic_monitor(struct arguments *args, struct dvb_device *dvb)
 				      DMX_OUT_TS_TAP, 0) < 0) {
 		dvb_dev_close(dvr_fd);
 		dvb_dev_close(fd);
-		return -1;
+		goto free;
 	}
 
 	gettimeofday(&startt, 0);
 	wait = 1000;
 
-	while (1) {
-		unsigned char buffer[BSIZE];
-		struct dvb_ts_packet_header *h = (void *)buffer;
-		int pid, ok;
-		ssize_t r;
-
-		if (timeout_flag)
-			break;
-
-		if ((r = dvb_dev_read(dvr_fd, buffer, BSIZE)) <= 0) {
+	while (!timeout_flag) {
+		r = dvb_dev_read(dvr_fd, buffer + pending, MON_BSIZE - pending);
+		if (r <= 0) {
 			if (r == -EOVERFLOW) {
-				struct timeval now;
-				int diff;
 				gettimeofday(&now, 0);
 				diff =
 				    (now.tv_sec - startt.tv_sec) * 1000 +
 				    (now.tv_usec - startt.tv_usec) / 1000;
 				fprintf(stderr, _("%.2fs: buffer overrun\n"), diff / 1000.);
+				ts_monitor_reset_cc(&mon);
+				pending = 0;
 				continue;
 			}
 			fprintf(stderr, _("dvbtraffic: read() returned error %zd\n"), r);
 			break;
 		}
-		if (r != BSIZE) {
-			fprintf(stderr, _("dvbtraffic: only read %zd bytes\n"), r);
-			break;
+
+		/* Remote devices may return part of a packet */
+		r += pending;
+		pending = ts_monitor_block(&mon, buffer, r);
+		if (pending)
+			memmove(buffer, buffer + r - pending, pending);
+
+		gettimeofday(&now, 0);
+		diff =
+		    (now.tv_sec - startt.tv_sec) * 1000 +
+		    (now.tv_usec - startt.tv_usec) / 1000;
+		if (diff > wait) {
+			if (isatty(STDOUT_FILENO))
+				printf("\x1b[1H\x1b[2J");
+
+			args->n_status_lines = 0;
+			ts_monitor_print(args, &mon, diff);
+			printf("\n\n");
+			get_show_stats(args, parms, 0);
+			wait += 1000;
 		}
+	}
+	dvb_dev_close(dvr_fd);
+	dvb_dev_close(fd);
+	ret = 0;
+free:
+	free(mon.match);
+	free(mon.pid);
+	free(buffer);
+	return ret;
+}
+
+/*
+ * Single Program Transport Stream outputs
+ *
+ * The whole MPEG-TS is read from the DVR, and each service is written
+ * to its own output, with its own PAT.
+ */
+
+static int spts_open_output(const char *name)
+{
+	struct addrinfo hints, *res, *ai;
+	char *host, *port;
+	int fd = -1, ret;
+
+	if (!strcmp(name, "-"))
+		return STDOUT_FILENO;
+
+	if (strncmp(name, "udp://", 6))
+		return open(name,
+#ifdef O_LARGEFILE
+			    O_LARGEFILE |
+#endif
+			    O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	host = strdup(name + 6);
+	if (!host)
+		return -1;
+	port = strrchr(host, ':');
+	if (!port) {
+		free(host);
+		errno = EINVAL;
+		return -1;
+	}
+	*port++ = '\0';
+
+	/* Allows IPv6 addresses as udp://[::1]:1234 */
+	if (host[0] == '[' && host[strlen(host) - 1] == ']') {
+		host[strlen(host) - 1] = '\0';
+		memmove(host, host + 1, strlen(host));
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	ret = getaddrinfo(host, port, &hints, &res);
+	free(host);
+	if (ret) {
+		ERROR("%s: %s", name, gai_strerror(ret));
+		errno = EINVAL;
+		return -1;
+	}
 
-		if (h->sync_byte != 0x47) {
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
 			continue;
-		}
+		if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
 
-		bswap16(h->bitfield);
+	return fd;
+}
 
-#if 0
-		/*
-		 * ITU-T Rec. H.222.0 decoders shall discard Transport Stream
-		 * packets with theadaptation_field_control field set to
-		 * a value of '00'.
-		 */
-		if (h->adaptation_field_control == 0)
+static void spts_print_stats(struct arguments *args, struct dvb_spts *spts,
+			     struct dvb_spts_stats *last, double interval)
+{
+	struct dvb_spts_stats stats;
+	unsigned i;
+
+	for (i = 0; i < args->n_spts; i++) {
+		if (dvb_spts_get_stats(spts, i, &stats) < 0)
 			continue;
-#endif
-		ok = 1;
-		pid = h->pid;
-
-		if (args->search) {
-			int i, sl = strlen(args->search);
-			ok = 0;
-			if (pid != 0x1fff) {
-				for (i = 0; i < (188 - sl); ++i) {
-					if (!memcmp(buffer + i, args->search, sl))
-						ok = 1;
-				}
-			}
+		fprintf(stderr, _("%-24s %8.2f Mbps %10llu KB"),
+			args->spts[i],
+			(stats.bytes - last[i].bytes) * 8 / interval / 1e6,
+			stats.bytes / 1024);
+		if (stats.pmt_pid >= 0)
+			fprintf(stderr, _("  PMT 0x%04x"), stats.pmt_pid);
+		else
+			fprintf(stderr, _("  no PMT yet"));
+		if (stats.dropped)
+			fprintf(stderr, _("  %llu packets dropped"),
+				stats.dropped);
+		fprintf(stderr, "\n");
+		last[i] = stats;
+	}
+}
+
+static int do_spts(struct arguments *args, struct dvb_device *dvb)
+{
+	struct dvb_v5_fe_parms *parms = dvb->fe_parms;
+	struct dvb_open_descriptor *fd = NULL, *dvr_fd = NULL;
+	struct dvb_spts_stats last[DVB_SPTS_MAX_OUTPUTS];
+	struct dvb_spts *spts;
+	struct timespec start, now;
+	int out_fd[DVB_SPTS_MAX_OUTPUTS];
+	unsigned long sid;
+	unsigned i;
+	uint8_t *buffer;
+	double t, last_t = 0;
+	char *p;
+	ssize_t r;
+	int ret = -1;
+
+	memset(last, 0, sizeof(last));
+	for (i = 0; i < args->n_spts; i++)
+		out_fd[i] = -1;
+
+	spts = dvb_spts_alloc(parms);
+	buffer = malloc(MON_BSIZE);
+	if (!spts || !buffer) {
+		ERROR("Not enough memory");
+		goto free;
+	}
+
+	for (i = 0; i < args->n_spts; i++) {
+		sid = strtoul(args->spts[i], &p, 0);
+		if (*p != ':' || sid > 0xffff) {
+			ERROR("invalid SPTS output '%s'. Should be SID:output",
+			      args->spts[i]);
+			goto free;
 		}
+		args->spts[i] = p + 1;
 
-		if (ok) {
-			pidt[pid]++;
-			pidt[0x2000]++;
+		out_fd[i] = spts_open_output(args->spts[i]);
+		if (out_fd[i] < 0) {
+			PERROR(_("open of '%s' failed"), args->spts[i]);
+			goto free;
 		}
+		dvb_spts_add_output(spts, sid, out_fd[i]);
+		if (args->silent < 2)
+			fprintf(stderr, _("service 0x%04lx will be written to '%s'\n"),
+				sid, args->spts[i]);
+	}
 
-		packets++;
-
-		if (!(packets & 0xFF)) {
-			struct timeval now;
-			int diff;
-			gettimeofday(&now, 0);
-			diff =
-			    (now.tv_sec - startt.tv_sec) * 1000 +
-			    (now.tv_usec - startt.tv_usec) / 1000;
-			if (diff > wait) {
-				if (isatty(STDOUT_FILENO))
-			                printf("\x1b[1H\x1b[2J");
-
-				args->n_status_lines = 0;
-				printf(_(" PID          FREQ         SPEED       TOTAL\n"));
-				int _pid = 0;
-				for (_pid = 0; _pid < 0x2000; _pid++) {
-					if (pidt[_pid]) {
-						if (!args->low_traffic && (pidt[_pid] * 1000. / diff) < 1)
-							continue;
-						printf("%04x %9.2f p/s %8.1f Kbps ",
-						     _pid,
-						     pidt[_pid] * 1000. / diff,
-						     pidt[_pid] * 1000. / diff * 8 * 188 / 1024);
-						if (pidt[_pid] * 188 / 1024)
-							printf("%8llu KB\n", pidt[_pid] * 188 / 1024);
-						else
-							printf(" %8llu B\n", pidt[_pid] * 188);
-					}
-				}
-				/* 0x2000 is the total traffic */
-				printf("TOT %10.2f p/s %8.1f Kbps %8llu KB\n",
-				     pidt[_pid] * 1000. / diff,
-				     pidt[_pid] * 1000. / diff * 8 * 188 / 1024,
-				     pidt[_pid] * 188 / 1024);
-				printf("\n\n");
-				get_show_stats(args, parms, 0);
-				wait += 1000;
+	/* A closed pipe should just drop its output */
+	signal(SIGPIPE, SIG_IGN);
+
+	args->exit_after_tuning = 1;
+	check_frontend(args, parms);
+
+	dvr_fd = dvb_dev_open(dvb, args->dvr_dev, O_RDONLY);
+	if (!dvr_fd)
+		goto free;
+
+	dvb_dev_set_bufsize(dvr_fd, 4 * 1024 * 1024);
+
+	fd = dvb_dev_open(dvb, args->demux_dev, O_RDWR);
+	if (!fd)
+		goto free;
+
+	if (args->silent < 2)
+		fprintf(stderr, _("  dvb_set_pesfilter to 0x2000\n"));
+	if (dvb_dev_dmx_set_pesfilter(fd, 0x2000, DMX_PES_OTHER,
+				      DMX_OUT_TS_TAP, 0) < 0)
+		goto free;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!timeout_flag) {
+		r = dvb_dev_read(dvr_fd, buffer, MON_BSIZE);
+		if (r <= 0) {
+			if (r == -EOVERFLOW) {
+				fprintf(stderr, _("buffer overrun\n"));
+				continue;
 			}
+			ERROR("Read failed");
+			break;
+		}
+		dvb_spts_feed(spts, buffer, r);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		t = (now.tv_sec - start.tv_sec) +
+		    (now.tv_nsec - start.tv_nsec) / 1e9;
+		if (args->silent < 2 && t - last_t >= 1) {
+			spts_print_stats(args, spts, last, t - last_t);
+			last_t = t;
 		}
 	}
-	dvb_dev_close(dvr_fd);
-	dvb_dev_close(fd);
-	return 0;
+	ret = 0;
+
+free:
+	if (fd)
+		dvb_dev_close(fd);
+	if (dvr_fd)
+		dvb_dev_close(dvr_fd);
+	if (spts)
+		dvb_spts_free(spts);
+	for (i = 0; i < args->n_spts; i++)
+		if (out_fd[i] >= 0 && out_fd[i] != STDOUT_FILENO)
+			close(out_fd[i]);
+	free(buffer);
+	return ret;
 }
 
 static void set_signals(struct arguments *args)
@@ -835,6 +1619,7 @@ int main(int argc, char **argv)
 	args.lna = LNA_AUTO;
 	args.input_format = FILE_DVBV5;
 	args.dvr_pipe = "/tmp/dvr-pipe";
+	args.rec_buffer = 32;
 
 	if (argp_parse(&argp, argc, argv, ARGP_NO_HELP | ARGP_NO_EXIT, &idx, &args)) {
 		argp_help(&argp, stderr, ARGP_HELP_SHORT_USAGE, PROGRAM_NAME);
@@ -877,7 +1662,7 @@ int main(int argc, char **argv)
 	if (!dvb)
 		return -1;
 
-	if (args.server && args.port) {
+	if (args.server && (args.port || args.server[0] == '/')) {
 		printf(_("Connecting to %s:%d\n"), args.server, args.port);
 		ret = dvb_dev_remote_init(dvb, args.server, args.port);
 		if (ret < 0)
@@ -959,6 +1744,12 @@ int main(int argc, char **argv)
 		goto err;
 	}
 
+	if (args.n_spts) {
+		set_signals(&args);
+		err = do_spts(&args, dvb);
+		goto err;
+	}
+
 	if (args.rec_psi) {
 		if (sid < 0) {
 			fprintf(stderr, _("Service id 0x%04x was not specified at the file\n"),
@@ -1087,8 +1878,8 @@ int main(int argc, char **argv)
 			}
 			if (!timeout_flag)
 				fprintf(stderr, _("Record to file '%s' started\n"), args.filename);
-			copy_to_file(dvr_fd, file_fd, args.timeout, args.silent);
-		} else if (args.server && args.port) {
+			copy_to_file(&args, dvr_fd, file_fd);
+		} else if (args.server && (args.port || args.server[0] == '/')) {
 			struct stat st;
 			if (stat(args.dvr_pipe, &st) == -1) {
 				if (mknod(args.dvr_pipe,
@@ -1126,7 +1917,7 @@ int main(int argc, char **argv)
 				err = -1;
 				goto err;
 			}
-			copy_to_file(dvr_fd, file_fd, args.timeout, args.silent);
+			copy_to_file(&args, dvr_fd, file_fd);
 		} else {
 			if (!timeout_flag)
 				fprintf(stderr, _("DVR interface '%s' can now be opened\n"), args.dvr_fname);
@@ -1147,6 +1938,8 @@ int main(int argc, char **argv)
 err:
 	if (args.confname)
 		free(args.confname);
+	if (args.cache_fname)
+		free(args.cache_fname);
 	dvb_dev_free(dvb);
 
 	return err;
@@ -0,0 +1 @@
+../common/v4l-stream-idx.c
\ No newline at end of file
@@ -15,11 +15,14 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/mman.h>
+#include <poll.h>
 #include <dirent.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "v4l2-ctl.h"
 #include "v4l-stream.h"
+#include "v4l-stream-idx.h"
 
 extern "C" {
 #include "v4l2-tpg.h"
@@ -44,6 +47,8 @@ static v4l2_std_id stream_out_std;
 static bool stream_out_refresh;
 static tpg_move_mode stream_out_hor_mode = TPG_MOVE_NONE;
 static tpg_move_mode stream_out_vert_mode = TPG_MOVE_NONE;
+static unsigned stream_out_cache;
+static unsigned stream_out_threads;
 static unsigned reqbufs_count_cap = 4;
 static unsigned reqbufs_count_out = 4;
 static char *file_cap;
@@ -56,6 +61,13 @@ static char *file_out;
 static char *host_out;
 static unsigned host_port_out = V4L_STREAM_PORT;
 static int host_fd_out = -1;
+static bool stream_to_idx;
+static struct v4l_idx_writer idx_writer;
+static struct v4l_idx_reader idx_reader;
+static unsigned idx_frame;
+static unsigned idx_first_frame;
+static bool stream_from_mmap;
+static unsigned stream_from_prefetch = 8;
 static struct tpg_data tpg;
 static unsigned output_field = V4L2_FIELD_NONE;
 static bool output_field_alt;
@@ -86,7 +98,13 @@ void streaming_usage(void)
 	       "                     data. If <file> is '-', then the data is written to stdout\n"
 	       "                     and the --silent option is turned on automatically.\n"
 	       "  --stream-to-host=<hostname[:port]> stream to this host. The default port is %d.\n"
+	       "  --stream-to-idx=<file>\n"
+	       "                     stream to this file using the indexed file format that stores\n"
+	       "                     the format, the timestamp, sequence and flags of each frame and\n"
+	       "                     a seek index. Such files are detected by --stream-from.\n"
 	       "  --stream-poll      use non-blocking mode and select() to stream.\n"
+	       "                     When streaming from a capture to an output device, poll()\n"
+	       "                     is always used and this sets a 2 second timeout.\n"
 	       "  --stream-mmap=<count>\n"
 	       "                     capture video using mmap() [VIDIOC_(D)QBUF]\n"
 	       "                     count: the number of buffers to allocate. The default is 3.\n"
@@ -98,6 +116,14 @@ void streaming_usage(void)
 	       "  --stream-from=<file> stream from this file. The default is to generate a pattern.\n"
 	       "                     If <file> is '-', then the data is read from stdin.\n"
 	       "  --stream-from-host=<hostname[:port]> stream from this host. The default port is %d.\n"
+	       "  --stream-from-frame=<frame>\n"
+	       "                     start streaming from this frame of an indexed file or of a\n"
+	       "                     file mapped with --stream-from-mmap.\n"
+	       "  --stream-from-mmap=<prefetch>\n"
+	       "                     mmap the --stream-from file instead of reading it. With\n"
+	       "                     --stream-out-user the output buffers point directly into\n"
+	       "                     the file, otherwise frames are copied from the mapping while\n"
+	       "                     a thread prefetches the next <prefetch> frames. The default is 8.\n"
 	       "  --stream-loop      loop when the end of the file we are streaming from is reached.\n"
 	       "                     The default is to stop.\n"
 	       "  --stream-out-pattern=<count>\n"
@@ -129,6 +155,13 @@ void streaming_usage(void)
 	       "                     and the range is [-3...3].\n"
 	       "  --stream-out-perc-fill=<percentage>\n"
 	       "                     percentage of the frame to actually fill. The default is 100%%.\n"
+	       "  --stream-out-cache=<size>\n"
+	       "                     render all frames of a moving test pattern up front into a cache\n"
+	       "                     of at most <size> MiB and cycle through those frames while streaming.\n"
+	       "                     With --stream-out-user the buffers point directly into the cache.\n"
+	       "  --stream-out-threads=<threads>\n"
+	       "                     split the rendering of each test pattern frame over <threads>\n"
+	       "                     threads. The default is 1.\n"
 	       "  --stream-out-mmap=<count>\n"
 	       "                     output video using mmap() [VIDIOC_(D)QBUF]\n"
 	       "                     count: the number of buffers to allocate. The default is 4.\n"
@@ -381,6 +414,14 @@ void streaming_cmd(int ch, char *optarg)
 		else
 			stream_out_vert_mode = (tpg_move_mode)(speed + 3);
 		break;
+	case OptStreamOutCache:
+		stream_out_cache = strtoul(optarg, 0L, 0);
+		break;
+	case OptStreamOutThreads:
+		stream_out_threads = strtoul(optarg, 0L, 0);
+		if (stream_out_threads > 64)
+			stream_out_threads = 64;
+		break;
 	case OptStreamOutPercFill:
 		stream_out_perc_fill = strtoul(optarg, 0L, 0);
 		if (stream_out_perc_fill > 100)
@@ -396,12 +437,24 @@ void streaming_cmd(int ch, char *optarg)
 	case OptStreamToHost:
 		host_cap = optarg;
 		break;
+	case OptStreamToIdx:
+		file_cap = optarg;
+		stream_to_idx = true;
+		break;
 	case OptStreamFrom:
 		file_out = optarg;
 		break;
 	case OptStreamFromHost:
 		host_out = optarg;
 		break;
+	case OptStreamFromFrame:
+		idx_frame = idx_first_frame = strtoul(optarg, 0L, 0);
+		break;
+	case OptStreamFromMmap:
+		stream_from_mmap = true;
+		if (optarg)
+			stream_from_prefetch = strtoul(optarg, 0L, 0);
+		break;
 	case OptStreamMmap:
 	case OptStreamUser:
 		if (optarg) {
@@ -528,8 +581,290 @@ public:
 	}
 };
 
+static FILE *open_stream_from(const char *file)
+{
+	FILE *fin = fopen(file, "r");
+
+	if (fin && v4l_idx_is_idx_file(fileno(fin)) &&
+	    v4l_idx_open(&idx_reader, fileno(fin)))
+		fprintf(stderr, "cannot map indexed file %s\n", file);
+	return fin;
+}
+
+static bool fill_buffer_from_idx(buffers &b, unsigned idx)
+{
+	const struct v4l_idx_frame_hdr *frm;
+
+	if (idx_frame >= idx_reader.num_frames && stream_loop)
+		idx_frame = idx_first_frame;
+	frm = v4l_idx_frame(&idx_reader, idx_frame);
+	if (frm == NULL) {
+		if (idx_frame < idx_reader.num_frames)
+			fprintf(stderr, "frame %u is corrupt\n", idx_frame);
+		return false;
+	}
+	idx_frame++;
+	if (frm->num_planes != b.num_planes) {
+		fprintf(stderr, "number of planes mismatch (%u != %u)\n",
+			frm->num_planes, b.num_planes);
+		return false;
+	}
+	for (unsigned j = 0; j < b.num_planes; j++) {
+		struct v4l2_plane &p = b.planes[idx][j];
+		__u32 bytesused = frm->planes[j].bytesused;
+
+		if (bytesused > p.length) {
+			fprintf(stderr, "plane size is too large (%u > %u)\n",
+				bytesused, p.length);
+			return false;
+		}
+		memcpy(b.bufs[idx][j], v4l_idx_plane(frm, j), bytesused);
+		p.bytesused = bytesused;
+	}
+	return true;
+}
+
+/*
+ * Frames from an indexed file carry their own bytesused values,
+ * otherwise the whole buffer is used.
+ */
+static void set_bytesused_from_idx(buffers &b, struct v4l2_buffer &buf)
+{
+	if (idx_reader.map == NULL)
+		return;
+	if (b.is_mplane) {
+		for (unsigned j = 0; j < b.num_planes; j++)
+			buf.m.planes[j].bytesused = b.planes[buf.index][j].bytesused;
+	} else {
+		buf.bytesused = b.planes[buf.index][0].bytesused;
+	}
+}
+
+/*
+ * State of a --stream-from file that is mapped with --stream-from-mmap.
+ * Indexed files are already mapped by idx_reader, for raw files each frame
+ * is frame_size bytes containing all planes back to back. In both cases
+ * idx_frame is the next frame to queue.
+ */
+static struct {
+	bool mapped;
+	bool failed;
+	const __u8 *map;
+	size_t size;
+	unsigned num_frames;
+	unsigned num_planes;
+	unsigned frame_size;
+	unsigned plane_offset[VIDEO_MAX_PLANES];
+	unsigned plane_size[VIDEO_MAX_PLANES];
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool running;
+	unsigned prefetched;
+} mfile;
+
+static const __u8 *mfile_plane(unsigned frame, unsigned plane, __u32 &bytesused)
+{
+	if (idx_reader.map) {
+		const struct v4l_idx_frame_hdr *frm = v4l_idx_frame(&idx_reader, frame);
+
+		if (frm == NULL || plane >= frm->num_planes)
+			return NULL;
+		bytesused = frm->planes[plane].bytesused;
+		return v4l_idx_plane(frm, plane);
+	}
+	bytesused = mfile.plane_size[plane];
+	return mfile.map + (size_t)frame * mfile.frame_size + mfile.plane_offset[plane];
+}
+
+/*
+ * Keep the next stream_from_prefetch frames resident so the streaming
+ * thread never waits for the disk while copying or queuing a frame.
+ */
+static void *mfile_prefetch(void *)
+{
+	long pagesize = sysconf(_SC_PAGESIZE);
+
+	pthread_mutex_lock(&mfile.lock);
+	while (mfile.running) {
+		unsigned target = idx_frame + stream_from_prefetch;
+
+		/* idx_frame jumps back when looping */
+		if (mfile.prefetched < idx_frame || mfile.prefetched > target)
+			mfile.prefetched = idx_frame;
+		if (mfile.prefetched == target) {
+			pthread_cond_wait(&mfile.cond, &mfile.lock);
+			continue;
+		}
+
+		unsigned frame = mfile.prefetched++;
+
+		pthread_mutex_unlock(&mfile.lock);
+		if (stream_loop && frame >= mfile.num_frames &&
+		    idx_first_frame < mfile.num_frames)
+			frame = idx_first_frame + (frame - mfile.num_frames) %
+				(mfile.num_frames - idx_first_frame);
+		if (frame < mfile.num_frames) {
+			for (unsigned j = 0; j < mfile.num_planes; j++) {
+				__u32 bytesused;
+				const __u8 *p = mfile_plane(frame, j, bytesused);
+
+				if (p == NULL)
+					break;
+
+				unsigned long start = (unsigned long)p & ~(pagesize - 1);
+				unsigned long end = (unsigned long)p + bytesused;
+				volatile __u8 sum = 0;
+
+				madvise((void *)start, end - start, MADV_WILLNEED);
+				for (unsigned long a = start; a < end; a += pagesize)
+					sum += *(const __u8 *)a;
+			}
+		}
+		pthread_mutex_lock(&mfile.lock);
+	}
+	pthread_mutex_unlock(&mfile.lock);
+	return NULL;
+}
+
+static bool mfile_map(buffers &b, unsigned idx, FILE *fin)
+{
+	if (mfile.mapped || mfile.failed)
+		return mfile.mapped;
+
+	if (idx_reader.map) {
+		mfile.map = idx_reader.map;
+		mfile.size = idx_reader.size;
+		mfile.num_frames = idx_reader.num_frames;
+	} else {
+		struct stat st;
+		void *map;
+
+		mfile.failed = true;
+		if (fstat(fileno(fin), &st) || !S_ISREG(st.st_mode)) {
+			fprintf(stderr, "--stream-from-mmap needs a regular file\n");
+			return false;
+		}
+		for (unsigned j = 0; j < b.num_planes; j++) {
+			mfile.plane_offset[j] = mfile.frame_size;
+			mfile.plane_size[j] = b.planes[idx][j].length;
+			mfile.frame_size += b.planes[idx][j].length;
+		}
+		if (!mfile.frame_size || (size_t)st.st_size < mfile.frame_size) {
+			fprintf(stderr, "file is smaller than one frame\n");
+			return false;
+		}
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(fin), 0);
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "could not mmap file: %s\n", strerror(errno));
+			return false;
+		}
+		mfile.map = (const __u8 *)map;
+		mfile.size = st.st_size;
+		mfile.num_frames = st.st_size / mfile.frame_size;
+		mfile.failed = false;
+	}
+	madvise((void *)mfile.map, mfile.size, MADV_SEQUENTIAL);
+	mfile.num_planes = b.num_planes;
+	mfile.mapped = true;
+
+	if (!options[OptStreamOutUser] && stream_from_prefetch) {
+		pthread_mutex_init(&mfile.lock, NULL);
+		pthread_cond_init(&mfile.cond, NULL);
+		mfile.prefetched = idx_frame;
+		mfile.running = true;
+		if (pthread_create(&mfile.thread, NULL, mfile_prefetch, NULL)) {
+			fprintf(stderr, "could not start prefetch thread\n");
+			mfile.running = false;
+		}
+	}
+	return true;
+}
+
+static void mfile_unmap(void)
+{
+	if (mfile.running) {
+		pthread_mutex_lock(&mfile.lock);
+		mfile.running = false;
+		pthread_cond_signal(&mfile.cond);
+		pthread_mutex_unlock(&mfile.lock);
+		pthread_join(mfile.thread, NULL);
+		pthread_cond_destroy(&mfile.cond);
+		pthread_mutex_destroy(&mfile.lock);
+	}
+	if (mfile.mapped && !idx_reader.map)
+		munmap((void *)mfile.map, mfile.size);
+	memset(&mfile, 0, sizeof(mfile));
+}
+
+/*
+ * USERPTR buffers are pointed straight at the mapped frame if the whole
+ * buffer length fits in the mapping, for all other buffers the frame is
+ * copied.
+ */
+static bool fill_buffer_from_map(buffers &b, struct v4l2_buffer &buf)
+{
+	unsigned idx = buf.index;
+	unsigned frame = idx_frame;
+
+	if (frame >= mfile.num_frames && stream_loop)
+		frame = idx_first_frame;
+	if (frame >= mfile.num_frames)
+		return false;
+	if (idx_reader.map) {
+		const struct v4l_idx_frame_hdr *frm = v4l_idx_frame(&idx_reader, frame);
+
+		if (frm == NULL) {
+			fprintf(stderr, "frame %u is corrupt\n", frame);
+			return false;
+		}
+		if (frm->num_planes != b.num_planes) {
+			fprintf(stderr, "number of planes mismatch\n");
+			return false;
+		}
+	}
+	for (unsigned j = 0; j < b.num_planes; j++) {
+		struct v4l2_plane &p = b.planes[idx][j];
+		__u32 bytesused;
+		const __u8 *data = mfile_plane(frame, j, bytesused);
+		unsigned long userptr = (unsigned long)b.bufs[idx][j];
+
+		if (bytesused > p.length) {
+			fprintf(stderr, "plane size is too large (%u > %u)\n",
+				bytesused, p.length);
+			return false;
+		}
+		if (b.memory == V4L2_MEMORY_USERPTR &&
+		    data + p.length <= mfile.map + mfile.size)
+			userptr = (unsigned long)data;
+		else
+			memcpy(b.bufs[idx][j], data, bytesused);
+		if (b.is_mplane) {
+			buf.m.planes[j].bytesused = bytesused;
+			if (b.memory == V4L2_MEMORY_USERPTR)
+				buf.m.planes[j].m.userptr = userptr;
+		} else {
+			buf.bytesused = bytesused;
+			if (b.memory == V4L2_MEMORY_USERPTR)
+				buf.m.userptr = userptr;
+		}
+	}
+	if (mfile.running) {
+		pthread_mutex_lock(&mfile.lock);
+		idx_frame = frame + 1;
+		pthread_cond_signal(&mfile.cond);
+		pthread_mutex_unlock(&mfile.lock);
+	} else {
+		idx_frame = frame + 1;
+	}
+	return true;
+}
+
 static bool fill_buffer_from_file(buffers &b, unsigned idx, FILE *fin)
 {
+	if (idx_reader.map)
+		return fill_buffer_from_idx(b, idx);
+
 	if (host_fd_out >= 0) {
 		for (;;) {
 			unsigned packet = read_u32(fin);
@@ -619,6 +954,289 @@ static bool fill_buffer_from_file(buffers &b, unsigned idx, FILE *fin)
 	return true;
 }
 
+static bool fill_buffer(buffers &b, struct v4l2_buffer &buf, FILE *fin)
+{
+	if (stream_from_mmap && mfile_map(b, buf.index, fin))
+		return fill_buffer_from_map(b, buf);
+	if (!fill_buffer_from_file(b, buf.index, fin))
+		return false;
+	set_bytesused_from_idx(b, buf);
+	return true;
+}
+
+/*
+ * Threads rendering the test pattern with --stream-out-threads. Each thread
+ * fills its own range of compose lines of every plane of the frame, the
+ * calling thread takes the first range.
+ */
+static struct {
+	unsigned num;
+	pthread_t thread[64];
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned gen;
+	unsigned busy;
+	bool stop;
+	unsigned num_planes;
+	unsigned plane[TPG_MAX_PLANES];
+	u8 *vbuf[TPG_MAX_PLANES];
+} tfill;
+
+static void tfill_lines(unsigned i)
+{
+	unsigned height = tpg.compose.height;
+	unsigned chunk = ((height + tfill.num - 1) / tfill.num + 3) & ~3U;
+	unsigned first = i * chunk;
+
+	if (first >= height)
+		return;
+	for (unsigned j = 0; j < tfill.num_planes; j++)
+		tpg_fill_plane_lines(&tpg, stream_out_std, tfill.plane[j],
+				     tfill.vbuf[j], first, first + chunk);
+}
+
+static void *tfill_thread(void *arg)
+{
+	unsigned i = (unsigned long)arg;
+	unsigned gen = 0;
+
+	pthread_mutex_lock(&tfill.lock);
+	for (;;) {
+		while (gen == tfill.gen && !tfill.stop)
+			pthread_cond_wait(&tfill.start, &tfill.lock);
+		if (tfill.stop)
+			break;
+		gen = tfill.gen;
+		pthread_mutex_unlock(&tfill.lock);
+		tfill_lines(i);
+		pthread_mutex_lock(&tfill.lock);
+		if (!--tfill.busy)
+			pthread_cond_signal(&tfill.done);
+	}
+	pthread_mutex_unlock(&tfill.lock);
+	return NULL;
+}
+
+static void tfill_start(void)
+{
+	pthread_mutex_init(&tfill.lock, NULL);
+	pthread_cond_init(&tfill.start, NULL);
+	pthread_cond_init(&tfill.done, NULL);
+	tfill.num = 1;
+	while (tfill.num < stream_out_threads) {
+		if (pthread_create(&tfill.thread[tfill.num], NULL, tfill_thread,
+				   (void *)(unsigned long)tfill.num)) {
+			fprintf(stderr, "could only start %u fill threads\n", tfill.num);
+			break;
+		}
+		tfill.num++;
+	}
+}
+
+static void tfill_stop(void)
+{
+	if (!tfill.num)
+		return;
+	pthread_mutex_lock(&tfill.lock);
+	tfill.stop = true;
+	pthread_cond_broadcast(&tfill.start);
+	pthread_mutex_unlock(&tfill.lock);
+	for (unsigned i = 1; i < tfill.num; i++)
+		pthread_join(tfill.thread[i], NULL);
+	pthread_cond_destroy(&tfill.done);
+	pthread_cond_destroy(&tfill.start);
+	pthread_mutex_destroy(&tfill.lock);
+	memset(&tfill, 0, sizeof(tfill));
+}
+
+/* Threaded equivalent of tpg_fillbuffer() */
+static void fill_tpg(unsigned p, u8 *vbuf)
+{
+	if (stream_out_threads <= 1) {
+		tpg_fillbuffer(&tpg, stream_out_std, p, vbuf);
+		return;
+	}
+	if (!tfill.num)
+		tfill_start();
+
+	tpg_recalc(&tpg);
+	if (tpg.buffers > 1) {
+		tfill.num_planes = 1;
+		tfill.plane[0] = p;
+		tfill.vbuf[0] = vbuf;
+	} else {
+		tfill.num_planes = tpg_g_planes(&tpg);
+		for (unsigned i = 0; i < tfill.num_planes; i++) {
+			tfill.plane[i] = i;
+			tfill.vbuf[i] = vbuf;
+			vbuf += tpg_calc_plane_size(&tpg, i);
+		}
+	}
+
+	pthread_mutex_lock(&tfill.lock);
+	tfill.busy = tfill.num - 1;
+	tfill.gen++;
+	pthread_cond_broadcast(&tfill.start);
+	pthread_mutex_unlock(&tfill.lock);
+
+	tfill_lines(0);
+
+	pthread_mutex_lock(&tfill.lock);
+	while (tfill.busy)
+		pthread_cond_wait(&tfill.done, &tfill.lock);
+	pthread_mutex_unlock(&tfill.lock);
+}
+
+/*
+ * Frames of a moving test pattern rendered up front with --stream-out-cache.
+ * Frame 0 is the frame that was due when the cache was built.
+ */
+static struct {
+	bool built;
+	bool failed;
+	u8 *buf;
+	unsigned frames;
+	unsigned frame_size;
+	unsigned plane_offset[VIDEO_MAX_PLANES];
+	unsigned pos;
+} fcache;
+
+static unsigned gcd(unsigned a, unsigned b)
+{
+	while (b) {
+		unsigned t = a % b;
+
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static unsigned lcm(unsigned a, unsigned b)
+{
+	return a / gcd(a, b) * b;
+}
+
+/* Number of frames after which a movement of step * factor wraps around */
+static unsigned mv_period(unsigned size, int step, unsigned factor)
+{
+	unsigned delta = (step * factor) % size;
+
+	return delta ? size / gcd(size, delta) : 1;
+}
+
+static bool build_frame_cache(buffers &b, unsigned idx)
+{
+	unsigned factor = V4L2_FIELD_HAS_T_OR_B(tpg.field) ? 1 : 2;
+	unsigned pagesize = sysconf(_SC_PAGESIZE);
+	unsigned start_field = tpg.field;
+	unsigned field = start_field;
+	int mv_hor_count = tpg.mv_hor_count;
+	int mv_vert_count = tpg.mv_vert_count;
+	unsigned period;
+	void *buf;
+
+	if (fcache.built || fcache.failed)
+		return fcache.built;
+	fcache.failed = true;
+
+	if (tpg.pattern == TPG_PAT_NOISE) {
+		fprintf(stderr, "the noise pattern cannot be cached\n");
+		return false;
+	}
+	period = lcm(mv_period(tpg.src_width, tpg.mv_hor_step, factor),
+		     mv_period(tpg.src_height, tpg.mv_vert_step, factor));
+	if (output_field_alt)
+		period = lcm(period, 2);
+
+	fcache.frame_size = 0;
+	for (unsigned j = 0; j < b.num_planes; j++) {
+		fcache.plane_offset[j] = fcache.frame_size;
+		fcache.frame_size += (b.planes[idx][j].length + pagesize - 1) & ~(pagesize - 1);
+	}
+	if ((__u64)period * fcache.frame_size > ((__u64)stream_out_cache << 20)) {
+		fprintf(stderr, "the pattern repeats after %u frames which needs %llu MiB, more than --stream-out-cache\n",
+			period, ((__u64)period * fcache.frame_size + (1 << 20) - 1) >> 20);
+		return false;
+	}
+	if (posix_memalign(&buf, pagesize, (size_t)period * fcache.frame_size)) {
+		fprintf(stderr, "could not allocate the frame cache\n");
+		return false;
+	}
+	fcache.buf = (u8 *)buf;
+
+	for (unsigned i = 0; i < period; i++) {
+		u8 *frame = fcache.buf + (size_t)i * fcache.frame_size;
+
+		tpg_s_field(&tpg, field, output_field_alt);
+		if (b.is_mplane) {
+			for (unsigned j = 0; j < b.num_planes; j++)
+				fill_tpg(j, frame + fcache.plane_offset[j]);
+		} else {
+			fill_tpg(0, frame);
+		}
+		tpg_update_mv_count(&tpg, V4L2_FIELD_HAS_T_OR_B(field));
+		if (output_field_alt) {
+			if (field == V4L2_FIELD_TOP)
+				field = V4L2_FIELD_BOTTOM;
+			else if (field == V4L2_FIELD_BOTTOM)
+				field = V4L2_FIELD_TOP;
+		}
+	}
+	tpg_s_field(&tpg, start_field, output_field_alt);
+	tpg.mv_hor_count = mv_hor_count;
+	tpg.mv_vert_count = mv_vert_count;
+
+	if (verbose)
+		fprintf(stderr, "cached %u frames (%llu MiB)\n", period,
+			((__u64)period * fcache.frame_size) >> 20);
+	fcache.frames = period;
+	fcache.pos = 0;
+	fcache.built = true;
+	fcache.failed = false;
+	return true;
+}
+
+static void fill_buffer_from_cache(buffers &b, struct v4l2_buffer &buf)
+{
+	u8 *frame = fcache.buf + (size_t)fcache.pos * fcache.frame_size;
+	unsigned idx = buf.index;
+
+	for (unsigned j = 0; j < b.num_planes; j++) {
+		u8 *data = frame + fcache.plane_offset[j];
+
+		if (b.memory != V4L2_MEMORY_USERPTR)
+			memcpy(b.bufs[idx][j], data, b.planes[idx][j].length);
+		else if (b.is_mplane)
+			buf.m.planes[j].m.userptr = (unsigned long)data;
+		else
+			buf.m.userptr = (unsigned long)data;
+	}
+	if (++fcache.pos == fcache.frames)
+		fcache.pos = 0;
+}
+
+static void free_frame_cache(void)
+{
+	free(fcache.buf);
+	memset(&fcache, 0, sizeof(fcache));
+}
+
+static void fill_buffer_from_tpg(buffers &b, struct v4l2_buffer &buf)
+{
+	if (stream_out_cache && build_frame_cache(b, buf.index)) {
+		fill_buffer_from_cache(b, buf);
+		return;
+	}
+	if (b.is_mplane) {
+		for (unsigned j = 0; j < b.num_planes; j++)
+			fill_tpg(j, (u8 *)b.bufs[buf.index][j]);
+	} else {
+		fill_tpg(0, (u8 *)b.bufs[buf.index][0]);
+	}
+}
+
 static int do_setup_cap_buffers(int fd, buffers &b)
 {
 	for (unsigned i = 0; i < b.bcount; i++) {
@@ -848,11 +1466,11 @@ static int do_setup_out_buffers(int fd, buffers &b, FILE *fin, bool qbuf)
 					b.bufs[i][j] = calloc(1, p.length);
 					planes[j].m.userptr = (unsigned long)b.bufs[i][j];
 				}
-				if (can_fill)
-					tpg_fillbuffer(&tpg, stream_out_std, j, (u8 *)b.bufs[i][j]);
 			}
+			if (can_fill)
+				fill_buffer_from_tpg(b, buf);
 			if (fin)
-				fill_buffer_from_file(b, buf.index, fin);
+				fill_buffer(b, buf, fin);
 		}
 		else {
 			b.planes[i][0].length = buf.length;
@@ -879,9 +1497,8 @@ static int do_setup_out_buffers(int fd, buffers &b, FILE *fin, bool qbuf)
 				b.bufs[i][0] = calloc(1, buf.length);
 				buf.m.userptr = (unsigned long)b.bufs[i][0];
 			}
-			if (!fin || !fill_buffer_from_file(b, buf.index, fin))
-				if (can_fill)
-					tpg_fillbuffer(&tpg, stream_out_std, 0, (u8 *)b.bufs[i][0]);
+			if ((!fin || !fill_buffer(b, buf, fin)) && can_fill)
+				fill_buffer_from_tpg(b, buf);
 		}
 		if (qbuf) {
 			if (V4L2_TYPE_IS_OUTPUT(buf.type))
@@ -908,9 +1525,50 @@ static void do_release_buffers(buffers &b)
 				test_munmap(b.bufs[i][j], b.planes[i][j].length);
 		}
 	}
+	free_frame_cache();
+	tfill_stop();
 	tpg_free(&tpg);
 }
 
+static int start_idx_file(int fd, buffers &b, FILE *fout)
+{
+	struct v4l2_format fmt;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = b.type;
+	doioctl(fd, VIDIOC_G_FMT, &fmt);
+	if (v4l_idx_write_header(&idx_writer, fout, &fmt, b.num_planes)) {
+		fprintf(stderr, "could not write indexed file header\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void write_idx_frame(buffers &b, struct v4l2_buffer &buf)
+{
+	void *data[VIDEO_MAX_PLANES];
+	__u32 used[VIDEO_MAX_PLANES];
+
+	for (unsigned j = 0; j < b.num_planes; j++) {
+		__u32 bytesused = b.is_mplane ? buf.m.planes[j].bytesused : buf.bytesused;
+		unsigned offset = b.is_mplane ? buf.m.planes[j].data_offset : 0;
+
+		if (offset > bytesused)
+			offset = 0;
+		data[j] = (char *)b.bufs[buf.index][j] + offset;
+		used[j] = bytesused - offset;
+	}
+	if (v4l_idx_write_frame(&idx_writer, &buf, data, used))
+		fprintf(stderr, "error writing frame %u\n", buf.sequence);
+}
+
+static void stop_idx_file(void)
+{
+	if (idx_writer.f && v4l_idx_write_trailer(&idx_writer))
+		fprintf(stderr, "could not write index\n");
+	idx_writer.f = NULL;
+}
+
 static int do_handle_cap(int fd, buffers &b, FILE *fout, int *index,
 			 unsigned &count, struct timespec &ts_last)
 {
@@ -953,7 +1611,10 @@ static int do_handle_cap(int fd, buffers &b, FILE *fout, int *index,
 			print_buffer(stderr, buf);
 		test_ioctl(fd, VIDIOC_QBUF, &buf);
 	}
-	if (fout && (!stream_skip || ignore_count_skip) && !(buf.flags & V4L2_BUF_FLAG_ERROR)) {
+	if (fout && idx_writer.f && (!stream_skip || ignore_count_skip) &&
+	    !(buf.flags & V4L2_BUF_FLAG_ERROR)) {
+		write_idx_frame(b, buf);
+	} else if (fout && (!stream_skip || ignore_count_skip) && !(buf.flags & V4L2_BUF_FLAG_ERROR)) {
 		unsigned rle_size[VIDEO_MAX_PLANES];
 
 		if (host_fd_cap >= 0) {
@@ -1130,16 +1791,10 @@ static int do_handle_out(int fd, buffers &b, FILE *fin, struct v4l2_buffer *cap,
 			output_field = V4L2_FIELD_TOP;
 	}
 
-	if (fin && !fill_buffer_from_file(b, buf.index, fin))
+	if (fin && !fill_buffer(b, buf, fin))
 		return -1;
-	if (!fin && stream_out_refresh) {
-		if (b.is_mplane) {
-			for (unsigned j = 0; j < b.num_planes; j++)
-				tpg_fillbuffer(&tpg, stream_out_std, j, (u8 *)b.bufs[buf.index][j]);
-		} else {
-			tpg_fillbuffer(&tpg, stream_out_std, 0, (u8 *)b.bufs[buf.index][0]);
-		}
-	}
+	if (!fin && stream_out_refresh)
+		fill_buffer_from_tpg(b, buf);
 
 	if (V4L2_TYPE_IS_OUTPUT(buf.type))
 		setTimeStamp(buf);
@@ -1183,7 +1838,8 @@ static int do_handle_out(int fd, buffers &b, FILE *fin, struct v4l2_buffer *cap,
 	return 0;
 }
 
-static int do_handle_out_to_in(int out_fd, int fd, buffers &out, buffers &in)
+static int do_handle_out_to_in(int out_fd, int fd, buffers &out, buffers &in,
+			       int *index)
 {
 	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 	struct v4l2_buffer buf;
@@ -1198,9 +1854,9 @@ static int do_handle_out_to_in(int out_fd, int fd, buffers &out, buffers &in)
 		buf.length = VIDEO_MAX_PLANES;
 	}
 
-	do {
-		ret = test_ioctl(out_fd, VIDIOC_DQBUF, &buf);
-	} while (ret < 0 && errno == EAGAIN);
+	ret = test_ioctl(out_fd, VIDIOC_DQBUF, &buf);
+	if (ret < 0 && errno == EAGAIN)
+		return 0;
 	if (ret < 0) {
 		fprintf(stderr, "%s: failed: %s\n", "VIDIOC_DQBUF", strerror(errno));
 		return -1;
@@ -1219,6 +1875,7 @@ static int do_handle_out_to_in(int out_fd, int fd, buffers &out, buffers &in)
 		fprintf(stderr, "%s: failed: %s\n", "VIDIOC_QBUF", strerror(errno));
 		return -1;
 	}
+	*index = buf.index;
 	return 0;
 }
 
@@ -1327,6 +1984,9 @@ static void streaming_set_cap(int fd)
 	if (b.reqbufs(fd, reqbufs_count_cap))
 		goto done;
 
+	if (fout && stream_to_idx && start_idx_file(fd, b, fout))
+		goto done;
+
 	if (do_setup_cap_buffers(fd, b))
 		goto done;
 
@@ -1386,6 +2046,7 @@ static void streaming_set_cap(int fd)
 	do_release_buffers(b);
 
 done:
+	stop_idx_file();
 	if (fout && fout != stdout) {
 		if (host_fd_cap >= 0)
 			write_u32(fout, V4L_STREAM_PACKET_END);
@@ -1393,6 +2054,27 @@ done:
 	}
 }
 
+static int set_fmt_from_idx(int fd, buffers &b)
+{
+	struct v4l2_format fmt;
+
+	v4l_idx_get_fmt(&idx_reader, &fmt);
+	if ((fmt.type == V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	     fmt.type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ||
+	     fmt.type == V4L2_BUF_TYPE_VIDEO_OUTPUT ||
+	     fmt.type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) &&
+	    V4L2_TYPE_IS_MULTIPLANAR(fmt.type) != b.is_mplane) {
+		fprintf(stderr, "single/multiplanar mismatch with indexed file\n");
+		return -1;
+	}
+	fmt.type = b.type;
+	if (doioctl(fd, VIDIOC_S_FMT, &fmt)) {
+		fprintf(stderr, "failed to set new format\n");
+		return -1;
+	}
+	return 0;
+}
+
 static void streaming_set_out(int fd)
 {
 	buffers b(true);
@@ -1419,7 +2101,9 @@ static void streaming_set_out(int fd)
 		if (!strcmp(file_out, "-"))
 			fin = stdin;
 		else
-			fin = fopen(file_out, "r");
+			fin = open_stream_from(file_out);
+		if (idx_reader.map && set_fmt_from_idx(fd, b))
+			goto done;
 	} else if (host_out) {
 		char *p = strchr(host_out, ':');
 		int listen_fd;
@@ -1588,6 +2272,8 @@ static void streaming_set_out(int fd)
 	do_release_buffers(b);
 
 done:
+	mfile_unmap();
+	v4l_idx_close(&idx_reader);
 	if (fin && fin != stdin)
 		fclose(fin);
 }
@@ -1643,13 +2329,16 @@ static void streaming_set_m2m(int fd)
 		if (!strcmp(file_out, "-"))
 			file[OUT] = stdin;
 		else
-			file[OUT] = fopen(file_out, "r");
+			file[OUT] = open_stream_from(file_out);
 	}
 
 	if (in.reqbufs(fd, reqbufs_count_cap) ||
 	    out.reqbufs(fd, reqbufs_count_out))
 		goto done;
 
+	if (file[CAP] && stream_to_idx && start_idx_file(fd, in, file[CAP]))
+		goto done;
+
 	if (do_setup_cap_buffers(fd, in) ||
 	    do_setup_out_buffers(fd, out, file[OUT], true))
 		goto done;
@@ -1743,6 +2432,9 @@ static void streaming_set_m2m(int fd)
 	do_release_buffers(out);
 
 done:
+	stop_idx_file();
+	mfile_unmap();
+	v4l_idx_close(&idx_reader);
 	if (file[CAP] && file[CAP] != stdout)
 		fclose(file[CAP]);
 
@@ -1753,6 +2445,7 @@ done:
 static void streaming_set_cap2out(int fd, int out_fd)
 {
 	int fd_flags = fcntl(fd, F_GETFL);
+	int out_fd_flags = fcntl(out_fd, F_GETFL);
 	bool use_poll = options[OptStreamPoll];
 	bool use_dmabuf = options[OptStreamDmaBuf] || options[OptStreamOutDmaBuf];
 	bool use_userptr = options[OptStreamUser] && options[OptStreamOutUser];
@@ -1761,8 +2454,11 @@ static void streaming_set_cap2out(int fd, int out_fd)
 	unsigned count[2] = { 0, 0 };
 	struct timespec ts_last[2];
 	FILE *file[2] = {NULL, NULL};
-	fd_set fds;
-	unsigned cnt = 0;
+	unsigned cap_queued = 0;
+	unsigned out_queued = 0;
+	__u64 cap_ts[VIDEO_MAX_FRAME] = { 0 };
+	__u64 lat_min = 0, lat_max = 0, lat_total = 0;
+	unsigned lat_count = 0;
 
 	if (!(capabilities & (V4L2_CAP_VIDEO_CAPTURE |
 			      V4L2_CAP_VIDEO_CAPTURE_MPLANE |
@@ -1808,7 +2504,7 @@ static void streaming_set_cap2out(int fd, int out_fd)
 		if (!strcmp(file_out, "-"))
 			file[OUT] = stdin;
 		else
-			file[OUT] = fopen(file_out, "r");
+			file[OUT] = open_stream_from(file_out);
 	}
 
 	if (in.reqbufs(fd, reqbufs_count_cap) ||
@@ -1828,6 +2524,13 @@ static void streaming_set_cap2out(int fd, int out_fd)
 		fprintf(stderr, "mismatch between number of planes\n");
 		goto done;
 	}
+	if (out.bcount < in.bcount) {
+		fprintf(stderr, "the output device has fewer buffers than the capture device\n");
+		goto done;
+	}
+
+	if (file[CAP] && stream_to_idx && start_idx_file(fd, in, file[CAP]))
+		goto done;
 
 	if (do_setup_cap_buffers(fd, in) ||
 	    do_setup_out_buffers(out_fd, out, file[OUT], false))
@@ -1837,76 +2540,124 @@ static void streaming_set_cap2out(int fd, int out_fd)
 	    doioctl(out_fd, VIDIOC_STREAMON, &out.type))
 		goto done;
 
-	if (use_poll)
-		fcntl(fd, F_SETFL, fd_flags | O_NONBLOCK);
-
-	while (1) {
-		struct timeval tv = { use_poll ? 2 : 0, 0 };
-		int r = 0;
+	/*
+	 * Every buffer index refers to the same memory in both queues. A
+	 * buffer is either queued to the capture device or to the output
+	 * device: it moves to the output queue when it is captured and back
+	 * to the capture queue when the output device is done with it.
+	 */
+	fcntl(fd, F_SETFL, fd_flags | O_NONBLOCK);
+	fcntl(out_fd, F_SETFL, out_fd_flags | O_NONBLOCK);
+	cap_queued = in.bcount;
 
-		FD_ZERO(&fds);
-		FD_SET(fd, &fds);
+	while (cap_queued || out_queued) {
+		struct pollfd pfd[2];
+		unsigned nfds = 0;
+		int r;
 
-		if (use_poll)
-			r = select(fd + 1, &fds, NULL, NULL, &tv);
+		if (cap_queued) {
+			pfd[nfds].fd = fd;
+			pfd[nfds++].events = POLLIN;
+		}
+		if (out_queued) {
+			pfd[nfds].fd = out_fd;
+			pfd[nfds++].events = POLLOUT;
+		}
 
+		r = poll(pfd, nfds, use_poll ? 2000 : -1);
 		if (r == -1) {
 			if (EINTR == errno)
 				continue;
-			fprintf(stderr, "select error: %s\n",
-					strerror(errno));
-			goto done;
+			fprintf(stderr, "poll error: %s\n", strerror(errno));
+			break;
 		}
-		if (use_poll && r == 0) {
-			fprintf(stderr, "select timeout\n");
-			goto done;
+		if (r == 0) {
+			fprintf(stderr, "poll timeout\n");
+			break;
 		}
 
-		if (FD_ISSET(fd, &fds)) {
+		for (unsigned i = 0; i < nfds && r >= 0; i++) {
+			struct v4l2_plane planes[VIDEO_MAX_PLANES];
+			struct v4l2_buffer buf;
 			int index = -1;
 
-			r = do_handle_cap(fd, in, file[CAP], &index,
-					   count[CAP], ts_last[CAP]);
-			if (r)
-				fprintf(stderr, "handle cap %d\n", r);
-			if (!r) {
-				struct v4l2_plane planes[VIDEO_MAX_PLANES];
-				struct v4l2_buffer buf;
-
-				memset(&buf, 0, sizeof(buf));
-				buf.type = in.type;
-				buf.index = index;
-				if (in.is_mplane) {
-					buf.m.planes = planes;
-					buf.length = VIDEO_MAX_PLANES;
-					memset(planes, 0, sizeof(planes));
+			if (!pfd[i].revents)
+				continue;
+
+			if (pfd[i].fd == out_fd) {
+				r = do_handle_out_to_in(out_fd, fd, out, in, &index);
+				if (r < 0 || index < 0)
+					continue;
+				out_queued--;
+				cap_queued++;
+				if (cap_ts[index]) {
+					struct timespec ts;
+					__u64 lat;
+
+					clock_gettime(CLOCK_MONOTONIC, &ts);
+					lat = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 - cap_ts[index];
+					if (verbose)
+						fprintf(stderr, "buffer %d latency: %llu us\n", index, lat);
+					if (!lat_count || lat < lat_min)
+						lat_min = lat;
+					if (lat > lat_max)
+						lat_max = lat;
+					lat_total += lat;
+					lat_count++;
 				}
-				if (test_ioctl(fd, VIDIOC_QUERYBUF, &buf))
-					break;
-				r = do_handle_out(out_fd, out, file[OUT], &buf,
-					   count[OUT], ts_last[OUT]);
+				continue;
 			}
-			if (r)
-				fprintf(stderr, "handle out %d\n", r);
-			if (!r && cnt++ > 1)
-				r = do_handle_out_to_in(out_fd, fd, out, in);
-			if (r)
-				fprintf(stderr, "handle out2in %d\n", r);
-			if (r < 0) {
-				doioctl(fd, VIDIOC_STREAMOFF, &in.type);
-				doioctl(out_fd, VIDIOC_STREAMOFF, &out.type);
-				break;
+
+			r = do_handle_cap(fd, in, file[CAP], &index,
+					  count[CAP], ts_last[CAP]);
+			if (index < 0)
+				continue;
+			cap_queued--;
+
+			memset(&buf, 0, sizeof(buf));
+			buf.type = in.type;
+			buf.index = index;
+			if (in.is_mplane) {
+				buf.m.planes = planes;
+				buf.length = VIDEO_MAX_PLANES;
+				memset(planes, 0, sizeof(planes));
 			}
+			if (test_ioctl(fd, VIDIOC_QUERYBUF, &buf)) {
+				r = -1;
+				continue;
+			}
+			if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+			    V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+				cap_ts[index] = buf.timestamp.tv_sec * 1000000ULL +
+						buf.timestamp.tv_usec;
+			else
+				cap_ts[index] = 0;
+			if (do_handle_out(out_fd, out, file[OUT], &buf,
+					  count[OUT], ts_last[OUT]) < 0)
+				r = -1;
+			out_queued++;
+		}
+		if (r < 0) {
+			doioctl(fd, VIDIOC_STREAMOFF, &in.type);
+			doioctl(out_fd, VIDIOC_STREAMOFF, &out.type);
+			break;
 		}
 	}
 
+	fcntl(out_fd, F_SETFL, out_fd_flags);
 	fcntl(fd, F_SETFL, fd_flags);
 	fprintf(stderr, "\n");
+	if (lat_count)
+		fprintf(stderr, "latency over %u frames: min %llu us, avg %llu us, max %llu us\n",
+			lat_count, lat_min, lat_total / lat_count, lat_max);
 
 	do_release_buffers(in);
 	do_release_buffers(out);
 
 done:
+	stop_idx_file();
+	mfile_unmap();
+	v4l_idx_close(&idx_reader);
 	if (file[CAP] && file[CAP] != stdout)
 		fclose(file[CAP]);
 
@@ -219,11 +219,14 @@ static struct option long_options[] = {
 	{"stream-poll", no_argument, 0, OptStreamPoll},
 	{"stream-to", required_argument, 0, OptStreamTo},
 	{"stream-to-host", required_argument, 0, OptStreamToHost},
+	{"stream-to-idx", required_argument, 0, OptStreamToIdx},
 	{"stream-mmap", optional_argument, 0, OptStreamMmap},
 	{"stream-user", optional_argument, 0, OptStreamUser},
 	{"stream-dmabuf", no_argument, 0, OptStreamDmaBuf},
 	{"stream-from", required_argument, 0, OptStreamFrom},
 	{"stream-from-host", required_argument, 0, OptStreamFromHost},
+	{"stream-from-frame", required_argument, 0, OptStreamFromFrame},
+	{"stream-from-mmap", optional_argument, 0, OptStreamFromMmap},
 	{"stream-out-pattern", required_argument, 0, OptStreamOutPattern},
 	{"stream-out-square", no_argument, 0, OptStreamOutSquare},
 	{"stream-out-border", no_argument, 0, OptStreamOutBorder},
@@ -237,6 +240,8 @@ static struct option long_options[] = {
 	{"stream-out-hor-speed", required_argument, 0, OptStreamOutHorSpeed},
 	{"stream-out-vert-speed", required_argument, 0, OptStreamOutVertSpeed},
 	{"stream-out-perc-fill", required_argument, 0, OptStreamOutPercFill},
+	{"stream-out-cache", required_argument, 0, OptStreamOutCache},
+	{"stream-out-threads", required_argument, 0, OptStreamOutThreads},
 	{"stream-out-mmap", optional_argument, 0, OptStreamOutMmap},
 	{"stream-out-user", optional_argument, 0, OptStreamOutUser},
 	{"stream-out-dmabuf", no_argument, 0, OptStreamOutDmaBuf},
@@ -173,11 +173,14 @@ enum Option {
 	OptStreamPoll,
 	OptStreamTo,
 	OptStreamToHost,
+	OptStreamToIdx,
 	OptStreamMmap,
 	OptStreamUser,
 	OptStreamDmaBuf,
 	OptStreamFrom,
 	OptStreamFromHost,
+	OptStreamFromFrame,
+	OptStreamFromMmap,
 	OptStreamOutPattern,
 	OptStreamOutSquare,
 	OptStreamOutBorder,
@@ -186,6 +189,8 @@ enum Option {
 	OptStreamOutHorSpeed,
 	OptStreamOutVertSpeed,
 	OptStreamOutPercFill,
+	OptStreamOutCache,
+	OptStreamOutThreads,
 	OptStreamOutAlphaComponent,
 	OptStreamOutAlphaRedOnly,
 	OptStreamOutRGBLimitedRange,